@@ -63,10 +63,32 @@ StreamBufferKindEnum = U8EnumDefinition(
     "FrStreamBufferKind", [(0, "FRSBK_STREAM_BUFFER"), (1, "FRSBK_MESSAGE_BUFFER")]
 )
 
-ENUMS = [QueueKindEnum, StreamBufferKindEnum]
+TaskStateEnum = U8EnumDefinition(
+    "FrTaskState",
+    [
+        (0, "FRTS_RUNNING"),
+        (1, "FRTS_READY"),
+        (2, "FRTS_BLOCKED"),
+        (3, "FRTS_SUSPENDED"),
+        (4, "FRTS_DELETED"),
+    ],
+)
+
+ENUMS = [QueueKindEnum, StreamBufferKindEnum, TaskStateEnum]
 
 # fmt: off
 EVTS = [
+    # State dump:
+    Evt("task_state", id=79, fields=[U32("task_id"), U8Enum("state", TaskStateEnum), U32("core_id")]),
+
+    # Stack usage:
+    Evt("task_stack_high_water_mark", id=80, fields=[U32("task_id"), U32("min_free_bytes")]),
+
+    # Heap:
+    Evt("heap_malloc",     id=81, fields=[U64("addr"), U32("size")]),
+    Evt("heap_free",       id=82, fields=[U64("addr"), U32("size")]),
+    Evt("task_heap_usage", id=83, fields=[U32("task_id"), U32("malloc_cnt"), U32("malloc_bytes"), U32("free_cnt"), U32("free_bytes")]),
+
     # Task scheduling events:
     Evt("task_switched_in",      id=84, fields=[U32("task_id")]),
     Evt("task_to_rdy_state",     id=85, fields=[U32("task_id")]),
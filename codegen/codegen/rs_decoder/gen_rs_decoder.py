@@ -1,7 +1,7 @@
 import os
 import subprocess
 import sys
-from typing import List
+from typing import List, Optional
 
 from model import (
     BasicField,
@@ -53,6 +53,17 @@ def gen_u8_enum(e: U8EnumDefinition) -> str:
     result += f"}}\n"
     result += f"\n"
 
+    # Enum names:
+    result += f"impl {e.name} {{\n"
+    result += f"  pub fn name(&self) -> &'static str {{\n"
+    result += f"    match self {{\n"
+    for entry_val, entry_name in e.entries:
+        result += f'      Self::{pascal_case(entry_name)} => "{pascal_case(entry_name)}",\n'
+    result += f"    }}\n"
+    result += f"  }}\n"
+    result += f"}}\n"
+    result += f"\n"
+
     return result
 
 
@@ -84,16 +95,28 @@ def basic_field_decode(f: BasicField) -> str:
             return f"{u8_enum.name}::try_from(decode_u8(buf, current_idx).context(\"Failed to decode '{f.name}' u8 enum field.\")?).context(\"Failed to decode '{f.name}' u8 enum field.\")?"
 
 
+def basic_field_val(f: BasicField, val: str) -> str:
+    match f.kind:
+        case "u8" | "u32":
+            return f"EvtFieldVal::Uint({val}.into())"
+        case "u64":
+            return f"EvtFieldVal::Uint({val})"
+        case "s64":
+            return f"EvtFieldVal::Int({val})"
+        case u8_enum:
+            return f"EvtFieldVal::Str({val}.name())"
+
+
 def varlen_field_type(f: VarlenFieldKind) -> str:
     match f:
         case "str":
-            return "String"
+            return "Arc<str>"
 
 
 def varlen_field_decode(f: VarlenFieldKind) -> str:
     match f:
         case "str":
-            return "decode_string(buf, current_idx)?"
+            return "decode_string(buf, current_idx, strings)?"
 
 
 def gen_evt_types(groups: List[EvtGroup]) -> str:
@@ -203,7 +226,10 @@ def gen_evt(e: Evt, group: EvtGroup) -> str:
     result += f"\n"
 
     result += f"impl {group.code_name()}{pascal_case(e.name)}Evt {{\n"
-    result += f"  fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {{\n"
+    if e.varlen_field is not None:
+        result += f"  fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {{\n"
+    else:
+        result += f"  fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {{\n"
 
     if not e.is_metadata:
         result += f"    let ts = decode_u64(buf, current_idx)?;\n"
@@ -252,6 +278,239 @@ def gen_evt(e: Evt, group: EvtGroup) -> str:
     return result
 
 
+def gen_evt_field_visit(e: Evt, pattern: str) -> str:
+    if len(e.fields) == 0 and len(e.optional_fields) == 0 and e.varlen_field is None:
+        return f"            {pattern}(_) => {{}}\n"
+
+    result = ""
+    result += f"            {pattern}(e) => {{\n"
+    for field in e.fields:
+        result += f'                f("{field.name}", {basic_field_val(field, "e." + field.name)});\n'
+    for field in e.optional_fields:
+        result += f"                if let Some(val) = e.{field.name} {{\n"
+        result += f'                    f("{field.name}", {basic_field_val(field, "val")});\n'
+        result += f"                }}\n"
+    if e.varlen_field is not None:
+        result += f'                f("{e.varlen_field.name}", EvtFieldVal::Str(&e.{e.varlen_field.name}));\n'
+    result += f"            }}\n"
+    return result
+
+
+def gen_evt_fields(groups: List[EvtGroup]) -> str:
+    result = ""
+    result += f"{pad_to_length('// ==== Event Fields ', 100, '=')}\n"
+    result += "\n"
+    result += "/// Value of an event field.\n"
+    result += "#[derive(Debug, Clone, Copy, PartialEq)]\n"
+    result += "pub enum EvtFieldVal<'a> {\n"
+    result += "    Uint(u64),\n"
+    result += "    Int(i64),\n"
+    result += "    Str(&'a str),\n"
+    result += "}\n"
+    result += "\n"
+
+    result += "impl RawEvt {\n"
+    result += "    /// Name of the kind of event.\n"
+    result += "    pub fn kind_name(&self) -> &'static str {\n"
+    result += "        match self {\n"
+    result += '            RawEvt::Invalid(_) => "Invalid",\n'
+    for group in groups:
+        name = group.code_name()
+        if group.normal_evt_cnt() > 0:
+            result += f"            RawEvt::{name}(e) => match e.kind {{\n"
+            for evt in group.evts:
+                if not evt.is_metadata:
+                    result += f'                {name}EvtKind::{pascal_case(evt.name)}(_) => "{pascal_case(evt.name)}",\n'
+            result += "            },\n"
+        if group.metadata_evt_cnt() > 0:
+            result += f"            RawEvt::{name}Metadata(e) => match e {{\n"
+            for evt in group.evts:
+                if evt.is_metadata:
+                    result += f'                {name}MetadataEvt::{pascal_case(evt.name)}(_) => "{pascal_case(evt.name)}",\n'
+            result += "            },\n"
+    result += "        }\n"
+    result += "    }\n"
+    result += "\n"
+
+    result += "    /// Call `f` with the name and value of every field of the event, except its timestamp.\n"
+    result += "    pub fn for_each_field<'a>(&'a self, mut f: impl FnMut(&'static str, EvtFieldVal<'a>)) {\n"
+    result += "        match self {\n"
+    result += "            RawEvt::Invalid(e) => {\n"
+    result += "                if let Some(err) = &e.err {\n"
+    result += '                    f("err", EvtFieldVal::Str(err));\n'
+    result += "                }\n"
+    result += "            }\n"
+    for group in groups:
+        name = group.code_name()
+        if group.normal_evt_cnt() > 0:
+            result += f"            RawEvt::{name}(e) => match &e.kind {{\n"
+            for evt in group.evts:
+                if not evt.is_metadata:
+                    result += gen_evt_field_visit(evt, f"{name}EvtKind::{pascal_case(evt.name)}")
+            result += "            },\n"
+        if group.metadata_evt_cnt() > 0:
+            result += f"            RawEvt::{name}Metadata(e) => match e {{\n"
+            for evt in group.evts:
+                if evt.is_metadata:
+                    result += gen_evt_field_visit(evt, f"{name}MetadataEvt::{pascal_case(evt.name)}")
+            result += "            },\n"
+    result += "        }\n"
+    result += "    }\n"
+    result += "}\n"
+    result += "\n"
+
+    return result
+
+
+def packed_shape(e: Evt) -> Optional[str]:
+    """Shape of the payload of an event in its packed form, or None if it has none."""
+    if len(e.optional_fields) > 0:
+        return None
+    kinds = [f.kind for f in e.fields]
+    if e.varlen_field is not None:
+        return "Str" if kinds == ["u32"] and e.varlen_field.kind == "str" else None
+    if kinds == ["u32"]:
+        return "Word"
+    if kinds == ["u32", "u32"]:
+        return "Pair"
+    if kinds == ["u32", "s64"]:
+        return "Val"
+    if kinds == ["u64", "u32"]:
+        return "Heap"
+    return None
+
+
+def packed_payload_pattern(shape: str, vals: List[str]) -> str:
+    match shape:
+        case "Word":
+            return f"PackedPayload::Word({vals[0]})"
+        case "Pair":
+            return f"PackedPayload::Pair([{vals[0]}, {vals[1]}])"
+        case _:
+            return f"PackedPayload::{shape}({', '.join(vals)})"
+
+
+def packed_evt_field_names(e: Evt) -> List[str]:
+    names = [f.name for f in e.fields]
+    if e.varlen_field is not None:
+        names.append(e.varlen_field.name)
+    return names
+
+
+def gen_packed_evts(groups: List[EvtGroup]) -> str:
+    packed = []
+    for group in groups:
+        for evt in group.evts:
+            shape = packed_shape(evt)
+            if shape is not None:
+                packed.append((group, evt, shape))
+
+    result = ""
+    result += f"{pad_to_length('// ==== Packed Events ', 100, '=')}\n"
+    result += "\n"
+    result += "/// Kind of an event whose fields can be packed into a [`PackedPayload`], used to store events\n"
+    result += "/// compactly. Events of all other kinds are `Other`.\n"
+    result += "#[derive(Debug, Clone, Copy, PartialEq, Eq)]\n"
+    result += "pub enum PackedKind {\n"
+    for group, evt, _ in packed:
+        result += f"    {group.code_name()}{pascal_case(evt.name)},\n"
+    result += "    Other,\n"
+    result += "}\n"
+    result += "\n"
+    result += "/// Shape of the payload of a packed event.\n"
+    result += "#[derive(Debug, Clone, Copy, PartialEq, Eq)]\n"
+    result += "pub enum PackedShape {\n"
+    result += "    Word,\n"
+    result += "    Pair,\n"
+    result += "    Str,\n"
+    result += "    Val,\n"
+    result += "    Heap,\n"
+    result += "    Other,\n"
+    result += "}\n"
+    result += "\n"
+    result += "/// Fields of a packed event, without its timestamp.\n"
+    result += "#[derive(Debug, Clone)]\n"
+    result += "pub enum PackedPayload {\n"
+    result += "    Word(u32),\n"
+    result += "    Pair([u32; 2]),\n"
+    result += "    Str(u32, Arc<str>),\n"
+    result += "    Val(u32, i64),\n"
+    result += "    Heap(u64, u32),\n"
+    result += "}\n"
+    result += "\n"
+
+    result += "impl PackedKind {\n"
+    result += "    pub fn shape(self) -> PackedShape {\n"
+    result += "        match self {\n"
+    for group, evt, shape in packed:
+        result += f"            PackedKind::{group.code_name()}{pascal_case(evt.name)} => PackedShape::{shape},\n"
+    result += "            PackedKind::Other => PackedShape::Other,\n"
+    result += "        }\n"
+    result += "    }\n"
+    result += "\n"
+    result += "    pub fn is_metadata(self) -> bool {\n"
+    result += "        matches!(\n"
+    result += "            self,\n"
+    metadata = [
+        f"PackedKind::{group.code_name()}{pascal_case(evt.name)}"
+        for group, evt, _ in packed
+        if evt.is_metadata
+    ]
+    result += "            " + " | ".join(metadata) + "\n"
+    result += "        )\n"
+    result += "    }\n"
+    result += "}\n"
+    result += "\n"
+
+    result += "impl RawEvt {\n"
+    result += "    /// Split the event into its kind and fields, or return it unchanged if it cannot be packed.\n"
+    result += "    pub fn pack(self) -> Result<(PackedKind, PackedPayload), RawEvt> {\n"
+    result += "        match self {\n"
+    for group, evt, shape in packed:
+        name = group.code_name()
+        evt_name = pascal_case(evt.name)
+        vals = [f"e.{n}" for n in packed_evt_field_names(evt)]
+        payload = packed_payload_pattern(shape, vals)
+        if evt.is_metadata:
+            pattern = f"RawEvt::{name}Metadata({name}MetadataEvt::{evt_name}(e))"
+        else:
+            pattern = f"RawEvt::{name}({name}Evt {{ kind: {name}EvtKind::{evt_name}(e), .. }})"
+        result += f"            {pattern} => Ok((PackedKind::{name}{evt_name}, {payload})),\n"
+    result += "            evt => Err(evt),\n"
+    result += "        }\n"
+    result += "    }\n"
+    result += "\n"
+    result += "    /// Rebuild an event from its timestamp, and the kind and fields returned by [`RawEvt::pack`].\n"
+    result += "    pub fn unpack(kind: PackedKind, ts: u64, payload: PackedPayload) -> RawEvt {\n"
+    result += "        match (kind, payload) {\n"
+    for group, evt, shape in packed:
+        name = group.code_name()
+        evt_name = pascal_case(evt.name)
+        field_names = packed_evt_field_names(evt)
+        pattern = packed_payload_pattern(shape, field_names)
+        fields = ", ".join(field_names)
+        evt_struct = f"{name}{evt_name}Evt {{ {fields} }}"
+        if evt.is_metadata:
+            value = f"RawEvt::{name}Metadata({name}MetadataEvt::{evt_name}({evt_struct}))"
+        else:
+            value = f"RawEvt::{name}({name}Evt {{ ts, kind: {name}EvtKind::{evt_name}({evt_struct}) }})"
+        result += f"            (PackedKind::{name}{evt_name}, {pattern}) => {value},\n"
+    result += '            (kind, payload) => panic!("Invalid payload {payload:?} for packed event kind {kind:?}."),\n'
+    result += "        }\n"
+    result += "    }\n"
+    result += "}\n"
+    result += "\n"
+
+    return result
+
+
+def evt_decode_args(e: Evt) -> str:
+    if e.varlen_field is not None:
+        return "buf, &mut current_idx, strings"
+    else:
+        return "buf, &mut current_idx"
+
+
 def gen_main_decode_func(groups: List[EvtGroup]) -> str:
 
     base_group = None
@@ -265,14 +524,12 @@ def gen_main_decode_func(groups: List[EvtGroup]) -> str:
     result += f"{pad_to_length('// ==== Main Decode Function ', 100, '=')}\n"
     result += "\n"
     result += "impl RawEvt {\n"
-    result += (
-        "    pub fn decode(buf: &[u8], mode: TraceMode) -> anyhow::Result<Self> {\n"
-    )
+    result += "    pub fn decode(buf: &[u8], mode: TraceMode, strings: &mut StringTable) -> anyhow::Result<Self> {\n"
     result += "        let mut current_idx: usize = 0;\n"
     result += "        let id: u8 = decode_u8(buf, &mut current_idx)?;\n"
     result += "        match id {\n"
     for event in base_group.evts:
-        result += f"            0x{event.id:X} => {base_group.code_name()}{pascal_case(event.name)}Evt::decode(buf, &mut current_idx),\n"
+        result += f"            0x{event.id:X} => {base_group.code_name()}{pascal_case(event.name)}Evt::decode({evt_decode_args(event)}),\n"
     result += f"            id => match mode {{\n"
     for group in groups:
         if group.name == "":
@@ -280,7 +537,7 @@ def gen_main_decode_func(groups: List[EvtGroup]) -> str:
         else:
             result += f"                TraceMode::{group.code_name()} => match id {{\n"
             for event in group.evts:
-                result += f"                0x{event.id:X} => {group.code_name()}{pascal_case(event.name)}Evt::decode(buf, &mut current_idx),\n"
+                result += f"                0x{event.id:X} => {group.code_name()}{pascal_case(event.name)}Evt::decode({evt_decode_args(event)}),\n"
             result += f'                    id => Err(anyhow!("Invalid event id 0x{{id:X}}!")),\n'
             result += f"                }}\n"
 
@@ -306,6 +563,10 @@ def gen(groups: List[EvtGroup], output_file: str, crate_dir: str):
 
     result += gen_main_decode_func(groups)
 
+    result += gen_evt_fields(groups)
+
+    result += gen_packed_evts(groups)
+
     with open(output_file, "w") as outfile:
         outfile.write(result)
 
@@ -10,7 +10,11 @@ cd ../tools/
 main_help=$(cargo run -- --help)
 conv_help=$(cargo run -- conv --help)
 dump_help=$(cargo run -- dump --help)
+index_help=$(cargo run -- index --help)
 compl_help=$(cargo run -- completion --help)
+analyze_help=$(cargo run -- analyze --help)
+analyze_lb_help=$(cargo run -- analyze load-balance --help)
+analyze_locks_help=$(cargo run -- analyze locks --help)
 
 cd "$script_dir"
 
@@ -23,5 +27,17 @@ echo "$conv_help" >> ./doc/cli_help/conv.txt
 echo "> tband-cli dump --help" > ./doc/cli_help/dump.txt
 echo "$dump_help" >> ./doc/cli_help/dump.txt
 
+echo "> tband-cli index --help" > ./doc/cli_help/index.txt
+echo "$index_help" >> ./doc/cli_help/index.txt
+
 echo "> tband-cli completion --help" > ./doc/cli_help/compl.txt
 echo "$compl_help" >> ./doc/cli_help/compl.txt
+
+echo "> tband-cli analyze --help" > ./doc/cli_help/analyze.txt
+echo "$analyze_help" >> ./doc/cli_help/analyze.txt
+echo "" >> ./doc/cli_help/analyze.txt
+echo "> tband-cli analyze load-balance --help" >> ./doc/cli_help/analyze.txt
+echo "$analyze_lb_help" >> ./doc/cli_help/analyze.txt
+echo "" >> ./doc/cli_help/analyze.txt
+echo "> tband-cli analyze locks --help" >> ./doc/cli_help/analyze.txt
+echo "$analyze_locks_help" >> ./doc/cli_help/analyze.txt
@@ -312,8 +312,75 @@ enum FrStreamBufferKind {
   FRSBK_MESSAGE_BUFFER = 0x1,
 };
 
+enum FrTaskState {
+  FRTS_RUNNING = 0x0,
+  FRTS_READY = 0x1,
+  FRTS_BLOCKED = 0x2,
+  FRTS_SUSPENDED = 0x3,
+  FRTS_DELETED = 0x4,
+};
+
 // ==== FreeRTOS Encoder Functions =============================================
 
+#define EVT_FREERTOS_TASK_STATE_IS_METADATA (0)
+#define EVT_FREERTOS_TASK_STATE_MAXLEN (COBS_MAXLEN((22)))
+static inline size_t encode_freertos_task_state(uint8_t buf[EVT_FREERTOS_TASK_STATE_MAXLEN], uint64_t ts, uint32_t task_id, enum FrTaskState state, uint32_t core_id) {
+  struct cobs_state cobs = cobs_start(buf);
+  encode_u8(&cobs, 0x4F);
+  encode_u64(&cobs, ts);
+  encode_u32(&cobs, task_id);
+  encode_u8(&cobs, (uint8_t)state);
+  encode_u32(&cobs, core_id);
+  return cobs_finish(&cobs);
+}
+
+#define EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_IS_METADATA (0)
+#define EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_MAXLEN (COBS_MAXLEN((21)))
+static inline size_t encode_freertos_task_stack_high_water_mark(uint8_t buf[EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_MAXLEN], uint64_t ts, uint32_t task_id, uint32_t min_free_bytes) {
+  struct cobs_state cobs = cobs_start(buf);
+  encode_u8(&cobs, 0x50);
+  encode_u64(&cobs, ts);
+  encode_u32(&cobs, task_id);
+  encode_u32(&cobs, min_free_bytes);
+  return cobs_finish(&cobs);
+}
+
+#define EVT_FREERTOS_HEAP_MALLOC_IS_METADATA (0)
+#define EVT_FREERTOS_HEAP_MALLOC_MAXLEN (COBS_MAXLEN((26)))
+static inline size_t encode_freertos_heap_malloc(uint8_t buf[EVT_FREERTOS_HEAP_MALLOC_MAXLEN], uint64_t ts, uint64_t addr, uint32_t size) {
+  struct cobs_state cobs = cobs_start(buf);
+  encode_u8(&cobs, 0x51);
+  encode_u64(&cobs, ts);
+  encode_u64(&cobs, addr);
+  encode_u32(&cobs, size);
+  return cobs_finish(&cobs);
+}
+
+#define EVT_FREERTOS_HEAP_FREE_IS_METADATA (0)
+#define EVT_FREERTOS_HEAP_FREE_MAXLEN (COBS_MAXLEN((26)))
+static inline size_t encode_freertos_heap_free(uint8_t buf[EVT_FREERTOS_HEAP_FREE_MAXLEN], uint64_t ts, uint64_t addr, uint32_t size) {
+  struct cobs_state cobs = cobs_start(buf);
+  encode_u8(&cobs, 0x52);
+  encode_u64(&cobs, ts);
+  encode_u64(&cobs, addr);
+  encode_u32(&cobs, size);
+  return cobs_finish(&cobs);
+}
+
+#define EVT_FREERTOS_TASK_HEAP_USAGE_IS_METADATA (0)
+#define EVT_FREERTOS_TASK_HEAP_USAGE_MAXLEN (COBS_MAXLEN((36)))
+static inline size_t encode_freertos_task_heap_usage(uint8_t buf[EVT_FREERTOS_TASK_HEAP_USAGE_MAXLEN], uint64_t ts, uint32_t task_id, uint32_t malloc_cnt, uint32_t malloc_bytes, uint32_t free_cnt, uint32_t free_bytes) {
+  struct cobs_state cobs = cobs_start(buf);
+  encode_u8(&cobs, 0x53);
+  encode_u64(&cobs, ts);
+  encode_u32(&cobs, task_id);
+  encode_u32(&cobs, malloc_cnt);
+  encode_u32(&cobs, malloc_bytes);
+  encode_u32(&cobs, free_cnt);
+  encode_u32(&cobs, free_bytes);
+  return cobs_finish(&cobs);
+}
+
 #define EVT_FREERTOS_TASK_SWITCHED_IN_IS_METADATA (0)
 #define EVT_FREERTOS_TASK_SWITCHED_IN_MAXLEN (COBS_MAXLEN((16)))
 static inline size_t encode_freertos_task_switched_in(uint8_t buf[EVT_FREERTOS_TASK_SWITCHED_IN_MAXLEN], uint64_t ts, uint32_t task_id) {
@@ -42,6 +42,50 @@ extern "C" {
   #define tband_configFREERTOS_STREAM_BUFFER_TRACE_ENABLE 1
 #endif /* tband_configFREERTOS_STREAM_BUFFER_TRACE_ENABLE */
 
+#ifndef tband_configFREERTOS_HEAP_TRACE_ENABLE
+  #define tband_configFREERTOS_HEAP_TRACE_ENABLE 0
+#endif /* tband_configFREERTOS_HEAP_TRACE_ENABLE */
+
+#ifndef tband_configFREERTOS_HEAP_TRACE_AGGREGATE
+  #define tband_configFREERTOS_HEAP_TRACE_AGGREGATE 0
+#endif /* tband_configFREERTOS_HEAP_TRACE_AGGREGATE */
+
+#ifndef tband_configFREERTOS_STACK_SAMPLE_ENABLE
+  #define tband_configFREERTOS_STACK_SAMPLE_ENABLE 0
+#endif /* tband_configFREERTOS_STACK_SAMPLE_ENABLE */
+
+#ifndef tband_configFREERTOS_STACK_SAMPLE_PERIOD_TICKS
+  #define tband_configFREERTOS_STACK_SAMPLE_PERIOD_TICKS 100
+#endif /* tband_configFREERTOS_STACK_SAMPLE_PERIOD_TICKS */
+
+#ifndef tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS
+  #define tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS 16
+#endif /* tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS */
+
+#ifndef tband_configFREERTOS_STATE_DUMP_ENABLE
+  #define tband_configFREERTOS_STATE_DUMP_ENABLE 0
+#endif /* tband_configFREERTOS_STATE_DUMP_ENABLE */
+
+#ifndef tband_configFREERTOS_STATE_DUMP_MAX_TASKS
+  #define tband_configFREERTOS_STATE_DUMP_MAX_TASKS 16
+#endif /* tband_configFREERTOS_STATE_DUMP_MAX_TASKS */
+
+#ifndef tband_configFREERTOS_STATE_DUMP_MAX_QUEUES
+  #define tband_configFREERTOS_STATE_DUMP_MAX_QUEUES 16
+#endif /* tband_configFREERTOS_STATE_DUMP_MAX_QUEUES */
+
+#if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+  #if (tband_configFREERTOS_TASK_TRACE_ENABLE != 1)
+    #error "tband_configFREERTOS_HEAP_TRACE_AGGREGATE requires tband_configFREERTOS_TASK_TRACE_ENABLE."
+  #endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE != 1) */
+#endif /* heap trace aggregation enabled */
+
+#if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+  #if (tband_configUSE_BACKEND_STREAMING != 1)
+    #error "tband_configFREERTOS_STATE_DUMP_ENABLE requires tband_configUSE_BACKEND_STREAMING."
+  #endif /* (tband_configUSE_BACKEND_STREAMING != 1) */
+#endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
 
 //===----------------------------------------------------------------------===//
 // TRACING
@@ -157,12 +201,18 @@ extern "C" {
   #endif /* (tband_configFREERTOS_TRACE_ENABLE == 1) */
 
   // Task deleted:
-  #if (tband_configFREERTOS_TASK_TRACE_ENABLE == 1)
+  #if ((tband_configFREERTOS_TASK_TRACE_ENABLE == 1) || (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1))
     void impl_tband_freertos_task_deleted(uint32_t task_id);
     #define traceTASK_DELETE(pxTask) impl_tband_freertos_task_deleted(                                                 \
         (pxTask)->uxTaskNumber  /* task id */                                                                          \
       )
-  #endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
+  #endif /* ((tband_configFREERTOS_TASK_TRACE_ENABLE == 1) || (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)) */
+
+  // Tick (used to periodically sample stack high-water-marks):
+  #if (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)
+    void impl_tband_freertos_tick(void);
+    #define traceTASK_INCREMENT_TICK(xTickCount) impl_tband_freertos_tick()
+  #endif /* (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) */
 
   // Queue created:
   #if (tband_configFREERTOS_TRACE_ENABLE == 1)
@@ -173,6 +223,22 @@ extern "C" {
       )
   #endif /* (tband_configFREERTOS_TRACE_ENABLE == 1) */
 
+  // Queue deleted (used to stop reporting the queue in state dumps):
+  #if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+    void impl_tband_freertos_queue_deleted(void *handle);
+    #define traceQUEUE_DELETE(pxQueue) impl_tband_freertos_queue_deleted((void *)(pxQueue))
+  #endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
+  // Heap usage flush (called by the backend before tracing is stopped):
+  #if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+    void impl_tband_freertos_flush_heap_usage(void);
+  #endif /* heap trace aggregation enabled */
+
+  // State dump (called by the streaming backend once streaming has started):
+  #if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+    void impl_tband_freertos_dump_state(void);
+  #endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
   // Queue name:
   #if (tband_configFREERTOS_TRACE_ENABLE == 1)
   void impl_tband_freertos_queue_name(void *queue_handle, char *name);
@@ -281,6 +347,24 @@ extern "C" {
       )
   #endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
 
+  // Heap allocation:
+  #if (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1)
+    void impl_tband_freertos_malloc(void *addr, uint32_t size);
+    #define traceMALLOC(pvAddress, uiSize) impl_tband_freertos_malloc(                                                 \
+        (void *)(pvAddress) /* address */,                                                                             \
+        (uint32_t)(uiSize) /* size */                                                                                  \
+      )
+  #endif /* (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) */
+
+  // Heap free:
+  #if (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1)
+    void impl_tband_freertos_free(void *addr, uint32_t size);
+    #define traceFREE(pvAddress, uiSize) impl_tband_freertos_free(                                                     \
+        (void *)(pvAddress) /* address */,                                                                             \
+        (uint32_t)(uiSize) /* size */                                                                                  \
+      )
+  #endif /* (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) */
+
   // Task-local event and value markers:
 
   #if ((tband_configMARKER_TRACE_ENABLE == 1) && (tband_configFREERTOS_TRACE_ENABLE == 1))
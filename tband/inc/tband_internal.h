@@ -20,6 +20,9 @@ bool tband_submit_to_backend(uint8_t *buf, size_t len, bool is_metadata);
 
 void handle_trace_evt(uint8_t *buf, size_t len, bool is_metadata, uint64_t ts);
 
+// Count events that could not be traced as dropped. Reported with the next traced event.
+void tband_count_dropped_evts(unsigned long cnt);
+
 // ===== Port ==================================================================
 
 #include "tband_port.h"
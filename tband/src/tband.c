@@ -141,6 +141,8 @@ static volatile unsigned long last_traced_dropped_evt_cnts[tband_portNUMBER_OF_C
 static volatile uint32_t dropped_evt_trace_periodic_cnts[tband_portNUMBER_OF_CORES] = {0};
 #endif
 
+void tband_count_dropped_evts(unsigned long cnt) { (void)atomic_fetch_add(&dropped_evt_cnt, cnt); }
+
 void handle_trace_evt(uint8_t *buf, size_t len, bool is_metadata, uint64_t ts) {
 #if tband_configTRACE_DROP_CNT_EVERY > 0
   uint32_t dropped_evt_trace_period_cnt = dropped_evt_trace_periodic_cnts[tband_portGET_CORE_ID()];
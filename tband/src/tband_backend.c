@@ -186,6 +186,25 @@ bool tband_tracing_backend_finished(unsigned int core_id) {
   return is_completed;
 }
 
+#if (tband_configUSE_BACKEND_STREAMING == 1) || (tband_configUSE_BACKEND_SNAPSHOT == 1)
+// Core that is stopping tracing, while it traces its last events with tracing_enabled_spinlock
+// held, or -1. Its backend must not try to acquire the spinlock again to stop tracing.
+static volatile int stopping_core_id = -1;
+
+// Internal implementation. Traces any events that were held back while tracing is still enabled.
+// *Must* be called from a critical section and while tracing_enabled_spinlock is held, right
+// before tracing is disabled, so that no events can be held back after it.
+static void impl_flush_before_stop(void) {
+#if (tband_configFREERTOS_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) &&   \
+  (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1)
+  stopping_core_id = (int)tband_portGET_CORE_ID();
+  // Trace the heap usage accumulated since the last task switch:
+  impl_tband_freertos_flush_heap_usage();
+  stopping_core_id = -1;
+#endif /* FreeRTOS heap trace aggregation enabled */
+}
+#endif /* Streaming or snapshot backend enabled */
+
 // ==== Metadata Buffer ========================================================
 
 #if (tband_configUSE_METADATA_BUF == 1)
@@ -355,6 +374,12 @@ int tband_start_streaming(void) {
   tband_spinlock_release(&tracing_enabled_spinlock);
   tband_portEXIT_CRITICAL_FROM_ANY();
 
+#if (tband_configFREERTOS_TRACE_ENABLE == 1) && (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+  if (err == 0) {
+    impl_tband_freertos_dump_state();
+  }
+#endif /* FreeRTOS state dump enabled */
+
   return err;
 }
 
@@ -368,14 +393,23 @@ int tband_restart_streaming(void) {
   tband_spinlock_release(&tracing_enabled_spinlock);
   tband_portEXIT_CRITICAL_FROM_ANY();
 
+#if (tband_configFREERTOS_TRACE_ENABLE == 1) && (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+  if (err == 0) {
+    impl_tband_freertos_dump_state();
+  }
+#endif /* FreeRTOS state dump enabled */
+
   return err;
 }
 
 int tband_stop_streaming(void) {
   int err = 0;
+
   tband_portENTER_CRITICAL_FROM_ANY();
   tband_spinlock_acquire(&tracing_enabled_spinlock);
 
+  impl_flush_before_stop();
+
   bool was_enabled = atomic_exchange(&tracing_enabled, false);
   if (!was_enabled) {
     err = -1;
@@ -452,7 +486,9 @@ bool tband_submit_to_backend(uint8_t *buf, size_t len, bool is_metadata) {
     tband_spinlock_release(&backend_spinlocks[core_id]);
   }
 
-  if (buffer_full) {
+  // If this core is already stopping tracing (and holding tracing_enabled_spinlock), it disables
+  // tracing itself:
+  if (buffer_full && stopping_core_id != (int)core_id) {
     // Stop tracing since buffer has filled.
     // First, acquire tracing_enabled_spinlock to be allowed to modify tracing_enabled:
     tband_spinlock_acquire(&tracing_enabled_spinlock);
@@ -498,9 +534,12 @@ end:
 
 int tband_stop_snapshot(void) {
   int err = 0;
+
   tband_portENTER_CRITICAL_FROM_ANY();
   tband_spinlock_acquire(&tracing_enabled_spinlock);
 
+  impl_flush_before_stop();
+
   bool was_enabled = atomic_exchange(&tracing_enabled, false);
   if (!was_enabled) {
     err = -1;
@@ -13,6 +13,7 @@
 // std:
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // FreeRTOS:
 #include "FreeRTOS.h"
@@ -32,6 +33,15 @@
 #error "configUSE_TRACE_FACILITY is not enabled!"
 #endif /* configUSE_TRACE_FACILITY == 0 */
 
+#if ((tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) && (INCLUDE_uxTaskGetStackHighWaterMark != 1))
+#error "INCLUDE_uxTaskGetStackHighWaterMark is not enabled but required for stack sampling!"
+#endif /* stack sampling enabled without INCLUDE_uxTaskGetStackHighWaterMark */
+
+#if ((tband_configFREERTOS_STATE_DUMP_ENABLE == 1) && (tband_portNUMBER_OF_CORES > 1) && \
+     (INCLUDE_xTaskGetCurrentTaskHandle != 1))
+#error "INCLUDE_xTaskGetCurrentTaskHandle is not enabled but required for multi-core state dumps!"
+#endif /* multi-core state dump enabled without INCLUDE_xTaskGetCurrentTaskHandle */
+
 // ===== STATE =================================================================
 
 // Unique ID counters (shared between all cores)
@@ -46,6 +56,91 @@ static volatile atomic_ulong next_queue_id = 1;
 static volatile uint32_t core_last_task[tband_portNUMBER_OF_CORES] = {0};
 #endif /* configUSE_PREEMPTION */
 
+#if (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)
+// Tasks whose stack high-water-mark is sampled. One task is sampled every
+// tband_configFREERTOS_STACK_SAMPLE_PERIOD_TICKS ticks, in round-robin order.
+// Tasks created while this table is full are not sampled.
+struct stack_sample_task {
+  TaskHandle_t handle; // NULL if slot is free.
+  uint32_t task_id;
+  // Set while the tick hook walks the stack of the task outside of the critical section. A task
+  // that is deleted in the meantime is not freed until this is cleared (see
+  // impl_tband_freertos_task_deleted).
+  volatile atomic_bool sampling;
+};
+static struct stack_sample_task stack_sample_tasks[tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS];
+static size_t stack_sample_next_idx = 0;
+static uint32_t stack_sample_tick_cnt = 0;
+#endif /* (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) */
+
+#if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+// Track heap usage of the task running on each core since it was last switched
+// in. This is traced as a single event once a different task is switched in,
+// instead of tracing every allocation.
+struct heap_usage {
+  uint32_t task_id;
+  uint32_t malloc_cnt;
+  uint32_t malloc_bytes;
+  uint32_t free_cnt;
+  uint32_t free_bytes;
+};
+static struct heap_usage core_heap_usage[tband_portNUMBER_OF_CORES] = {0};
+#endif /* heap trace aggregation enabled */
+
+#if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+// Queues whose fill level is reported when a state dump is taken. Queues
+// created while this table is full are not reported.
+struct state_dump_queue {
+  QueueHandle_t handle; // NULL if slot is free.
+  uint32_t queue_id;
+  bool is_mutex;
+};
+static struct state_dump_queue state_dump_queues[tband_configFREERTOS_STATE_DUMP_MAX_QUEUES];
+
+#if ((tband_configFREERTOS_TASK_TRACE_ENABLE == 1) && (tband_portNUMBER_OF_CORES == 1))
+// Tasks whose state is reported if there are more tasks than fit into the
+// snapshot taken with uxTaskGetSystemState. Tasks created while this table is
+// full are not reported.
+struct state_dump_task {
+  TaskHandle_t handle; // NULL if slot is free.
+  uint32_t task_id;
+};
+static struct state_dump_task state_dump_task_handles[tband_configFREERTOS_STATE_DUMP_MAX_TASKS];
+#endif /* task trace enabled on single core */
+
+// Scratch space for the task states and the fill level of the registered
+// queues. Only ever used by a single state dump at a time, since only one call
+// to start streaming can succeed.
+static TaskStatus_t state_dump_tasks[tband_configFREERTOS_STATE_DUMP_MAX_TASKS];
+struct state_dump_queue_fill {
+  struct state_dump_queue queue;
+  uint32_t fill;
+};
+static struct state_dump_queue_fill
+  state_dump_queue_fills[tband_configFREERTOS_STATE_DUMP_MAX_QUEUES];
+#endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
+// ===== HELPERS ===============================================================
+
+#if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+// Trace and reset the accumulated heap usage of a core, if any.
+// Note: Must be called from within a critical section.
+static void flush_heap_usage(struct heap_usage *usage, uint64_t ts) {
+  if (usage->malloc_cnt == 0 && usage->free_cnt == 0) {
+    return;
+  }
+  uint8_t buf[EVT_FREERTOS_TASK_HEAP_USAGE_MAXLEN];
+  size_t len = encode_freertos_task_heap_usage(buf, ts, usage->task_id, usage->malloc_cnt,
+                                               usage->malloc_bytes, usage->free_cnt,
+                                               usage->free_bytes);
+  handle_trace_evt(buf, len, EVT_FREERTOS_TASK_HEAP_USAGE_IS_METADATA, ts);
+  usage->malloc_cnt = 0;
+  usage->malloc_bytes = 0;
+  usage->free_cnt = 0;
+  usage->free_bytes = 0;
+}
+#endif /* heap trace aggregation enabled */
+
 // ===== TRACE HOOKS ===========================================================
 
 // FIXME add version toggle
@@ -101,6 +196,17 @@ void impl_tband_freertos_task_switched_in(uint32_t task_id) {
 #endif /* configUSE_PREEMPTION */
 
   uint64_t ts = tband_portTIMESTAMP();
+
+#if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+  {
+    struct heap_usage *usage = &core_heap_usage[tband_portGET_CORE_ID()];
+    if (usage->task_id != task_id) {
+      flush_heap_usage(usage, ts);
+      usage->task_id = task_id;
+    }
+  }
+#endif /* heap trace aggregation enabled */
+
   uint8_t buf[EVT_FREERTOS_TASK_SWITCHED_IN_MAXLEN];
   size_t len = encode_freertos_task_switched_in(buf, ts, task_id);
   handle_trace_evt(buf, len, EVT_FREERTOS_TASK_SWITCHED_IN_IS_METADATA, ts);
@@ -243,22 +349,266 @@ void impl_tband_freertos_task_create(void *task_handle, uint32_t priority, char
     size_t len = encode_freertos_task_name(buf, task_id, name);
     handle_trace_evt(buf, len, EVT_FREERTOS_TASK_NAME_IS_METADATA, ts);
   }
+
+#if (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)
+  for (size_t i = 0; i < tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS; i++) {
+    if (stack_sample_tasks[i].handle == NULL) {
+      stack_sample_tasks[i].handle = task;
+      stack_sample_tasks[i].task_id = task_id;
+      break;
+    }
+  }
+#endif /* (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) */
+
+#if ((tband_configFREERTOS_STATE_DUMP_ENABLE == 1) && \
+     (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) && (tband_portNUMBER_OF_CORES == 1))
+  for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_TASKS; i++) {
+    if (state_dump_task_handles[i].handle == NULL) {
+      state_dump_task_handles[i].handle = task;
+      state_dump_task_handles[i].task_id = task_id;
+      break;
+    }
+  }
+#endif /* state dump enabled on single core */
+
   tband_portEXIT_CRITICAL_FROM_ANY();
 }
 
 #endif /* (tband_configFREERTOS_TRACE_ENABLE == 1) */
 
-#if (tband_configFREERTOS_TASK_TRACE_ENABLE == 1)
+#if ((tband_configFREERTOS_TASK_TRACE_ENABLE == 1) || (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1))
 void impl_tband_freertos_task_deleted(uint32_t task_id) {
   tband_portENTER_CRITICAL_FROM_ANY();
+
+#if (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)
+  // Stop sampling the task, since its stack is about to be freed:
+  for (size_t i = 0; i < tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS; i++) {
+    if (stack_sample_tasks[i].handle != NULL && stack_sample_tasks[i].task_id == task_id) {
+      stack_sample_tasks[i].handle = NULL;
+      // On SMP, the tick hook may be walking the stack on another core right now. Wait for it to
+      // finish before the kernel frees the task. The tick hook does not enter a critical section
+      // before it is done, so this cannot deadlock:
+      while (atomic_load(&stack_sample_tasks[i].sampling)) {
+      }
+      break;
+    }
+  }
+#endif /* (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) */
+
+#if ((tband_configFREERTOS_STATE_DUMP_ENABLE == 1) && \
+     (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) && (tband_portNUMBER_OF_CORES == 1))
+  for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_TASKS; i++) {
+    struct state_dump_task *slot = &state_dump_task_handles[i];
+    if (slot->handle != NULL && slot->task_id == task_id) {
+      slot->handle = NULL;
+      break;
+    }
+  }
+#endif /* state dump enabled on single core */
+
+#if (tband_configFREERTOS_TASK_TRACE_ENABLE == 1)
   uint64_t ts = tband_portTIMESTAMP();
   uint8_t buf[EVT_FREERTOS_TASK_DELETED_MAXLEN];
   size_t len = encode_freertos_task_deleted(buf, ts, task_id);
   handle_trace_evt(buf, len, EVT_FREERTOS_TASK_DELETED_IS_METADATA, ts);
+#endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
+
+  tband_portEXIT_CRITICAL_FROM_ANY();
+}
+#endif /* task tracing or stack sampling enabled */
+
+#if (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1)
+void impl_tband_freertos_tick(void) {
+  // Called from the tick interrupt: Avoid taking the critical section unless a task is sampled.
+  if (!tband_tracing_enabled()) return;
+
+  // The tick counter and round-robin index are only accessed from the tick hook:
+  stack_sample_tick_cnt++;
+  if (stack_sample_tick_cnt < tband_configFREERTOS_STACK_SAMPLE_PERIOD_TICKS) return;
+  stack_sample_tick_cnt = 0;
+
+  // Select the next registered task:
+  TaskHandle_t handle = NULL;
+  uint32_t task_id = 0;
+  size_t sample_idx = 0;
+  tband_portENTER_CRITICAL_FROM_ANY();
+  for (size_t i = 0; i < tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS; i++) {
+    size_t idx = (stack_sample_next_idx + i) % tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS;
+    if (stack_sample_tasks[idx].handle == NULL) continue;
+
+    stack_sample_next_idx = (idx + 1) % tband_configFREERTOS_STACK_SAMPLE_MAX_TASKS;
+    handle = stack_sample_tasks[idx].handle;
+    task_id = stack_sample_tasks[idx].task_id;
+    sample_idx = idx;
+    atomic_store(&stack_sample_tasks[idx].sampling, true);
+    break;
+  }
+  tband_portEXIT_CRITICAL_FROM_ANY();
+  if (handle == NULL) return;
+
+  // Walks the stack of the task, so is done outside of the critical section. While the slot is
+  // marked as being sampled, deleting the task waits before the task is freed:
+  UBaseType_t hwm_words = uxTaskGetStackHighWaterMark(handle);
+  uint32_t min_free_bytes = (uint32_t)(hwm_words * sizeof(StackType_t));
+  atomic_store(&stack_sample_tasks[sample_idx].sampling, false);
+
+  tband_portENTER_CRITICAL_FROM_ANY();
+  uint64_t ts = tband_portTIMESTAMP();
+  uint8_t buf[EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_MAXLEN];
+  size_t len = encode_freertos_task_stack_high_water_mark(buf, ts, task_id, min_free_bytes);
+  handle_trace_evt(buf, len, EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_IS_METADATA, ts);
   tband_portEXIT_CRITICAL_FROM_ANY();
 }
+#endif /* (tband_configFREERTOS_STACK_SAMPLE_ENABLE == 1) */
+
+#if ((tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) && (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1))
+// Trace the heap usage accumulated on all cores. Called by the backend right before tracing is
+// disabled (while holding the lock that guards it), so no usage since the last task switch is lost.
+void impl_tband_freertos_flush_heap_usage(void) {
+  tband_portENTER_CRITICAL_FROM_ANY();
+  uint64_t ts = tband_portTIMESTAMP();
+  for (size_t core_id = 0; core_id < tband_portNUMBER_OF_CORES; core_id++) {
+    flush_heap_usage(&core_heap_usage[core_id], ts);
+  }
+  tband_portEXIT_CRITICAL_FROM_ANY();
+}
+#endif /* heap trace aggregation enabled */
+
+#if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+// Trace the current state and priority of all tasks, and the current fill level of all
+// registered queues. Called by the streaming backend once streaming has started, outside of any
+// critical section, since the task list can only be walked with the scheduler suspended.
+// If there are more tasks than tband_configFREERTOS_STATE_DUMP_MAX_TASKS, only the state of the
+// first tband_configFREERTOS_STATE_DUMP_MAX_TASKS tasks is traced (on a single core), and the
+// remaining tasks are counted as dropped events.
+void impl_tband_freertos_dump_state(void) {
+  // Keep the scheduler suspended until the dump has been traced. On a single core, this means no
+  // task changes state between the snapshot being taken and traced. On SMP, tasks that are
+  // already running on other cores keep running, and may change state in the meantime. The
+  // snapshot is taken outside of the critical section, since the kernel functions used enter
+  // critical sections of their own:
+  vTaskSuspendAll();
+
+#if (tband_configFREERTOS_TASK_TRACE_ENABLE == 1)
+  UBaseType_t total_task_cnt = uxTaskGetNumberOfTasks();
+  UBaseType_t task_cnt = 0;
+  if (total_task_cnt <= tband_configFREERTOS_STATE_DUMP_MAX_TASKS) {
+    task_cnt =
+      uxTaskGetSystemState(state_dump_tasks, tband_configFREERTOS_STATE_DUMP_MAX_TASKS, NULL);
+  } else {
+#if (tband_portNUMBER_OF_CORES == 1)
+    // uxTaskGetSystemState only takes a snapshot if all tasks fit. Query the registered tasks
+    // individually instead. With the scheduler suspended, no task can be created or deleted while
+    // the table is walked. On SMP, a task running on another core could delete a task while it is
+    // being queried, so no task states are traced there.
+    for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_TASKS; i++) {
+      if (state_dump_task_handles[i].handle == NULL) continue;
+      vTaskGetInfo(state_dump_task_handles[i].handle, &state_dump_tasks[task_cnt], pdFALSE,
+                   eInvalid);
+      task_cnt++;
+    }
+#endif /* (tband_portNUMBER_OF_CORES == 1) */
+  }
+  UBaseType_t dropped_task_cnt = total_task_cnt > task_cnt ? total_task_cnt - task_cnt : 0;
+
+#if (tband_portNUMBER_OF_CORES > 1)
+  TaskHandle_t running_tasks[tband_portNUMBER_OF_CORES];
+  for (BaseType_t core = 0; core < tband_portNUMBER_OF_CORES; core++) {
+    running_tasks[core] = xTaskGetCurrentTaskHandleForCore(core);
+  }
+#endif /* (tband_portNUMBER_OF_CORES > 1) */
+#endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
+
+#if (tband_configFREERTOS_QUEUE_TRACE_ENABLE == 1)
+  // Read the fill levels while in the critical section, so no queue can be deleted (see
+  // impl_tband_freertos_queue_deleted) while its fill level is read. The ISR variant does not
+  // enter a critical section of its own:
+  size_t queue_cnt = 0;
+  tband_portENTER_CRITICAL_FROM_ANY();
+  for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_QUEUES; i++) {
+    if (state_dump_queues[i].handle == NULL) continue;
+    state_dump_queue_fills[queue_cnt].queue = state_dump_queues[i];
+    state_dump_queue_fills[queue_cnt].fill =
+      (uint32_t)uxQueueMessagesWaitingFromISR(state_dump_queues[i].handle);
+    queue_cnt++;
+  }
+  tband_portEXIT_CRITICAL_FROM_ANY();
+#endif /* (tband_configFREERTOS_QUEUE_TRACE_ENABLE == 1) */
+
+  tband_portENTER_CRITICAL_FROM_ANY();
+  uint64_t ts = tband_portTIMESTAMP();
+
+#if (tband_configFREERTOS_TASK_TRACE_ENABLE == 1)
+  if (dropped_task_cnt > 0) {
+    tband_count_dropped_evts((unsigned long)dropped_task_cnt);
+  }
+
+  for (UBaseType_t i = 0; i < task_cnt; i++) {
+    TaskStatus_t *status = &state_dump_tasks[i];
+    uint32_t task_id = (uint32_t)status->xTaskNumber;
+    if (task_id == 0) continue; // Created before the tracer was set up.
+
+    enum FrTaskState state;
+    uint32_t core_id = 0;
+    switch (status->eCurrentState) {
+      case eRunning:
+        state = FRTS_RUNNING;
+#if (tband_portNUMBER_OF_CORES > 1)
+        for (BaseType_t core = 0; core < tband_portNUMBER_OF_CORES; core++) {
+          if (running_tasks[core] == status->xHandle) {
+            core_id = (uint32_t)core;
+            break;
+          }
+        }
+#endif /* (tband_portNUMBER_OF_CORES > 1) */
+        break;
+      case eReady:
+        state = FRTS_READY;
+        break;
+      case eBlocked:
+        state = FRTS_BLOCKED;
+        break;
+      case eSuspended:
+        state = FRTS_SUSPENDED;
+        break;
+      case eDeleted:
+        state = FRTS_DELETED;
+        break;
+      default:
+        continue;
+    }
+
+    {
+      uint8_t buf[EVT_FREERTOS_TASK_STATE_MAXLEN];
+      size_t len = encode_freertos_task_state(buf, ts, task_id, state, core_id);
+      handle_trace_evt(buf, len, EVT_FREERTOS_TASK_STATE_IS_METADATA, ts);
+    }
+    {
+      uint32_t priority = (uint32_t)status->uxCurrentPriority;
+      uint8_t buf[EVT_FREERTOS_TASK_PRIORITY_SET_MAXLEN];
+      size_t len = encode_freertos_task_priority_set(buf, ts, task_id, priority);
+      handle_trace_evt(buf, len, EVT_FREERTOS_TASK_PRIORITY_SET_IS_METADATA, ts);
+    }
+  }
 #endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
 
+#if (tband_configFREERTOS_QUEUE_TRACE_ENABLE == 1)
+  for (size_t i = 0; i < queue_cnt; i++) {
+    struct state_dump_queue_fill *queue = &state_dump_queue_fills[i];
+    // The holder of a taken mutex is not known, so it is only reported once released:
+    if (queue->queue.is_mutex && queue->fill == 0) continue;
+
+    uint8_t buf[EVT_FREERTOS_QUEUE_CUR_LENGTH_MAXLEN];
+    size_t len = encode_freertos_queue_cur_length(buf, ts, queue->queue.queue_id, queue->fill);
+    handle_trace_evt(buf, len, EVT_FREERTOS_QUEUE_CUR_LENGTH_IS_METADATA, ts);
+  }
+#endif /* (tband_configFREERTOS_QUEUE_TRACE_ENABLE == 1) */
+
+  tband_portEXIT_CRITICAL_FROM_ANY();
+  (void)xTaskResumeAll();
+}
+#endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
 #if (tband_configFREERTOS_TRACE_ENABLE == 1)
 void impl_tband_freertos_queue_created(void *handle, uint8_t type_val) {
   tband_portENTER_CRITICAL_FROM_ANY();
@@ -317,10 +667,35 @@ void impl_tband_freertos_queue_created(void *handle, uint8_t type_val) {
   (void)type_val;
 #endif /* (tband_configFREERTOS_QUEUE_TRACE_ENABLE == 1) */
 
+#if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+  for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_QUEUES; i++) {
+    if (state_dump_queues[i].handle == NULL) {
+      state_dump_queues[i].handle = queue;
+      state_dump_queues[i].queue_id = id;
+      state_dump_queues[i].is_mutex =
+        (type_val == queueQUEUE_TYPE_MUTEX) || (type_val == queueQUEUE_TYPE_RECURSIVE_MUTEX);
+      break;
+    }
+  }
+#endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
   tband_portEXIT_CRITICAL_FROM_ANY();
 }
 #endif /* (tband_configFREERTOS_TRACE_ENABLE == 1) */
 
+#if (tband_configFREERTOS_STATE_DUMP_ENABLE == 1)
+void impl_tband_freertos_queue_deleted(void *handle) {
+  tband_portENTER_CRITICAL_FROM_ANY();
+  for (size_t i = 0; i < tband_configFREERTOS_STATE_DUMP_MAX_QUEUES; i++) {
+    if (state_dump_queues[i].handle == (QueueHandle_t)handle) {
+      state_dump_queues[i].handle = NULL;
+      break;
+    }
+  }
+  tband_portEXIT_CRITICAL_FROM_ANY();
+}
+#endif /* (tband_configFREERTOS_STATE_DUMP_ENABLE == 1) */
+
 #if (tband_configFREERTOS_TRACE_ENABLE == 1)
 void impl_tband_freertos_queue_name(void *queue_handle, char *name) {
   tband_portENTER_CRITICAL_FROM_ANY();
@@ -447,6 +822,44 @@ void impl_tband_freertos_blocking_on_queue_peek(uint32_t queue_id, uint32_t tick
 }
 #endif /* (tband_configFREERTOS_TASK_TRACE_ENABLE == 1) */
 
+#if (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1)
+void impl_tband_freertos_malloc(void *addr, uint32_t size) {
+  if (addr == NULL) {
+    return; // Failed allocation.
+  }
+  tband_portENTER_CRITICAL_FROM_ANY();
+#if (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1)
+  struct heap_usage *usage = &core_heap_usage[tband_portGET_CORE_ID()];
+  usage->malloc_cnt++;
+  usage->malloc_bytes += size;
+#else
+  uint64_t ts = tband_portTIMESTAMP();
+  uint8_t buf[EVT_FREERTOS_HEAP_MALLOC_MAXLEN];
+  size_t len = encode_freertos_heap_malloc(buf, ts, (uint64_t)(uintptr_t)addr, size);
+  handle_trace_evt(buf, len, EVT_FREERTOS_HEAP_MALLOC_IS_METADATA, ts);
+#endif /* tband_configFREERTOS_HEAP_TRACE_AGGREGATE */
+  tband_portEXIT_CRITICAL_FROM_ANY();
+}
+#endif /* (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) */
+
+#if (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1)
+void impl_tband_freertos_free(void *addr, uint32_t size) {
+  tband_portENTER_CRITICAL_FROM_ANY();
+#if (tband_configFREERTOS_HEAP_TRACE_AGGREGATE == 1)
+  (void)addr;
+  struct heap_usage *usage = &core_heap_usage[tband_portGET_CORE_ID()];
+  usage->free_cnt++;
+  usage->free_bytes += size;
+#else
+  uint64_t ts = tband_portTIMESTAMP();
+  uint8_t buf[EVT_FREERTOS_HEAP_FREE_MAXLEN];
+  size_t len = encode_freertos_heap_free(buf, ts, (uint64_t)(uintptr_t)addr, size);
+  handle_trace_evt(buf, len, EVT_FREERTOS_HEAP_FREE_IS_METADATA, ts);
+#endif /* tband_configFREERTOS_HEAP_TRACE_AGGREGATE */
+  tband_portEXIT_CRITICAL_FROM_ANY();
+}
+#endif /* (tband_configFREERTOS_HEAP_TRACE_ENABLE == 1) */
+
 #if ((tband_configMARKER_TRACE_ENABLE == 1) && (tband_configFREERTOS_TRACE_ENABLE == 1))
 void impl_tband_freertos_task_evtmarker_name(uint32_t id, const char *name) {
   tband_portENTER_CRITICAL_FROM_ANY();
@@ -260,6 +260,91 @@ void test_valmarker(void){
 
 // ==== FreeRTOS Encoder Tests =========================================================================================
 
+void test_freertos_task_state(void){
+  {
+    // Min
+    uint8_t buf[EVT_FREERTOS_TASK_STATE_MAXLEN] = {0};
+    size_t len = encode_freertos_task_state(buf, 0x0, 0x0, 0x0, 0x0);
+    uint8_t expected[] = {0x4f, 0x0, 0x0, 0x0, 0x0};
+    compare_arrays(buf, len, expected, sizeof(expected), "MIN");
+  }
+  {
+    // Max
+    uint8_t buf[EVT_FREERTOS_TASK_STATE_MAXLEN] = {0};
+    size_t len = encode_freertos_task_state(buf, UINT64_MAX, UINT32_MAX, UINT8_MAX, UINT32_MAX);
+    uint8_t expected[] = {0x4f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf};
+    compare_arrays(buf, len, expected, sizeof(expected), "MAX");
+  }
+}
+
+void test_freertos_task_stack_high_water_mark(void){
+  {
+    // Min
+    uint8_t buf[EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_MAXLEN] = {0};
+    size_t len = encode_freertos_task_stack_high_water_mark(buf, 0x0, 0x0, 0x0);
+    uint8_t expected[] = {0x50, 0x0, 0x0, 0x0};
+    compare_arrays(buf, len, expected, sizeof(expected), "MIN");
+  }
+  {
+    // Max
+    uint8_t buf[EVT_FREERTOS_TASK_STACK_HIGH_WATER_MARK_MAXLEN] = {0};
+    size_t len = encode_freertos_task_stack_high_water_mark(buf, UINT64_MAX, UINT32_MAX, UINT32_MAX);
+    uint8_t expected[] = {0x50, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xf};
+    compare_arrays(buf, len, expected, sizeof(expected), "MAX");
+  }
+}
+
+void test_freertos_heap_malloc(void){
+  {
+    // Min
+    uint8_t buf[EVT_FREERTOS_HEAP_MALLOC_MAXLEN] = {0};
+    size_t len = encode_freertos_heap_malloc(buf, 0x0, 0x0, 0x0);
+    uint8_t expected[] = {0x51, 0x0, 0x0, 0x0};
+    compare_arrays(buf, len, expected, sizeof(expected), "MIN");
+  }
+  {
+    // Max
+    uint8_t buf[EVT_FREERTOS_HEAP_MALLOC_MAXLEN] = {0};
+    size_t len = encode_freertos_heap_malloc(buf, UINT64_MAX, UINT64_MAX, UINT32_MAX);
+    uint8_t expected[] = {0x51, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xf};
+    compare_arrays(buf, len, expected, sizeof(expected), "MAX");
+  }
+}
+
+void test_freertos_heap_free(void){
+  {
+    // Min
+    uint8_t buf[EVT_FREERTOS_HEAP_FREE_MAXLEN] = {0};
+    size_t len = encode_freertos_heap_free(buf, 0x0, 0x0, 0x0);
+    uint8_t expected[] = {0x52, 0x0, 0x0, 0x0};
+    compare_arrays(buf, len, expected, sizeof(expected), "MIN");
+  }
+  {
+    // Max
+    uint8_t buf[EVT_FREERTOS_HEAP_FREE_MAXLEN] = {0};
+    size_t len = encode_freertos_heap_free(buf, UINT64_MAX, UINT64_MAX, UINT32_MAX);
+    uint8_t expected[] = {0x52, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xf};
+    compare_arrays(buf, len, expected, sizeof(expected), "MAX");
+  }
+}
+
+void test_freertos_task_heap_usage(void){
+  {
+    // Min
+    uint8_t buf[EVT_FREERTOS_TASK_HEAP_USAGE_MAXLEN] = {0};
+    size_t len = encode_freertos_task_heap_usage(buf, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0);
+    uint8_t expected[] = {0x53, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0};
+    compare_arrays(buf, len, expected, sizeof(expected), "MIN");
+  }
+  {
+    // Max
+    uint8_t buf[EVT_FREERTOS_TASK_HEAP_USAGE_MAXLEN] = {0};
+    size_t len = encode_freertos_task_heap_usage(buf, UINT64_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX);
+    uint8_t expected[] = {0x53, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xf, 0xff, 0xff, 0xff, 0xff, 0xf};
+    compare_arrays(buf, len, expected, sizeof(expected), "MAX");
+  }
+}
+
 void test_freertos_task_switched_in(void){
   {
     // Min
@@ -875,6 +960,11 @@ int main(void) {
   RUN_TEST(test_evtmarker_end);
   RUN_TEST(test_valmarker_name);
   RUN_TEST(test_valmarker);
+  RUN_TEST(test_freertos_task_state);
+  RUN_TEST(test_freertos_task_stack_high_water_mark);
+  RUN_TEST(test_freertos_heap_malloc);
+  RUN_TEST(test_freertos_heap_free);
+  RUN_TEST(test_freertos_task_heap_usage);
   RUN_TEST(test_freertos_task_switched_in);
   RUN_TEST(test_freertos_task_to_rdy_state);
   RUN_TEST(test_freertos_task_resumed);
@@ -1,3 +1,6 @@
+use std::{collections::HashMap, io::Write};
+
+use flate2::{write::ZlibEncoder, Compression};
 use prost::Message;
 
 mod protos {
@@ -6,8 +9,14 @@ mod protos {
     include!(concat!(env!("OUT_DIR"), "/perfetto.protos.rs"));
 }
 
+mod wire;
+
+use wire::{put_debug_annotation, put_debug_annotation_name, EvtCounterValue, EvtName, EvtPacket};
+
+const SEQUENCE_ID: u32 = 0xDEADBEEF;
+
 const TRUSTED_PACKET_SEQUENCE_ID: Option<protos::trace_packet::OptionalTrustedPacketSequenceId> =
-    Some(protos::trace_packet::OptionalTrustedPacketSequenceId::TrustedPacketSequenceId(0xDEADBEEF));
+    Some(protos::trace_packet::OptionalTrustedPacketSequenceId::TrustedPacketSequenceId(SEQUENCE_ID));
 
 pub trait Uuid {
     fn uuid(&self) -> u64;
@@ -19,6 +28,7 @@ pub struct Synthetto {
     uuid_cnt: u64,
     track_descriptors: Vec<protos::TrackDescriptor>,
     last_emited_descriptor: Option<usize>,
+    sequence_cnt: u32,
 }
 
 impl Default for Synthetto {
@@ -33,6 +43,7 @@ impl Synthetto {
             uuid_cnt: 1,
             track_descriptors: vec![],
             last_emited_descriptor: None,
+            sequence_cnt: 0,
         }
     }
 
@@ -267,6 +278,185 @@ impl Synthetto {
 
         r
     }
+
+    /// New packet sequence, with its own interning state (see [`Sequence`]).
+    pub fn new_sequence(&mut self) -> Sequence {
+        let id = SEQUENCE_ID.wrapping_add(self.sequence_cnt);
+        self.sequence_cnt += 1;
+        Sequence {
+            id,
+            interned_event_names: HashMap::new(),
+            interned_annotation_names: HashMap::new(),
+            annotation_buf: vec![],
+            annotation_name_buf: vec![],
+            incremental_state_cleared: false,
+        }
+    }
+}
+
+/// Packet sequence that packets with interned names are emitted on.
+///
+/// Interned names are only valid on the sequence that interned them, and are emitted with the
+/// first packet of the sequence that refers to them. Packets of a sequence must therefore be
+/// emitted in the order in which they are created, but packets of different sequences are
+/// independent of each other: Tracks that are generated separately (such as on different threads)
+/// can each use their own sequence, and their packets can be concatenated in any order.
+pub struct Sequence {
+    id: u32,
+    /// Interning IDs of all event names emitted so far.
+    interned_event_names: HashMap<String, u64>,
+    /// Interning IDs of all debug annotation names emitted so far.
+    interned_annotation_names: HashMap<String, u64>,
+    /// Scratch buffers for the encoded debug annotations, and newly interned annotation names, of
+    /// a directly written packet.
+    annotation_buf: Vec<u8>,
+    annotation_name_buf: Vec<u8>,
+    /// Set once a packet has cleared the incremental state of the sequence.
+    incremental_state_cleared: bool,
+}
+
+impl Sequence {
+    /// Wrap a track event that refers to an interned event name into a packet.
+    ///
+    /// A name is only included in the trace with the first packet that refers to it, all later
+    /// packets only carry its interning ID. The first such packet also clears the incremental state
+    /// of the sequence. Packets must therefore be emitted in the order in which they are created.
+    ///
+    /// The names of the debug annotations in `args` are interned in the same way.
+    fn interned_evt_packet(
+        &mut self,
+        ts: u64,
+        name: &str,
+        args: &[(&str, DebugValue)],
+        evt: protos::TrackEvent,
+    ) -> TracePacket {
+        let (iid, is_new) = self.intern_event_name(name);
+        let mut interned = protos::InternedData::default();
+        if is_new {
+            interned.event_names.push(protos::EventName {
+                iid: Some(iid),
+                name: Some(name.to_string()),
+            });
+        }
+
+        let mut debug_annotations = vec![];
+        for (arg_name, val) in args {
+            let (arg_iid, is_new) = self.intern_annotation_name(arg_name);
+            if is_new {
+                interned.debug_annotation_names.push(protos::DebugAnnotationName {
+                    iid: Some(arg_iid),
+                    name: Some(arg_name.to_string()),
+                });
+            }
+            debug_annotations.push(protos::DebugAnnotation {
+                name_field: Some(protos::debug_annotation::NameField::NameIid(arg_iid)),
+                value: Some(match val {
+                    DebugValue::Uint(val) => protos::debug_annotation::Value::UintValue(*val),
+                    DebugValue::Int(val) => protos::debug_annotation::Value::IntValue(*val),
+                    DebugValue::Str(val) => protos::debug_annotation::Value::StringValue(val.to_string()),
+                }),
+                ..protos::DebugAnnotation::default()
+            });
+        }
+
+        let has_interned_data = !interned.event_names.is_empty() || !interned.debug_annotation_names.is_empty();
+        let interned_data = has_interned_data.then_some(interned);
+        let sequence_flags = self.incremental_sequence_flags();
+
+        TracePacket {
+            timestamp: Some(ts),
+            data: Some(protos::trace_packet::Data::TrackEvent(protos::TrackEvent {
+                name_field: Some(protos::track_event::NameField::NameIid(iid)),
+                debug_annotations,
+                ..evt
+            })),
+            interned_data,
+            sequence_flags: Some(sequence_flags),
+            optional_trusted_packet_sequence_id: Some(
+                protos::trace_packet::OptionalTrustedPacketSequenceId::TrustedPacketSequenceId(self.id),
+            ),
+            ..protos::TracePacket::default()
+        }
+    }
+
+    /// Like [`Sequence::interned_evt_packet`], but write the packet directly.
+    fn write_interned_evt_packet(
+        &mut self,
+        buf: &mut Vec<u8>,
+        name: &str,
+        args: &[(&str, DebugValue)],
+        evt: EvtPacket,
+    ) {
+        let (iid, is_new) = self.intern_event_name(name);
+
+        let mut annotations = std::mem::take(&mut self.annotation_buf);
+        let mut annotation_names = std::mem::take(&mut self.annotation_name_buf);
+        annotations.clear();
+        annotation_names.clear();
+        for (arg_name, val) in args {
+            let (arg_iid, is_new) = self.intern_annotation_name(arg_name);
+            if is_new {
+                put_debug_annotation_name(&mut annotation_names, arg_iid, arg_name);
+            }
+            put_debug_annotation(&mut annotations, arg_iid, val);
+        }
+
+        EvtPacket {
+            name: EvtName::Interned(iid),
+            debug_annotations: &annotations,
+            interned_name: is_new.then_some((iid, name)),
+            interned_annotation_names: &annotation_names,
+            sequence_id: self.id,
+            sequence_flags: Some(self.incremental_sequence_flags()),
+            ..evt
+        }
+        .write(buf);
+
+        self.annotation_buf = annotations;
+        self.annotation_name_buf = annotation_names;
+    }
+
+    /// Interning ID of an event name, and whether the name was interned just now.
+    fn intern_event_name(&mut self, name: &str) -> (u64, bool) {
+        if let Some(iid) = self.interned_event_names.get(name) {
+            return (*iid, false);
+        }
+
+        // Interning ID 0 is invalid:
+        let iid = self.interned_event_names.len() as u64 + 1;
+        self.interned_event_names.insert(name.to_string(), iid);
+        (iid, true)
+    }
+
+    /// Interning ID of a debug annotation name, and whether the name was interned just now.
+    fn intern_annotation_name(&mut self, name: &str) -> (u64, bool) {
+        if let Some(iid) = self.interned_annotation_names.get(name) {
+            return (*iid, false);
+        }
+
+        // Interning ID 0 is invalid:
+        let iid = self.interned_annotation_names.len() as u64 + 1;
+        self.interned_annotation_names.insert(name.to_string(), iid);
+        (iid, true)
+    }
+
+    /// Sequence flags of a packet that depends on interned data.
+    fn incremental_sequence_flags(&mut self) -> u32 {
+        let mut sequence_flags = protos::trace_packet::SequenceFlags::SeqNeedsIncrementalState as u32;
+        if !self.incremental_state_cleared {
+            sequence_flags |= protos::trace_packet::SequenceFlags::SeqIncrementalStateCleared as u32;
+            self.incremental_state_cleared = true;
+        }
+        sequence_flags
+    }
+}
+
+/// Typed value of a debug annotation (argument) of a track event.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum DebugValue<'a> {
+    Uint(u64),
+    Int(i64),
+    Str(&'a str),
 }
 
 pub struct Track<S, K>
@@ -331,6 +521,17 @@ impl<S: TrackScope> Track<S, EventTrack> {
         }
     }
 
+    /// Like [`Track::slice_begin_evt`], but with an interned name. Suited for names that repeat
+    /// throughout the trace, which are then only included once per sequence.
+    pub fn interned_slice_begin_evt(&self, seq: &mut Sequence, ts: u64, name: &str) -> TracePacket {
+        let evt = protos::TrackEvent {
+            track_uuid: Some(self.uuid),
+            r#type: Some(protos::track_event::Type::SliceBegin as i32),
+            ..protos::TrackEvent::default()
+        };
+        seq.interned_evt_packet(ts, name, &[], evt)
+    }
+
     pub fn slice_end_evt(&self, ts: u64) -> TracePacket {
         protos::TracePacket {
             timestamp: Some(ts),
@@ -358,6 +559,139 @@ impl<S: TrackScope> Track<S, EventTrack> {
             ..protos::TracePacket::default()
         }
     }
+
+    /// Like [`Track::instant_evt`], but with an interned name (see
+    /// [`Track::interned_slice_begin_evt`]).
+    pub fn interned_instant_evt(&self, seq: &mut Sequence, ts: u64, name: &str) -> TracePacket {
+        let evt = protos::TrackEvent {
+            track_uuid: Some(self.uuid),
+            r#type: Some(protos::track_event::Type::Instant as i32),
+            ..protos::TrackEvent::default()
+        };
+        seq.interned_evt_packet(ts, name, &[], evt)
+    }
+
+    /// Like [`Track::interned_instant_evt`], but with typed debug annotations (arguments). The
+    /// annotation names are interned as well.
+    pub fn interned_instant_evt_with_args(
+        &self,
+        seq: &mut Sequence,
+        ts: u64,
+        name: &str,
+        args: &[(&str, DebugValue)],
+    ) -> TracePacket {
+        let evt = protos::TrackEvent {
+            track_uuid: Some(self.uuid),
+            r#type: Some(protos::track_event::Type::Instant as i32),
+            ..protos::TrackEvent::default()
+        };
+        seq.interned_evt_packet(ts, name, args, evt)
+    }
+
+    /// Like [`Track::interned_instant_evt`], but connect the event to other events with flows.
+    ///
+    /// Flow IDs are global within the trace. The earliest event with a flow ID is the source of
+    /// the flow, which passes through all later events with the same ID, and ends at an event
+    /// that lists it in `terminating_flow_ids`.
+    pub fn interned_instant_evt_with_flows(
+        &self,
+        seq: &mut Sequence,
+        ts: u64,
+        name: &str,
+        flow_ids: &[u64],
+        terminating_flow_ids: &[u64],
+    ) -> TracePacket {
+        let evt = protos::TrackEvent {
+            track_uuid: Some(self.uuid),
+            r#type: Some(protos::track_event::Type::Instant as i32),
+            flow_ids: flow_ids.to_vec(),
+            terminating_flow_ids: terminating_flow_ids.to_vec(),
+            ..protos::TrackEvent::default()
+        };
+        seq.interned_evt_packet(ts, name, &[], evt)
+    }
+
+    /// Like [`Track::slice_begin_evt`], but append the encoded packet to `buf` (see
+    /// [`write_packet`]) instead of building it.
+    pub fn write_slice_begin_evt(&self, buf: &mut Vec<u8>, ts: u64, name: Option<&str>) {
+        let name = name.map_or(EvtName::None, EvtName::Inline);
+        self.evt_packet(ts, protos::track_event::Type::SliceBegin, name)
+            .write(buf);
+    }
+
+    /// Like [`Track::interned_slice_begin_evt`], but append the encoded packet to `buf`.
+    pub fn write_interned_slice_begin_evt(&self, seq: &mut Sequence, buf: &mut Vec<u8>, ts: u64, name: &str) {
+        let evt = self.evt_packet(ts, protos::track_event::Type::SliceBegin, EvtName::None);
+        seq.write_interned_evt_packet(buf, name, &[], evt);
+    }
+
+    /// Like [`Track::slice_end_evt`], but append the encoded packet to `buf`.
+    pub fn write_slice_end_evt(&self, buf: &mut Vec<u8>, ts: u64) {
+        self.evt_packet(ts, protos::track_event::Type::SliceEnd, EvtName::None)
+            .write(buf);
+    }
+
+    /// Like [`Track::instant_evt`], but append the encoded packet to `buf`.
+    pub fn write_instant_evt(&self, buf: &mut Vec<u8>, ts: u64, name: &str) {
+        self.evt_packet(ts, protos::track_event::Type::Instant, EvtName::Inline(name))
+            .write(buf);
+    }
+
+    /// Like [`Track::interned_instant_evt`], but append the encoded packet to `buf`.
+    pub fn write_interned_instant_evt(&self, seq: &mut Sequence, buf: &mut Vec<u8>, ts: u64, name: &str) {
+        let evt = self.evt_packet(ts, protos::track_event::Type::Instant, EvtName::None);
+        seq.write_interned_evt_packet(buf, name, &[], evt);
+    }
+
+    /// Like [`Track::interned_instant_evt_with_args`], but append the encoded packet to `buf`.
+    pub fn write_interned_instant_evt_with_args(
+        &self,
+        seq: &mut Sequence,
+        buf: &mut Vec<u8>,
+        ts: u64,
+        name: &str,
+        args: &[(&str, DebugValue)],
+    ) {
+        let evt = self.evt_packet(ts, protos::track_event::Type::Instant, EvtName::None);
+        seq.write_interned_evt_packet(buf, name, args, evt);
+    }
+
+    /// Like [`Track::interned_instant_evt_with_flows`], but append the encoded packet to `buf`.
+    pub fn write_interned_instant_evt_with_flows(
+        &self,
+        seq: &mut Sequence,
+        buf: &mut Vec<u8>,
+        ts: u64,
+        name: &str,
+        flow_ids: &[u64],
+        terminating_flow_ids: &[u64],
+    ) {
+        let evt = EvtPacket {
+            flow_ids,
+            terminating_flow_ids,
+            ..self.evt_packet(ts, protos::track_event::Type::Instant, EvtName::None)
+        };
+        seq.write_interned_evt_packet(buf, name, &[], evt);
+    }
+}
+
+impl<S: TrackScope, K: TrackType> Track<S, K> {
+    fn evt_packet<'a>(&self, ts: u64, kind: protos::track_event::Type, name: EvtName<'a>) -> EvtPacket<'a> {
+        EvtPacket {
+            ts,
+            sequence_id: SEQUENCE_ID,
+            kind,
+            track_uuid: self.uuid,
+            name,
+            counter_value: EvtCounterValue::None,
+            flow_ids: &[],
+            terminating_flow_ids: &[],
+            debug_annotations: &[],
+            interned_name: None,
+            interned_annotation_names: &[],
+            sequence_flags: None,
+        }
+    }
 }
 
 // == Counter Tracks ==
@@ -398,6 +732,33 @@ impl<S: TrackScope> Track<S, CounterTrack> {
     }
 }
 
+impl<S: TrackScope> Track<S, CounterTrack> {
+    /// Like [`Track::int_counter_evt`], but append the encoded packet to `buf` (see
+    /// [`write_packet`]) instead of building it.
+    pub fn write_int_counter_evt<V>(&self, buf: &mut Vec<u8>, ts: u64, val: V)
+    where
+        V: Into<i64>,
+    {
+        EvtPacket {
+            counter_value: EvtCounterValue::Int(val.into()),
+            ..self.evt_packet(ts, protos::track_event::Type::Counter, EvtName::None)
+        }
+        .write(buf);
+    }
+
+    /// Like [`Track::float_counter_evt`], but append the encoded packet to `buf`.
+    pub fn write_float_counter_evt<V>(&self, buf: &mut Vec<u8>, ts: u64, val: V)
+    where
+        V: Into<f64>,
+    {
+        EvtPacket {
+            counter_value: EvtCounterValue::Float(val.into()),
+            ..self.evt_packet(ts, protos::track_event::Type::Counter, EvtName::None)
+        }
+        .write(buf);
+    }
+}
+
 pub enum CounterTrackUnit {
     Unspecified,
     TimeNs,
@@ -426,6 +787,325 @@ impl CounterTrackUnit {
     }
 }
 
+// == Scheduling ==
+
+/// State of a thread when it is switched out, as reported by the kernel's `sched_switch` event.
+pub enum ThreadState {
+    /// Preempted, but ready to run.
+    Runnable,
+    /// Waiting for an event.
+    Sleeping,
+    Stopped,
+    Dead,
+}
+
+impl ThreadState {
+    fn to_kernel_state(&self) -> i64 {
+        match self {
+            ThreadState::Runnable => 0,
+            ThreadState::Sleeping => 0x01, // TASK_INTERRUPTIBLE
+            ThreadState::Stopped => 0x04,  // __TASK_STOPPED
+            ThreadState::Dead => 0x10,     // EXIT_DEAD
+        }
+    }
+}
+
+/// Scheduling events of a single CPU: Which thread runs on it (`sched_switch`), and which threads
+/// are woken up to run on it (`sched_waking`).
+///
+/// The events are emitted in Perfetto's compact ftrace encoding, from which the trace processor
+/// derives its native CPU scheduling and thread state views. Threads are identified by their tid
+/// (see [`Synthetto::new_thread`]), with tid 0 being the idle thread of the CPU. Switches and
+/// wakeups must each be added in order of their timestamp.
+pub struct CpuSched {
+    cpu: u32,
+    compact: protos::ftrace_event_bundle::CompactSched,
+    name_indices: HashMap<String, u32>,
+    last_switch_ts: u64,
+    last_waking_ts: u64,
+}
+
+impl CpuSched {
+    pub fn new(cpu: u32) -> Self {
+        CpuSched {
+            cpu,
+            compact: protos::ftrace_event_bundle::CompactSched::default(),
+            name_indices: HashMap::new(),
+            last_switch_ts: 0,
+            last_waking_ts: 0,
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Number of switches and wakeups added.
+    pub fn len(&self) -> usize {
+        self.compact.switch_timestamp.len() + self.compact.waking_timestamp.len()
+    }
+
+    /// Switch to thread `next_tid`, leaving the thread that was running before in `prev_state`.
+    pub fn switch(&mut self, ts: u64, prev_state: ThreadState, next_tid: i32, next_prio: i32, next_name: &str) {
+        debug_assert!(ts >= self.last_switch_ts, "Task switches must be added in order.");
+        let name_idx = self.intern_name(next_name);
+        let c = &mut self.compact;
+        c.switch_timestamp.push(ts - self.last_switch_ts);
+        c.switch_prev_state.push(prev_state.to_kernel_state());
+        c.switch_next_pid.push(next_tid);
+        c.switch_next_prio.push(next_prio);
+        c.switch_next_comm_index.push(name_idx);
+        self.last_switch_ts = ts;
+    }
+
+    /// Wake up thread `tid`, to run on `target_cpu`.
+    pub fn waking(&mut self, ts: u64, tid: i32, target_cpu: u32, prio: i32, name: &str) {
+        debug_assert!(ts >= self.last_waking_ts, "Wakeups must be added in order.");
+        let name_idx = self.intern_name(name);
+        let c = &mut self.compact;
+        c.waking_timestamp.push(ts - self.last_waking_ts);
+        c.waking_pid.push(tid);
+        c.waking_target_cpu.push(target_cpu as i32);
+        c.waking_prio.push(prio);
+        c.waking_comm_index.push(name_idx);
+        c.waking_common_flags.push(0);
+        self.last_waking_ts = ts;
+    }
+
+    /// Packet holding all events added so far.
+    pub fn into_packet(self) -> TracePacket {
+        TracePacket {
+            data: Some(protos::trace_packet::Data::FtraceEvents(protos::FtraceEventBundle {
+                cpu: Some(self.cpu),
+                compact_sched: Some(self.compact),
+                ..protos::FtraceEventBundle::default()
+            })),
+            ..protos::TracePacket::default()
+        }
+    }
+
+    /// Thread names are interned separately for every packet.
+    fn intern_name(&mut self, name: &str) -> u32 {
+        if let Some(idx) = self.name_indices.get(name) {
+            return *idx;
+        }
+
+        let idx = self.compact.intern_table.len() as u32;
+        self.compact.intern_table.push(name.to_string());
+        self.name_indices.insert(name.to_string(), idx);
+        idx
+    }
+}
+
 pub fn encode_trace(i: Vec<TracePacket>) -> Vec<u8> {
     protos::Trace { packet: i }.encode_to_vec()
 }
+
+/// Append an encoded packet to `buf`. Concatenated, the output of all calls forms a single trace,
+/// the same as [`encode_trace`] would produce for all packets.
+pub fn write_packet(buf: &mut Vec<u8>, packet: &TracePacket) {
+    wire::put_trace_packet_key(buf);
+    packet
+        .encode_length_delimited(buf)
+        .expect("Encoding into a vector cannot fail.");
+}
+
+/// Packet holding a compressed batch of encoded packets (as produced by [`write_packet`] or
+/// [`encode_trace`]). When reading the trace, Perfetto decompresses the batch and handles its
+/// packets as if they were in place of the compressed packet.
+pub fn compressed_packets(packets: &[u8]) -> TracePacket {
+    let mut encoder = ZlibEncoder::new(Vec::with_capacity(packets.len() / 4), Compression::default());
+    encoder.write_all(packets).expect("Writing to a vector cannot fail.");
+    let compressed = encoder.finish().expect("Writing to a vector cannot fail.");
+
+    TracePacket {
+        data: Some(protos::trace_packet::Data::CompressedPackets(compressed)),
+        ..protos::TracePacket::default()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn written_packets_match_encoded_packets() {
+        let mut syn = Synthetto::new();
+        let process = syn.new_process(1, String::from("Process"), vec![], None);
+        let track = syn.new_process_track(String::from("Track"), &process);
+        let counter =
+            syn.new_process_counter_track(String::from("Counter"), CounterTrackUnit::Count, 1, false, &process);
+
+        let mut packets = syn.new_descriptor_trace_evts();
+        let mut written = vec![];
+        for packet in &packets {
+            write_packet(&mut written, packet);
+        }
+
+        for ts in [0, 1, 1 << 40, u64::MAX] {
+            packets.push(track.slice_begin_evt(ts, Some(String::from("Slice"))));
+            track.write_slice_begin_evt(&mut written, ts, Some("Slice"));
+            packets.push(track.slice_begin_evt(ts, None));
+            track.write_slice_begin_evt(&mut written, ts, None);
+            packets.push(track.slice_end_evt(ts));
+            track.write_slice_end_evt(&mut written, ts);
+            packets.push(track.instant_evt(ts, String::new()));
+            track.write_instant_evt(&mut written, ts, "");
+        }
+
+        for val in [0, 1, -1, i64::MIN, i64::MAX] {
+            packets.push(counter.int_counter_evt(7, val));
+            counter.write_int_counter_evt(&mut written, 7, val);
+        }
+
+        for val in [0.0, -1.5, f64::MAX] {
+            packets.push(counter.float_counter_evt(7, val));
+            counter.write_float_counter_evt(&mut written, 7, val);
+        }
+
+        assert_eq!(written, encode_trace(packets));
+    }
+
+    #[test]
+    fn written_interned_packets_match_encoded_packets() {
+        let mut syn = Synthetto::new();
+        let track = syn.new_global_track(String::from("Track"));
+        let mut seq = syn.new_sequence();
+        let mut written_seq = Synthetto::new().new_sequence();
+
+        let mut packets = vec![];
+        let mut written = vec![];
+        for (ts, name) in ["A", "B", "A", "C", "B"].into_iter().enumerate() {
+            let ts = ts as u64;
+            packets.push(track.interned_slice_begin_evt(&mut seq, ts, name));
+            track.write_interned_slice_begin_evt(&mut written_seq, &mut written, ts, name);
+            packets.push(track.interned_instant_evt(&mut seq, ts, name));
+            track.write_interned_instant_evt(&mut written_seq, &mut written, ts, name);
+        }
+
+        assert_eq!(written, encode_trace(packets));
+    }
+
+    #[test]
+    fn sequences_intern_independently() {
+        let mut syn = Synthetto::new();
+        let track = syn.new_global_track(String::from("Track"));
+        let mut a = syn.new_sequence();
+        let mut b = syn.new_sequence();
+
+        let a1 = track.interned_instant_evt(&mut a, 0, "Name");
+        let a2 = track.interned_instant_evt(&mut a, 1, "Name");
+        let b1 = track.interned_instant_evt(&mut b, 2, "Name");
+
+        // Every sequence interns the name, and clears its incremental state, on its own:
+        for (packet, interned, flags) in [(&a1, true, 3), (&a2, false, 2), (&b1, true, 3)] {
+            assert_eq!(packet.interned_data.is_some(), interned);
+            assert_eq!(packet.sequence_flags, Some(flags));
+        }
+        assert_eq!(a1.optional_trusted_packet_sequence_id, a2.optional_trusted_packet_sequence_id);
+        assert_ne!(a1.optional_trusted_packet_sequence_id, b1.optional_trusted_packet_sequence_id);
+    }
+
+    #[test]
+    fn written_annotated_packets_match_encoded_packets() {
+        let mut syn = Synthetto::new();
+        let track = syn.new_global_track(String::from("Track"));
+        let mut seq = syn.new_sequence();
+        let mut written_seq = Synthetto::new().new_sequence();
+
+        let evts: [(&str, &[(&str, DebugValue)]); 4] = [
+            ("A", &[("id", DebugValue::Uint(3)), ("val", DebugValue::Int(-1000))]),
+            ("B", &[]),
+            ("A", &[("id", DebugValue::Uint(u64::MAX))]),
+            ("C", &[("msg", DebugValue::Str("hello")), ("id", DebugValue::Uint(0))]),
+        ];
+
+        let mut packets = vec![];
+        let mut written = vec![];
+        for (ts, (name, args)) in evts.into_iter().enumerate() {
+            let ts = ts as u64;
+            packets.push(track.interned_instant_evt_with_args(&mut seq, ts, name, args));
+            track.write_interned_instant_evt_with_args(&mut written_seq, &mut written, ts, name, args);
+        }
+
+        assert_eq!(written, encode_trace(packets));
+    }
+
+    #[test]
+    fn written_flow_packets_match_encoded_packets() {
+        let mut syn = Synthetto::new();
+        let track = syn.new_global_track(String::from("Track"));
+        let mut seq = syn.new_sequence();
+        let mut written_seq = Synthetto::new().new_sequence();
+
+        let evts: [(&str, &[u64], &[u64]); 4] = [
+            ("Send", &[1], &[]),
+            ("Send", &[2, u64::MAX], &[]),
+            ("Receive", &[], &[1]),
+            ("Both", &[u64::MAX], &[2]),
+        ];
+
+        let mut packets = vec![];
+        let mut written = vec![];
+        for (ts, (name, flow_ids, terminating_flow_ids)) in evts.into_iter().enumerate() {
+            let ts = ts as u64;
+            packets.push(track.interned_instant_evt_with_flows(&mut seq, ts, name, flow_ids, terminating_flow_ids));
+            track.write_interned_instant_evt_with_flows(
+                &mut written_seq,
+                &mut written,
+                ts,
+                name,
+                flow_ids,
+                terminating_flow_ids,
+            );
+        }
+
+        assert_eq!(written, encode_trace(packets));
+    }
+
+    #[test]
+    fn cpu_sched_encoding() {
+        let mut sched = CpuSched::new(1);
+        assert!(sched.is_empty());
+
+        sched.switch(100, ThreadState::Runnable, 5, 2, "A");
+        sched.waking(120, 6, 1, 3, "B");
+        sched.switch(130, ThreadState::Sleeping, 6, 3, "B");
+        sched.switch(130, ThreadState::Dead, 0, 0, "Idle");
+        sched.waking(150, 5, 1, 2, "A");
+        assert!(!sched.is_empty());
+
+        let c = &sched.compact;
+        assert_eq!(c.intern_table, ["A", "B", "Idle"]);
+        assert_eq!(c.switch_timestamp, [100, 30, 0]);
+        assert_eq!(c.switch_prev_state, [0, 1, 0x10]);
+        assert_eq!(c.switch_next_pid, [5, 6, 0]);
+        assert_eq!(c.switch_next_comm_index, [0, 1, 2]);
+        assert_eq!(c.waking_timestamp, [120, 30]);
+        assert_eq!(c.waking_pid, [6, 5]);
+        assert_eq!(c.waking_comm_index, [1, 0]);
+    }
+
+    #[test]
+    fn compressed_packets_roundtrip() {
+        let mut syn = Synthetto::new();
+        let track = syn.new_global_track(String::from("Track"));
+
+        let mut packets = vec![];
+        for ts in 0..1000 {
+            track.write_instant_evt(&mut packets, ts, "Instant");
+        }
+
+        let packet = compressed_packets(&packets);
+        let Some(protos::trace_packet::Data::CompressedPackets(compressed)) = &packet.data else {
+            panic!("Expected compressed packets.");
+        };
+        assert!(compressed.len() < packets.len() / 4);
+
+        let mut decompressed = vec![];
+        flate2::write::ZlibDecoder::new(&mut decompressed)
+            .write_all(compressed)
+            .unwrap();
+        assert_eq!(decompressed, packets);
+    }
+}
@@ -0,0 +1,275 @@
+//! Direct protobuf encoding of the most common packets.
+//!
+//! Track events make up nearly all of a trace. Instead of building a [`crate::TracePacket`] for
+//! every one of them, they are written straight into the output buffer. The encoding is
+//! identical to the one prost produces for the same packet (fields are written in order of their
+//! tag, and a oneof at the position of its lowest tag), so directly written packets and encoded
+//! packet structs can be mixed freely.
+
+use crate::{protos, DebugValue};
+
+const WIRE_TYPE_VARINT: u32 = 0;
+const WIRE_TYPE_I64: u32 = 1;
+const WIRE_TYPE_LEN: u32 = 2;
+
+// Field tags:
+const TRACE_PACKET: u32 = 1;
+
+const PACKET_TIMESTAMP: u32 = 8;
+const PACKET_TRUSTED_PACKET_SEQUENCE_ID: u32 = 10;
+const PACKET_TRACK_EVENT: u32 = 11;
+const PACKET_INTERNED_DATA: u32 = 12;
+const PACKET_SEQUENCE_FLAGS: u32 = 13;
+
+const INTERNED_DATA_EVENT_NAMES: u32 = 2;
+const INTERNED_DATA_DEBUG_ANNOTATION_NAMES: u32 = 3;
+const EVENT_NAME_IID: u32 = 1;
+const EVENT_NAME_NAME: u32 = 2;
+const DEBUG_ANNOTATION_NAME_IID: u32 = 1;
+const DEBUG_ANNOTATION_NAME_NAME: u32 = 2;
+
+const DEBUG_ANNOTATION_NAME_IID_FIELD: u32 = 1;
+const DEBUG_ANNOTATION_UINT_VALUE: u32 = 3;
+const DEBUG_ANNOTATION_INT_VALUE: u32 = 4;
+const DEBUG_ANNOTATION_STRING_VALUE: u32 = 6;
+
+const TRACK_EVENT_DEBUG_ANNOTATIONS: u32 = 4;
+const TRACK_EVENT_TYPE: u32 = 9;
+const TRACK_EVENT_NAME_IID: u32 = 10;
+const TRACK_EVENT_TRACK_UUID: u32 = 11;
+const TRACK_EVENT_NAME: u32 = 23;
+const TRACK_EVENT_COUNTER_VALUE: u32 = 30;
+const TRACK_EVENT_DOUBLE_COUNTER_VALUE: u32 = 44;
+const TRACK_EVENT_FLOW_IDS: u32 = 47;
+const TRACK_EVENT_TERMINATING_FLOW_IDS: u32 = 48;
+
+pub(crate) enum EvtName<'a> {
+    None,
+    Interned(u64),
+    Inline(&'a str),
+}
+
+pub(crate) enum EvtCounterValue {
+    None,
+    Int(i64),
+    Float(f64),
+}
+
+/// Fields of a track event packet that can be written directly.
+pub(crate) struct EvtPacket<'a> {
+    pub ts: u64,
+    pub sequence_id: u32,
+    pub kind: protos::track_event::Type,
+    pub track_uuid: u64,
+    pub name: EvtName<'a>,
+    pub counter_value: EvtCounterValue,
+    pub flow_ids: &'a [u64],
+    pub terminating_flow_ids: &'a [u64],
+    /// Encoded `TrackEvent.debug_annotations` entries (see [`put_debug_annotation`]).
+    pub debug_annotations: &'a [u8],
+    /// Event name that is interned with this packet.
+    pub interned_name: Option<(u64, &'a str)>,
+    /// Encoded `InternedData.debug_annotation_names` entries (see [`put_debug_annotation_name`]).
+    pub interned_annotation_names: &'a [u8],
+    pub sequence_flags: Option<u32>,
+}
+
+impl EvtPacket<'_> {
+    /// Append the packet to `buf`, as an entry of the `Trace.packet` field.
+    pub fn write(&self, buf: &mut Vec<u8>) {
+        let evt_len = self.evt_len();
+        let interned_data_len = self.interned_data_len();
+
+        let mut packet_len = varint_field_len(PACKET_TIMESTAMP, self.ts)
+            + varint_field_len(PACKET_TRUSTED_PACKET_SEQUENCE_ID, self.sequence_id as u64)
+            + len_field_len(PACKET_TRACK_EVENT, evt_len);
+        if let Some(len) = interned_data_len {
+            packet_len += len_field_len(PACKET_INTERNED_DATA, len);
+        }
+        if let Some(flags) = self.sequence_flags {
+            packet_len += varint_field_len(PACKET_SEQUENCE_FLAGS, flags as u64);
+        }
+
+        buf.reserve(len_field_len(TRACE_PACKET, packet_len));
+        put_len_header(buf, TRACE_PACKET, packet_len);
+
+        // The `data` oneof, which holds the track event, has the lowest tag of all fields:
+        put_len_header(buf, PACKET_TRACK_EVENT, evt_len);
+        buf.extend_from_slice(self.debug_annotations);
+        put_varint_field(buf, TRACK_EVENT_TYPE, self.kind as i32 as u64);
+        match self.name {
+            EvtName::None => (),
+            EvtName::Interned(iid) => put_varint_field(buf, TRACK_EVENT_NAME_IID, iid),
+            EvtName::Inline(name) => put_bytes_field(buf, TRACK_EVENT_NAME, name.as_bytes()),
+        }
+        put_varint_field(buf, TRACK_EVENT_TRACK_UUID, self.track_uuid);
+        match self.counter_value {
+            EvtCounterValue::None => (),
+            EvtCounterValue::Int(val) => put_varint_field(buf, TRACK_EVENT_COUNTER_VALUE, val as u64),
+            EvtCounterValue::Float(val) => {
+                put_key(buf, TRACK_EVENT_DOUBLE_COUNTER_VALUE, WIRE_TYPE_I64);
+                buf.extend_from_slice(&val.to_le_bytes());
+            }
+        }
+        // Repeated fields of proto2 messages are not packed:
+        for id in self.flow_ids {
+            put_key(buf, TRACK_EVENT_FLOW_IDS, WIRE_TYPE_I64);
+            buf.extend_from_slice(&id.to_le_bytes());
+        }
+        for id in self.terminating_flow_ids {
+            put_key(buf, TRACK_EVENT_TERMINATING_FLOW_IDS, WIRE_TYPE_I64);
+            buf.extend_from_slice(&id.to_le_bytes());
+        }
+
+        put_varint_field(buf, PACKET_TIMESTAMP, self.ts);
+        put_varint_field(buf, PACKET_TRUSTED_PACKET_SEQUENCE_ID, self.sequence_id as u64);
+
+        if let Some(len) = interned_data_len {
+            put_len_header(buf, PACKET_INTERNED_DATA, len);
+            if let Some((iid, name)) = self.interned_name {
+                put_len_header(buf, INTERNED_DATA_EVENT_NAMES, event_name_len(iid, name));
+                put_varint_field(buf, EVENT_NAME_IID, iid);
+                put_bytes_field(buf, EVENT_NAME_NAME, name.as_bytes());
+            }
+            buf.extend_from_slice(self.interned_annotation_names);
+        }
+
+        if let Some(flags) = self.sequence_flags {
+            put_varint_field(buf, PACKET_SEQUENCE_FLAGS, flags as u64);
+        }
+    }
+
+    fn evt_len(&self) -> usize {
+        let mut len = self.debug_annotations.len()
+            + varint_field_len(TRACK_EVENT_TYPE, self.kind as i32 as u64)
+            + varint_field_len(TRACK_EVENT_TRACK_UUID, self.track_uuid);
+        len += match self.name {
+            EvtName::None => 0,
+            EvtName::Interned(iid) => varint_field_len(TRACK_EVENT_NAME_IID, iid),
+            EvtName::Inline(name) => len_field_len(TRACK_EVENT_NAME, name.len()),
+        };
+        len += match self.counter_value {
+            EvtCounterValue::None => 0,
+            EvtCounterValue::Int(val) => varint_field_len(TRACK_EVENT_COUNTER_VALUE, val as u64),
+            EvtCounterValue::Float(_) => key_len(TRACK_EVENT_DOUBLE_COUNTER_VALUE) + 8,
+        };
+        len += self.flow_ids.len() * (key_len(TRACK_EVENT_FLOW_IDS) + 8);
+        len += self.terminating_flow_ids.len() * (key_len(TRACK_EVENT_TERMINATING_FLOW_IDS) + 8);
+        len
+    }
+
+    fn interned_data_len(&self) -> Option<usize> {
+        if self.interned_name.is_none() && self.interned_annotation_names.is_empty() {
+            return None;
+        }
+        let name_len = self
+            .interned_name
+            .map_or(0, |(iid, name)| len_field_len(INTERNED_DATA_EVENT_NAMES, event_name_len(iid, name)));
+        Some(name_len + self.interned_annotation_names.len())
+    }
+}
+
+/// Append a `TrackEvent.debug_annotations` entry with an interned name to `buf`.
+pub(crate) fn put_debug_annotation(buf: &mut Vec<u8>, name_iid: u64, val: &DebugValue) {
+    let mut len = varint_field_len(DEBUG_ANNOTATION_NAME_IID_FIELD, name_iid);
+    len += match val {
+        DebugValue::Uint(val) => varint_field_len(DEBUG_ANNOTATION_UINT_VALUE, *val),
+        DebugValue::Int(val) => varint_field_len(DEBUG_ANNOTATION_INT_VALUE, *val as u64),
+        DebugValue::Str(val) => len_field_len(DEBUG_ANNOTATION_STRING_VALUE, val.len()),
+    };
+
+    put_len_header(buf, TRACK_EVENT_DEBUG_ANNOTATIONS, len);
+    put_varint_field(buf, DEBUG_ANNOTATION_NAME_IID_FIELD, name_iid);
+    match val {
+        DebugValue::Uint(val) => put_varint_field(buf, DEBUG_ANNOTATION_UINT_VALUE, *val),
+        DebugValue::Int(val) => put_varint_field(buf, DEBUG_ANNOTATION_INT_VALUE, *val as u64),
+        DebugValue::Str(val) => put_bytes_field(buf, DEBUG_ANNOTATION_STRING_VALUE, val.as_bytes()),
+    }
+}
+
+/// Append an `InternedData.debug_annotation_names` entry to `buf`.
+pub(crate) fn put_debug_annotation_name(buf: &mut Vec<u8>, iid: u64, name: &str) {
+    let len = varint_field_len(DEBUG_ANNOTATION_NAME_IID, iid) + len_field_len(DEBUG_ANNOTATION_NAME_NAME, name.len());
+    put_len_header(buf, INTERNED_DATA_DEBUG_ANNOTATION_NAMES, len);
+    put_varint_field(buf, DEBUG_ANNOTATION_NAME_IID, iid);
+    put_bytes_field(buf, DEBUG_ANNOTATION_NAME_NAME, name.as_bytes());
+}
+
+/// Write the key of a `Trace.packet` entry. Must be followed by the length-delimited packet.
+pub(crate) fn put_trace_packet_key(buf: &mut Vec<u8>) {
+    put_key(buf, TRACE_PACKET, WIRE_TYPE_LEN);
+}
+
+fn event_name_len(iid: u64, name: &str) -> usize {
+    varint_field_len(EVENT_NAME_IID, iid) + len_field_len(EVENT_NAME_NAME, name.len())
+}
+
+// == Primitives ==
+
+fn varint_len(val: u64) -> usize {
+    // Every byte holds 7 bits, and at least one byte is needed:
+    ((64 - (val | 1).leading_zeros()) as usize).div_ceil(7)
+}
+
+fn key_len(tag: u32) -> usize {
+    varint_len((tag as u64) << 3)
+}
+
+fn varint_field_len(tag: u32, val: u64) -> usize {
+    key_len(tag) + varint_len(val)
+}
+
+fn len_field_len(tag: u32, len: usize) -> usize {
+    key_len(tag) + varint_len(len as u64) + len
+}
+
+fn put_varint(buf: &mut Vec<u8>, mut val: u64) {
+    while val >= 0x80 {
+        buf.push((val as u8) | 0x80);
+        val >>= 7;
+    }
+    buf.push(val as u8);
+}
+
+fn put_key(buf: &mut Vec<u8>, tag: u32, wire_type: u32) {
+    put_varint(buf, ((tag as u64) << 3) | wire_type as u64);
+}
+
+fn put_varint_field(buf: &mut Vec<u8>, tag: u32, val: u64) {
+    put_key(buf, tag, WIRE_TYPE_VARINT);
+    put_varint(buf, val);
+}
+
+fn put_len_header(buf: &mut Vec<u8>, tag: u32, len: usize) {
+    put_key(buf, tag, WIRE_TYPE_LEN);
+    put_varint(buf, len as u64);
+}
+
+fn put_bytes_field(buf: &mut Vec<u8>, tag: u32, val: &[u8]) {
+    put_len_header(buf, tag, val.len());
+    buf.extend_from_slice(val);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn varint_lengths() {
+        for val in [
+            0,
+            1,
+            0x7F,
+            0x80,
+            0x3FFF,
+            0x4000,
+            u32::MAX as u64,
+            u64::MAX - 1,
+            u64::MAX,
+        ] {
+            let mut buf = vec![];
+            put_varint(&mut buf, val);
+            assert_eq!(buf.len(), varint_len(val), "{val:#X}");
+        }
+    }
+}
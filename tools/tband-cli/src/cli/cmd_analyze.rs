@@ -0,0 +1,177 @@
+use clap::{Parser, Subcommand};
+
+use super::cmd_convert::{load_trace, InputFile, InputFormat, TraceMode};
+
+#[derive(Parser, Debug)]
+#[command(about = "Analyse trace recording")]
+pub struct Cmd {
+    #[command(subcommand)]
+    pub analysis: Analysis,
+}
+
+#[derive(Subcommand, Debug)]
+pub enum Analysis {
+    LoadBalance(LoadBalanceCmd),
+    Locks(LocksCmd),
+}
+
+impl Cmd {
+    pub fn run(self) -> anyhow::Result<()> {
+        match self.analysis {
+            Analysis::LoadBalance(cmd) => cmd.run(),
+            Analysis::Locks(cmd) => cmd.run(),
+        }
+    }
+}
+
+// == Load Balance =============================================================
+
+#[derive(Parser, Debug)]
+#[command(about = "Summarise per-core utilisation and task migrations of a FreeRTOS trace")]
+pub struct LoadBalanceCmd {
+    /// Input format
+    #[arg(short, long, default_value = "bin")]
+    pub format: InputFormat,
+
+    /// Number of cores of target
+    #[arg(short, long, default_value = "1")]
+    pub core_count: usize,
+
+    /// Input files with optional core id.
+    ///
+    /// For split multi-core recording, append core id to file name as such: filename@core_id
+    #[arg(action = clap::ArgAction::Append)]
+    pub input: Vec<InputFile>,
+}
+
+impl LoadBalanceCmd {
+    pub fn run(self) -> anyhow::Result<()> {
+        let trace = load_trace(self.format, TraceMode::FreeRTOS, self.core_count, self.input)?;
+        let summary = trace.freertos_load_balance();
+
+        println!("Trace duration: {:.3} ms", ns_to_ms(summary.duration_ns));
+        println!();
+
+        println!(
+            "{:>4}  {:>11}  {:>11}  {:>13}  {:>14}",
+            "Core", "Utilisation", "Busy [ms]", "Migrations in", "Migrations out"
+        );
+        for core in &summary.cores {
+            println!(
+                "{:>4}  {:>9.1} %  {:>11.3}  {:>13}  {:>14}",
+                core.core_id,
+                core.utilisation() * 100.0,
+                ns_to_ms(core.busy_ns),
+                core.migrations_in,
+                core.migrations_out
+            );
+        }
+        println!();
+
+        let name_width = summary.tasks.iter().map(|t| t.name.len()).max().unwrap_or(0).max(4);
+        print!("{:<name_width$}  {:>10}", "Task", "Migrations");
+        for core in &summary.cores {
+            print!("  {:>14}", format!("Core {} [ms]", core.core_id));
+        }
+        println!();
+        for task in &summary.tasks {
+            print!("{:<name_width$}  {:>10}", task.name, task.migrations);
+            for core in &summary.cores {
+                let run_ns = task.run_ns.get(&core.core_id).copied().unwrap_or(0);
+                print!("  {:>14.3}", ns_to_ms(run_ns));
+            }
+            println!();
+        }
+
+        Ok(())
+    }
+}
+
+// == Locks ====================================================================
+
+#[derive(Parser, Debug)]
+#[command(about = "Summarise mutex contention and priority inversions of a FreeRTOS trace")]
+pub struct LocksCmd {
+    /// Input format
+    #[arg(short, long, default_value = "bin")]
+    pub format: InputFormat,
+
+    /// Number of cores of target
+    #[arg(short, long, default_value = "1")]
+    pub core_count: usize,
+
+    /// Input files with optional core id.
+    ///
+    /// For split multi-core recording, append core id to file name as such: filename@core_id
+    #[arg(action = clap::ArgAction::Append)]
+    pub input: Vec<InputFile>,
+}
+
+impl LocksCmd {
+    pub fn run(self) -> anyhow::Result<()> {
+        let trace = load_trace(self.format, TraceMode::FreeRTOS, self.core_count, self.input)?;
+        let analysis = trace.freertos_lock_analysis();
+
+        println!("Mutexes:");
+        if analysis.mutexes.is_empty() {
+            println!("  None.");
+        }
+        for mutex in &analysis.mutexes {
+            println!();
+            println!("  {}:", mutex.name);
+            println!("    Acquisitions:    {}", mutex.acquisitions);
+            let percentile_ms = |p| mutex.hold_time_percentile(p).map(ns_to_ms).unwrap_or(0.0);
+            println!(
+                "    Hold time [ms]:  min {:.3}, median {:.3}, p95 {:.3}, max {:.3}",
+                percentile_ms(0.0),
+                percentile_ms(0.5),
+                percentile_ms(0.95),
+                percentile_ms(1.0)
+            );
+            println!("    Waits:           {}", mutex.waits);
+            println!(
+                "    Wait time [ms]:  total {:.3}, max {:.3}",
+                ns_to_ms(mutex.total_wait_ns),
+                ns_to_ms(mutex.max_wait_ns)
+            );
+            if !mutex.waiters.is_empty() {
+                println!("    Waiters:         {}", mutex.waiters.join(", "));
+            }
+        }
+        println!();
+
+        println!("Priority inversions:");
+        if analysis.priority_inversions.is_empty() {
+            println!("  None.");
+        }
+        for inversion in &analysis.priority_inversions {
+            let base_priority = match inversion.base_priority {
+                Some(base_priority) => base_priority.to_string(),
+                None => String::from("?"),
+            };
+            let ongoing = if inversion.ongoing { " (until end of trace)" } else { "" };
+            println!();
+            println!(
+                "  At {:.3} ms for {:.3} ms{ongoing}:",
+                ns_to_ms(inversion.start_ns),
+                ns_to_ms(inversion.duration_ns)
+            );
+            println!(
+                "    Holder:   {} (priority {base_priority} -> {})",
+                inversion.holder, inversion.inherited_priority
+            );
+            if !inversion.waiters.is_empty() {
+                println!("    Waiters:  {}", inversion.waiters.join(", "));
+            }
+            if let Some(mutex) = &inversion.mutex {
+                println!("    Mutex:    {mutex}");
+            }
+        }
+
+        Ok(())
+    }
+}
+
+fn ns_to_ms(ns: u64) -> f64 {
+    ns as f64 / 1_000_000.0
+}
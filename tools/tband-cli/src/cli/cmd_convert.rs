@@ -3,14 +3,32 @@ use anyhow::anyhow;
 use lazy_static::lazy_static;
 use log::info;
 use regex::Regex;
-use std::{fmt::Display, path::PathBuf, str::FromStr};
-use tband_conv::convert::TraceConverter;
+use std::{
+    fmt::Display,
+    fs::File,
+    io::{BufWriter, Write},
+    path::{Path, PathBuf},
+    str::FromStr,
+};
+
+use super::{
+    cmd_index::{default_index_path, parse_duration_ns, parse_window, IndexCheckpoint, StreamPosition, TraceIndex},
+    input::{read_file_chunked, read_file_chunked_from},
+    pipeline::convert_pipelined,
+    split::{convert_split, parse_split_every, SplitEvery},
+};
+use tband_conv::{
+    convert::TraceConverter,
+    generate_perfetto::{CounterLod, PerfettoGenerator, PerfettoOptions},
+    Trace,
+};
 
 use clap::{Parser, ValueEnum};
 
 #[derive(ValueEnum, Clone, Debug, Copy)]
 pub enum InputFormat {
     Hex,
+    Base64,
     Bin,
 }
 
@@ -18,6 +36,7 @@ impl Display for InputFormat {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
             InputFormat::Hex => write!(f, "hex"),
+            InputFormat::Base64 => write!(f, "base64"),
             InputFormat::Bin => write!(f, "binary"),
         }
     }
@@ -96,6 +115,81 @@ pub struct Cmd {
     #[arg(long, action = clap::ArgAction::SetTrue)]
     pub serve: bool,
 
+    /// Only convert the trace from this time on (such as '1.5s'), relative to the start of the
+    /// trace. Requires an index (see the 'index' command).
+    ///
+    /// The converted trace starts at the last checkpoint of the index before this time.
+    #[arg(long, value_parser = parse_duration_ns)]
+    pub from: Option<u64>,
+
+    /// Only convert the trace up to this time (such as '1.7s'), relative to the start of the
+    /// trace. Requires an index (see the 'index' command).
+    #[arg(long, value_parser = parse_duration_ns)]
+    pub to: Option<u64>,
+
+    /// Index used to seek to '--from' [default: first input file with '.tbindex' appended]
+    #[arg(long)]
+    pub index: Option<PathBuf>,
+
+    /// Decode, convert and save the trace concurrently, streaming it to the output file.
+    ///
+    /// Converts the trace incrementally: Objects that are only named after they first appear
+    /// in the trace keep their generic name.
+    #[arg(long, action = clap::ArgAction::SetTrue, requires = "output", conflicts_with_all = ["open", "serve", "from", "to"])]
+    pub pipeline: bool,
+
+    /// Split the trace into a series of self-contained traces, each covering this much trace time
+    /// (such as '10s') or being about this size (such as '1GB').
+    ///
+    /// Every part is saved as the output file with its number appended (such as
+    /// 'trace_000.pftrace'), and includes all tracks and the state at its start. Parts are
+    /// converted and generated in parallel.
+    #[arg(long, value_parser = parse_split_every, requires = "output", conflicts_with_all = ["open", "serve", "pipeline", "from", "to"])]
+    pub split_every: Option<SplitEvery>,
+
+    /// Show FreeRTOS task switches as Perfetto scheduling data.
+    ///
+    /// Tasks appear as threads and cores as CPUs in Perfetto's CPU scheduling and thread state
+    /// views, instead of as per-task and per-core "running" tracks. Much more compact for traces
+    /// with many task switches.
+    #[arg(long, action = clap::ArgAction::SetTrue)]
+    pub sched: bool,
+
+    /// Include a "Trace Events" track for every core, showing every raw trace event.
+    #[arg(long, action = clap::ArgAction::SetTrue)]
+    pub raw_evts: bool,
+
+    /// Downsample dense counter tracks to buckets of this duration (such as '1ms').
+    ///
+    /// Only the samples with the minimum and maximum value and the last sample of every bucket
+    /// are kept. Applies to value markers, queue fill levels, heap usage and stack high water
+    /// marks.
+    #[arg(long, value_parser = parse_duration_ns)]
+    pub lod: Option<u64>,
+
+    /// Keep counters at full resolution in this window (such as '1.5s..1.7s'), relative to the
+    /// start of the trace. Can be given multiple times.
+    #[arg(long, requires = "lod", value_parser = parse_window, action = clap::ArgAction::Append)]
+    pub full_res: Vec<(u64, u64)>,
+
+    /// Also emit every downsampled counter at full resolution, on a separate track
+    #[arg(long, requires = "lod", action = clap::ArgAction::SetTrue)]
+    pub full_res_tracks: bool,
+
+    /// Compress the trace, in batches of packets that Perfetto decompresses when loading it.
+    ///
+    /// Generated traces are very repetitive, and typically shrink several-fold. Batches are
+    /// compressed in parallel.
+    #[arg(long, action = clap::ArgAction::SetTrue)]
+    pub compress: bool,
+
+    /// Number of threads generating the trace [default: number of cores]
+    ///
+    /// The global, task and core tracks are generated in parallel. The generated trace does not
+    /// depend on the number of threads.
+    #[arg(long)]
+    pub threads: Option<usize>,
+
     /// Input files with optional core id.
     ///
     /// For split multi-core recording, append core id to file name as such: filename@core_id
@@ -105,50 +199,60 @@ pub struct Cmd {
 
 impl Cmd {
     pub fn run(self) -> anyhow::Result<()> {
-        if self.core_count == 0 {
-            return Err(anyhow!("Core count cannot be zero."));
-        }
+        let options = PerfettoOptions {
+            compact_sched: self.sched,
+            raw_evts: self.raw_evts,
+            counter_lod: self.lod.map(|bucket_ns| CounterLod {
+                bucket_ns,
+                full_res_windows: self.full_res.clone(),
+                full_res_tracks: self.full_res_tracks,
+            }),
+            compress: self.compress,
+            threads: self
+                .threads
+                .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get())),
+        };
 
-        if self.input.is_empty() {
-            return Err(anyhow!("Require at least one input file."));
+        if self.pipeline {
+            let output = self.output.expect("--pipeline requires --output");
+            convert_pipelined(self.format, self.mode, self.core_count, &self.input, &output, options)?;
+            info!("Conversion finished.");
+            return Ok(());
         }
 
-        for file in &self.input {
-            if let Some(core_id) = file.core_id {
-                if core_id as usize >= self.core_count {
-                    return Err(anyhow!(
-                        "Core id {core_id} for file '{}' invalid for {}-core trace.",
-                        file.file.to_string_lossy(),
-                        self.core_count
-                    ));
-                }
-            }
+        if let Some(split) = self.split_every {
+            let output = self.output.expect("--split-every requires --output");
+            convert_split(self.format, self.mode, self.core_count, &self.input, &output, options, split)?;
+            info!("Conversion finished.");
+            return Ok(());
         }
 
-        let mode = match self.mode {
-            TraceMode::BareMetal => tband_conv::decode::evts::TraceMode::Base,
-            TraceMode::FreeRTOS => tband_conv::decode::evts::TraceMode::FreeRTOS,
+        let trace = if self.from.is_some() || self.to.is_some() {
+            let index = self.index.unwrap_or_else(|| default_index_path(&self.input));
+            let window = (self.from.unwrap_or(0), self.to);
+            load_trace_window(self.format, self.mode, self.core_count, &self.input, &index, window)?
+        } else {
+            load_trace(self.format, self.mode, self.core_count, self.input)?
         };
 
-        let mut tc = TraceConverter::new(self.core_count, mode)?;
-
-        for inp in self.input {
-            info!("Opening {} file \"{}\"..", self.format, inp.file.to_string_lossy());
-            let data = read_file(&inp.file, self.format)?;
-            info!("Decoding events..");
-            if let Some(core_id) = inp.core_id {
-                info!("Adding events to core {core_id} trace sequence..");
-                tc.add_binary_to_core(&data, core_id)?;
-            } else {
-                info!("Adding events to trace sequence..");
-                tc.add_binary(&data)?;
+        if !self.open && !self.serve {
+            // Only saving the trace: Write it while it is being generated.
+            if let Some(output) = self.output {
+                info!("Generating Perfetto Trace and saving to '{}'..", output.to_string_lossy());
+                let mut w = BufWriter::new(File::create(output)?);
+                PerfettoGenerator::with_options(options).finish_to(&trace, &mut w)?;
+                w.flush()?;
             }
+            info!("Conversion finished.");
+            return Ok(());
         }
 
-        info!("Converting..");
-        let trace = tc.convert()?;
         info!("Genertating Perfetto Trace..");
-        let trace = trace.generate_perfetto_trace();
+        let trace = {
+            let mut data = vec![];
+            PerfettoGenerator::with_options(options).finish_to(&trace, &mut data)?;
+            data
+        };
         info!("Conversion finished.");
 
         if let Some(output) = self.output {
@@ -168,30 +272,151 @@ impl Cmd {
     }
 }
 
-pub fn read_file(f: &PathBuf, format: InputFormat) -> anyhow::Result<Vec<u8>> {
-    match format {
-        InputFormat::Hex => {
-            let mut bytes: Vec<u8> = Vec::with_capacity(2048);
-            let content = std::fs::read_to_string(f)?;
-            let mut string = String::new();
-            for c in content.chars() {
-                if c.is_whitespace() {
-                    continue;
-                }
-                if !c.is_ascii_hexdigit() {
-                    return Err(anyhow!("Invalid hex input file."));
-                }
-
-                string.push(c);
-                if string.len() == 2 {
-                    bytes.push(u8::from_str_radix(&string, 16)?);
-                    string.clear();
-                }
+/// Decode and convert the given input files.
+pub fn load_trace(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: Vec<InputFile>,
+) -> anyhow::Result<Trace> {
+    let mut tc = load_converter(format, mode, core_count, &input)?;
+
+    info!("Converting..");
+    tc.convert()
+}
+
+/// Decode the given input files, and add them to a new trace converter.
+pub fn load_converter(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+) -> anyhow::Result<TraceConverter> {
+    let mut tc = new_converter(mode, core_count, input)?;
+
+    for inp in input {
+        info!("Decoding {} file \"{}\"..", format, inp.file.to_string_lossy());
+        if let Some(core_id) = inp.core_id {
+            info!("Adding events to core {core_id} trace sequence..");
+            read_file_chunked(&inp.file, format, |data| tc.add_binary_to_core(data, core_id))?;
+        } else {
+            info!("Adding events to trace sequence..");
+            read_file_chunked(&inp.file, format, |data| tc.add_binary(data))?;
+        }
+    }
+
+    Ok(tc)
+}
+
+/// Decode and convert only the window `(from, to)` of the given input files, in nanoseconds
+/// relative to the start of the trace. Seeks to the last checkpoint of the index before `from`,
+/// and stops reading every input once it is past `to`.
+pub fn load_trace_window(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    index: &Path,
+    window: (u64, Option<u64>),
+) -> anyhow::Result<Trace> {
+    info!("Loading index '{}'..", index.to_string_lossy());
+    let index = TraceIndex::load(index, format, mode, core_count, input)?;
+
+    let (from, to) = window;
+    let from_ts = index.start_ts + from / index.ts_resolution_ns;
+    let to_ts = to.map(|to| index.start_ts + to / index.ts_resolution_ns);
+    if to_ts.is_some_and(|to_ts| to_ts < from_ts) {
+        return Err(anyhow!("End of window is before its start."));
+    }
+
+    let checkpoint = index.checkpoints.into_iter().rev().find(|cp| cp.state.ts <= from_ts);
+    if let Some(cp) = &checkpoint {
+        let cp_time_ns = (cp.state.ts - index.start_ts) * index.ts_resolution_ns;
+        info!("Resuming from checkpoint at {:.3}s..", cp_time_ns as f64 / 1e9);
+    }
+
+    load_trace_from(format, mode, core_count, input, checkpoint, to_ts)
+}
+
+/// Decode and convert the given input files from a checkpoint of their index (or from their
+/// start), and up to the timestamp `to_ts` (or to their end).
+pub fn load_trace_from(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    checkpoint: Option<IndexCheckpoint>,
+    to_ts: Option<u64>,
+) -> anyhow::Result<Trace> {
+    let mut tc = new_converter(mode, core_count, input)?;
+
+    let positions = match checkpoint {
+        Some(cp) => {
+            tc.restore_checkpoint(cp.state)?;
+            cp.positions
+        }
+        None => {
+            let start = |inp: &InputFile| StreamPosition {
+                offset: 0,
+                core_id: inp.core_id.unwrap_or(0),
+                text: None,
+            };
+            input.iter().map(start).collect()
+        }
+    };
+
+    if let Some(to_ts) = to_ts {
+        tc.set_end_ts(to_ts);
+    }
+    let past_end = |ts: u64| to_ts.is_some_and(|to_ts| ts > to_ts);
+
+    for (inp, pos) in input.iter().zip(positions) {
+        info!("Decoding {} file \"{}\" from byte {}..", format, inp.file.to_string_lossy(), pos.offset);
+        if let Some(core_id) = inp.core_id {
+            read_file_chunked_from(&inp.file, format, pos.offset, pos.text.as_ref(), |data| {
+                tc.add_binary_to_core(data, core_id)?;
+                Ok(!past_end(tc.core_max_ts(core_id)))
+            })?;
+        } else {
+            tc.set_current_core(pos.core_id)?;
+            read_file_chunked_from(&inp.file, format, pos.offset, pos.text.as_ref(), |data| {
+                tc.add_binary(data)?;
+                Ok(!(0..core_count as u32).all(|core_id| past_end(tc.core_max_ts(core_id))))
+            })?;
+        }
+    }
+
+    info!("Converting..");
+    tc.convert()
+}
+
+pub fn new_converter(mode: TraceMode, core_count: usize, input: &[InputFile]) -> anyhow::Result<TraceConverter> {
+    if core_count == 0 {
+        return Err(anyhow!("Core count cannot be zero."));
+    }
+
+    if input.is_empty() {
+        return Err(anyhow!("Require at least one input file."));
+    }
+
+    for file in input {
+        if let Some(core_id) = file.core_id {
+            if core_id as usize >= core_count {
+                return Err(anyhow!(
+                    "Core id {core_id} for file '{}' invalid for {}-core trace.",
+                    file.file.to_string_lossy(),
+                    core_count
+                ));
             }
-            Ok(bytes)
         }
-        InputFormat::Bin => Ok(std::fs::read(f)?),
     }
+
+    let mode = match mode {
+        TraceMode::BareMetal => tband_conv::decode::evts::TraceMode::Base,
+        TraceMode::FreeRTOS => tband_conv::decode::evts::TraceMode::FreeRTOS,
+    };
+
+    TraceConverter::new(core_count, mode)
 }
 
 #[cfg(test)]
@@ -1,4 +1,4 @@
-use crate::cli::cmd_convert::read_file;
+use crate::cli::input::read_file_chunked;
 use log::{info, warn};
 use tband_conv::decode::StreamDecoder;
 
@@ -31,16 +31,14 @@ impl Cmd {
             TraceMode::FreeRTOS => tband_conv::decode::evts::TraceMode::FreeRTOS,
         };
 
-        info!("Opening {} file \"{}\"..", self.format, self.input.file.to_string_lossy());
-        let data = read_file(&self.input.file, self.format)?;
-
-        info!("Decoding events..");
+        info!("Decoding {} file \"{}\"..", self.format, self.input.file.to_string_lossy());
         let mut decode = StreamDecoder::new(mode);
-        let evts = decode.process_binary(&data);
-
-        for evt in evts {
-            println!("{}", serde_json::to_string(&evt).unwrap());
-        }
+        read_file_chunked(&self.input.file, self.format, |data| {
+            for evt in decode.process_binary(data) {
+                println!("{}", serde_json::to_string(&evt).unwrap());
+            }
+            Ok(())
+        })?;
 
         let trailing_bytes = decode.get_bytes_in_buffer();
         if trailing_bytes > 0 {
@@ -0,0 +1,358 @@
+use std::{
+    ffi::OsString,
+    fs::File,
+    io::{BufReader, BufWriter},
+    path::{Path, PathBuf},
+};
+
+use anyhow::anyhow;
+use log::info;
+use serde::{Deserialize, Serialize};
+use tband_conv::{
+    convert::CheckpointEvery,
+    decode::{
+        evts::{BaseEvt, BaseEvtKind, RawEvt},
+        StreamDecoder,
+    },
+    ConverterCheckpoint,
+};
+
+use clap::Parser;
+
+use super::{
+    cmd_convert::{load_converter, InputFile, InputFormat, TraceMode},
+    input::{read_file_chunked_with_positions, TextPosition},
+};
+
+#[derive(Parser, Debug)]
+#[command(about = "Create seekable index of trace recording")]
+pub struct Cmd {
+    /// Input format
+    #[arg(short, long, default_value = "bin")]
+    pub format: InputFormat,
+
+    /// TraceMode
+    #[arg(short, long, default_value = "free-rtos")]
+    pub mode: TraceMode,
+
+    /// Number of cores of target
+    #[arg(short, long, default_value = "1")]
+    pub core_count: usize,
+
+    /// Trace time between checkpoints (such as '500ms' or '1s')
+    #[arg(long, default_value = "1s", value_parser = parse_duration_ns)]
+    pub interval: u64,
+
+    /// Location to store index [default: first input file with '.tbindex' appended]
+    #[arg(short, long)]
+    pub output: Option<PathBuf>,
+
+    /// Input files with optional core id.
+    ///
+    /// For split multi-core recording, append core id to file name as such: filename@core_id
+    #[arg(action = clap::ArgAction::Append)]
+    pub input: Vec<InputFile>,
+}
+
+impl Cmd {
+    pub fn run(self) -> anyhow::Result<()> {
+        let output = self.output.unwrap_or_else(|| default_index_path(&self.input));
+
+        let every = CheckpointEvery::Duration(self.interval);
+        let index = build_index(self.format, self.mode, self.core_count, &self.input, every)?;
+
+        info!("Saving index with {} checkpoints to '{}'.", index.checkpoints.len(), output.to_string_lossy());
+        serde_json::to_writer(BufWriter::new(File::create(output)?), &index)?;
+
+        Ok(())
+    }
+}
+
+/// Decode and convert the given input files, and take a checkpoint every given trace time or
+/// number of events.
+pub fn build_index(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    every: CheckpointEvery,
+) -> anyhow::Result<TraceIndex> {
+    let mut tc = load_converter(format, mode, core_count, input)?;
+
+    info!("Converting..");
+    let (trace, checkpoints) = tc.convert_with_checkpoints_every(every)?;
+    let (start_ts, _) = trace.ts_range();
+    let checkpoint_ts: Vec<u64> = checkpoints.iter().map(|cp| cp.ts).collect();
+
+    let mut positions = vec![];
+    for inp in input {
+        info!("Locating checkpoints in \"{}\"..", inp.file.to_string_lossy());
+        positions.push(locate_checkpoints(inp, format, trace.mode, &checkpoint_ts)?);
+    }
+
+    let checkpoints = checkpoints
+        .into_iter()
+        .enumerate()
+        .map(|(idx, state)| IndexCheckpoint {
+            positions: positions.iter().map(|p| p[idx].clone()).collect(),
+            state,
+        })
+        .collect();
+
+    Ok(TraceIndex {
+        version: TRACE_INDEX_VERSION,
+        format: format.to_string(),
+        mode: mode.to_string(),
+        core_count,
+        inputs: input.iter().map(IndexedInput::new).collect::<anyhow::Result<_>>()?,
+        start_ts,
+        ts_resolution_ns: trace.ts_resolution_ns.unwrap_or(1),
+        interval_ns: match every {
+            CheckpointEvery::Duration(interval) => interval,
+            CheckpointEvery::Evts(_) => 0,
+        },
+        checkpoints,
+    })
+}
+
+// == Index ====================================================================
+
+const TRACE_INDEX_VERSION: u32 = 2;
+
+/// Sidecar index of a trace recording, which allows converting only a window of the recording.
+#[derive(Serialize, Deserialize, Debug)]
+pub struct TraceIndex {
+    pub version: u32,
+    pub format: String,
+    pub mode: String,
+    pub core_count: usize,
+    pub inputs: Vec<IndexedInput>,
+    /// Timestamp of the first event of the trace.
+    pub start_ts: u64,
+    pub ts_resolution_ns: u64,
+    /// Trace time between checkpoints, or 0 if they were taken every given number of events.
+    pub interval_ns: u64,
+    pub checkpoints: Vec<IndexCheckpoint>,
+}
+
+#[derive(Serialize, Deserialize, Debug, PartialEq)]
+pub struct IndexedInput {
+    pub file: PathBuf,
+    pub core_id: Option<u32>,
+    /// File size, to detect a file that changed after it was indexed.
+    pub size: u64,
+}
+
+impl IndexedInput {
+    fn new(inp: &InputFile) -> anyhow::Result<Self> {
+        Ok(IndexedInput {
+            file: inp.file.clone(),
+            core_id: inp.core_id,
+            size: std::fs::metadata(&inp.file)?.len(),
+        })
+    }
+}
+
+#[derive(Serialize, Deserialize, Debug)]
+pub struct IndexCheckpoint {
+    /// Position of the checkpoint in every input file, in the same order as the inputs.
+    pub positions: Vec<StreamPosition>,
+    /// Conversion state at the checkpoint.
+    pub state: ConverterCheckpoint,
+}
+
+/// Position in an input stream at which conversion can be resumed.
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq)]
+pub struct StreamPosition {
+    /// Offset of the first frame at or after the checkpoint, in bytes of binary trace data.
+    pub offset: u64,
+    /// Core that the events at the offset belong to.
+    pub core_id: u32,
+    /// Position in a hex or base64 file from which the text is decoded to reach the offset.
+    #[serde(default)]
+    pub text: Option<TextPosition>,
+}
+
+impl TraceIndex {
+    /// Load an index, and check that it was created for the given inputs.
+    pub fn load(
+        path: &Path,
+        format: InputFormat,
+        mode: TraceMode,
+        core_count: usize,
+        input: &[InputFile],
+    ) -> anyhow::Result<Self> {
+        let file = File::open(path).map_err(|err| {
+            anyhow!("Could not open index '{}' ({err}). Create it with the 'index' command.", path.to_string_lossy())
+        })?;
+        let index: TraceIndex = serde_json::from_reader(BufReader::new(file))?;
+
+        if index.version != TRACE_INDEX_VERSION {
+            return Err(anyhow!("Unsupported index version {}.", index.version));
+        }
+        if index.format != format.to_string() || index.mode != mode.to_string() || index.core_count != core_count {
+            return Err(anyhow!(
+                "Index was created for {}-core {} trace in {} format.",
+                index.core_count,
+                index.mode,
+                index.format
+            ));
+        }
+
+        let inputs = input
+            .iter()
+            .map(IndexedInput::new)
+            .collect::<anyhow::Result<Vec<_>>>()?;
+        if inputs != index.inputs {
+            return Err(anyhow!("Index was created for different input files. Re-create it with the 'index' command."));
+        }
+
+        Ok(index)
+    }
+}
+
+pub fn default_index_path(input: &[InputFile]) -> PathBuf {
+    let mut path = input
+        .first()
+        .map(|inp| inp.file.clone().into_os_string())
+        .unwrap_or_default();
+    path.push(OsString::from(".tbindex"));
+    PathBuf::from(path)
+}
+
+/// Find the position of every checkpoint in an input file: The first frame with a timestamp at
+/// or after the checkpoint.
+fn locate_checkpoints(
+    inp: &InputFile,
+    format: InputFormat,
+    mode: tband_conv::decode::evts::TraceMode,
+    checkpoint_ts: &[u64],
+) -> anyhow::Result<Vec<StreamPosition>> {
+    let mut positions = vec![];
+    let mut core_id = inp.core_id.unwrap_or(0);
+    let mut decoder = StreamDecoder::new(mode);
+
+    // Offset of the start of the current frame, and of the current chunk:
+    let mut offset: u64 = 0;
+    let mut chunk_offset: u64 = 0;
+
+    // Position of every chunk of a hex or base64 file:
+    let mut text_positions = vec![];
+
+    read_file_chunked_with_positions(&inp.file, format, |text, data| {
+        text_positions.extend(text);
+
+        // The decoder returns one event for every frame that ends in this chunk, in order:
+        let mut evts = decoder.process_binary(data).into_iter();
+        let mut delims = memchr::memchr_iter(0, data);
+        for (evt, delim_idx) in evts.by_ref().zip(delims.by_ref()) {
+            if let Some(ts) = evt.ts().filter(|_| !matches!(evt, RawEvt::Invalid(_))) {
+                while positions.len() < checkpoint_ts.len() && ts >= checkpoint_ts[positions.len()] {
+                    positions.push(StreamPosition {
+                        offset,
+                        core_id,
+                        text: None,
+                    });
+                }
+            }
+
+            if let RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::CoreId(evt),
+                ..
+            }) = &evt
+            {
+                if inp.core_id.is_none() {
+                    core_id = evt.core_id;
+                }
+            }
+
+            offset = chunk_offset + delim_idx as u64 + 1;
+        }
+        debug_assert!(evts.next().is_none() && delims.next().is_none());
+
+        chunk_offset += data.len() as u64;
+        Ok(())
+    })?;
+
+    // Checkpoints after the last event of this file:
+    let end = StreamPosition {
+        offset,
+        core_id,
+        text: None,
+    };
+    positions.resize(checkpoint_ts.len(), end);
+
+    // Resume decoding text at the start of the chunk that includes the checkpoint:
+    for pos in &mut positions {
+        pos.text = text_positions
+            .iter()
+            .rev()
+            .find(|text| text.offset <= pos.offset)
+            .cloned();
+    }
+
+    Ok(positions)
+}
+
+/// Parse a duration such as '1.5s', '200ms', '300us' or '10ns' into nanoseconds.
+pub fn parse_duration_ns(s: &str) -> Result<u64, String> {
+    let unit_idx = s.find(|c: char| c.is_ascii_alphabetic()).unwrap_or(s.len());
+    let (value, unit) = s.split_at(unit_idx);
+
+    let ns_per_unit = match unit {
+        "ns" => 1.0,
+        "us" => 1e3,
+        "ms" => 1e6,
+        "s" => 1e9,
+        _ => return Err(format!("Invalid unit '{unit}' (expected 'ns', 'us', 'ms' or 's').")),
+    };
+
+    let value: f64 = value.trim().parse().map_err(|_| format!("Invalid duration '{s}'."))?;
+    if !value.is_finite() || value < 0.0 {
+        return Err(format!("Invalid duration '{s}'."));
+    }
+
+    Ok((value * ns_per_unit).round() as u64)
+}
+
+/// Parse a time window such as '1.5s..1.7s' into a start and end in nanoseconds.
+pub fn parse_window(s: &str) -> Result<(u64, u64), String> {
+    let (start, end) = s
+        .split_once("..")
+        .ok_or_else(|| format!("Invalid window '{s}' (expected 'start..end')."))?;
+    let (start, end) = (parse_duration_ns(start)?, parse_duration_ns(end)?);
+    if start > end {
+        return Err(format!("Invalid window '{s}' (start after end)."));
+    }
+    Ok((start, end))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn duration_parsing() {
+        assert_eq!(parse_duration_ns("1s"), Ok(1_000_000_000));
+        assert_eq!(parse_duration_ns("1.5s"), Ok(1_500_000_000));
+        assert_eq!(parse_duration_ns("200ms"), Ok(200_000_000));
+        assert_eq!(parse_duration_ns("300us"), Ok(300_000));
+        assert_eq!(parse_duration_ns("10ns"), Ok(10));
+        assert_eq!(parse_duration_ns("0ms"), Ok(0));
+
+        parse_duration_ns("10").unwrap_err();
+        parse_duration_ns("10min").unwrap_err();
+        parse_duration_ns("ms").unwrap_err();
+        parse_duration_ns("-1s").unwrap_err();
+    }
+
+    #[test]
+    fn window_parsing() {
+        assert_eq!(parse_window("1.5s..1.7s"), Ok((1_500_000_000, 1_700_000_000)));
+        assert_eq!(parse_window("0ms..10us"), Ok((0, 10_000)));
+
+        parse_window("1s").unwrap_err();
+        parse_window("2s..1s").unwrap_err();
+        parse_window("1s..").unwrap_err();
+    }
+}
@@ -0,0 +1,456 @@
+use std::{
+    fmt::Display,
+    fs::File,
+    io::{ErrorKind, Read, Seek, SeekFrom},
+    path::Path,
+};
+
+use anyhow::anyhow;
+use log::info;
+use serde::{Deserialize, Serialize};
+
+use super::cmd_convert::InputFormat;
+
+/// Size of the chunks in which input files are read and decoded.
+const CHUNK_SIZE: usize = 8 << 20;
+
+/// Markers that may surround a hex or base64 trace dump. They are ignored.
+const MARKERS: [&[u8]; 2] = [
+    b"==== START OF TONBANDGERAET BUFFER ====",
+    b"==== END OF TONBANDGERAET BUFFER ====",
+];
+
+/// Read an input file chunk by chunk, and pass the decoded binary trace data of every chunk to
+/// `consume`. Only a single chunk of the file is kept in memory at any time.
+pub fn read_file_chunked(
+    f: &Path,
+    format: InputFormat,
+    mut consume: impl FnMut(&[u8]) -> anyhow::Result<()>,
+) -> anyhow::Result<()> {
+    read_chunks(f, format, 0, None, CHUNK_SIZE, |_, data| consume(data).map(|_| true))
+}
+
+/// Like [`read_file_chunked`], but also pass the position at the start of every chunk of a hex
+/// or base64 file to `consume`, from which decoding can later be resumed.
+pub fn read_file_chunked_with_positions(
+    f: &Path,
+    format: InputFormat,
+    mut consume: impl FnMut(Option<TextPosition>, &[u8]) -> anyhow::Result<()>,
+) -> anyhow::Result<()> {
+    read_chunks(f, format, 0, None, CHUNK_SIZE, |pos, data| consume(pos, data).map(|_| true))
+}
+
+/// Like [`read_file_chunked`], but skip the first `offset` bytes of decoded trace data. Stops
+/// early once `consume` returns false.
+///
+/// Binary files are read starting at the offset. Hex and base64 files are decoded starting at
+/// `text`, a position at or before the offset (see [`read_file_chunked_with_positions`]), or
+/// else from the start.
+pub fn read_file_chunked_from(
+    f: &Path,
+    format: InputFormat,
+    offset: u64,
+    text: Option<&TextPosition>,
+    mut consume: impl FnMut(&[u8]) -> anyhow::Result<bool>,
+) -> anyhow::Result<()> {
+    read_chunks(f, format, offset, text, CHUNK_SIZE, |_, data| consume(data))
+}
+
+fn read_chunks(
+    f: &Path,
+    format: InputFormat,
+    offset: u64,
+    text: Option<&TextPosition>,
+    chunk_size: usize,
+    mut consume: impl FnMut(Option<TextPosition>, &[u8]) -> anyhow::Result<bool>,
+) -> anyhow::Result<()> {
+    let mut file = File::open(f)?;
+    let mut chunk = vec![0; chunk_size];
+
+    let mut text_decoder = match format {
+        InputFormat::Bin => None,
+        InputFormat::Hex => Some(TextDecoder::new(TextEncoding::Hex)),
+        InputFormat::Base64 => Some(TextDecoder::new(TextEncoding::Base64)),
+    };
+    let mut decoded = vec![];
+
+    // Position in the text file, and in the decoded trace data:
+    let mut text_offset = 0;
+    let mut decoded_offset = 0;
+
+    if let Some(text_decoder) = &mut text_decoder {
+        if let Some(text) = text.filter(|text| text.offset <= offset) {
+            file.seek(SeekFrom::Start(text.text_offset))?;
+            text_decoder.restore(&text.decoder);
+            text_offset = text.text_offset;
+            decoded_offset = text.offset;
+        }
+    } else {
+        file.seek(SeekFrom::Start(offset))?;
+        decoded_offset = offset;
+    }
+
+    // Number of decoded bytes left to skip:
+    let mut skip = offset - decoded_offset;
+
+    loop {
+        let len = match file.read(&mut chunk) {
+            Ok(0) => break,
+            Ok(len) => len,
+            Err(err) if err.kind() == ErrorKind::Interrupted => continue,
+            Err(err) => return Err(err.into()),
+        };
+
+        let (pos, data) = if let Some(text_decoder) = &mut text_decoder {
+            let pos = TextPosition {
+                text_offset,
+                offset: decoded_offset,
+                decoder: text_decoder.state(),
+            };
+            decoded.clear();
+            text_decoder.decode(&chunk[..len], &mut decoded)?;
+            text_offset += len as u64;
+            decoded_offset += decoded.len() as u64;
+            (Some(pos), &decoded[..])
+        } else {
+            (None, &chunk[..len])
+        };
+
+        let skipped = u64::min(skip, data.len() as u64) as usize;
+        skip -= skipped as u64;
+        if skipped < data.len() && !consume(pos, &data[skipped..])? {
+            return Ok(());
+        }
+    }
+
+    if let Some(text_decoder) = text_decoder {
+        text_decoder.finish()?;
+    }
+
+    Ok(())
+}
+
+/// Position in a hex or base64 input file at which decoding can be resumed, without decoding
+/// the text before it.
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq)]
+pub struct TextPosition {
+    /// Offset in the text file, in bytes.
+    pub text_offset: u64,
+    /// Offset of the same position in the decoded trace data, in bytes.
+    pub offset: u64,
+    decoder: TextDecoderState,
+}
+
+// == Text Decoder =============================================================
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum TextEncoding {
+    Hex,
+    Base64,
+}
+
+impl TextEncoding {
+    fn bits_per_char(&self) -> u32 {
+        match self {
+            TextEncoding::Hex => 4,
+            TextEncoding::Base64 => 6,
+        }
+    }
+
+    fn lut(&self) -> &'static [u8; 256] {
+        match self {
+            TextEncoding::Hex => &HEX_LUT,
+            TextEncoding::Base64 => &BASE64_LUT,
+        }
+    }
+}
+
+impl Display for TextEncoding {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            TextEncoding::Hex => write!(f, "hex"),
+            TextEncoding::Base64 => write!(f, "base64"),
+        }
+    }
+}
+
+// Character classes in the lookup tables. All other entries are the value of a digit.
+const CHAR_INVALID: u8 = 0xFF;
+const CHAR_WHITESPACE: u8 = 0xFE;
+const CHAR_EQUALS: u8 = 0xFD;
+
+const HEX_LUT: [u8; 256] = char_lut(TextEncoding::Hex);
+const BASE64_LUT: [u8; 256] = char_lut(TextEncoding::Base64);
+
+const fn char_lut(encoding: TextEncoding) -> [u8; 256] {
+    let mut lut = [CHAR_INVALID; 256];
+    let mut idx = 0;
+    while idx < 256 {
+        let c = idx as u8;
+        lut[idx] = match encoding {
+            TextEncoding::Hex => match c {
+                b'0'..=b'9' => c - b'0',
+                b'a'..=b'f' => c - b'a' + 10,
+                b'A'..=b'F' => c - b'A' + 10,
+                _ => CHAR_INVALID,
+            },
+            TextEncoding::Base64 => match c {
+                b'A'..=b'Z' => c - b'A',
+                b'a'..=b'z' => c - b'a' + 26,
+                b'0'..=b'9' => c - b'0' + 52,
+                b'+' => 62,
+                b'/' => 63,
+                _ => CHAR_INVALID,
+            },
+        };
+        if c.is_ascii_whitespace() {
+            lut[idx] = CHAR_WHITESPACE;
+        } else if c == b'=' {
+            lut[idx] = CHAR_EQUALS;
+        }
+        idx += 1;
+    }
+    lut
+}
+
+/// State of a [`TextDecoder`] between two chunks of text.
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq)]
+struct TextDecoderState {
+    acc: u32,
+    acc_bits: u32,
+    marker_len: usize,
+    marker_candidates: [bool; MARKERS.len()],
+}
+
+/// Streaming hex/base64 decoder.
+///
+/// Text may be split into chunks at any point, including in the middle of a byte or marker:
+/// All state is carried over in a handful of integers instead of buffering the input.
+struct TextDecoder {
+    encoding: TextEncoding,
+    lut: &'static [u8; 256],
+    bits_per_char: u32,
+
+    /// Bits decoded that do not yet form a full byte.
+    acc: u32,
+    acc_bits: u32,
+
+    /// Number of characters of a marker matched so far, starting at a '='.
+    marker_len: usize,
+    /// Markers that match all characters seen so far.
+    marker_candidates: [bool; MARKERS.len()],
+}
+
+impl TextDecoder {
+    fn new(encoding: TextEncoding) -> Self {
+        TextDecoder {
+            encoding,
+            lut: encoding.lut(),
+            bits_per_char: encoding.bits_per_char(),
+            acc: 0,
+            acc_bits: 0,
+            marker_len: 0,
+            marker_candidates: [false; MARKERS.len()],
+        }
+    }
+
+    fn state(&self) -> TextDecoderState {
+        TextDecoderState {
+            acc: self.acc,
+            acc_bits: self.acc_bits,
+            marker_len: self.marker_len,
+            marker_candidates: self.marker_candidates,
+        }
+    }
+
+    fn restore(&mut self, state: &TextDecoderState) {
+        self.acc = state.acc;
+        self.acc_bits = state.acc_bits;
+        self.marker_len = state.marker_len;
+        self.marker_candidates = state.marker_candidates;
+    }
+
+    fn decode(&mut self, text: &[u8], out: &mut Vec<u8>) -> anyhow::Result<()> {
+        out.reserve(text.len() * self.bits_per_char as usize / 8);
+
+        for &c in text {
+            if self.marker_len != 0 && self.match_marker(c)? {
+                continue;
+            }
+
+            let val = self.lut[c as usize];
+            if val < 64 {
+                self.acc = ((self.acc << self.bits_per_char) | val as u32) & 0xFFFF;
+                self.acc_bits += self.bits_per_char;
+                if self.acc_bits >= 8 {
+                    self.acc_bits -= 8;
+                    out.push((self.acc >> self.acc_bits) as u8);
+                }
+            } else if val == CHAR_EQUALS {
+                self.marker_len = 1;
+                self.marker_candidates = [true; MARKERS.len()];
+            } else if val == CHAR_INVALID {
+                return Err(anyhow!("Invalid character '{}' in {} input.", c.escape_ascii(), self.encoding));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Check for an end of input in the middle of a byte or marker.
+    fn finish(mut self) -> anyhow::Result<()> {
+        if self.marker_len != 0 {
+            self.end_marker_mismatch()?;
+        }
+
+        match self.encoding {
+            TextEncoding::Hex if self.acc_bits != 0 => Err(anyhow!("Odd number of hex characters.")),
+            TextEncoding::Base64 if self.acc_bits == 6 => Err(anyhow!("Truncated base64 input.")),
+            _ => Ok(()),
+        }
+    }
+
+    /// Continue matching a marker. Returns true if `c` is part of the marker.
+    fn match_marker(&mut self, c: u8) -> anyhow::Result<bool> {
+        for (candidate, marker) in self.marker_candidates.iter_mut().zip(MARKERS) {
+            *candidate &= marker.get(self.marker_len) == Some(&c);
+        }
+
+        if !self.marker_candidates.contains(&true) {
+            self.end_marker_mismatch()?;
+            return Ok(false);
+        }
+
+        self.marker_len += 1;
+        for (candidate, marker) in self.marker_candidates.iter().zip(MARKERS) {
+            if *candidate && marker.len() == self.marker_len {
+                info!("Ignoring marker '{}'.", marker.escape_ascii());
+                self.marker_len = 0;
+            }
+        }
+
+        Ok(true)
+    }
+
+    /// Handle characters that looked like the start of a marker but are not.
+    fn end_marker_mismatch(&mut self) -> anyhow::Result<()> {
+        // All markers start with "==== ". Up to four equal signs are base64 padding, which ends
+        // a group of four characters and discards any left-over bits:
+        let len = self.marker_len;
+        self.marker_len = 0;
+        if self.encoding == TextEncoding::Base64 && len <= 4 {
+            self.acc_bits = 0;
+            return Ok(());
+        }
+
+        Err(anyhow!("Invalid sequence '{}' in {} input.", MARKERS[0][..len].escape_ascii(), self.encoding))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn decode(encoding: TextEncoding, text: &str) -> anyhow::Result<Vec<u8>> {
+        let mut decoder = TextDecoder::new(encoding);
+        let mut out = vec![];
+        decoder.decode(text.as_bytes(), &mut out)?;
+        decoder.finish()?;
+        Ok(out)
+    }
+
+    #[test]
+    fn hex() {
+        assert!(decode(TextEncoding::Hex, "").unwrap().is_empty());
+        assert_eq!(decode(TextEncoding::Hex, "00ff 1A\n2b\r\n").unwrap(), vec![0x00, 0xFF, 0x1A, 0x2B]);
+        assert_eq!(decode(TextEncoding::Hex, "0 0f\nf").unwrap(), vec![0x00, 0xFF]);
+
+        decode(TextEncoding::Hex, "00f").unwrap_err();
+        decode(TextEncoding::Hex, "00fg").unwrap_err();
+        decode(TextEncoding::Hex, "00ff=").unwrap_err();
+        decode(TextEncoding::Hex, "==== START OF SOMETHING ELSE ====").unwrap_err();
+    }
+
+    #[test]
+    fn hex_markers() {
+        let text = "==== START OF TONBANDGERAET BUFFER ====\n0102\n03==== END OF TONBANDGERAET BUFFER ====\n";
+        assert_eq!(decode(TextEncoding::Hex, text).unwrap(), vec![0x01, 0x02, 0x03]);
+
+        decode(TextEncoding::Hex, "0102\n==== END OF TONBANDGERAET").unwrap_err();
+    }
+
+    #[test]
+    fn base64() {
+        assert!(decode(TextEncoding::Base64, "").unwrap().is_empty());
+        assert_eq!(decode(TextEncoding::Base64, "AAEC/w==").unwrap(), vec![0x00, 0x01, 0x02, 0xFF]);
+        assert_eq!(decode(TextEncoding::Base64, "AAEC\n/w").unwrap(), vec![0x00, 0x01, 0x02, 0xFF]);
+        assert_eq!(decode(TextEncoding::Base64, "AAEC+/8=").unwrap(), vec![0x00, 0x01, 0x02, 0xFB, 0xFF]);
+
+        decode(TextEncoding::Base64, "AAECA").unwrap_err();
+        decode(TextEncoding::Base64, "AA.C").unwrap_err();
+    }
+
+    #[test]
+    fn base64_markers() {
+        let text = "==== START OF TONBANDGERAET BUFFER ====\nAAEC/w==\n==== END OF TONBANDGERAET BUFFER ====";
+        assert_eq!(decode(TextEncoding::Base64, text).unwrap(), vec![0x00, 0x01, 0x02, 0xFF]);
+    }
+
+    #[test]
+    fn chunk_boundaries() {
+        let inputs = [
+            (TextEncoding::Hex, "==== START OF TONBANDGERAET BUFFER ====\n0102 0304\r\nabcd\n"),
+            (TextEncoding::Base64, "==== START OF TONBANDGERAET BUFFER ====\nAAEC/w==\nAAEC+/8=\n"),
+        ];
+
+        for (encoding, text) in inputs {
+            let expected = decode(encoding, text).unwrap();
+            for chunk_size in 1..text.len() {
+                let mut decoder = TextDecoder::new(encoding);
+                let mut out = vec![];
+                for chunk in text.as_bytes().chunks(chunk_size) {
+                    decoder.decode(chunk, &mut out).unwrap();
+                }
+                decoder.finish().unwrap();
+                assert_eq!(out, expected);
+            }
+        }
+    }
+
+    #[test]
+    fn resume_at_text_position() {
+        let inputs = [
+            (InputFormat::Hex, "==== START OF TONBANDGERAET BUFFER ====\n0102 0304\r\nabcd\n0506\n"),
+            (InputFormat::Base64, "==== START OF TONBANDGERAET BUFFER ====\nAAEC/w==\nAAEC+/8=\nBQY=\n"),
+        ];
+
+        let path = std::env::temp_dir().join(format!("tband-input-test-{}", std::process::id()));
+        for (format, text) in inputs {
+            std::fs::write(&path, text).unwrap();
+
+            for chunk_size in 1..text.len() {
+                let mut expected = vec![];
+                let mut positions = vec![];
+                read_chunks(&path, format, 0, None, chunk_size, |pos, data| {
+                    positions.push(pos.unwrap());
+                    expected.extend_from_slice(data);
+                    Ok(true)
+                })
+                .unwrap();
+
+                // Resuming at the last position before every offset decodes the same data:
+                for offset in 0..expected.len() as u64 {
+                    let text = positions.iter().rev().find(|pos| pos.offset <= offset);
+                    let mut data = vec![];
+                    read_chunks(&path, format, offset, text, chunk_size, |_, chunk| {
+                        data.extend_from_slice(chunk);
+                        Ok(true)
+                    })
+                    .unwrap();
+                    assert_eq!(data, expected[offset as usize..]);
+                }
+            }
+        }
+        std::fs::remove_file(&path).unwrap();
+    }
+}
@@ -1,7 +1,12 @@
+mod cmd_analyze;
 mod cmd_completion;
 mod cmd_convert;
 mod cmd_dump;
+mod cmd_index;
 mod cmd_serve;
+mod input;
+mod pipeline;
+mod split;
 
 use clap::Parser;
 
@@ -22,4 +27,6 @@ pub enum CliCmd {
     Serve(cmd_serve::Cmd),
     Completion(cmd_completion::Cmd),
     Dump(cmd_dump::Cmd),
+    Index(cmd_index::Cmd),
+    Analyze(cmd_analyze::Cmd),
 }
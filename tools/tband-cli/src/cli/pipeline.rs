@@ -0,0 +1,267 @@
+use std::{
+    collections::BTreeMap,
+    fs::File,
+    io::{BufWriter, Write},
+    path::Path,
+    sync::mpsc::{sync_channel, Receiver, SyncSender},
+    thread,
+};
+
+use anyhow::anyhow;
+use log::{info, warn};
+use tband_conv::{
+    convert::TraceConverter,
+    decode::{evts::RawEvt, StreamDecoder},
+    generate_perfetto::{PerfettoGenerator, PerfettoOptions},
+};
+
+use super::{
+    cmd_convert::{new_converter, InputFile, InputFormat, TraceMode},
+    input::read_file_chunked_from,
+};
+
+/// Number of batches of decoded events or encoded trace data that may be queued between two stages
+/// of the pipeline before the earlier stage has to wait.
+const PIPELINE_DEPTH: usize = 4;
+
+/// Maximum number of events passed from a decoder to the converter at once. Bounds the number of
+/// Perfetto packets generated by a single conversion step.
+const PIPELINE_BATCH_EVTS: usize = 64 * 1024;
+
+/// Decoded events of an input stream, and the core they belong to (`None` for a stream with
+/// core ID events).
+type EvtBatch = (Option<u32>, Vec<RawEvt>);
+
+/// Decode and convert the given input files on several threads, and stream the Perfetto trace to
+/// `output`.
+///
+/// Every input stream is read and decoded by a separate thread, and the encoded trace is written
+/// by another thread. Merging, conversion and encoding run on the calling thread: after every
+/// batch, the converter merges the decoded events, converts them incrementally (see
+/// [`TraceConverter::convert_incremental`]) and generates the Perfetto trace of everything that
+/// could be converted. The generator encodes directly from the converter's live trace, which cannot
+/// be handed to another thread without copying it. Stages are connected by bounded channels, so
+/// only a few batches are in flight between any two stages, and the encoded trace never has to be
+/// held in memory.
+pub fn convert_pipelined(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    output: &Path,
+    options: PerfettoOptions,
+) -> anyhow::Result<()> {
+    let tc = new_converter(mode, core_count, input)?;
+
+    let mode = match mode {
+        TraceMode::BareMetal => tband_conv::decode::evts::TraceMode::Base,
+        TraceMode::FreeRTOS => tband_conv::decode::evts::TraceMode::FreeRTOS,
+    };
+
+    // Events of a stream without core ID are assigned to the core of the last events added, so
+    // they cannot be interleaved with events of other streams:
+    if input.len() > 1 && input.iter().any(|inp| inp.core_id.is_none()) {
+        return Err(anyhow!("Pipelined conversion requires a core id for every input file if there is more than one."));
+    }
+
+    // Files of the same stream are decoded in order, by the same decoder:
+    let mut streams: BTreeMap<Option<u32>, Vec<&InputFile>> = BTreeMap::new();
+    for inp in input {
+        streams.entry(inp.core_id).or_default().push(inp);
+    }
+
+    thread::scope(|s| {
+        let (evt_send, evt_recv) = sync_channel::<EvtBatch>(PIPELINE_DEPTH);
+        let (data_send, data_recv) = sync_channel::<Vec<u8>>(PIPELINE_DEPTH);
+
+        let decoders: Vec<_> = streams
+            .into_iter()
+            .map(|(core_id, files)| {
+                let evt_send = evt_send.clone();
+                s.spawn(move || decode_stream(format, mode, core_id, files, evt_send))
+            })
+            .collect();
+        drop(evt_send);
+
+        let writer = s.spawn(move || write_stream(output, data_recv));
+
+        info!("Converting..");
+        let converted = convert_stream(tc, options, evt_recv, data_send);
+
+        for decoder in decoders {
+            decoder.join().expect("Decoder thread panicked.")?;
+        }
+        converted?;
+        writer.join().expect("Writer thread panicked.")
+    })
+}
+
+/// Decode the files of a single input stream, and pass on the events in batches. Stops early if
+/// the converter has stopped.
+fn decode_stream(
+    format: InputFormat,
+    mode: tband_conv::decode::evts::TraceMode,
+    core_id: Option<u32>,
+    files: Vec<&InputFile>,
+    evt_send: SyncSender<EvtBatch>,
+) -> anyhow::Result<()> {
+    let mut decoder = StreamDecoder::new(mode);
+
+    for inp in files {
+        info!("Decoding {} file \"{}\"..", format, inp.file.to_string_lossy());
+        read_file_chunked_from(&inp.file, format, 0, None, |data| {
+            let mut evts = decoder.process_binary(data).into_iter();
+            loop {
+                let batch: Vec<RawEvt> = evts.by_ref().take(PIPELINE_BATCH_EVTS).collect();
+                if batch.is_empty() {
+                    return Ok(true);
+                }
+                if evt_send.send((core_id, batch)).is_err() {
+                    return Ok(false);
+                }
+            }
+        })?;
+    }
+
+    let bytes_left = decoder.get_bytes_in_buffer();
+    if bytes_left != 0 {
+        match core_id {
+            Some(core_id) => {
+                warn!("Unfinished frame of {bytes_left} trailing bytes in input stream for core {core_id}!")
+            }
+            None => warn!("Unfinished frame of {bytes_left} trailing bytes in input stream!"),
+        }
+    }
+
+    Ok(())
+}
+
+/// Merge and convert decoded events as they arrive, and generate their Perfetto trace.
+/// Concatenated, the generated batches form a single trace. Stops early if the writer has stopped.
+fn convert_stream(
+    mut tc: TraceConverter,
+    options: PerfettoOptions,
+    evt_recv: Receiver<EvtBatch>,
+    data_send: SyncSender<Vec<u8>>,
+) -> anyhow::Result<()> {
+    let mut generator = PerfettoGenerator::with_options(options);
+
+    for (core_id, evts) in evt_recv {
+        match core_id {
+            Some(core_id) => tc.add_decoded_evts_to_core(evts, core_id)?,
+            None => tc.add_decoded_evts(evts)?,
+        }
+
+        let data = generator.generate(tc.convert_incremental()?);
+        if !data.is_empty() && data_send.send(data).is_err() {
+            return Ok(());
+        }
+    }
+
+    let trace = tc.convert_incremental()?;
+    if trace.evt_count == 0 {
+        return Err(anyhow!("Cannot convert with zero results."));
+    }
+    if trace.ts_resolution_ns.is_none() {
+        warn!("Trace did not include timestamp timer resolution - assuming 1ns.");
+    }
+
+    let mut data = generator.generate(trace);
+    data.extend(generator.generate_final(trace));
+    let _ = data_send.send(data);
+    Ok(())
+}
+
+fn write_stream(output: &Path, data_recv: Receiver<Vec<u8>>) -> anyhow::Result<()> {
+    info!("Saving to '{}'.", output.to_string_lossy());
+    let mut file = BufWriter::new(File::create(output)?);
+
+    for data in data_recv {
+        file.write_all(&data)?;
+    }
+
+    file.flush()?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::cli::{cmd_convert::load_trace, split::tests::frame};
+
+    /// Split a Perfetto trace into its top-level packets.
+    fn packets(mut data: &[u8]) -> Vec<&[u8]> {
+        let mut packets = vec![];
+        while !data.is_empty() {
+            assert_eq!(data[0], 0x0A, "Expected a length-delimited TracePacket.");
+            let (mut len, mut shift, mut idx) = (0usize, 0, 1);
+            loop {
+                len |= ((data[idx] & 0x7F) as usize) << shift;
+                shift += 7;
+                idx += 1;
+                if data[idx - 1] & 0x80 == 0 {
+                    break;
+                }
+            }
+            packets.push(&data[idx..idx + len]);
+            data = &data[idx + len..];
+        }
+        packets
+    }
+
+    /// FreeRTOS recording of one core, which switches between two of four tasks every 10ns.
+    fn core_recording(core_id: u32, evt_cnt: u64) -> Vec<u8> {
+        let mut out = vec![];
+        frame(&mut out, 0x02, &[1], ""); // TsResolutionNs
+        for task_id in 1..=4 {
+            frame(&mut out, 0x5F, &[task_id], &format!("task{task_id}")); // TaskName
+        }
+        for i in 0..evt_cnt {
+            let task_id = 1 + 2 * core_id as u64 + i % 2;
+            frame(&mut out, 0x54, &[10 * i + 10 + core_id as u64, task_id], "");
+            // TaskSwitchedIn
+        }
+        out
+    }
+
+    #[test]
+    fn pipelined_trace_matches_sequential_trace() {
+        let dir = std::env::temp_dir().join(format!("tband-pipeline-test-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+
+        // Enough events for several batches per stream:
+        let evt_cnt = 3 * PIPELINE_BATCH_EVTS as u64 / 2;
+        let input: Vec<_> = (0..2)
+            .map(|core_id| {
+                let file = dir.join(format!("core{core_id}.bin"));
+                std::fs::write(&file, core_recording(core_id, evt_cnt)).unwrap();
+                InputFile {
+                    file,
+                    core_id: Some(core_id),
+                }
+            })
+            .collect();
+
+        let options = PerfettoOptions::default();
+        let output = dir.join("trace.pftrace");
+        convert_pipelined(InputFormat::Bin, TraceMode::FreeRTOS, 2, &input, &output, options.clone()).unwrap();
+        let pipelined = std::fs::read(&output).unwrap();
+
+        let trace = load_trace(InputFormat::Bin, TraceMode::FreeRTOS, 2, input.clone()).unwrap();
+        let mut sequential = vec![];
+        PerfettoGenerator::with_options(options)
+            .finish_to(&trace, &mut sequential)
+            .unwrap();
+
+        // Packets are generated in a different order, but the same packets are included:
+        let mut pipelined_packets = packets(&pipelined);
+        let mut sequential_packets = packets(&sequential);
+        assert_eq!(pipelined_packets.len(), sequential_packets.len());
+        pipelined_packets.sort();
+        sequential_packets.sort();
+        assert!(pipelined_packets == sequential_packets);
+
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+}
@@ -0,0 +1,381 @@
+use std::{
+    fs::File,
+    io::{BufWriter, Write},
+    path::{Path, PathBuf},
+    sync::Mutex,
+    thread,
+};
+
+use anyhow::anyhow;
+use log::info;
+use tband_conv::{
+    convert::CheckpointEvery,
+    generate_perfetto::{PerfettoGenerator, PerfettoOptions},
+};
+
+use super::{
+    cmd_convert::{load_trace_from, InputFile, InputFormat, TraceMode},
+    cmd_index::{build_index, parse_duration_ns, IndexCheckpoint},
+};
+
+/// Where to split a trace into parts.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum SplitEvery {
+    /// Trace time covered by every part, in ns.
+    Duration(u64),
+    /// Approximate size of every part, in bytes.
+    Size(u64),
+}
+
+/// Decode and convert the given input files, and save them as a series of self-contained
+/// Perfetto traces, each covering a part of the recording.
+///
+/// The recording is indexed once, with a checkpoint at the start of every part. Every part is
+/// then converted from its checkpoint, which restores the state at its start (such as running
+/// tasks, active ISRs, open slices and counter values), and generated with all of its tracks.
+/// Parts are converted and generated in parallel.
+pub fn convert_split(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    output: &Path,
+    options: PerfettoOptions,
+    split: SplitEvery,
+) -> anyhow::Result<()> {
+    let (parts, lod_origin) = split_parts(format, mode, core_count, input, &options, split)?;
+    let part_count = parts.len();
+    let digits = usize::max(3, (part_count - 1).to_string().len());
+
+    // Parts are generated in parallel, with the remaining threads generating the tracks of a part:
+    let workers = options.threads.clamp(1, part_count);
+    let options = PerfettoOptions {
+        threads: usize::max(options.threads / workers, 1),
+        ..options
+    };
+
+    info!("Converting {part_count} parts..");
+    let parts = Mutex::new(parts.into_iter().enumerate());
+    thread::scope(|s| {
+        let workers: Vec<_> = (0..workers)
+            .map(|_| {
+                s.spawn(|| -> anyhow::Result<()> {
+                    loop {
+                        let Some((idx, part)) = parts.lock().unwrap().next() else {
+                            return Ok(());
+                        };
+
+                        let trace = load_trace_from(format, mode, core_count, input, part.checkpoint, part.end_ts)?;
+
+                        let path = part_path(output, idx, digits);
+                        info!("Saving part {}/{} to '{}'..", idx + 1, part_count, path.to_string_lossy());
+                        let mut w = BufWriter::new(File::create(path)?);
+                        PerfettoGenerator::with_options(options.clone())
+                            .with_lod_origin(lod_origin)
+                            .finish_to(&trace, &mut w)?;
+                        w.flush()?;
+                    }
+                })
+            })
+            .collect();
+
+        workers
+            .into_iter()
+            .try_for_each(|worker| worker.join().expect("part conversion panicked"))
+    })
+}
+
+/// Part of a split trace.
+struct Part {
+    /// Checkpoint at the start of the part, or `None` for the first part.
+    checkpoint: Option<IndexCheckpoint>,
+    /// Timestamp of the last event of the part, or `None` for the last part.
+    end_ts: Option<u64>,
+}
+
+/// Index the recording, and split it into parts. Also returns the origin of downsampled counters
+/// (see [`PerfettoGenerator::with_lod_origin`]), in ns, so that all parts are downsampled alike.
+fn split_parts(
+    format: InputFormat,
+    mode: TraceMode,
+    core_count: usize,
+    input: &[InputFile],
+    options: &PerfettoOptions,
+    split: SplitEvery,
+) -> anyhow::Result<(Vec<Part>, u64)> {
+    let every = match split {
+        SplitEvery::Duration(0) => return Err(anyhow!("Cannot split trace into parts of zero length.")),
+        SplitEvery::Duration(interval) => CheckpointEvery::Duration(interval),
+        SplitEvery::Size(0) => return Err(anyhow!("Cannot split trace into parts of zero size.")),
+        SplitEvery::Size(size) => {
+            let evts = u64::max(size / perfetto_bytes_per_evt(options), 1);
+            info!("Splitting trace into parts of about {evts} events.");
+            CheckpointEvery::Evts(evts as usize)
+        }
+    };
+
+    let index = build_index(format, mode, core_count, input, every)?;
+    let lod_origin = index.start_ts * index.ts_resolution_ns;
+
+    // Every part starts at a checkpoint (or at the start of the trace), and ends just before the
+    // next one. Intervals without any events have no checkpoint, and are merged into the part before.
+    let end_ts: Vec<_> = index
+        .checkpoints
+        .iter()
+        .map(|cp| Some(cp.state.ts - 1))
+        .chain([None])
+        .collect();
+    let start = std::iter::once(None).chain(index.checkpoints.into_iter().map(Some));
+    let parts = start
+        .zip(end_ts)
+        .map(|(checkpoint, end_ts)| Part { checkpoint, end_ts })
+        .collect();
+
+    Ok((parts, lod_origin))
+}
+
+/// Approximate size of a Perfetto trace per converted event, in bytes, which allows picking the
+/// number of events per part while indexing the recording. Measured on FreeRTOS traces dominated
+/// by task switches, queue operations and ISRs.
+fn perfetto_bytes_per_evt(options: &PerfettoOptions) -> u64 {
+    let mut bytes = if options.compact_sched {
+        PERFETTO_BYTES_PER_EVT_SCHED
+    } else {
+        PERFETTO_BYTES_PER_EVT
+    };
+    if options.raw_evts {
+        bytes += PERFETTO_BYTES_PER_RAW_EVT;
+    }
+    if options.compress {
+        bytes /= PERFETTO_COMPRESSION_RATIO;
+    }
+    u64::max(bytes, 1)
+}
+
+const PERFETTO_BYTES_PER_EVT: u64 = 64;
+const PERFETTO_BYTES_PER_EVT_SCHED: u64 = 32;
+const PERFETTO_BYTES_PER_RAW_EVT: u64 = 32;
+/// Compression ratio of a Perfetto trace (see [`PerfettoOptions::compress`]). Less repetitive
+/// traces compress worse than the traces measured, so this is on the low side.
+const PERFETTO_COMPRESSION_RATIO: u64 = 6;
+
+/// Location of part `idx`: The output file, with the zero-padded part number appended to its
+/// name (such as 'trace_003.pftrace').
+fn part_path(output: &Path, idx: usize, digits: usize) -> PathBuf {
+    let stem = output.file_stem().unwrap_or_default().to_string_lossy();
+    let name = match output.extension() {
+        Some(ext) => format!("{stem}_{idx:0digits$}.{}", ext.to_string_lossy()),
+        None => format!("{stem}_{idx:0digits$}"),
+    };
+    output.with_file_name(name)
+}
+
+/// Parse a duration such as '10s' (see [`parse_duration_ns`]) or a size such as '1GB', '500MB'
+/// or '512MiB'.
+pub fn parse_split_every(s: &str) -> Result<SplitEvery, String> {
+    let unit_idx = s.find(|c: char| c.is_ascii_alphabetic()).unwrap_or(s.len());
+    let (value, unit) = s.split_at(unit_idx);
+
+    let bytes_per_unit: u64 = match unit {
+        "B" => 1,
+        "kB" | "KB" => 1_000,
+        "MB" => 1_000_000,
+        "GB" => 1_000_000_000,
+        "KiB" => 1 << 10,
+        "MiB" => 1 << 20,
+        "GiB" => 1 << 30,
+        _ => {
+            return parse_duration_ns(s)
+                .map(SplitEvery::Duration)
+                .map_err(|_| format!("Invalid duration or size '{s}' (such as '10s' or '1GB')."))
+        }
+    };
+
+    let value: f64 = value.trim().parse().map_err(|_| format!("Invalid size '{s}'."))?;
+    if !value.is_finite() || value < 0.0 {
+        return Err(format!("Invalid size '{s}'."));
+    }
+
+    Ok(SplitEvery::Size((value * bytes_per_unit as f64).round() as u64))
+}
+
+#[cfg(test)]
+pub(super) mod tests {
+    use super::*;
+
+    use tband_conv::trace::freertos::TaskState;
+
+    /// Append a COBS-encoded frame with the given event ID, varlen fields and trailing string.
+    pub(in super::super) fn frame(out: &mut Vec<u8>, id: u8, fields: &[u64], s: &str) {
+        let mut data = vec![id];
+        for &field in fields {
+            let mut val = field;
+            while val >= 0x80 {
+                data.push((val & 0x7F) as u8 | 0x80);
+                val >>= 7;
+            }
+            data.push(val as u8);
+        }
+        data.extend_from_slice(s.as_bytes());
+
+        let mut code_idx = out.len();
+        out.push(0);
+        for b in data {
+            if b != 0 {
+                out.push(b);
+            }
+            if b == 0 || out.len() - code_idx == 0xFF {
+                out[code_idx] = (out.len() - code_idx) as u8;
+                code_idx = out.len();
+                out.push(0);
+            }
+        }
+        out[code_idx] = (out.len() - code_idx) as u8;
+        out.push(0);
+    }
+
+    /// FreeRTOS recording of two tasks switching every 10ns from 10ns to 300ns, with an event
+    /// marker slice that is opened at 5ns and never closed.
+    pub(in super::super) fn recording() -> Vec<u8> {
+        let mut out = vec![];
+        frame(&mut out, 0x02, &[1], ""); // TsResolutionNs
+        frame(&mut out, 0x5F, &[1], "a"); // TaskName
+        frame(&mut out, 0x5F, &[2], "b"); // TaskName
+        frame(&mut out, 0x08, &[5, 0], "outer"); // EvtmarkerBegin
+        for i in 0..30 {
+            frame(&mut out, 0x54, &[10 * i + 10, 1 + i % 2], ""); // TaskSwitchedIn
+        }
+        out
+    }
+
+    /// Write the recording as a file in the given format, and return it as an input.
+    fn input(dir: &Path, format: InputFormat) -> Vec<InputFile> {
+        let data = recording();
+        let (name, contents) = match format {
+            InputFormat::Bin => ("trace.bin", data),
+            InputFormat::Hex => {
+                let hex: Vec<_> = data.iter().map(|b| format!("{b:02x}")).collect();
+                let text = hex.chunks(16).map(|line| line.concat() + "\n").collect::<String>();
+                ("trace.hex", text.into_bytes())
+            }
+            InputFormat::Base64 => {
+                const CHARS: &[u8] = b"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+                let mut text = String::new();
+                for line in data.chunks(48) {
+                    for group in line.chunks(3) {
+                        let bits = group
+                            .iter()
+                            .enumerate()
+                            .fold(0u32, |acc, (i, b)| acc | (*b as u32) << (16 - 8 * i));
+                        for i in 0..=group.len() {
+                            text.push(CHARS[(bits >> (18 - 6 * i) & 0x3F) as usize] as char);
+                        }
+                        text.push_str(&"=="[..3 - group.len()]);
+                    }
+                    text.push('\n');
+                }
+                ("trace.b64", text.into_bytes())
+            }
+        };
+        let file = dir.join(name);
+        std::fs::write(&file, contents).unwrap();
+        vec![InputFile { file, core_id: None }]
+    }
+
+    fn test_dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("tband-split-test-{name}-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    /// Split the recording, and check that every part starts with the task that was running and
+    /// the slice that was open at its start.
+    fn check_parts(dir: &Path, format: InputFormat, split: SplitEvery, expected_start_ts: &[u64]) {
+        let input = input(dir, format);
+        let options = PerfettoOptions::default();
+        let (parts, _) = split_parts(format, TraceMode::FreeRTOS, 1, &input, &options, split).unwrap();
+
+        let start_ts: Vec<_> = parts
+            .iter()
+            .skip(1)
+            .map(|p| p.checkpoint.as_ref().unwrap().state.ts)
+            .collect();
+        assert_eq!(start_ts, expected_start_ts);
+        let end_ts: Vec<_> = parts.iter().map(|p| p.end_ts).collect();
+        let expected_end_ts: Vec<_> = expected_start_ts.iter().map(|ts| Some(ts - 1)).chain([None]).collect();
+        assert_eq!(end_ts, expected_end_ts);
+
+        for (idx, part) in parts.into_iter().enumerate() {
+            let start_ts = part.checkpoint.as_ref().map(|cp| cp.state.ts);
+            let end_ts = part.end_ts;
+            let t = load_trace_from(format, TraceMode::FreeRTOS, 1, &input, part.checkpoint, end_ts).unwrap();
+
+            // Only events of the part are included:
+            let (first_ts, last_ts) = t.ts_range();
+            assert_eq!(first_ts, start_ts.map_or(5, |ts| ts.div_ceil(10) * 10), "part {idx}");
+            assert_eq!(last_ts, end_ts.map_or(300, |ts| ts / 10 * 10), "part {idx}");
+
+            // The task that was running at the start of the part is restored:
+            if let Some(start_ts) = start_ts {
+                let running = &t.cores[&0].freertos.running_task.0[0];
+                let task_id = 1 + ((start_ts - 11) / 10) as usize % 2;
+                assert_eq!((running.ts, running.inner), (start_ts, task_id), "part {idx}");
+                let state = &t.freertos.tasks.get(task_id).unwrap().state.0[0];
+                assert_eq!(state.ts, start_ts);
+                assert!(matches!(state.inner, TaskState::Running { core_id: 0 }));
+            }
+        }
+
+        // Every generated part includes the open slice:
+        let output = dir.join("trace.pftrace");
+        convert_split(format, TraceMode::FreeRTOS, 1, &input, &output, options, split).unwrap();
+        for idx in 0..=expected_start_ts.len() {
+            let data = std::fs::read(part_path(&output, idx, 3)).unwrap();
+            assert!(data.windows(5).any(|w| w == b"outer"), "part {idx}");
+        }
+        assert!(!part_path(&output, expected_start_ts.len() + 1, 3).exists());
+    }
+
+    #[test]
+    fn split_by_duration() {
+        let dir = test_dir("duration");
+        check_parts(&dir, InputFormat::Bin, SplitEvery::Duration(110), &[115, 225]);
+        check_parts(&dir, InputFormat::Hex, SplitEvery::Duration(110), &[115, 225]);
+        check_parts(&dir, InputFormat::Base64, SplitEvery::Duration(110), &[115, 225]);
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+
+    #[test]
+    fn split_by_size() {
+        // Parts of about 10 events each:
+        let dir = test_dir("size");
+        let size = SplitEvery::Size(10 * perfetto_bytes_per_evt(&PerfettoOptions::default()));
+        check_parts(&dir, InputFormat::Bin, size, &[100, 200, 300]);
+        check_parts(&dir, InputFormat::Hex, size, &[100, 200, 300]);
+        check_parts(&dir, InputFormat::Base64, size, &[100, 200, 300]);
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+
+    #[test]
+    fn split_every_parsing() {
+        assert_eq!(parse_split_every("10s"), Ok(SplitEvery::Duration(10_000_000_000)));
+        assert_eq!(parse_split_every("500ms"), Ok(SplitEvery::Duration(500_000_000)));
+        assert_eq!(parse_split_every("1GB"), Ok(SplitEvery::Size(1_000_000_000)));
+        assert_eq!(parse_split_every("1.5MB"), Ok(SplitEvery::Size(1_500_000)));
+        assert_eq!(parse_split_every("512MiB"), Ok(SplitEvery::Size(512 << 20)));
+        assert_eq!(parse_split_every("100B"), Ok(SplitEvery::Size(100)));
+
+        parse_split_every("10").unwrap_err();
+        parse_split_every("1TB").unwrap_err();
+        parse_split_every("GB").unwrap_err();
+        parse_split_every("-1GB").unwrap_err();
+    }
+
+    #[test]
+    fn part_paths() {
+        let path = |output: &str, idx, digits| part_path(Path::new(output), idx, digits);
+        assert_eq!(path("out/trace.pftrace", 3, 3), PathBuf::from("out/trace_003.pftrace"));
+        assert_eq!(path("trace", 12, 4), PathBuf::from("trace_0012"));
+        assert_eq!(path("trace.pftrace", 1234, 3), PathBuf::from("trace_1234.pftrace"));
+    }
+}
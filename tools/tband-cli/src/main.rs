@@ -38,8 +38,10 @@ fn main() -> ExitCode {
     let rst = match cli.cmd {
         CliCmd::Conv(cmd) => cmd.run(),
         CliCmd::Dump(cmd) => cmd.run(),
+        CliCmd::Index(cmd) => cmd.run(),
         CliCmd::Serve(cmd) => cmd.run(),
         CliCmd::Completion(cmd) => cmd.run(),
+        CliCmd::Analyze(cmd) => cmd.run(),
     };
 
     match rst {
@@ -1,6 +1,16 @@
 use anyhow::anyhow;
 
 pub fn cobs_decode_frame(inp: &[u8]) -> anyhow::Result<Vec<u8>> {
+    let mut result = vec![];
+    cobs_decode_frame_into(inp, &mut result)?;
+    Ok(result)
+}
+
+/// Decode a COBS frame into `out`, replacing its previous content. Allows a single buffer to be
+/// re-used for all frames instead of allocating a new one for every frame.
+pub fn cobs_decode_frame_into(inp: &[u8], out: &mut Vec<u8>) -> anyhow::Result<()> {
+    out.clear();
+
     if inp.is_empty() || (inp.len() == 1 && inp[0] == 0) {
         return Err(anyhow!("Empty COBS frame."));
     }
@@ -8,37 +18,30 @@ pub fn cobs_decode_frame(inp: &[u8]) -> anyhow::Result<Vec<u8>> {
         return Err(anyhow!("Invalid COBS frame: First byte zero!"));
     }
 
-    let mut result = vec![];
-
-    let mut code_cnt = inp[0] as usize;
-    let mut code_initial = inp[0] as usize;
-
-    for byte in inp.iter().skip(1) {
-        let byte = *byte;
+    // Index of the current code byte. Every block consists of a code byte, followed by
+    // `code - 1` non-zero data bytes which are copied as a whole:
+    let mut code_idx = 0;
 
-        code_cnt -= 1;
+    loop {
+        let code = inp[code_idx] as usize;
+        let block_end = code_idx + code;
+        let data = &inp[code_idx + 1..usize::min(block_end, inp.len())];
 
-        if byte == 0 {
-            if code_cnt != 0 {
-                return Err(anyhow!("Invalid COBS frame: Pointer past end of block! Are bytes missing?"));
-            } else {
-                break;
-            }
+        if memchr::memchr(0, data).is_some() {
+            return Err(anyhow!("Invalid COBS frame: Pointer past end of block! Are bytes missing?"));
         }
+        out.extend_from_slice(data);
 
-        if code_cnt == 0 {
-            if code_initial != 0xFF {
-                result.push(0);
-            }
+        // Frame ends without a delimiter, or with a delimiter right after this block:
+        if block_end >= inp.len() || inp[block_end] == 0 {
+            return Ok(());
+        }
 
-            code_cnt = byte as usize;
-            code_initial = byte as usize;
-        } else {
-            result.push(byte);
+        if code != 0xFF {
+            out.push(0);
         }
+        code_idx = block_end;
     }
-
-    Ok(result)
 }
 
 #[cfg(test)]
@@ -50,6 +53,27 @@ mod tests {
         assert_eq!(cobs_decode_frame(&[0x1, 0x0]).unwrap(), vec![]);
     }
 
+    #[test]
+    fn test_cobs_into_reuses_buffer() {
+        let mut out = vec![0xAA; 16];
+        cobs_decode_frame_into(&[0x03, 0x01, 0x02, 0x02, 0x03, 0x00], &mut out).unwrap();
+        assert_eq!(out, vec![0x01, 0x02, 0x00, 0x03]);
+        cobs_decode_frame_into(&[0x02, 0x01, 0x00], &mut out).unwrap();
+        assert_eq!(out, vec![0x01]);
+    }
+
+    #[test]
+    fn test_cobs_unterminated() {
+        assert_eq!(cobs_decode_frame(&[0x03, 0x01, 0x02, 0x02, 0x03]).unwrap(), vec![0x01, 0x02, 0x00, 0x03]);
+        assert_eq!(cobs_decode_frame(&[0x03, 0x01]).unwrap(), vec![0x01]);
+    }
+
+    #[test]
+    fn test_cobs_pointer_past_end() {
+        cobs_decode_frame(&[0x04, 0x01, 0x02, 0x00]).unwrap_err();
+        cobs_decode_frame(&[0x02, 0x01, 0x03, 0x01, 0x00]).unwrap_err();
+    }
+
     #[test]
     fn test_cobs_nonzero_len_1() {
         assert_eq!(cobs_decode_frame(&[0x02, 0x01, 0x00]).unwrap(), vec![0x01]);
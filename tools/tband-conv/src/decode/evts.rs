@@ -10,10 +10,12 @@
 //! ```
 //!
 //! This file is generated automatically. See `code_gen` folder in repo.
+use std::sync::Arc;
+
 use anyhow::{anyhow, Context};
 use serde::Serialize;
 
-use crate::decode::{bytes_left, decode_s64, decode_string, decode_u32, decode_u64, decode_u8};
+use crate::decode::{bytes_left, decode_s64, decode_string, decode_u32, decode_u64, decode_u8, StringTable};
 
 // ==== Event Groups ===============================================================================
 
@@ -134,13 +136,13 @@ impl BaseTsResolutionNsEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct BaseIsrNameEvt {
     pub isr_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl BaseIsrNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let isr_id = decode_u32(buf, current_idx).context("Failed to decode 'isr_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'IsrName' event."));
         }
@@ -189,13 +191,13 @@ impl BaseIsrExitEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct BaseEvtmarkerNameEvt {
     pub evtmarker_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl BaseEvtmarkerNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'EvtmarkerName' event."));
         }
@@ -206,14 +208,14 @@ impl BaseEvtmarkerNameEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct BaseEvtmarkerEvt {
     pub evtmarker_id: u32,
-    pub msg: String,
+    pub msg: Arc<str>,
 }
 
 impl BaseEvtmarkerEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let ts = decode_u64(buf, current_idx)?;
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
-        let msg = decode_string(buf, current_idx)?;
+        let msg = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'Evtmarker' event."));
         }
@@ -227,14 +229,14 @@ impl BaseEvtmarkerEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct BaseEvtmarkerBeginEvt {
     pub evtmarker_id: u32,
-    pub msg: String,
+    pub msg: Arc<str>,
 }
 
 impl BaseEvtmarkerBeginEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let ts = decode_u64(buf, current_idx)?;
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
-        let msg = decode_string(buf, current_idx)?;
+        let msg = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'EvtmarkerBegin' event."));
         }
@@ -267,13 +269,13 @@ impl BaseEvtmarkerEndEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct BaseValmarkerNameEvt {
     pub valmarker_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl BaseValmarkerNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let valmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'valmarker_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'ValmarkerName' event."));
         }
@@ -312,6 +314,11 @@ pub struct FreeRTOSEvt {
 
 #[derive(Debug, Clone, Serialize)]
 pub enum FreeRTOSEvtKind {
+    TaskState(FreeRTOSTaskStateEvt),
+    TaskStackHighWaterMark(FreeRTOSTaskStackHighWaterMarkEvt),
+    HeapMalloc(FreeRTOSHeapMallocEvt),
+    HeapFree(FreeRTOSHeapFreeEvt),
+    TaskHeapUsage(FreeRTOSTaskHeapUsageEvt),
     TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt),
     TaskToRdyState(FreeRTOSTaskToRdyStateEvt),
     TaskResumed(FreeRTOSTaskResumedEvt),
@@ -379,6 +386,19 @@ impl TryFrom<u8> for FrQueueKind {
     }
 }
 
+impl FrQueueKind {
+    pub fn name(&self) -> &'static str {
+        match self {
+            Self::FrqkQueue => "FrqkQueue",
+            Self::FrqkCountingSemphr => "FrqkCountingSemphr",
+            Self::FrqkBinarySemphr => "FrqkBinarySemphr",
+            Self::FrqkMutex => "FrqkMutex",
+            Self::FrqkRecursiveMutex => "FrqkRecursiveMutex",
+            Self::FrqkQueueSet => "FrqkQueueSet",
+        }
+    }
+}
+
 #[derive(Debug, Clone, Copy, Serialize)]
 pub enum FrStreamBufferKind {
     FrsbkStreamBuffer,
@@ -397,6 +417,179 @@ impl TryFrom<u8> for FrStreamBufferKind {
     }
 }
 
+impl FrStreamBufferKind {
+    pub fn name(&self) -> &'static str {
+        match self {
+            Self::FrsbkStreamBuffer => "FrsbkStreamBuffer",
+            Self::FrsbkMessageBuffer => "FrsbkMessageBuffer",
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Serialize)]
+pub enum FrTaskState {
+    FrtsRunning,
+    FrtsReady,
+    FrtsBlocked,
+    FrtsSuspended,
+    FrtsDeleted,
+}
+
+impl TryFrom<u8> for FrTaskState {
+    type Error = anyhow::Error;
+
+    fn try_from(value: u8) -> Result<Self, Self::Error> {
+        match value {
+            0 => Ok(Self::FrtsRunning),
+            1 => Ok(Self::FrtsReady),
+            2 => Ok(Self::FrtsBlocked),
+            3 => Ok(Self::FrtsSuspended),
+            4 => Ok(Self::FrtsDeleted),
+            _ => Err(anyhow!("Invalid FrTaskState")),
+        }
+    }
+}
+
+impl FrTaskState {
+    pub fn name(&self) -> &'static str {
+        match self {
+            Self::FrtsRunning => "FrtsRunning",
+            Self::FrtsReady => "FrtsReady",
+            Self::FrtsBlocked => "FrtsBlocked",
+            Self::FrtsSuspended => "FrtsSuspended",
+            Self::FrtsDeleted => "FrtsDeleted",
+        }
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct FreeRTOSTaskStateEvt {
+    pub task_id: u32,
+    pub state: FrTaskState,
+    pub core_id: u32,
+}
+
+impl FreeRTOSTaskStateEvt {
+    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+        let ts = decode_u64(buf, current_idx)?;
+        let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
+        let state =
+            FrTaskState::try_from(decode_u8(buf, current_idx).context("Failed to decode 'state' u8 enum field.")?)
+                .context("Failed to decode 'state' u8 enum field.")?;
+        let core_id = decode_u32(buf, current_idx).context("Failed to decode 'core_id' u32 field.")?;
+        if bytes_left(buf, *current_idx) {
+            return Err(anyhow!("Loose bytes at end of 'TaskState' event."));
+        }
+        Ok(RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::TaskState(Self {
+                task_id,
+                state,
+                core_id,
+            }),
+        }))
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct FreeRTOSTaskStackHighWaterMarkEvt {
+    pub task_id: u32,
+    pub min_free_bytes: u32,
+}
+
+impl FreeRTOSTaskStackHighWaterMarkEvt {
+    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+        let ts = decode_u64(buf, current_idx)?;
+        let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
+        let min_free_bytes = decode_u32(buf, current_idx).context("Failed to decode 'min_free_bytes' u32 field.")?;
+        if bytes_left(buf, *current_idx) {
+            return Err(anyhow!("Loose bytes at end of 'TaskStackHighWaterMark' event."));
+        }
+        Ok(RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::TaskStackHighWaterMark(Self {
+                task_id,
+                min_free_bytes,
+            }),
+        }))
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct FreeRTOSHeapMallocEvt {
+    pub addr: u64,
+    pub size: u32,
+}
+
+impl FreeRTOSHeapMallocEvt {
+    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+        let ts = decode_u64(buf, current_idx)?;
+        let addr = decode_u64(buf, current_idx).context("Failed to decode 'addr' u64 field.")?;
+        let size = decode_u32(buf, current_idx).context("Failed to decode 'size' u32 field.")?;
+        if bytes_left(buf, *current_idx) {
+            return Err(anyhow!("Loose bytes at end of 'HeapMalloc' event."));
+        }
+        Ok(RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::HeapMalloc(Self { addr, size }),
+        }))
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct FreeRTOSHeapFreeEvt {
+    pub addr: u64,
+    pub size: u32,
+}
+
+impl FreeRTOSHeapFreeEvt {
+    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+        let ts = decode_u64(buf, current_idx)?;
+        let addr = decode_u64(buf, current_idx).context("Failed to decode 'addr' u64 field.")?;
+        let size = decode_u32(buf, current_idx).context("Failed to decode 'size' u32 field.")?;
+        if bytes_left(buf, *current_idx) {
+            return Err(anyhow!("Loose bytes at end of 'HeapFree' event."));
+        }
+        Ok(RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::HeapFree(Self { addr, size }),
+        }))
+    }
+}
+
+#[derive(Debug, Clone, Serialize)]
+pub struct FreeRTOSTaskHeapUsageEvt {
+    pub task_id: u32,
+    pub malloc_cnt: u32,
+    pub malloc_bytes: u32,
+    pub free_cnt: u32,
+    pub free_bytes: u32,
+}
+
+impl FreeRTOSTaskHeapUsageEvt {
+    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+        let ts = decode_u64(buf, current_idx)?;
+        let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
+        let malloc_cnt = decode_u32(buf, current_idx).context("Failed to decode 'malloc_cnt' u32 field.")?;
+        let malloc_bytes = decode_u32(buf, current_idx).context("Failed to decode 'malloc_bytes' u32 field.")?;
+        let free_cnt = decode_u32(buf, current_idx).context("Failed to decode 'free_cnt' u32 field.")?;
+        let free_bytes = decode_u32(buf, current_idx).context("Failed to decode 'free_bytes' u32 field.")?;
+        if bytes_left(buf, *current_idx) {
+            return Err(anyhow!("Loose bytes at end of 'TaskHeapUsage' event."));
+        }
+        Ok(RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::TaskHeapUsage(Self {
+                task_id,
+                malloc_cnt,
+                malloc_bytes,
+                free_cnt,
+                free_bytes,
+            }),
+        }))
+    }
+}
+
 #[derive(Debug, Clone, Serialize)]
 pub struct FreeRTOSTaskSwitchedInEvt {
     pub task_id: u32,
@@ -615,13 +808,13 @@ impl FreeRTOSTaskCreatedEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct FreeRTOSTaskNameEvt {
     pub task_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl FreeRTOSTaskNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'TaskName' event."));
         }
@@ -702,13 +895,13 @@ impl FreeRTOSQueueCreatedEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct FreeRTOSQueueNameEvt {
     pub queue_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl FreeRTOSQueueNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let queue_id = decode_u32(buf, current_idx).context("Failed to decode 'queue_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'QueueName' event."));
         }
@@ -977,14 +1170,14 @@ impl FreeRTOSQueueCurLengthEvt {
 pub struct FreeRTOSTaskEvtmarkerNameEvt {
     pub evtmarker_id: u32,
     pub task_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl FreeRTOSTaskEvtmarkerNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
         let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'TaskEvtmarkerName' event."));
         }
@@ -999,14 +1192,14 @@ impl FreeRTOSTaskEvtmarkerNameEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct FreeRTOSTaskEvtmarkerEvt {
     pub evtmarker_id: u32,
-    pub msg: String,
+    pub msg: Arc<str>,
 }
 
 impl FreeRTOSTaskEvtmarkerEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let ts = decode_u64(buf, current_idx)?;
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
-        let msg = decode_string(buf, current_idx)?;
+        let msg = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'TaskEvtmarker' event."));
         }
@@ -1020,14 +1213,14 @@ impl FreeRTOSTaskEvtmarkerEvt {
 #[derive(Debug, Clone, Serialize)]
 pub struct FreeRTOSTaskEvtmarkerBeginEvt {
     pub evtmarker_id: u32,
-    pub msg: String,
+    pub msg: Arc<str>,
 }
 
 impl FreeRTOSTaskEvtmarkerBeginEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let ts = decode_u64(buf, current_idx)?;
         let evtmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'evtmarker_id' u32 field.")?;
-        let msg = decode_string(buf, current_idx)?;
+        let msg = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'TaskEvtmarkerBegin' event."));
         }
@@ -1061,14 +1254,14 @@ impl FreeRTOSTaskEvtmarkerEndEvt {
 pub struct FreeRTOSTaskValmarkerNameEvt {
     pub valmarker_id: u32,
     pub task_id: u32,
-    pub name: String,
+    pub name: Arc<str>,
 }
 
 impl FreeRTOSTaskValmarkerNameEvt {
-    fn decode(buf: &[u8], current_idx: &mut usize) -> anyhow::Result<RawEvt> {
+    fn decode(buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<RawEvt> {
         let valmarker_id = decode_u32(buf, current_idx).context("Failed to decode 'valmarker_id' u32 field.")?;
         let task_id = decode_u32(buf, current_idx).context("Failed to decode 'task_id' u32 field.")?;
-        let name = decode_string(buf, current_idx)?;
+        let name = decode_string(buf, current_idx, strings)?;
         if bytes_left(buf, *current_idx) {
             return Err(anyhow!("Loose bytes at end of 'TaskValmarkerName' event."));
         }
@@ -1104,25 +1297,30 @@ impl FreeRTOSTaskValmarkerEvt {
 // ==== Main Decode Function =======================================================================
 
 impl RawEvt {
-    pub fn decode(buf: &[u8], mode: TraceMode) -> anyhow::Result<Self> {
+    pub fn decode(buf: &[u8], mode: TraceMode, strings: &mut StringTable) -> anyhow::Result<Self> {
         let mut current_idx: usize = 0;
         let id: u8 = decode_u8(buf, &mut current_idx)?;
         match id {
             0x0 => BaseCoreIdEvt::decode(buf, &mut current_idx),
             0x1 => BaseDroppedEvtCntEvt::decode(buf, &mut current_idx),
             0x2 => BaseTsResolutionNsEvt::decode(buf, &mut current_idx),
-            0x3 => BaseIsrNameEvt::decode(buf, &mut current_idx),
+            0x3 => BaseIsrNameEvt::decode(buf, &mut current_idx, strings),
             0x4 => BaseIsrEnterEvt::decode(buf, &mut current_idx),
             0x5 => BaseIsrExitEvt::decode(buf, &mut current_idx),
-            0x6 => BaseEvtmarkerNameEvt::decode(buf, &mut current_idx),
-            0x7 => BaseEvtmarkerEvt::decode(buf, &mut current_idx),
-            0x8 => BaseEvtmarkerBeginEvt::decode(buf, &mut current_idx),
+            0x6 => BaseEvtmarkerNameEvt::decode(buf, &mut current_idx, strings),
+            0x7 => BaseEvtmarkerEvt::decode(buf, &mut current_idx, strings),
+            0x8 => BaseEvtmarkerBeginEvt::decode(buf, &mut current_idx, strings),
             0x9 => BaseEvtmarkerEndEvt::decode(buf, &mut current_idx),
-            0xA => BaseValmarkerNameEvt::decode(buf, &mut current_idx),
+            0xA => BaseValmarkerNameEvt::decode(buf, &mut current_idx, strings),
             0xB => BaseValmarkerEvt::decode(buf, &mut current_idx),
             id => match mode {
                 TraceMode::Base => Err(anyhow!("Invalid event id 0x{id:X}!")),
                 TraceMode::FreeRTOS => match id {
+                    0x4F => FreeRTOSTaskStateEvt::decode(buf, &mut current_idx),
+                    0x50 => FreeRTOSTaskStackHighWaterMarkEvt::decode(buf, &mut current_idx),
+                    0x51 => FreeRTOSHeapMallocEvt::decode(buf, &mut current_idx),
+                    0x52 => FreeRTOSHeapFreeEvt::decode(buf, &mut current_idx),
+                    0x53 => FreeRTOSTaskHeapUsageEvt::decode(buf, &mut current_idx),
                     0x54 => FreeRTOSTaskSwitchedInEvt::decode(buf, &mut current_idx),
                     0x55 => FreeRTOSTaskToRdyStateEvt::decode(buf, &mut current_idx),
                     0x56 => FreeRTOSTaskResumedEvt::decode(buf, &mut current_idx),
@@ -1134,12 +1332,12 @@ impl RawEvt {
                     0x5C => FreeRTOSTaskPriorityInheritEvt::decode(buf, &mut current_idx),
                     0x5D => FreeRTOSTaskPriorityDisinheritEvt::decode(buf, &mut current_idx),
                     0x5E => FreeRTOSTaskCreatedEvt::decode(buf, &mut current_idx),
-                    0x5F => FreeRTOSTaskNameEvt::decode(buf, &mut current_idx),
+                    0x5F => FreeRTOSTaskNameEvt::decode(buf, &mut current_idx, strings),
                     0x60 => FreeRTOSTaskIsIdleTaskEvt::decode(buf, &mut current_idx),
                     0x61 => FreeRTOSTaskIsTimerTaskEvt::decode(buf, &mut current_idx),
                     0x62 => FreeRTOSTaskDeletedEvt::decode(buf, &mut current_idx),
                     0x63 => FreeRTOSQueueCreatedEvt::decode(buf, &mut current_idx),
-                    0x64 => FreeRTOSQueueNameEvt::decode(buf, &mut current_idx),
+                    0x64 => FreeRTOSQueueNameEvt::decode(buf, &mut current_idx, strings),
                     0x65 => FreeRTOSQueueKindEvt::decode(buf, &mut current_idx),
                     0x66 => FreeRTOSQueueSendEvt::decode(buf, &mut current_idx),
                     0x67 => FreeRTOSQueueSendFromIsrEvt::decode(buf, &mut current_idx),
@@ -1152,11 +1350,11 @@ impl RawEvt {
                     0x6E => FreeRTOSCurtaskBlockOnQueueSendEvt::decode(buf, &mut current_idx),
                     0x6F => FreeRTOSCurtaskBlockOnQueueReceiveEvt::decode(buf, &mut current_idx),
                     0x70 => FreeRTOSQueueCurLengthEvt::decode(buf, &mut current_idx),
-                    0x7A => FreeRTOSTaskEvtmarkerNameEvt::decode(buf, &mut current_idx),
-                    0x7B => FreeRTOSTaskEvtmarkerEvt::decode(buf, &mut current_idx),
-                    0x7C => FreeRTOSTaskEvtmarkerBeginEvt::decode(buf, &mut current_idx),
+                    0x7A => FreeRTOSTaskEvtmarkerNameEvt::decode(buf, &mut current_idx, strings),
+                    0x7B => FreeRTOSTaskEvtmarkerEvt::decode(buf, &mut current_idx, strings),
+                    0x7C => FreeRTOSTaskEvtmarkerBeginEvt::decode(buf, &mut current_idx, strings),
                     0x7D => FreeRTOSTaskEvtmarkerEndEvt::decode(buf, &mut current_idx),
-                    0x7E => FreeRTOSTaskValmarkerNameEvt::decode(buf, &mut current_idx),
+                    0x7E => FreeRTOSTaskValmarkerNameEvt::decode(buf, &mut current_idx, strings),
                     0x7F => FreeRTOSTaskValmarkerEvt::decode(buf, &mut current_idx),
                     id => Err(anyhow!("Invalid event id 0x{id:X}!")),
                 },
@@ -1164,3 +1362,870 @@ impl RawEvt {
         }
     }
 }
+
+// ==== Event Fields ===============================================================================
+
+/// Value of an event field.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum EvtFieldVal<'a> {
+    Uint(u64),
+    Int(i64),
+    Str(&'a str),
+}
+
+impl RawEvt {
+    /// Name of the kind of event.
+    pub fn kind_name(&self) -> &'static str {
+        match self {
+            RawEvt::Invalid(_) => "Invalid",
+            RawEvt::Base(e) => match e.kind {
+                BaseEvtKind::CoreId(_) => "CoreId",
+                BaseEvtKind::DroppedEvtCnt(_) => "DroppedEvtCnt",
+                BaseEvtKind::IsrEnter(_) => "IsrEnter",
+                BaseEvtKind::IsrExit(_) => "IsrExit",
+                BaseEvtKind::Evtmarker(_) => "Evtmarker",
+                BaseEvtKind::EvtmarkerBegin(_) => "EvtmarkerBegin",
+                BaseEvtKind::EvtmarkerEnd(_) => "EvtmarkerEnd",
+                BaseEvtKind::Valmarker(_) => "Valmarker",
+            },
+            RawEvt::BaseMetadata(e) => match e {
+                BaseMetadataEvt::TsResolutionNs(_) => "TsResolutionNs",
+                BaseMetadataEvt::IsrName(_) => "IsrName",
+                BaseMetadataEvt::EvtmarkerName(_) => "EvtmarkerName",
+                BaseMetadataEvt::ValmarkerName(_) => "ValmarkerName",
+            },
+            RawEvt::FreeRTOS(e) => match e.kind {
+                FreeRTOSEvtKind::TaskState(_) => "TaskState",
+                FreeRTOSEvtKind::TaskStackHighWaterMark(_) => "TaskStackHighWaterMark",
+                FreeRTOSEvtKind::HeapMalloc(_) => "HeapMalloc",
+                FreeRTOSEvtKind::HeapFree(_) => "HeapFree",
+                FreeRTOSEvtKind::TaskHeapUsage(_) => "TaskHeapUsage",
+                FreeRTOSEvtKind::TaskSwitchedIn(_) => "TaskSwitchedIn",
+                FreeRTOSEvtKind::TaskToRdyState(_) => "TaskToRdyState",
+                FreeRTOSEvtKind::TaskResumed(_) => "TaskResumed",
+                FreeRTOSEvtKind::TaskResumedFromIsr(_) => "TaskResumedFromIsr",
+                FreeRTOSEvtKind::TaskSuspended(_) => "TaskSuspended",
+                FreeRTOSEvtKind::CurtaskDelay(_) => "CurtaskDelay",
+                FreeRTOSEvtKind::CurtaskDelayUntil(_) => "CurtaskDelayUntil",
+                FreeRTOSEvtKind::TaskPrioritySet(_) => "TaskPrioritySet",
+                FreeRTOSEvtKind::TaskPriorityInherit(_) => "TaskPriorityInherit",
+                FreeRTOSEvtKind::TaskPriorityDisinherit(_) => "TaskPriorityDisinherit",
+                FreeRTOSEvtKind::TaskCreated(_) => "TaskCreated",
+                FreeRTOSEvtKind::TaskDeleted(_) => "TaskDeleted",
+                FreeRTOSEvtKind::QueueCreated(_) => "QueueCreated",
+                FreeRTOSEvtKind::QueueSend(_) => "QueueSend",
+                FreeRTOSEvtKind::QueueSendFromIsr(_) => "QueueSendFromIsr",
+                FreeRTOSEvtKind::QueueOverwrite(_) => "QueueOverwrite",
+                FreeRTOSEvtKind::QueueOverwriteFromIsr(_) => "QueueOverwriteFromIsr",
+                FreeRTOSEvtKind::QueueReceive(_) => "QueueReceive",
+                FreeRTOSEvtKind::QueueReceiveFromIsr(_) => "QueueReceiveFromIsr",
+                FreeRTOSEvtKind::QueueReset(_) => "QueueReset",
+                FreeRTOSEvtKind::CurtaskBlockOnQueuePeek(_) => "CurtaskBlockOnQueuePeek",
+                FreeRTOSEvtKind::CurtaskBlockOnQueueSend(_) => "CurtaskBlockOnQueueSend",
+                FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(_) => "CurtaskBlockOnQueueReceive",
+                FreeRTOSEvtKind::QueueCurLength(_) => "QueueCurLength",
+                FreeRTOSEvtKind::TaskEvtmarker(_) => "TaskEvtmarker",
+                FreeRTOSEvtKind::TaskEvtmarkerBegin(_) => "TaskEvtmarkerBegin",
+                FreeRTOSEvtKind::TaskEvtmarkerEnd(_) => "TaskEvtmarkerEnd",
+                FreeRTOSEvtKind::TaskValmarker(_) => "TaskValmarker",
+            },
+            RawEvt::FreeRTOSMetadata(e) => match e {
+                FreeRTOSMetadataEvt::TaskName(_) => "TaskName",
+                FreeRTOSMetadataEvt::TaskIsIdleTask(_) => "TaskIsIdleTask",
+                FreeRTOSMetadataEvt::TaskIsTimerTask(_) => "TaskIsTimerTask",
+                FreeRTOSMetadataEvt::QueueName(_) => "QueueName",
+                FreeRTOSMetadataEvt::QueueKind(_) => "QueueKind",
+                FreeRTOSMetadataEvt::TaskEvtmarkerName(_) => "TaskEvtmarkerName",
+                FreeRTOSMetadataEvt::TaskValmarkerName(_) => "TaskValmarkerName",
+            },
+        }
+    }
+
+    /// Call `f` with the name and value of every field of the event, except its timestamp.
+    pub fn for_each_field<'a>(&'a self, mut f: impl FnMut(&'static str, EvtFieldVal<'a>)) {
+        match self {
+            RawEvt::Invalid(e) => {
+                if let Some(err) = &e.err {
+                    f("err", EvtFieldVal::Str(err));
+                }
+            }
+            RawEvt::Base(e) => match &e.kind {
+                BaseEvtKind::CoreId(e) => {
+                    f("core_id", EvtFieldVal::Uint(e.core_id.into()));
+                }
+                BaseEvtKind::DroppedEvtCnt(e) => {
+                    f("cnt", EvtFieldVal::Uint(e.cnt.into()));
+                }
+                BaseEvtKind::IsrEnter(e) => {
+                    f("isr_id", EvtFieldVal::Uint(e.isr_id.into()));
+                }
+                BaseEvtKind::IsrExit(e) => {
+                    f("isr_id", EvtFieldVal::Uint(e.isr_id.into()));
+                }
+                BaseEvtKind::Evtmarker(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("msg", EvtFieldVal::Str(&e.msg));
+                }
+                BaseEvtKind::EvtmarkerBegin(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("msg", EvtFieldVal::Str(&e.msg));
+                }
+                BaseEvtKind::EvtmarkerEnd(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                }
+                BaseEvtKind::Valmarker(e) => {
+                    f("valmarker_id", EvtFieldVal::Uint(e.valmarker_id.into()));
+                    f("val", EvtFieldVal::Int(e.val));
+                }
+            },
+            RawEvt::BaseMetadata(e) => match e {
+                BaseMetadataEvt::TsResolutionNs(e) => {
+                    f("ns_per_ts", EvtFieldVal::Uint(e.ns_per_ts));
+                }
+                BaseMetadataEvt::IsrName(e) => {
+                    f("isr_id", EvtFieldVal::Uint(e.isr_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+                BaseMetadataEvt::EvtmarkerName(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+                BaseMetadataEvt::ValmarkerName(e) => {
+                    f("valmarker_id", EvtFieldVal::Uint(e.valmarker_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+            },
+            RawEvt::FreeRTOS(e) => match &e.kind {
+                FreeRTOSEvtKind::TaskState(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("state", EvtFieldVal::Str(e.state.name()));
+                    f("core_id", EvtFieldVal::Uint(e.core_id.into()));
+                }
+                FreeRTOSEvtKind::TaskStackHighWaterMark(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("min_free_bytes", EvtFieldVal::Uint(e.min_free_bytes.into()));
+                }
+                FreeRTOSEvtKind::HeapMalloc(e) => {
+                    f("addr", EvtFieldVal::Uint(e.addr));
+                    f("size", EvtFieldVal::Uint(e.size.into()));
+                }
+                FreeRTOSEvtKind::HeapFree(e) => {
+                    f("addr", EvtFieldVal::Uint(e.addr));
+                    f("size", EvtFieldVal::Uint(e.size.into()));
+                }
+                FreeRTOSEvtKind::TaskHeapUsage(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("malloc_cnt", EvtFieldVal::Uint(e.malloc_cnt.into()));
+                    f("malloc_bytes", EvtFieldVal::Uint(e.malloc_bytes.into()));
+                    f("free_cnt", EvtFieldVal::Uint(e.free_cnt.into()));
+                    f("free_bytes", EvtFieldVal::Uint(e.free_bytes.into()));
+                }
+                FreeRTOSEvtKind::TaskSwitchedIn(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::TaskToRdyState(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::TaskResumed(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::TaskResumedFromIsr(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::TaskSuspended(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::CurtaskDelay(e) => {
+                    f("ticks", EvtFieldVal::Uint(e.ticks.into()));
+                }
+                FreeRTOSEvtKind::CurtaskDelayUntil(e) => {
+                    f("time_to_wake", EvtFieldVal::Uint(e.time_to_wake.into()));
+                }
+                FreeRTOSEvtKind::TaskPrioritySet(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("priority", EvtFieldVal::Uint(e.priority.into()));
+                }
+                FreeRTOSEvtKind::TaskPriorityInherit(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("priority", EvtFieldVal::Uint(e.priority.into()));
+                }
+                FreeRTOSEvtKind::TaskPriorityDisinherit(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("priority", EvtFieldVal::Uint(e.priority.into()));
+                }
+                FreeRTOSEvtKind::TaskCreated(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::TaskDeleted(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSEvtKind::QueueCreated(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                }
+                FreeRTOSEvtKind::QueueSend(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueSendFromIsr(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueOverwrite(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueOverwriteFromIsr(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueReceive(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueReceiveFromIsr(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("len_after", EvtFieldVal::Uint(e.len_after.into()));
+                }
+                FreeRTOSEvtKind::QueueReset(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                }
+                FreeRTOSEvtKind::CurtaskBlockOnQueuePeek(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("ticks_to_wait", EvtFieldVal::Uint(e.ticks_to_wait.into()));
+                }
+                FreeRTOSEvtKind::CurtaskBlockOnQueueSend(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("ticks_to_wait", EvtFieldVal::Uint(e.ticks_to_wait.into()));
+                }
+                FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("ticks_to_wait", EvtFieldVal::Uint(e.ticks_to_wait.into()));
+                }
+                FreeRTOSEvtKind::QueueCurLength(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("length", EvtFieldVal::Uint(e.length.into()));
+                }
+                FreeRTOSEvtKind::TaskEvtmarker(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("msg", EvtFieldVal::Str(&e.msg));
+                }
+                FreeRTOSEvtKind::TaskEvtmarkerBegin(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("msg", EvtFieldVal::Str(&e.msg));
+                }
+                FreeRTOSEvtKind::TaskEvtmarkerEnd(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                }
+                FreeRTOSEvtKind::TaskValmarker(e) => {
+                    f("valmarker_id", EvtFieldVal::Uint(e.valmarker_id.into()));
+                    f("val", EvtFieldVal::Int(e.val));
+                }
+            },
+            RawEvt::FreeRTOSMetadata(e) => match e {
+                FreeRTOSMetadataEvt::TaskName(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+                FreeRTOSMetadataEvt::TaskIsIdleTask(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("core_id", EvtFieldVal::Uint(e.core_id.into()));
+                }
+                FreeRTOSMetadataEvt::TaskIsTimerTask(e) => {
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                }
+                FreeRTOSMetadataEvt::QueueName(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+                FreeRTOSMetadataEvt::QueueKind(e) => {
+                    f("queue_id", EvtFieldVal::Uint(e.queue_id.into()));
+                    f("kind", EvtFieldVal::Str(e.kind.name()));
+                }
+                FreeRTOSMetadataEvt::TaskEvtmarkerName(e) => {
+                    f("evtmarker_id", EvtFieldVal::Uint(e.evtmarker_id.into()));
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+                FreeRTOSMetadataEvt::TaskValmarkerName(e) => {
+                    f("valmarker_id", EvtFieldVal::Uint(e.valmarker_id.into()));
+                    f("task_id", EvtFieldVal::Uint(e.task_id.into()));
+                    f("name", EvtFieldVal::Str(&e.name));
+                }
+            },
+        }
+    }
+}
+
+// ==== Packed Events ==============================================================================
+
+/// Kind of an event whose fields can be packed into a [`PackedPayload`], used to store events
+/// compactly. Events of all other kinds are `Other`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PackedKind {
+    BaseCoreId,
+    BaseDroppedEvtCnt,
+    BaseIsrName,
+    BaseIsrEnter,
+    BaseIsrExit,
+    BaseEvtmarkerName,
+    BaseEvtmarker,
+    BaseEvtmarkerBegin,
+    BaseEvtmarkerEnd,
+    BaseValmarkerName,
+    BaseValmarker,
+    FreeRTOSTaskStackHighWaterMark,
+    FreeRTOSHeapMalloc,
+    FreeRTOSHeapFree,
+    FreeRTOSTaskSwitchedIn,
+    FreeRTOSTaskToRdyState,
+    FreeRTOSTaskResumed,
+    FreeRTOSTaskResumedFromIsr,
+    FreeRTOSTaskSuspended,
+    FreeRTOSCurtaskDelay,
+    FreeRTOSCurtaskDelayUntil,
+    FreeRTOSTaskPrioritySet,
+    FreeRTOSTaskPriorityInherit,
+    FreeRTOSTaskPriorityDisinherit,
+    FreeRTOSTaskCreated,
+    FreeRTOSTaskName,
+    FreeRTOSTaskIsIdleTask,
+    FreeRTOSTaskIsTimerTask,
+    FreeRTOSTaskDeleted,
+    FreeRTOSQueueCreated,
+    FreeRTOSQueueName,
+    FreeRTOSQueueSend,
+    FreeRTOSQueueSendFromIsr,
+    FreeRTOSQueueOverwrite,
+    FreeRTOSQueueOverwriteFromIsr,
+    FreeRTOSQueueReceive,
+    FreeRTOSQueueReceiveFromIsr,
+    FreeRTOSQueueReset,
+    FreeRTOSCurtaskBlockOnQueuePeek,
+    FreeRTOSCurtaskBlockOnQueueSend,
+    FreeRTOSCurtaskBlockOnQueueReceive,
+    FreeRTOSQueueCurLength,
+    FreeRTOSTaskEvtmarker,
+    FreeRTOSTaskEvtmarkerBegin,
+    FreeRTOSTaskEvtmarkerEnd,
+    FreeRTOSTaskValmarker,
+    Other,
+}
+
+/// Shape of the payload of a packed event.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PackedShape {
+    Word,
+    Pair,
+    Str,
+    Val,
+    Heap,
+    Other,
+}
+
+/// Fields of a packed event, without its timestamp.
+#[derive(Debug, Clone)]
+pub enum PackedPayload {
+    Word(u32),
+    Pair([u32; 2]),
+    Str(u32, Arc<str>),
+    Val(u32, i64),
+    Heap(u64, u32),
+}
+
+impl PackedKind {
+    pub fn shape(self) -> PackedShape {
+        match self {
+            PackedKind::BaseCoreId => PackedShape::Word,
+            PackedKind::BaseDroppedEvtCnt => PackedShape::Word,
+            PackedKind::BaseIsrName => PackedShape::Str,
+            PackedKind::BaseIsrEnter => PackedShape::Word,
+            PackedKind::BaseIsrExit => PackedShape::Word,
+            PackedKind::BaseEvtmarkerName => PackedShape::Str,
+            PackedKind::BaseEvtmarker => PackedShape::Str,
+            PackedKind::BaseEvtmarkerBegin => PackedShape::Str,
+            PackedKind::BaseEvtmarkerEnd => PackedShape::Word,
+            PackedKind::BaseValmarkerName => PackedShape::Str,
+            PackedKind::BaseValmarker => PackedShape::Val,
+            PackedKind::FreeRTOSTaskStackHighWaterMark => PackedShape::Pair,
+            PackedKind::FreeRTOSHeapMalloc => PackedShape::Heap,
+            PackedKind::FreeRTOSHeapFree => PackedShape::Heap,
+            PackedKind::FreeRTOSTaskSwitchedIn => PackedShape::Word,
+            PackedKind::FreeRTOSTaskToRdyState => PackedShape::Word,
+            PackedKind::FreeRTOSTaskResumed => PackedShape::Word,
+            PackedKind::FreeRTOSTaskResumedFromIsr => PackedShape::Word,
+            PackedKind::FreeRTOSTaskSuspended => PackedShape::Word,
+            PackedKind::FreeRTOSCurtaskDelay => PackedShape::Word,
+            PackedKind::FreeRTOSCurtaskDelayUntil => PackedShape::Word,
+            PackedKind::FreeRTOSTaskPrioritySet => PackedShape::Pair,
+            PackedKind::FreeRTOSTaskPriorityInherit => PackedShape::Pair,
+            PackedKind::FreeRTOSTaskPriorityDisinherit => PackedShape::Pair,
+            PackedKind::FreeRTOSTaskCreated => PackedShape::Word,
+            PackedKind::FreeRTOSTaskName => PackedShape::Str,
+            PackedKind::FreeRTOSTaskIsIdleTask => PackedShape::Pair,
+            PackedKind::FreeRTOSTaskIsTimerTask => PackedShape::Word,
+            PackedKind::FreeRTOSTaskDeleted => PackedShape::Word,
+            PackedKind::FreeRTOSQueueCreated => PackedShape::Word,
+            PackedKind::FreeRTOSQueueName => PackedShape::Str,
+            PackedKind::FreeRTOSQueueSend => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueSendFromIsr => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueOverwrite => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueOverwriteFromIsr => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueReceive => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueReceiveFromIsr => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueReset => PackedShape::Word,
+            PackedKind::FreeRTOSCurtaskBlockOnQueuePeek => PackedShape::Pair,
+            PackedKind::FreeRTOSCurtaskBlockOnQueueSend => PackedShape::Pair,
+            PackedKind::FreeRTOSCurtaskBlockOnQueueReceive => PackedShape::Pair,
+            PackedKind::FreeRTOSQueueCurLength => PackedShape::Pair,
+            PackedKind::FreeRTOSTaskEvtmarker => PackedShape::Str,
+            PackedKind::FreeRTOSTaskEvtmarkerBegin => PackedShape::Str,
+            PackedKind::FreeRTOSTaskEvtmarkerEnd => PackedShape::Word,
+            PackedKind::FreeRTOSTaskValmarker => PackedShape::Val,
+            PackedKind::Other => PackedShape::Other,
+        }
+    }
+
+    pub fn is_metadata(self) -> bool {
+        matches!(
+            self,
+            PackedKind::BaseIsrName
+                | PackedKind::BaseEvtmarkerName
+                | PackedKind::BaseValmarkerName
+                | PackedKind::FreeRTOSTaskName
+                | PackedKind::FreeRTOSTaskIsIdleTask
+                | PackedKind::FreeRTOSTaskIsTimerTask
+                | PackedKind::FreeRTOSQueueName
+        )
+    }
+}
+
+impl RawEvt {
+    /// Split the event into its kind and fields, or return it unchanged if it cannot be packed.
+    pub fn pack(self) -> Result<(PackedKind, PackedPayload), RawEvt> {
+        match self {
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::CoreId(e),
+                ..
+            }) => Ok((PackedKind::BaseCoreId, PackedPayload::Word(e.core_id))),
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::DroppedEvtCnt(e),
+                ..
+            }) => Ok((PackedKind::BaseDroppedEvtCnt, PackedPayload::Word(e.cnt))),
+            RawEvt::BaseMetadata(BaseMetadataEvt::IsrName(e)) => {
+                Ok((PackedKind::BaseIsrName, PackedPayload::Str(e.isr_id, e.name)))
+            }
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::IsrEnter(e),
+                ..
+            }) => Ok((PackedKind::BaseIsrEnter, PackedPayload::Word(e.isr_id))),
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::IsrExit(e),
+                ..
+            }) => Ok((PackedKind::BaseIsrExit, PackedPayload::Word(e.isr_id))),
+            RawEvt::BaseMetadata(BaseMetadataEvt::EvtmarkerName(e)) => {
+                Ok((PackedKind::BaseEvtmarkerName, PackedPayload::Str(e.evtmarker_id, e.name)))
+            }
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::Evtmarker(e),
+                ..
+            }) => Ok((PackedKind::BaseEvtmarker, PackedPayload::Str(e.evtmarker_id, e.msg))),
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::EvtmarkerBegin(e),
+                ..
+            }) => Ok((PackedKind::BaseEvtmarkerBegin, PackedPayload::Str(e.evtmarker_id, e.msg))),
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::EvtmarkerEnd(e),
+                ..
+            }) => Ok((PackedKind::BaseEvtmarkerEnd, PackedPayload::Word(e.evtmarker_id))),
+            RawEvt::BaseMetadata(BaseMetadataEvt::ValmarkerName(e)) => {
+                Ok((PackedKind::BaseValmarkerName, PackedPayload::Str(e.valmarker_id, e.name)))
+            }
+            RawEvt::Base(BaseEvt {
+                kind: BaseEvtKind::Valmarker(e),
+                ..
+            }) => Ok((PackedKind::BaseValmarker, PackedPayload::Val(e.valmarker_id, e.val))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskStackHighWaterMark(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskStackHighWaterMark, PackedPayload::Pair([e.task_id, e.min_free_bytes]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::HeapMalloc(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSHeapMalloc, PackedPayload::Heap(e.addr, e.size))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::HeapFree(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSHeapFree, PackedPayload::Heap(e.addr, e.size))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskSwitchedIn(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskSwitchedIn, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskToRdyState(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskToRdyState, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskResumed(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskResumed, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskResumedFromIsr(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskResumedFromIsr, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskSuspended(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskSuspended, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::CurtaskDelay(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSCurtaskDelay, PackedPayload::Word(e.ticks))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::CurtaskDelayUntil(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSCurtaskDelayUntil, PackedPayload::Word(e.time_to_wake))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskPrioritySet(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskPrioritySet, PackedPayload::Pair([e.task_id, e.priority]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskPriorityInherit(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskPriorityInherit, PackedPayload::Pair([e.task_id, e.priority]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskPriorityDisinherit(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskPriorityDisinherit, PackedPayload::Pair([e.task_id, e.priority]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskCreated(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskCreated, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskName(e)) => {
+                Ok((PackedKind::FreeRTOSTaskName, PackedPayload::Str(e.task_id, e.name)))
+            }
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsIdleTask(e)) => {
+                Ok((PackedKind::FreeRTOSTaskIsIdleTask, PackedPayload::Pair([e.task_id, e.core_id])))
+            }
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsTimerTask(e)) => {
+                Ok((PackedKind::FreeRTOSTaskIsTimerTask, PackedPayload::Word(e.task_id)))
+            }
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskDeleted(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskDeleted, PackedPayload::Word(e.task_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueCreated(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueCreated, PackedPayload::Word(e.queue_id))),
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::QueueName(e)) => {
+                Ok((PackedKind::FreeRTOSQueueName, PackedPayload::Str(e.queue_id, e.name)))
+            }
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueSend(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueSend, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueSendFromIsr(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueSendFromIsr, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueOverwrite(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueOverwrite, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueOverwriteFromIsr(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueOverwriteFromIsr, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueReceive(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueReceive, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueReceiveFromIsr(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueReceiveFromIsr, PackedPayload::Pair([e.queue_id, e.len_after]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueReset(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueReset, PackedPayload::Word(e.queue_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::CurtaskBlockOnQueuePeek(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSCurtaskBlockOnQueuePeek, PackedPayload::Pair([e.queue_id, e.ticks_to_wait]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::CurtaskBlockOnQueueSend(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSCurtaskBlockOnQueueSend, PackedPayload::Pair([e.queue_id, e.ticks_to_wait]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(e),
+                ..
+            }) => {
+                Ok((PackedKind::FreeRTOSCurtaskBlockOnQueueReceive, PackedPayload::Pair([e.queue_id, e.ticks_to_wait])))
+            }
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::QueueCurLength(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSQueueCurLength, PackedPayload::Pair([e.queue_id, e.length]))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskEvtmarker(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskEvtmarker, PackedPayload::Str(e.evtmarker_id, e.msg))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskEvtmarkerBegin(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskEvtmarkerBegin, PackedPayload::Str(e.evtmarker_id, e.msg))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskEvtmarkerEnd(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskEvtmarkerEnd, PackedPayload::Word(e.evtmarker_id))),
+            RawEvt::FreeRTOS(FreeRTOSEvt {
+                kind: FreeRTOSEvtKind::TaskValmarker(e),
+                ..
+            }) => Ok((PackedKind::FreeRTOSTaskValmarker, PackedPayload::Val(e.valmarker_id, e.val))),
+            evt => Err(evt),
+        }
+    }
+
+    /// Rebuild an event from its timestamp, and the kind and fields returned by [`RawEvt::pack`].
+    pub fn unpack(kind: PackedKind, ts: u64, payload: PackedPayload) -> RawEvt {
+        match (kind, payload) {
+            (PackedKind::BaseCoreId, PackedPayload::Word(core_id)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::CoreId(BaseCoreIdEvt { core_id }),
+            }),
+            (PackedKind::BaseDroppedEvtCnt, PackedPayload::Word(cnt)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::DroppedEvtCnt(BaseDroppedEvtCntEvt { cnt }),
+            }),
+            (PackedKind::BaseIsrName, PackedPayload::Str(isr_id, name)) => {
+                RawEvt::BaseMetadata(BaseMetadataEvt::IsrName(BaseIsrNameEvt { isr_id, name }))
+            }
+            (PackedKind::BaseIsrEnter, PackedPayload::Word(isr_id)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::IsrEnter(BaseIsrEnterEvt { isr_id }),
+            }),
+            (PackedKind::BaseIsrExit, PackedPayload::Word(isr_id)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::IsrExit(BaseIsrExitEvt { isr_id }),
+            }),
+            (PackedKind::BaseEvtmarkerName, PackedPayload::Str(evtmarker_id, name)) => {
+                RawEvt::BaseMetadata(BaseMetadataEvt::EvtmarkerName(BaseEvtmarkerNameEvt { evtmarker_id, name }))
+            }
+            (PackedKind::BaseEvtmarker, PackedPayload::Str(evtmarker_id, msg)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::Evtmarker(BaseEvtmarkerEvt { evtmarker_id, msg }),
+            }),
+            (PackedKind::BaseEvtmarkerBegin, PackedPayload::Str(evtmarker_id, msg)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::EvtmarkerBegin(BaseEvtmarkerBeginEvt { evtmarker_id, msg }),
+            }),
+            (PackedKind::BaseEvtmarkerEnd, PackedPayload::Word(evtmarker_id)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::EvtmarkerEnd(BaseEvtmarkerEndEvt { evtmarker_id }),
+            }),
+            (PackedKind::BaseValmarkerName, PackedPayload::Str(valmarker_id, name)) => {
+                RawEvt::BaseMetadata(BaseMetadataEvt::ValmarkerName(BaseValmarkerNameEvt { valmarker_id, name }))
+            }
+            (PackedKind::BaseValmarker, PackedPayload::Val(valmarker_id, val)) => RawEvt::Base(BaseEvt {
+                ts,
+                kind: BaseEvtKind::Valmarker(BaseValmarkerEvt { valmarker_id, val }),
+            }),
+            (PackedKind::FreeRTOSTaskStackHighWaterMark, PackedPayload::Pair([task_id, min_free_bytes])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskStackHighWaterMark(FreeRTOSTaskStackHighWaterMarkEvt {
+                        task_id,
+                        min_free_bytes,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSHeapMalloc, PackedPayload::Heap(addr, size)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::HeapMalloc(FreeRTOSHeapMallocEvt { addr, size }),
+            }),
+            (PackedKind::FreeRTOSHeapFree, PackedPayload::Heap(addr, size)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::HeapFree(FreeRTOSHeapFreeEvt { addr, size }),
+            }),
+            (PackedKind::FreeRTOSTaskSwitchedIn, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSTaskToRdyState, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskToRdyState(FreeRTOSTaskToRdyStateEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSTaskResumed, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskResumed(FreeRTOSTaskResumedEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSTaskResumedFromIsr, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskResumedFromIsr(FreeRTOSTaskResumedFromIsrEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSTaskSuspended, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskSuspended(FreeRTOSTaskSuspendedEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSCurtaskDelay, PackedPayload::Word(ticks)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::CurtaskDelay(FreeRTOSCurtaskDelayEvt { ticks }),
+            }),
+            (PackedKind::FreeRTOSCurtaskDelayUntil, PackedPayload::Word(time_to_wake)) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::CurtaskDelayUntil(FreeRTOSCurtaskDelayUntilEvt { time_to_wake }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskPrioritySet, PackedPayload::Pair([task_id, priority])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskPrioritySet(FreeRTOSTaskPrioritySetEvt { task_id, priority }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskPriorityInherit, PackedPayload::Pair([task_id, priority])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskPriorityInherit(FreeRTOSTaskPriorityInheritEvt { task_id, priority }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskPriorityDisinherit, PackedPayload::Pair([task_id, priority])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskPriorityDisinherit(FreeRTOSTaskPriorityDisinheritEvt {
+                        task_id,
+                        priority,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskCreated, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSTaskName, PackedPayload::Str(task_id, name)) => {
+                RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskName(FreeRTOSTaskNameEvt { task_id, name }))
+            }
+            (PackedKind::FreeRTOSTaskIsIdleTask, PackedPayload::Pair([task_id, core_id])) => {
+                RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsIdleTask(FreeRTOSTaskIsIdleTaskEvt {
+                    task_id,
+                    core_id,
+                }))
+            }
+            (PackedKind::FreeRTOSTaskIsTimerTask, PackedPayload::Word(task_id)) => {
+                RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsTimerTask(FreeRTOSTaskIsTimerTaskEvt { task_id }))
+            }
+            (PackedKind::FreeRTOSTaskDeleted, PackedPayload::Word(task_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::TaskDeleted(FreeRTOSTaskDeletedEvt { task_id }),
+            }),
+            (PackedKind::FreeRTOSQueueCreated, PackedPayload::Word(queue_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::QueueCreated(FreeRTOSQueueCreatedEvt { queue_id }),
+            }),
+            (PackedKind::FreeRTOSQueueName, PackedPayload::Str(queue_id, name)) => {
+                RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::QueueName(FreeRTOSQueueNameEvt { queue_id, name }))
+            }
+            (PackedKind::FreeRTOSQueueSend, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueSend(FreeRTOSQueueSendEvt { queue_id, len_after }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueSendFromIsr, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueSendFromIsr(FreeRTOSQueueSendFromIsrEvt { queue_id, len_after }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueOverwrite, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueOverwrite(FreeRTOSQueueOverwriteEvt { queue_id, len_after }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueOverwriteFromIsr, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueOverwriteFromIsr(FreeRTOSQueueOverwriteFromIsrEvt {
+                        queue_id,
+                        len_after,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueReceive, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueReceive(FreeRTOSQueueReceiveEvt { queue_id, len_after }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueReceiveFromIsr, PackedPayload::Pair([queue_id, len_after])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueReceiveFromIsr(FreeRTOSQueueReceiveFromIsrEvt { queue_id, len_after }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueReset, PackedPayload::Word(queue_id)) => RawEvt::FreeRTOS(FreeRTOSEvt {
+                ts,
+                kind: FreeRTOSEvtKind::QueueReset(FreeRTOSQueueResetEvt { queue_id }),
+            }),
+            (PackedKind::FreeRTOSCurtaskBlockOnQueuePeek, PackedPayload::Pair([queue_id, ticks_to_wait])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::CurtaskBlockOnQueuePeek(FreeRTOSCurtaskBlockOnQueuePeekEvt {
+                        queue_id,
+                        ticks_to_wait,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSCurtaskBlockOnQueueSend, PackedPayload::Pair([queue_id, ticks_to_wait])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::CurtaskBlockOnQueueSend(FreeRTOSCurtaskBlockOnQueueSendEvt {
+                        queue_id,
+                        ticks_to_wait,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSCurtaskBlockOnQueueReceive, PackedPayload::Pair([queue_id, ticks_to_wait])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(FreeRTOSCurtaskBlockOnQueueReceiveEvt {
+                        queue_id,
+                        ticks_to_wait,
+                    }),
+                })
+            }
+            (PackedKind::FreeRTOSQueueCurLength, PackedPayload::Pair([queue_id, length])) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::QueueCurLength(FreeRTOSQueueCurLengthEvt { queue_id, length }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskEvtmarker, PackedPayload::Str(evtmarker_id, msg)) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskEvtmarker(FreeRTOSTaskEvtmarkerEvt { evtmarker_id, msg }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskEvtmarkerBegin, PackedPayload::Str(evtmarker_id, msg)) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskEvtmarkerBegin(FreeRTOSTaskEvtmarkerBeginEvt { evtmarker_id, msg }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskEvtmarkerEnd, PackedPayload::Word(evtmarker_id)) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskEvtmarkerEnd(FreeRTOSTaskEvtmarkerEndEvt { evtmarker_id }),
+                })
+            }
+            (PackedKind::FreeRTOSTaskValmarker, PackedPayload::Val(valmarker_id, val)) => {
+                RawEvt::FreeRTOS(FreeRTOSEvt {
+                    ts,
+                    kind: FreeRTOSEvtKind::TaskValmarker(FreeRTOSTaskValmarkerEvt { valmarker_id, val }),
+                })
+            }
+            (kind, payload) => panic!("Invalid payload {payload:?} for packed event kind {kind:?}."),
+        }
+    }
+}
@@ -1,6 +1,11 @@
 mod cobs;
 pub mod evts;
 
+use std::{
+    collections::HashSet,
+    sync::{Arc, Mutex},
+};
+
 use anyhow::anyhow;
 use log::warn;
 
@@ -9,7 +14,62 @@ use crate::decode::evts::InvalidEvt;
 use self::evts::{RawEvt, TraceMode};
 
 pub fn decode_frame(input: &[u8], mode: TraceMode) -> anyhow::Result<RawEvt> {
-    RawEvt::decode(&cobs::cobs_decode_frame(input)?, mode)
+    RawEvt::decode(&cobs::cobs_decode_frame(input)?, mode, &mut StringTable::new())
+}
+
+/// Interned strings of decoded events.
+///
+/// Marker messages and object names are usually repeated many times in a trace. Interning them
+/// means every distinct string is only allocated once, and copying an event is cheap.
+#[derive(Debug, Clone, Default)]
+pub struct StringTable {
+    strings: HashSet<Arc<str>>,
+    /// Table shared by all decoders that decode parts of the same input in parallel. Strings not
+    /// yet in this table are interned there, so that all parts use the same allocation.
+    shared: Option<Arc<Mutex<HashSet<Arc<str>>>>>,
+}
+
+impl StringTable {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Table of a decoder running in parallel to others, that interns all new strings into `shared`.
+    fn with_shared(shared: Arc<Mutex<HashSet<Arc<str>>>>) -> Self {
+        Self {
+            strings: HashSet::new(),
+            shared: Some(shared),
+        }
+    }
+
+    pub fn intern(&mut self, s: &str) -> Arc<str> {
+        if let Some(interned) = self.strings.get(s) {
+            return interned.clone();
+        }
+        let interned = match &self.shared {
+            Some(shared) => intern_into(&mut shared.lock().unwrap(), s),
+            None => Arc::from(s),
+        };
+        self.strings.insert(interned.clone());
+        interned
+    }
+
+    pub fn len(&self) -> usize {
+        self.strings.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.strings.is_empty()
+    }
+}
+
+fn intern_into(strings: &mut HashSet<Arc<str>>, s: &str) -> Arc<str> {
+    if let Some(interned) = strings.get(s) {
+        return interned.clone();
+    }
+    let interned: Arc<str> = Arc::from(s);
+    strings.insert(interned.clone());
+    interned
 }
 
 fn bytes_left(evt_buf: &[u8], current_idx: usize) -> bool {
@@ -113,21 +173,30 @@ fn decode_s64(evt_buf: &[u8], current_idx: &mut usize) -> anyhow::Result<i64> {
     }
 }
 
-fn decode_string(evt_buf: &[u8], current_idx: &mut usize) -> anyhow::Result<String> {
+fn decode_string(evt_buf: &[u8], current_idx: &mut usize, strings: &mut StringTable) -> anyhow::Result<Arc<str>> {
     if !bytes_left(evt_buf, *current_idx) {
-        Ok(String::new())
+        Ok(strings.intern(""))
     } else {
-        let result = String::from_utf8(evt_buf[*current_idx..].to_vec())?;
+        let result = strings.intern(std::str::from_utf8(&evt_buf[*current_idx..])?);
         *current_idx = evt_buf.len();
         Ok(result)
     }
 }
 
+/// Inputs are only split up for parallel decoding if every thread gets at least this many bytes.
+const PARALLEL_MIN_BYTES_PER_THREAD: usize = 256 * 1024;
+
 #[derive(Debug, Clone)]
 pub struct StreamDecoder {
     mode: TraceMode,
+    /// Start of a frame that was not yet terminated at the end of the last input chunk.
     frame_buf: Vec<u8>,
+    /// Scratch buffer that frames are COBS-decoded into, re-used for all frames.
+    decode_buf: Vec<u8>,
+    strings: StringTable,
     last_ts: Option<u64>,
+    /// Maximum number of threads used to decode a single input chunk.
+    threads: usize,
 }
 
 impl StreamDecoder {
@@ -135,26 +204,137 @@ impl StreamDecoder {
         StreamDecoder {
             mode,
             frame_buf: vec![],
+            decode_buf: vec![],
+            strings: StringTable::new(),
             last_ts: None,
+            threads: std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1),
         }
     }
 
+    /// Limit the number of threads used to decode a single input chunk. Set to 1 to disable
+    /// parallel decoding.
+    pub fn set_thread_count(&mut self, threads: usize) {
+        self.threads = usize::max(threads, 1);
+    }
+
     pub fn process_binary(&mut self, input: &[u8]) -> Vec<RawEvt> {
+        let parts = usize::min(self.threads, input.len() / PARALLEL_MIN_BYTES_PER_THREAD);
+        if parts > 1 {
+            self.process_binary_parallel(input, parts)
+        } else {
+            self.process_binary_sequential(input)
+        }
+    }
+
+    fn process_binary_sequential(&mut self, input: &[u8]) -> Vec<RawEvt> {
+        let mut result = vec![];
+        let mut rest = input;
+
+        while let Some(delim_idx) = memchr::memchr(0, rest) {
+            let frame = &rest[..=delim_idx];
+            rest = &rest[delim_idx + 1..];
+
+            if self.frame_buf.is_empty() {
+                // Frame is contained in this chunk: Decode it directly from the input.
+                result.push(self.process_full_frame(frame));
+            } else {
+                // Frame started in a previous chunk:
+                let mut frame_buf = std::mem::take(&mut self.frame_buf);
+                frame_buf.extend_from_slice(frame);
+                result.push(self.process_full_frame(&frame_buf));
+                frame_buf.clear();
+                self.frame_buf = frame_buf;
+            }
+        }
+
+        self.frame_buf.extend_from_slice(rest);
+
+        result
+    }
+
+    /// Split the input at frame delimiters into (up to) `parts` parts, and decode them
+    /// concurrently. The result is identical to decoding the input sequentially.
+    fn process_binary_parallel(&mut self, input: &[u8], parts: usize) -> Vec<RawEvt> {
         let mut result = vec![];
+        let mut rest = input;
+
+        // Finish the frame started in a previous chunk sequentially:
+        if !self.frame_buf.is_empty() {
+            let Some(delim_idx) = memchr::memchr(0, rest) else {
+                self.frame_buf.extend_from_slice(rest);
+                return result;
+            };
+            result = self.process_binary_sequential(&rest[..=delim_idx]);
+            rest = &rest[delim_idx + 1..];
+        }
+
+        // Keep the unfinished frame at the end for the next chunk:
+        let Some(last_delim_idx) = memchr::memrchr(0, rest) else {
+            self.frame_buf.extend_from_slice(rest);
+            return result;
+        };
+        let (mut frames, trailing) = rest.split_at(last_delim_idx + 1);
+
+        let mut chunks = vec![];
+        while chunks.len() + 1 < parts && !frames.is_empty() {
+            let target = frames.len() / (parts - chunks.len());
+            // The last byte is always a delimiter:
+            let delim_idx = target + memchr::memchr(0, &frames[target..]).unwrap();
+            let (chunk, remainder) = frames.split_at(delim_idx + 1);
+            chunks.push(chunk);
+            frames = remainder;
+        }
+        if !frames.is_empty() {
+            chunks.push(frames);
+        }
 
-        for byte in input {
-            self.frame_buf.push(*byte);
-            if *byte == 0 {
-                result.push(self.process_full_frame());
-                self.frame_buf.clear();
+        // All workers intern their strings into the table of this decoder, so that the same string
+        // decoded by different workers is the same allocation:
+        let shared = Arc::new(Mutex::new(std::mem::take(&mut self.strings.strings)));
+        let decoded: Vec<Vec<RawEvt>> = std::thread::scope(|s| {
+            let workers: Vec<_> = chunks
+                .iter()
+                .map(|chunk| {
+                    let mut decoder = StreamDecoder {
+                        mode: self.mode,
+                        frame_buf: vec![],
+                        decode_buf: vec![],
+                        strings: StringTable::with_shared(shared.clone()),
+                        last_ts: None,
+                        threads: 1,
+                    };
+                    s.spawn(move || decoder.process_binary_sequential(chunk))
+                })
+                .collect();
+
+            workers
+                .into_iter()
+                .map(|worker| worker.join().expect("Decoder thread panicked."))
+                .collect()
+        });
+        self.strings.strings = Arc::into_inner(shared).unwrap().into_inner().unwrap();
+
+        // Every worker starts without knowing the last timestamp. Invalid events before the first
+        // timestamp of a part get the last timestamp of the previous parts, as they would have
+        // when decoding sequentially:
+        for mut evts in decoded {
+            for evt in &mut evts {
+                if let RawEvt::Invalid(InvalidEvt { ts: ts @ None, .. }) = evt {
+                    *ts = self.last_ts;
+                } else if let Some(ts) = evt.ts() {
+                    self.last_ts = Some(ts);
+                }
             }
+            result.extend(evts);
         }
 
+        self.frame_buf.extend_from_slice(trailing);
+
         result
     }
 
-    fn process_full_frame(&mut self) -> RawEvt {
-        if self.frame_buf.len() == 1 && self.frame_buf[0] == 0 {
+    fn process_full_frame(&mut self, frame: &[u8]) -> RawEvt {
+        if frame.len() == 1 && frame[0] == 0 {
             warn!("Empty COBS frame. Ignoring.");
             return RawEvt::Invalid(InvalidEvt {
                 ts: self.last_ts,
@@ -162,7 +342,10 @@ impl StreamDecoder {
             });
         }
 
-        match decode_frame(&self.frame_buf, self.mode) {
+        let decoded = cobs::cobs_decode_frame_into(frame, &mut self.decode_buf)
+            .and_then(|_| RawEvt::decode(&self.decode_buf, self.mode, &mut self.strings));
+
+        match decoded {
             Ok(evt) => {
                 if let Some(new_ts) = evt.ts() {
                     self.last_ts = Some(new_ts);
@@ -281,12 +464,133 @@ mod tests {
         decode_s64(&[0xFF, 0xFF, 0xFF, 0xFF], &mut 0).unwrap_err();
     }
 
+    #[test]
+    fn test_stream_decoder_chunking() {
+        let mut input = vec![0x08, 0x55, 0xa3, 0x8d, 0xe3, 0x04, 0xab, 0x04, 0x00];
+        input.push(0x00);
+        input.extend([0x05, 0x01, 0x00]);
+        input.extend([0x09, 0x5d, 0xfc, 0x80, 0xfe, 0xc1, 0x04, 0x65, 0x2a, 0x00]);
+        input.extend([0x08, 0x55]);
+
+        let mut decoder = StreamDecoder::new(TraceMode::FreeRTOS);
+        let evts = decoder.process_binary(&input);
+        assert!(matches!(evts[0], RawEvt::FreeRTOS(_)));
+        assert!(matches!(evts[1], RawEvt::Invalid(_)));
+        assert!(matches!(evts[2], RawEvt::Invalid(_)));
+        assert!(matches!(evts[3], RawEvt::FreeRTOS(_)));
+        let expected = format!("{evts:?}");
+        assert_eq!(decoder.get_bytes_in_buffer(), 2);
+
+        for chunk_size in 1..input.len() {
+            let mut decoder = StreamDecoder::new(TraceMode::FreeRTOS);
+            let mut evts = vec![];
+            for chunk in input.chunks(chunk_size) {
+                evts.extend(decoder.process_binary(chunk));
+            }
+            assert_eq!(format!("{evts:?}"), expected);
+            assert_eq!(decoder.get_bytes_in_buffer(), 2);
+        }
+    }
+
+    #[test]
+    fn test_stream_decoder_parallel() {
+        let mut input = vec![0x00, 0x05, 0x01, 0x00]; // Invalid events before first timestamp
+        for i in 0..200u8 {
+            let ts = i & 0x7F;
+            input.extend([0x06, 0x07, ts | 0x80, 0x01, 0x01, b'a' + (i % 3), 0x00]); // Event marker
+            if i % 7 == 0 {
+                input.extend([0x05, 0x01, 0x00]); // Invalid event
+            }
+            if i % 11 == 0 {
+                input.push(0x00); // Empty frame
+            }
+        }
+        input.extend([0x06, 0x07]); // Unfinished frame
+
+        for split in [0, 1, 5, 100] {
+            let mut decoder = StreamDecoder::new(TraceMode::Base);
+            let mut expected = decoder.process_binary_sequential(&input[..split]);
+            expected.extend(decoder.process_binary_sequential(&input[split..]));
+            let expected = format!("{expected:?}");
+
+            for parts in 2..10 {
+                let mut decoder = StreamDecoder::new(TraceMode::Base);
+                let mut evts = decoder.process_binary_parallel(&input[..split], parts);
+                evts.extend(decoder.process_binary_parallel(&input[split..], parts));
+                assert_eq!(format!("{evts:?}"), expected);
+                assert_eq!(decoder.get_bytes_in_buffer(), 2);
+                assert_eq!(decoder.strings.len(), 3);
+            }
+        }
+    }
+
+    #[test]
+    fn test_stream_decoder_interns_strings() {
+        use crate::decode::evts::*;
+
+        let input = [
+            0x06, 0x07, 0x05, 0x01, b'h', b'i', 0x00, // Event marker 'hi' at ts 5
+            0x06, 0x07, 0x06, 0x01, b'h', b'i', 0x00, // Event marker 'hi' at ts 6
+        ];
+        let mut decoder = StreamDecoder::new(TraceMode::Base);
+        let evts = decoder.process_binary(&input);
+
+        let msgs: Vec<_> = evts
+            .iter()
+            .map(|evt| match evt {
+                RawEvt::Base(BaseEvt {
+                    kind: BaseEvtKind::Evtmarker(evt),
+                    ..
+                }) => evt.msg.clone(),
+                _ => panic!("Wrong event."),
+            })
+            .collect();
+        assert_eq!(&*msgs[0], "hi");
+        assert!(Arc::ptr_eq(&msgs[0], &msgs[1]));
+        assert_eq!(decoder.strings.len(), 1);
+    }
+
+    #[test]
+    fn test_stream_decoder_parallel_interns_strings() {
+        use crate::decode::evts::*;
+
+        let mut input = vec![];
+        for i in 0..200u8 {
+            let ts = i & 0x7F;
+            input.extend([0x06, 0x07, ts | 0x80, 0x01, 0x01, b'a' + (i % 3), 0x00]);
+            // Event marker
+        }
+
+        let mut decoder = StreamDecoder::new(TraceMode::Base);
+        decoder.strings.intern("b");
+        let evts = decoder.process_binary_parallel(&input, 8);
+        let msgs: Vec<_> = evts
+            .iter()
+            .map(|evt| match evt {
+                RawEvt::Base(BaseEvt {
+                    kind: BaseEvtKind::Evtmarker(evt),
+                    ..
+                }) => evt.msg.clone(),
+                _ => panic!("Wrong event."),
+            })
+            .collect();
+
+        // Strings decoded by different workers, or interned before, are the same allocation:
+        assert_eq!(msgs.len(), 200);
+        for (idx, msg) in msgs.iter().enumerate() {
+            assert!(Arc::ptr_eq(msg, &msgs[idx % 3]));
+        }
+        assert_eq!(decoder.strings.len(), 3);
+        assert!(Arc::ptr_eq(&decoder.strings.intern("a"), &msgs[0]));
+        assert!(Arc::ptr_eq(&decoder.strings.intern("b"), &msgs[1]));
+    }
+
     #[test]
     fn test_decode_freertos_task_to_ready() {
         use crate::decode::evts::*;
 
         let buf = [0x55, 0xa3, 0x8d, 0xe3, 0x04, 0xab, 0x04];
-        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS).unwrap();
+        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS, &mut StringTable::new()).unwrap();
 
         let RawEvt::FreeRTOS(evt) = evt else {
             panic!("Wrong event class.");
@@ -303,7 +607,7 @@ mod tests {
         use crate::decode::evts::*;
 
         let buf = [0x5d, 0xfc, 0x80, 0xfe, 0xc1, 0x04, 0x65, 0x2a];
-        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS).unwrap();
+        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS, &mut StringTable::new()).unwrap();
 
         let RawEvt::FreeRTOS(evt) = evt else {
             panic!("Wrong event class.");
@@ -321,7 +625,7 @@ mod tests {
         use crate::decode::evts::*;
 
         let buf = [0x64, 0x65, 0x74, 0x65, 0x73, 0x74, 0x31, 0x32, 0x31, 0x32];
-        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS).unwrap();
+        let evt = RawEvt::decode(&buf, TraceMode::FreeRTOS, &mut StringTable::new()).unwrap();
 
         let RawEvt::FreeRTOSMetadata(evt) = evt else {
             panic!("Wrong event class.");
@@ -330,6 +634,6 @@ mod tests {
             panic!("Wrong event.");
         };
         assert_eq!(evt.queue_id, 101);
-        assert_eq!(evt.name, String::from("test1212"));
+        assert_eq!(&*evt.name, "test1212");
     }
 }
@@ -11,9 +11,25 @@ pub trait NewWithId {
     fn new(id: usize) -> Self;
 }
 
-pub struct ObjectMap<T>(pub BTreeMap<usize, T>)
+/// Registry of trace objects by ID.
+///
+/// Most IDs are allocated densely (such as task and queue IDs), so objects are stored in a vector
+/// indexed by their ID. IDs that are much larger than the number of objects (such as user-chosen
+/// marker IDs) are kept in a sparse map instead, so that memory use stays proportional to the
+/// number of objects. Objects are always iterated in order of ascending ID.
+pub struct ObjectMap<T>
 where
-    T: NewWithId;
+    T: NewWithId,
+{
+    /// Objects with an ID below `dense.len()`, indexed by ID.
+    dense: Vec<Option<T>>,
+    /// Objects with an ID of at least `dense.len()`.
+    sparse: BTreeMap<usize, T>,
+    len: usize,
+}
+
+/// IDs below this are always stored densely.
+const OBJECT_MAP_MIN_DENSE_LEN: usize = 64;
 
 impl<T> Default for ObjectMap<T>
 where
@@ -29,27 +45,145 @@ where
     T: NewWithId,
 {
     pub fn new() -> Self {
-        ObjectMap(BTreeMap::new())
+        ObjectMap {
+            dense: vec![],
+            sparse: BTreeMap::new(),
+            len: 0,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
     }
 
     pub fn get(&self, id: usize) -> Option<&T> {
-        self.0.get(&id)
+        match self.dense.get(id) {
+            Some(slot) => slot.as_ref(),
+            None => self.sparse.get(&id),
+        }
     }
 
     pub fn get_mut(&mut self, id: usize) -> Option<&mut T> {
-        self.0.get_mut(&id)
+        match self.dense.get_mut(id) {
+            Some(slot) => slot.as_mut(),
+            None => self.sparse.get_mut(&id),
+        }
     }
 
     pub fn get_or_create(&mut self, id: usize) -> &T {
-        self.0.entry(id).or_insert_with(|| T::new(id))
+        self.get_mut_or_create(id)
     }
 
     pub fn get_mut_or_create(&mut self, id: usize) -> &mut T {
-        self.0.entry(id).or_insert_with(|| T::new(id))
+        // Grow the dense storage as long as at least half of it would be in use:
+        if id >= self.dense.len() && id < usize::max(OBJECT_MAP_MIN_DENSE_LEN, 2 * (self.len + 1)) {
+            self.grow_dense(id + 1);
+        }
+
+        if let Some(slot) = self.dense.get_mut(id) {
+            if slot.is_none() {
+                self.len += 1;
+            }
+            return slot.get_or_insert_with(|| T::new(id));
+        }
+
+        match self.sparse.entry(id) {
+            btree_map::Entry::Occupied(entry) => entry.into_mut(),
+            btree_map::Entry::Vacant(entry) => {
+                self.len += 1;
+                entry.insert(T::new(id))
+            }
+        }
     }
 
     pub fn ensure_exists(&mut self, id: usize) {
-        self.0.entry(id).or_insert_with(|| T::new(id));
+        self.get_mut_or_create(id);
+    }
+
+    pub fn iter(&self) -> Iter<'_, T> {
+        Iter {
+            dense: self.dense.iter().enumerate(),
+            sparse: self.sparse.iter(),
+        }
+    }
+
+    pub fn iter_mut(&mut self) -> IterMut<'_, T> {
+        IterMut {
+            dense: self.dense.iter_mut().enumerate(),
+            sparse: self.sparse.iter_mut(),
+        }
+    }
+
+    pub fn values(&self) -> impl Iterator<Item = &T> {
+        self.iter().map(|(_, obj)| obj)
+    }
+
+    /// Extend the dense storage to `len` IDs, and move all objects with a smaller ID into it.
+    fn grow_dense(&mut self, len: usize) {
+        self.dense.resize_with(len, || None);
+
+        let sparse = self.sparse.split_off(&len);
+        for (id, obj) in std::mem::replace(&mut self.sparse, sparse) {
+            self.dense[id] = Some(obj);
+        }
+    }
+}
+
+pub struct Iter<'a, T> {
+    dense: std::iter::Enumerate<std::slice::Iter<'a, Option<T>>>,
+    sparse: btree_map::Iter<'a, usize, T>,
+}
+
+impl<'a, T> Iterator for Iter<'a, T> {
+    type Item = (usize, &'a T);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        for (id, slot) in self.dense.by_ref() {
+            if let Some(obj) = slot {
+                return Some((id, obj));
+            }
+        }
+        self.sparse.next().map(|(id, obj)| (*id, obj))
+    }
+}
+
+pub struct IterMut<'a, T> {
+    dense: std::iter::Enumerate<std::slice::IterMut<'a, Option<T>>>,
+    sparse: btree_map::IterMut<'a, usize, T>,
+}
+
+impl<'a, T> Iterator for IterMut<'a, T> {
+    type Item = (usize, &'a mut T);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        for (id, slot) in self.dense.by_ref() {
+            if let Some(obj) = slot {
+                return Some((id, obj));
+            }
+        }
+        self.sparse.next().map(|(id, obj)| (*id, obj))
+    }
+}
+
+pub struct IntoIter<T> {
+    dense: std::iter::Enumerate<std::vec::IntoIter<Option<T>>>,
+    sparse: btree_map::IntoIter<usize, T>,
+}
+
+impl<T> Iterator for IntoIter<T> {
+    type Item = (usize, T);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        for (id, slot) in self.dense.by_ref() {
+            if let Some(obj) = slot {
+                return Some((id, obj));
+            }
+        }
+        self.sparse.next()
     }
 }
 
@@ -57,11 +191,11 @@ impl<'a, T> IntoIterator for &'a ObjectMap<T>
 where
     T: NewWithId,
 {
-    type Item = (&'a usize, &'a T);
-    type IntoIter = btree_map::Iter<'a, usize, T>;
+    type Item = (usize, &'a T);
+    type IntoIter = Iter<'a, T>;
 
     fn into_iter(self) -> Self::IntoIter {
-        self.0.iter()
+        self.iter()
     }
 }
 
@@ -69,11 +203,11 @@ impl<'a, T> IntoIterator for &'a mut ObjectMap<T>
 where
     T: NewWithId,
 {
-    type Item = (&'a usize, &'a mut T);
-    type IntoIter = btree_map::IterMut<'a, usize, T>;
+    type Item = (usize, &'a mut T);
+    type IntoIter = IterMut<'a, T>;
 
     fn into_iter(self) -> Self::IntoIter {
-        self.0.iter_mut()
+        self.iter_mut()
     }
 }
 
@@ -82,10 +216,13 @@ where
     T: NewWithId,
 {
     type Item = (usize, T);
-    type IntoIter = btree_map::IntoIter<usize, T>;
+    type IntoIter = IntoIter<T>;
 
     fn into_iter(self) -> Self::IntoIter {
-        self.0.into_iter()
+        IntoIter {
+            dense: self.dense.into_iter().enumerate(),
+            sparse: self.sparse.into_iter(),
+        }
     }
 }
 
@@ -118,4 +255,50 @@ impl<T> Timeseries<T> {
     pub fn push(&mut self, ts: u64, t: T) {
         self.0.push(Ts::new(ts, t));
     }
+
+    /// The last value recorded at or before `ts`.
+    pub fn value_at(&self, ts: u64) -> Option<&T> {
+        let idx = self.0.partition_point(|x| x.ts <= ts);
+        idx.checked_sub(1).map(|idx| &self.0[idx].inner)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    struct Obj(usize);
+
+    impl NewWithId for Obj {
+        fn new(id: usize) -> Self {
+            Obj(id)
+        }
+    }
+
+    #[test]
+    fn object_map() {
+        let mut map: ObjectMap<Obj> = ObjectMap::new();
+        for id in [3, 1_000_000, 1, 500, 3, 200] {
+            map.ensure_exists(id);
+        }
+        assert_eq!(map.len(), 5);
+        assert!(map.dense.len() < 200);
+
+        // Dense storage grows to include previously sparse IDs as the map fills up:
+        for id in 4..100 {
+            map.get_mut_or_create(id).0 += 1;
+        }
+        assert_eq!(map.len(), 101);
+        assert!(map.sparse.keys().all(|id| *id >= map.dense.len()));
+
+        let ids: Vec<_> = map.iter().map(|(id, obj)| (id, obj.0 - id)).collect();
+        let mut expected: Vec<_> = [1, 3, 200, 500, 1_000_000].into_iter().map(|id| (id, 0)).collect();
+        expected.extend((4..100).map(|id| (id, 1)));
+        expected.sort();
+        assert_eq!(ids, expected);
+
+        assert!(map.get(2).is_none());
+        assert_eq!(map.get(1_000_000).unwrap().0, 1_000_000);
+        assert_eq!(map.into_iter().map(|(id, _)| id).last(), Some(1_000_000));
+    }
 }
@@ -48,23 +48,19 @@ impl TraceConverter {
             BaseEvtKind::Evtmarker(evt) => {
                 let evtmarker_id = evt.evtmarker_id as usize;
                 let evtmarker = t.user_evt_markers.get_mut_or_create(evtmarker_id);
-                evtmarker
-                    .markers
-                    .push(ts, UserEvtMarker::Instant { msg: evt.msg.clone() })
+                evtmarker.push_marker(ts, UserEvtMarker::Instant { msg: evt.msg.clone() })
             }
 
             BaseEvtKind::EvtmarkerBegin(evt) => {
                 let evtmarker_id = evt.evtmarker_id as usize;
                 let evtmarker = t.user_evt_markers.get_mut_or_create(evtmarker_id);
-                evtmarker
-                    .markers
-                    .push(ts, UserEvtMarker::SliceBegin { msg: evt.msg.clone() })
+                evtmarker.push_marker(ts, UserEvtMarker::SliceBegin { msg: evt.msg.clone() })
             }
 
             BaseEvtKind::EvtmarkerEnd(evt) => {
                 let evtmarker_id = evt.evtmarker_id as usize;
                 let evtmarker = t.user_evt_markers.get_mut_or_create(evtmarker_id);
-                evtmarker.markers.push(ts, UserEvtMarker::SliceEnd)
+                evtmarker.push_marker(ts, UserEvtMarker::SliceEnd)
             }
 
             BaseEvtKind::Valmarker(evt) => {
@@ -99,39 +95,39 @@ impl TraceConverter {
                 let isr_id = evt.isr_id as usize;
                 let isr = t.core_mut(core_id).isrs.get_mut_or_create(isr_id);
                 if let Some(previous_name) = &mut isr.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!("[--METADATA--] Overiding isr #{isr_id} name from '{previous_name}' to '{}'.", evt.name);
                     }
                 }
-                isr.name = Some(evt.name.clone());
+                isr.name = Some(evt.name.to_string());
             }
 
             BaseMetadataEvt::EvtmarkerName(evt) => {
                 let evtmarker_id = evt.evtmarker_id as usize;
                 let evtmarker = t.user_evt_markers.get_mut_or_create(evtmarker_id);
                 if let Some(previous_name) = &evtmarker.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overiding Event Marker #{evtmarker_id} name from '{previous_name}' to '{}'.",
                             evt.name
                         );
                     }
                 }
-                evtmarker.name = Some(evt.name.clone());
+                evtmarker.name = Some(evt.name.to_string());
             }
 
             BaseMetadataEvt::ValmarkerName(evt) => {
                 let valmarker_id = evt.valmarker_id as usize;
                 let valmarker = t.user_val_markers.get_mut_or_create(valmarker_id);
                 if let Some(previous_name) = &valmarker.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overiding Value Marker #{valmarker_id} name from '{previous_name}' to '{}'.",
                             evt.name
                         );
                     }
                 }
-                valmarker.name = Some(evt.name.clone());
+                valmarker.name = Some(evt.name.to_string());
             }
         }
     }
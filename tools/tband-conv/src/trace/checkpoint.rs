@@ -0,0 +1,181 @@
+use std::collections::BTreeMap;
+
+use serde::{Deserialize, Serialize};
+
+use crate::{
+    freertos::FreeRTOSCheckpoint, ISRState, ObjectMap, Trace, UserEvtMarker, UserEvtMarkerTrace, UserValMarkerTrace,
+};
+
+/// Snapshot of the conversion state at a point in time.
+///
+/// Converting a trace can be started at a checkpoint instead of at the beginning of the trace,
+/// by restoring the checkpoint and then adding only the events from its timestamp on (see
+/// [`crate::convert::TraceConverter::restore_checkpoint`]). The checkpoint only holds the
+/// state that conversion depends on, and the current value of every object, but no history.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct ConverterCheckpoint {
+    /// The snapshot includes all events before this timestamp, and none after.
+    pub ts: u64,
+    pub ts_resolution_ns: Option<u64>,
+    dropped_evt_cnt: u32,
+    cores: Vec<CoreCheckpoint>,
+    user_evt_markers: BTreeMap<usize, EvtMarkerCheckpoint>,
+    user_val_markers: BTreeMap<usize, ValMarkerCheckpoint>,
+    freertos: FreeRTOSCheckpoint,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+struct CoreCheckpoint {
+    isrs: Vec<ISRCheckpoint>,
+    /// FreeRTOS task running on the core.
+    current_task_id: Option<usize>,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+struct ISRCheckpoint {
+    id: usize,
+    name: Option<String>,
+    active: bool,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub(crate) struct EvtMarkerCheckpoint {
+    name: Option<String>,
+    /// Messages of the slices that are open, outermost first.
+    open_slices: Vec<String>,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub(crate) struct ValMarkerCheckpoint {
+    name: Option<String>,
+    val: Option<i64>,
+}
+
+impl ConverterCheckpoint {
+    pub(crate) fn core_count(&self) -> usize {
+        self.cores.len()
+    }
+}
+
+impl Trace {
+    /// Take a checkpoint of the current conversion state. All events before `ts`, and none
+    /// after, must have been converted.
+    pub(crate) fn checkpoint(&self, ts: u64) -> ConverterCheckpoint {
+        let cores = self
+            .cores
+            .values()
+            .map(|core| CoreCheckpoint {
+                isrs: core
+                    .isrs
+                    .iter()
+                    .map(|(id, isr)| ISRCheckpoint {
+                        id,
+                        name: isr.name.clone(),
+                        active: matches!(isr.current_state, ISRState::Active),
+                    })
+                    .collect(),
+                current_task_id: core.freertos.current_task_id,
+            })
+            .collect();
+
+        ConverterCheckpoint {
+            ts,
+            ts_resolution_ns: self.ts_resolution_ns,
+            dropped_evt_cnt: self.dropped_evt_cnt,
+            cores,
+            user_evt_markers: evt_marker_checkpoints(&self.user_evt_markers),
+            user_val_markers: val_marker_checkpoints(&self.user_val_markers),
+            freertos: self.freertos.checkpoint(),
+        }
+    }
+
+    /// Restore the conversion state of a checkpoint into a newly created trace. The current
+    /// value of every object is recorded at the timestamp of the checkpoint.
+    pub(crate) fn restore_checkpoint(&mut self, cp: &ConverterCheckpoint) {
+        let ts = cp.ts;
+
+        self.ts_resolution_ns = cp.ts_resolution_ns;
+        self.dropped_evt_cnt = cp.dropped_evt_cnt;
+
+        for (core_id, core_cp) in cp.cores.iter().enumerate().take(self.core_count) {
+            let core = self.core_mut(core_id);
+            for isr_cp in &core_cp.isrs {
+                let isr = core.isrs.get_mut_or_create(isr_cp.id);
+                isr.name = isr_cp.name.clone();
+                if isr_cp.active {
+                    isr.state.push(ts, ISRState::Active);
+                    isr.current_state = ISRState::Active;
+                }
+            }
+            if let Some(task_id) = core_cp.current_task_id {
+                core.freertos.running_task.push(ts, task_id);
+                core.freertos.current_task_id = Some(task_id);
+            }
+        }
+
+        restore_evt_markers(ts, &mut self.user_evt_markers, &cp.user_evt_markers);
+        restore_val_markers(ts, &mut self.user_val_markers, &cp.user_val_markers);
+
+        self.freertos.restore_checkpoint(ts, &cp.freertos);
+    }
+}
+
+pub(crate) fn evt_marker_checkpoints(markers: &ObjectMap<UserEvtMarkerTrace>) -> BTreeMap<usize, EvtMarkerCheckpoint> {
+    markers
+        .iter()
+        .map(|(id, marker)| {
+            let cp = EvtMarkerCheckpoint {
+                name: marker.name.clone(),
+                open_slices: marker.open_slices.iter().map(|msg| msg.to_string()).collect(),
+            };
+            (id, cp)
+        })
+        .collect()
+}
+
+pub(crate) fn val_marker_checkpoints(markers: &ObjectMap<UserValMarkerTrace>) -> BTreeMap<usize, ValMarkerCheckpoint> {
+    markers
+        .iter()
+        .map(|(id, marker)| {
+            let cp = ValMarkerCheckpoint {
+                name: marker.name.clone(),
+                val: marker.vals.0.last().map(|x| x.inner),
+            };
+            (id, cp)
+        })
+        .collect()
+}
+
+/// Restore event markers, re-opening every slice that was open at the checkpoint.
+pub(crate) fn restore_evt_markers(
+    ts: u64,
+    markers: &mut ObjectMap<UserEvtMarkerTrace>,
+    cps: &BTreeMap<usize, EvtMarkerCheckpoint>,
+) {
+    for (id, cp) in cps {
+        let marker = markers.get_mut_or_create(*id);
+        marker.name = cp.name.clone();
+        for msg in &cp.open_slices {
+            marker.push_marker(
+                ts,
+                UserEvtMarker::SliceBegin {
+                    msg: msg.as_str().into(),
+                },
+            );
+        }
+    }
+}
+
+pub(crate) fn restore_val_markers(
+    ts: u64,
+    markers: &mut ObjectMap<UserValMarkerTrace>,
+    cps: &BTreeMap<usize, ValMarkerCheckpoint>,
+) {
+    for (id, cp) in cps {
+        let marker = markers.get_mut_or_create(*id);
+        marker.name = cp.name.clone();
+        if let Some(val) = cp.val {
+            marker.vals.push(ts, val);
+        }
+    }
+}
@@ -1,28 +1,36 @@
+use std::sync::Arc;
+
 use crate::{
     decode::{
         evts::{BaseEvt, BaseEvtKind, InvalidEvt, RawEvt, TraceMode},
         StreamDecoder,
     },
-    Trace, TraceErrMarker, TraceEvtMarker,
+    ConverterCheckpoint, EvtStore, Trace, TraceErrMarker,
 };
 use anyhow::anyhow;
 use log::{debug, info, trace, warn};
 
-#[derive(Debug, Clone)]
-struct TraceEvt {
-    core_id: usize,
-    ts: Option<u64>,
-    kind: RawEvt,
-}
-
 // ==== Trace Converter ========================================================
 
+/// How often to take a checkpoint (see [`TraceConverter::convert_with_checkpoints_every`]).
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum CheckpointEvery {
+    /// Every given number of nanoseconds of trace time, starting at the first event.
+    Duration(u64),
+    /// Every given number of events with a timestamp.
+    Evts(usize),
+}
+
 pub struct TraceConverter {
     mode: TraceMode,
     core_count: usize,
     common_stream_decoder: StreamDecoder,
     core_stream_decoder: Vec<StreamDecoder>,
     evts: TraceEvtSequence,
+    /// Trace that is kept up to date by [`TraceConverter::convert_incremental`].
+    live: Option<Trace>,
+    /// Conversion state that every converted trace starts from.
+    checkpoint: Option<ConverterCheckpoint>,
 }
 
 impl TraceConverter {
@@ -30,6 +38,9 @@ impl TraceConverter {
         if core_count == 0 {
             return Err(anyhow!("Core count must be greater than 0."));
         }
+        if core_count > u16::MAX as usize + 1 {
+            return Err(anyhow!("Core count must not be greater than {}.", u16::MAX as usize + 1));
+        }
 
         Ok(TraceConverter {
             core_count,
@@ -37,12 +48,60 @@ impl TraceConverter {
             common_stream_decoder: StreamDecoder::new(mode),
             core_stream_decoder: Vec::from_iter(std::iter::repeat_n(StreamDecoder::new(mode), core_count)),
             evts: TraceEvtSequence::new(core_count),
+            live: None,
+            checkpoint: None,
         })
     }
 
+    /// Resume conversion from a checkpoint instead of from the start of the trace.
+    ///
+    /// Must be called before any events are added. Afterwards, only events from the timestamp of
+    /// the checkpoint on are converted. All others are dropped.
+    pub fn restore_checkpoint(&mut self, cp: ConverterCheckpoint) -> anyhow::Result<()> {
+        if self.evts.len() != 0 {
+            return Err(anyhow!("Cannot restore checkpoint after events have been added."));
+        }
+        if cp.core_count() != self.core_count {
+            return Err(anyhow!(
+                "Checkpoint is for a {}-core trace but trace converter was configured for {} cores!",
+                cp.core_count(),
+                self.core_count
+            ));
+        }
+
+        self.evts.start_ts = Some(cp.ts);
+        self.checkpoint = Some(cp);
+        Ok(())
+    }
+
+    /// Drop all events after the given timestamp.
+    pub fn set_end_ts(&mut self, ts: u64) {
+        self.evts.end_ts = Some(ts);
+    }
+
+    /// Set the core that events added with [`TraceConverter::add_binary`] are assigned to, until
+    /// the next core ID event. Needed to resume a multi-core stream in the middle.
+    pub fn set_current_core(&mut self, core_id: u32) -> anyhow::Result<()> {
+        if core_id as usize >= self.core_count {
+            return Err(anyhow!(
+                "Attempted to switch to core {} but trace converter was configure for {} cores!",
+                core_id,
+                self.core_count
+            ));
+        }
+
+        self.evts.current_core = core_id as usize;
+        Ok(())
+    }
+
+    /// Largest timestamp added to the given core so far.
+    pub fn core_max_ts(&self, core_id: u32) -> u64 {
+        self.evts.core_max_ts[core_id as usize]
+    }
+
     pub fn add_binary(&mut self, data: &[u8]) -> anyhow::Result<()> {
         let evts = self.common_stream_decoder.process_binary(data);
-        self.add_evts(&evts)
+        self.evts.add_evts(evts)
     }
 
     pub fn add_binary_to_core(&mut self, data: &[u8], core_id: u32) -> anyhow::Result<()> {
@@ -56,18 +115,55 @@ impl TraceConverter {
 
         let evts = self.core_stream_decoder[core_id as usize].process_binary(data);
 
-        self.add_evts_to_core(&evts, core_id)
+        self.evts.add_evts_to_core(evts, core_id)
     }
 
     pub fn add_evts(&mut self, evts: &[RawEvt]) -> anyhow::Result<()> {
-        self.evts.add_evts(evts)
+        self.evts.add_evts(evts.iter().cloned())
     }
 
     pub fn add_evts_to_core(&mut self, evts: &[RawEvt], core_id: u32) -> anyhow::Result<()> {
+        self.evts.add_evts_to_core(evts.iter().cloned(), core_id)
+    }
+
+    /// Like [`TraceConverter::add_evts`], for events that were decoded separately (such as on
+    /// another thread, using a [`StreamDecoder`]).
+    pub fn add_decoded_evts(&mut self, evts: Vec<RawEvt>) -> anyhow::Result<()> {
+        self.evts.add_evts(evts)
+    }
+
+    /// Like [`TraceConverter::add_evts_to_core`], for events that were decoded separately.
+    pub fn add_decoded_evts_to_core(&mut self, evts: Vec<RawEvt>, core_id: u32) -> anyhow::Result<()> {
         self.evts.add_evts_to_core(evts, core_id)
     }
 
     pub fn convert(&mut self) -> anyhow::Result<Trace> {
+        let (trace, _) = self.convert_all(None)?;
+        Ok(trace)
+    }
+
+    /// Like [`TraceConverter::convert`], but also take a checkpoint of the conversion state every
+    /// `interval_ns` nanoseconds of trace time, starting at the first event.
+    pub fn convert_with_checkpoints(&mut self, interval_ns: u64) -> anyhow::Result<(Trace, Vec<ConverterCheckpoint>)> {
+        self.convert_with_checkpoints_every(CheckpointEvery::Duration(interval_ns))
+    }
+
+    /// Like [`TraceConverter::convert_with_checkpoints`], but with checkpoints either every given
+    /// trace time or every given number of events.
+    pub fn convert_with_checkpoints_every(
+        &mut self,
+        every: CheckpointEvery,
+    ) -> anyhow::Result<(Trace, Vec<ConverterCheckpoint>)> {
+        if matches!(every, CheckpointEvery::Duration(0) | CheckpointEvery::Evts(0)) {
+            return Err(anyhow!("Checkpoint interval must be greater than 0."));
+        }
+        self.convert_all(Some(every))
+    }
+
+    fn convert_all(
+        &mut self,
+        checkpoint_every: Option<CheckpointEvery>,
+    ) -> anyhow::Result<(Trace, Vec<ConverterCheckpoint>)> {
         info!("Starting initial conversion for {}-core trace. Event count: {}.", self.core_count, self.evts.len());
 
         for (core_id, stream_decoder) in self.core_stream_decoder.iter().enumerate() {
@@ -84,37 +180,104 @@ impl TraceConverter {
         debug!("Number of events that can be processed: {}.", max_idx + 1);
         debug!("Number of events that can not be processed: {}.", self.evts.len() - max_idx - 1);
 
-        let mut trace = Trace::new(self.core_count, self.mode);
+        let mut trace = self.new_trace(self.evts.evts.clone(), max_idx + 1);
+        let mut checkpoints = vec![];
 
-        for evt_idx in 0..=max_idx {
-            let evt = &self.evts.evts[evt_idx];
-            let core_id = evt.core_id;
+        // Interval and timestamp of the next checkpoint, in trace timestamp units. Only known
+        // once the first timestamp is reached, after all metadata events:
+        let mut next_checkpoint: Option<(u64, u64)> = None;
 
-            self.generate_trace_event_marker(&mut trace, evt);
+        // Events converted since the last checkpoint, and timestamp of the last event:
+        let mut evts_since_checkpoint = 0;
+        let mut last_ts: Option<u64> = None;
 
-            match &evt.kind {
-                RawEvt::Invalid(evt) => self.convert_invalid_evt(&mut trace, core_id, evt),
-                RawEvt::Base(evt) => self.convert_base_evt(&mut trace, core_id, evt),
-                RawEvt::BaseMetadata(evt) => self.convert_base_metadata_evt(&mut trace, core_id, evt),
-                RawEvt::FreeRTOS(evt) => self.convert_freertos_evt(&mut trace, core_id, evt),
-                RawEvt::FreeRTOSMetadata(evt) => self.convert_freertos_metadata_evt(&mut trace, core_id, evt),
+        for evt_idx in 0..=max_idx {
+            let ts = self.evts.evts.ts(evt_idx);
+            match (checkpoint_every, ts) {
+                (Some(CheckpointEvery::Duration(interval_ns)), Some(ts)) => match next_checkpoint {
+                    None => {
+                        let interval = u64::max(interval_ns / trace.ts_resolution_ns.unwrap_or(1), 1);
+                        next_checkpoint = Some((interval, ts + interval));
+                    }
+                    Some((interval, checkpoint_ts)) if ts >= checkpoint_ts => {
+                        // Only take the latest checkpoint if there are no events for several intervals:
+                        let checkpoint_ts = checkpoint_ts + (ts - checkpoint_ts) / interval * interval;
+                        checkpoints.push(trace.checkpoint(checkpoint_ts));
+                        next_checkpoint = Some((interval, checkpoint_ts + interval));
+                    }
+                    Some(_) => (),
+                },
+                (Some(CheckpointEvery::Evts(evt_cnt)), Some(ts)) => {
+                    // All events before a checkpoint must have an earlier timestamp, so events
+                    // with the same timestamp are never split up:
+                    if evts_since_checkpoint >= evt_cnt && last_ts.is_some_and(|last_ts| ts > last_ts) {
+                        checkpoints.push(trace.checkpoint(ts));
+                        evts_since_checkpoint = 0;
+                    }
+                    evts_since_checkpoint += 1;
+                    last_ts = Some(ts);
+                }
+                _ => (),
             }
+
+            self.convert_evt(&mut trace, evt_idx);
         }
 
         if trace.ts_resolution_ns.is_none() {
             warn!("Trace did not include timestamp timer resolution - assuming 1ns.");
         }
 
-        Ok(trace)
+        Ok((trace, checkpoints))
     }
 
-    fn generate_trace_event_marker(&self, t: &mut Trace, e: &TraceEvt) {
-        if let Some(ts) = e.ts {
-            t.cores
-                .get_mut(&e.core_id)
-                .unwrap()
-                .evts
-                .push(ts, TraceEvtMarker(e.kind.clone()));
+    fn new_trace(&self, evts: Arc<EvtStore>, evt_count: usize) -> Trace {
+        let mut trace = Trace::new(self.core_count, self.mode, evts, evt_count);
+        if let Some(cp) = &self.checkpoint {
+            trace.restore_checkpoint(cp);
+        }
+        trace
+    }
+
+    /// Apply all events that became convertible since the last call to a trace that is kept
+    /// between calls, and return it.
+    ///
+    /// Unlike [`TraceConverter::convert`], every event is only converted once, which makes
+    /// repeatedly converting a growing trace (such as when monitoring a running target) linear in
+    /// the number of events. Events that were converted can no longer be reordered: Metadata
+    /// events that arrive later are converted after them instead of at the start of the trace.
+    pub fn convert_incremental(&mut self) -> anyhow::Result<&Trace> {
+        let mut trace = match self.live.take() {
+            Some(trace) => trace,
+            None => self.new_trace(Arc::new(EvtStore::new()), 0),
+        };
+
+        // Release the trace's reference to the events, so that new events can be merged in
+        // without copying all events:
+        trace.evts = Arc::new(EvtStore::new());
+
+        let end_idx = self.evts.convertable_evt_idx().map(|idx| idx + 1).unwrap_or(0);
+        debug!("Number of new events that can be processed: {}.", end_idx - trace.evt_count);
+
+        trace.evts = self.evts.evts.clone();
+        for evt_idx in trace.evt_count..end_idx {
+            self.convert_evt(&mut trace, evt_idx);
+        }
+        trace.evt_count = end_idx;
+        self.evts.sealed = end_idx;
+
+        Ok(self.live.insert(trace))
+    }
+
+    fn convert_evt(&self, trace: &mut Trace, evt_idx: usize) {
+        let evt = self.evts.evts.evt(evt_idx);
+        let core_id = self.evts.evts.core_id(evt_idx);
+
+        match &evt {
+            RawEvt::Invalid(evt) => self.convert_invalid_evt(trace, core_id, evt),
+            RawEvt::Base(evt) => self.convert_base_evt(trace, core_id, evt),
+            RawEvt::BaseMetadata(evt) => self.convert_base_metadata_evt(trace, core_id, evt),
+            RawEvt::FreeRTOS(evt) => self.convert_freertos_evt(trace, core_id, evt),
+            RawEvt::FreeRTOSMetadata(evt) => self.convert_freertos_metadata_evt(trace, core_id, evt),
         }
     }
 
@@ -130,23 +293,39 @@ impl TraceConverter {
 struct TraceEvtSequence {
     core_count: usize,
     current_core: usize,
-    evts: Vec<TraceEvt>,
+    /// All events, sorted by timestamp, as of the last conversion. Shared with the last trace
+    /// converted from this sequence.
+    evts: Arc<EvtStore>,
+    /// Events added since the last conversion, in order of arrival. Metadata events have no
+    /// timestamp and are queued separately, every other event is queued on its core. Every queue
+    /// is therefore sorted by timestamp.
+    pending_metadata: EvtStore,
+    pending: Vec<EvtStore>,
     core_max_ts: Vec<u64>,
+    /// Number of leading events that were converted incrementally. Pending events are only
+    /// merged into the events after them.
+    sealed: usize,
+    /// Events with a timestamp outside of this window are dropped.
+    start_ts: Option<u64>,
+    end_ts: Option<u64>,
 }
 
 impl TraceEvtSequence {
     fn new(core_count: usize) -> Self {
         TraceEvtSequence {
             current_core: 0,
-            evts: vec![],
+            evts: Arc::new(EvtStore::new()),
+            pending_metadata: EvtStore::new(),
+            pending: Vec::from_iter(std::iter::repeat_with(EvtStore::new).take(core_count)),
             core_count,
             core_max_ts: Vec::from_iter(std::iter::repeat_n(0, core_count)),
+            sealed: 0,
+            start_ts: None,
+            end_ts: None,
         }
     }
 
-    fn add_evts(&mut self, evts: &[RawEvt]) -> anyhow::Result<()> {
-        self.evts.reserve_exact(evts.len());
-
+    fn add_evts(&mut self, evts: impl IntoIterator<Item = RawEvt>) -> anyhow::Result<()> {
         for evt in evts {
             let ts = evt.ts();
 
@@ -183,29 +362,28 @@ impl TraceEvtSequence {
 
                 self.core_max_ts[self.current_core] = ts;
 
-                self.evts.push(TraceEvt {
-                    core_id: self.current_core,
-                    kind: evt.clone(),
-                    ts: Some(ts),
-                })
+                if !self.in_window(ts) {
+                    continue;
+                }
+                self.pending[self.current_core].push(self.current_core, evt);
             } else {
                 debug!("[-----??-----] [C{:01}] {:?}", self.current_core, evt);
-                self.evts.push(TraceEvt {
-                    core_id: self.current_core,
-                    kind: evt.clone(),
-                    ts: None,
-                })
+                self.pending_metadata.push(self.current_core, evt);
             }
         }
 
         Ok(())
     }
 
+    fn in_window(&self, ts: u64) -> bool {
+        self.start_ts.is_none_or(|start_ts| ts >= start_ts) && self.end_ts.is_none_or(|end_ts| ts <= end_ts)
+    }
+
     fn len(&self) -> usize {
-        self.evts.len()
+        self.evts.len() + self.pending_metadata.len() + self.pending.iter().map(|q| q.len()).sum::<usize>()
     }
 
-    fn add_evts_to_core(&mut self, evts: &[RawEvt], core_id: u32) -> anyhow::Result<()> {
+    fn add_evts_to_core(&mut self, evts: impl IntoIterator<Item = RawEvt>, core_id: u32) -> anyhow::Result<()> {
         let core_id = core_id as usize;
 
         if core_id >= self.core_count {
@@ -224,8 +402,30 @@ impl TraceEvtSequence {
         *self.core_max_ts.iter().min().unwrap()
     }
 
+    /// Merge all pending events into the sorted event store. Metadata events are sorted as if
+    /// they occurred at timestamp 0, but never before a sealed event.
+    ///
+    /// All pending events with a timestamp are newer than the sealed events, since those are at
+    /// most as new as the oldest event of any core. Events are therefore still ordered by
+    /// `ts <= limit` for any limit at least as new as the sealed events.
+    fn merge_pending(&mut self) {
+        if self.pending_metadata.is_empty() && self.pending.iter().all(|q| q.is_empty()) {
+            return;
+        }
+
+        let evts = Arc::make_mut(&mut self.evts);
+
+        // Already sorted events go first, so that events with the same timestamp stay in order
+        // of arrival on every core:
+        let mut stores = vec![evts.split_off(self.sealed)];
+        stores.push(std::mem::take(&mut self.pending_metadata));
+        stores.extend(self.pending.iter_mut().map(std::mem::take));
+
+        evts.append(EvtStore::merge(stores));
+    }
+
     fn convertable_evt_idx(&mut self) -> Option<usize> {
-        self.evts.sort_unstable_by_key(|x| x.ts.unwrap_or(0));
+        self.merge_pending();
 
         for (core_id, max_ts) in self.core_max_ts.iter().enumerate() {
             debug!("Largest timestamp on core {core_id}: {max_ts}.");
@@ -233,25 +433,9 @@ impl TraceEvtSequence {
 
         let conversion_timestamp_limit = self.max_shared_ts();
 
-        match self
-            .evts
-            .binary_search_by_key(&conversion_timestamp_limit, |x| x.ts.unwrap_or(0))
-        {
-            Ok(mut idx) => {
-                while (idx + 1 < self.evts.len()) && (self.evts[idx + 1].ts.unwrap_or(0) == conversion_timestamp_limit)
-                {
-                    idx += 1;
-                }
-                Some(idx)
-            }
-            Err(insert_idx) => {
-                if insert_idx == 0 {
-                    None
-                } else {
-                    Some(insert_idx - 1)
-                }
-            }
-        }
+        // Index of the first event after the limit:
+        let end_idx = self.evts.partition_point(|ts| ts <= conversion_timestamp_limit);
+        end_idx.checked_sub(1)
     }
 }
 
@@ -260,7 +444,14 @@ mod tests {
 
     use super::*;
 
-    use crate::decode::evts::{BaseCoreIdEvt, BaseEvt, BaseEvtKind, BaseIsrEnterEvt};
+    use crate::{
+        decode::evts::{
+            BaseCoreIdEvt, BaseEvt, BaseEvtKind, BaseEvtmarkerBeginEvt, BaseEvtmarkerEndEvt, BaseIsrEnterEvt,
+            BaseIsrExitEvt, BaseIsrNameEvt, BaseMetadataEvt, BaseValmarkerEvt,
+        },
+        generate_perfetto::PerfettoGenerator,
+        UserEvtMarker,
+    };
 
     fn dummy_core_id_evt(ts: u64, core_id: u32) -> RawEvt {
         RawEvt::Base(BaseEvt {
@@ -276,35 +467,51 @@ mod tests {
         })
     }
 
+    fn dummy_isr_evt(ts: u64, isr_id: u32, enter: bool) -> RawEvt {
+        let kind = if enter {
+            BaseEvtKind::IsrEnter(BaseIsrEnterEvt { isr_id })
+        } else {
+            BaseEvtKind::IsrExit(BaseIsrExitEvt { isr_id })
+        };
+        RawEvt::Base(BaseEvt { ts, kind })
+    }
+
+    fn dummy_metadata_evt(isr_id: u32) -> RawEvt {
+        RawEvt::BaseMetadata(BaseMetadataEvt::IsrName(BaseIsrNameEvt {
+            isr_id,
+            name: Arc::from("isr"),
+        }))
+    }
+
     #[test]
     fn out_of_order_evts_one_core() {
         let mut t = TraceEvtSequence::new(1);
-        t.add_evts(&[dummy_raw_evt(0)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap_err(); // Event out of order
+        t.add_evts([dummy_raw_evt(0)]).unwrap();
+        t.add_evts([dummy_raw_evt(1)]).unwrap();
+        t.add_evts([dummy_raw_evt(2)]).unwrap();
+        t.add_evts([dummy_raw_evt(2)]).unwrap();
+        t.add_evts([dummy_raw_evt(1)]).unwrap_err(); // Event out of order
     }
 
     #[test]
     fn out_of_order_evts_multi_core() {
         let mut t = TraceEvtSequence::new(2);
-        t.add_evts(&[dummy_raw_evt(0)]).unwrap(); // Core 0, TS: 0
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap(); // Core 0, TS: 2
-        t.add_evts(&[dummy_core_id_evt(0, 1)]).unwrap(); // Core 1, TS: 0
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap(); // Core 1, TS: 1
-        t.add_evts(&[dummy_core_id_evt(0, 0)]).unwrap_err(); // Core 0, TS: 0
+        t.add_evts([dummy_raw_evt(0)]).unwrap(); // Core 0, TS: 0
+        t.add_evts([dummy_raw_evt(2)]).unwrap(); // Core 0, TS: 2
+        t.add_evts([dummy_core_id_evt(0, 1)]).unwrap(); // Core 1, TS: 0
+        t.add_evts([dummy_raw_evt(1)]).unwrap();
+        t.add_evts([dummy_raw_evt(1)]).unwrap(); // Core 1, TS: 1
+        t.add_evts([dummy_core_id_evt(0, 0)]).unwrap_err(); // Core 0, TS: 0
     }
 
     #[test]
     fn max_shared_ts_idx_single_core() {
         let mut t = TraceEvtSequence::new(1);
         assert_eq!(t.convertable_evt_idx(), None);
-        t.add_evts(&[dummy_raw_evt(0)]).unwrap();
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap();
+        t.add_evts([dummy_raw_evt(0)]).unwrap();
+        t.add_evts([dummy_raw_evt(1)]).unwrap();
         assert_eq!(t.convertable_evt_idx(), Some(1));
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap();
+        t.add_evts([dummy_raw_evt(2)]).unwrap();
         assert_eq!(t.convertable_evt_idx(), Some(2));
     }
 
@@ -314,51 +521,361 @@ mod tests {
         assert_eq!(t.convertable_evt_idx(), None);
 
         // Core 0, TS: 0
-        t.add_evts(&[dummy_raw_evt(1)]).unwrap();
+        t.add_evts([dummy_raw_evt(1)]).unwrap();
         // > Core 0: | 1
         //   Core 1: |
         assert_eq!(t.convertable_evt_idx(), None);
 
         // Core 1, TS: 0
-        t.add_evts(&[dummy_core_id_evt(1, 1)]).unwrap();
+        t.add_evts([dummy_core_id_evt(1, 1)]).unwrap();
         //   Core 0: 1 |
         // > Core 1:   |
         assert_eq!(t.convertable_evt_idx(), Some(0));
 
         // Core 1, TS: 2
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap();
+        t.add_evts([dummy_raw_evt(2)]).unwrap();
         //   Core 0: 1 |
         // > Core 1:   | 2
         assert_eq!(t.convertable_evt_idx(), Some(0));
 
         // Core 0, TS: 1
-        t.add_evts(&[dummy_core_id_evt(1, 0)]).unwrap();
+        t.add_evts([dummy_core_id_evt(1, 0)]).unwrap();
         // > Core 0: 1 |
         //   Core 1:   | 2
         assert_eq!(t.convertable_evt_idx(), Some(0));
 
         // Core 0, TS: 2
-        t.add_evts(&[dummy_raw_evt(2)]).unwrap();
+        t.add_evts([dummy_raw_evt(2)]).unwrap();
         // > Core 0: 1 2 |
         //   Core 1:   2 |
         assert_eq!(t.convertable_evt_idx(), Some(2));
 
         // Core 0, TS: 10
-        t.add_evts(&[dummy_raw_evt(10)]).unwrap();
+        t.add_evts([dummy_raw_evt(10)]).unwrap();
         // > Core 0: 1 2 | 10
         //   Core 1:   2 |
         assert_eq!(t.convertable_evt_idx(), Some(2));
 
         // Core 1, TS: 9
-        t.add_evts(&[dummy_core_id_evt(9, 1)]).unwrap();
+        t.add_evts([dummy_core_id_evt(9, 1)]).unwrap();
         //   Core 0: 1 2 | 10
         // > Core 1:   2 |
         assert_eq!(t.convertable_evt_idx(), Some(2));
 
         // Core 0, TS: 11
-        t.add_evts(&[dummy_raw_evt(11)]).unwrap();
+        t.add_evts([dummy_raw_evt(11)]).unwrap();
         //   Core 0: 1 2 10 |
         // > Core 1:   2    | 11
         assert_eq!(t.convertable_evt_idx(), Some(3));
     }
+
+    #[test]
+    fn sealed_evts_are_not_reordered() {
+        let mut t = TraceEvtSequence::new(1);
+        t.add_evts([dummy_raw_evt(1), dummy_raw_evt(2)]).unwrap();
+        assert_eq!(t.convertable_evt_idx(), Some(1));
+        t.sealed = 2;
+
+        t.add_evts([dummy_raw_evt(3), dummy_metadata_evt(0)]).unwrap();
+        assert_eq!(t.convertable_evt_idx(), Some(3));
+        assert_eq!(t.evts.sort_ts(2), 0);
+        assert_eq!(t.evts.sort_ts(3), 3);
+    }
+
+    /// Core, timestamp, and ID of every merged event, in order. Every test event carries a unique
+    /// ID as its ISR ID.
+    fn merged_order(t: &TraceEvtSequence) -> Vec<(usize, Option<u64>, u32)> {
+        (0..t.evts.len())
+            .map(|idx| {
+                let id = match t.evts.evt(idx) {
+                    RawEvt::Base(BaseEvt {
+                        kind: BaseEvtKind::IsrEnter(evt),
+                        ..
+                    }) => evt.isr_id,
+                    RawEvt::BaseMetadata(BaseMetadataEvt::IsrName(evt)) => evt.isr_id,
+                    evt => panic!("Unexpected event {evt:?}"),
+                };
+                (t.evts.core_id(idx), t.evts.ts(idx), id)
+            })
+            .collect()
+    }
+
+    #[test]
+    fn merge_pending_order() {
+        let mut t = TraceEvtSequence::new(2);
+        t.add_evts_to_core([dummy_isr_evt(5, 0, true), dummy_isr_evt(7, 1, true)], 1)
+            .unwrap();
+        t.add_evts_to_core([dummy_isr_evt(0, 2, true), dummy_metadata_evt(3)], 0)
+            .unwrap();
+        t.add_evts_to_core([dummy_isr_evt(5, 4, true), dummy_isr_evt(6, 5, true)], 0)
+            .unwrap();
+        t.add_evts_to_core([dummy_metadata_evt(6), dummy_isr_evt(7, 7, true)], 1)
+            .unwrap();
+        t.merge_pending();
+
+        // Metadata events go first, in order of arrival. Timestamped events with the same
+        // timestamp are ordered by core, and then in order of arrival:
+        assert_eq!(
+            merged_order(&t),
+            vec![
+                (0, None, 3),
+                (1, None, 6),
+                (0, Some(0), 2),
+                (0, Some(5), 4),
+                (1, Some(5), 0),
+                (0, Some(6), 5),
+                (1, Some(7), 1),
+                (1, Some(7), 7),
+            ]
+        );
+    }
+
+    #[test]
+    fn merge_pending_matches_full_sort() {
+        const CORE_CNT: usize = 3;
+
+        // Interleave the cores at random, with few distinct timestamps so that many events share
+        // a timestamp across cores, and metadata events in between:
+        let mut rng: u64 = 0x2545_f491_4f6c_dd1d;
+        let mut next_rand = |max: u64| {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            rng % max
+        };
+        let mut core_ts = [0; CORE_CNT];
+        let mut arrivals = vec![];
+        for id in 0..2000u32 {
+            let core_id = next_rand(CORE_CNT as u64) as usize;
+            let evt = if next_rand(10) == 0 {
+                dummy_metadata_evt(id)
+            } else {
+                core_ts[core_id] += next_rand(3);
+                dummy_isr_evt(core_ts[core_id], id, true)
+            };
+            arrivals.push((core_id, evt));
+        }
+
+        // Order of the previous implementation, which sorted all events by timestamp (treating
+        // metadata as timestamp 0) in order of arrival. Ties that it left to the order of arrival
+        // are now broken by putting metadata first, and then by core:
+        let mut expected: Vec<_> = arrivals
+            .iter()
+            .map(|(core_id, evt)| {
+                let id = match evt {
+                    RawEvt::Base(BaseEvt {
+                        kind: BaseEvtKind::IsrEnter(evt),
+                        ..
+                    }) => evt.isr_id,
+                    RawEvt::BaseMetadata(BaseMetadataEvt::IsrName(evt)) => evt.isr_id,
+                    _ => unreachable!(),
+                };
+                (*core_id, evt.ts(), id)
+            })
+            .collect();
+        let full_sort_ts: Vec<_> = {
+            let mut ts: Vec<_> = expected.iter().map(|(_, ts, _)| ts.unwrap_or(0)).collect();
+            ts.sort();
+            ts
+        };
+        expected
+            .sort_by_key(|(core_id, ts, _)| (ts.unwrap_or(0), ts.is_some(), if ts.is_some() { *core_id } else { 0 }));
+
+        // Merged in a single step:
+        let mut t = TraceEvtSequence::new(CORE_CNT);
+        for (core_id, evt) in &arrivals {
+            t.add_evts_to_core([evt.clone()], *core_id as u32).unwrap();
+        }
+        t.merge_pending();
+        assert_eq!(merged_order(&t), expected);
+
+        // Merged in many steps, every merge keeps the events sorted by timestamp and every core
+        // in order of arrival:
+        let mut t = TraceEvtSequence::new(CORE_CNT);
+        for (idx, (core_id, evt)) in arrivals.iter().enumerate() {
+            t.add_evts_to_core([evt.clone()], *core_id as u32).unwrap();
+            if idx % 37 == 0 {
+                t.merge_pending();
+            }
+        }
+        t.merge_pending();
+        let order = merged_order(&t);
+        let sort_ts: Vec<_> = (0..t.evts.len()).map(|idx| t.evts.sort_ts(idx)).collect();
+        assert_eq!(sort_ts, full_sort_ts);
+        for core_id in 0..CORE_CNT {
+            let core_evt_ids = |order: &[(usize, Option<u64>, u32)]| -> Vec<u32> {
+                let core_evts = order.iter().filter(|(c, ts, _)| *c == core_id && ts.is_some());
+                core_evts.map(|(_, _, id)| *id).collect()
+            };
+            assert_eq!(core_evt_ids(&order), core_evt_ids(&expected));
+        }
+    }
+
+    #[test]
+    fn convert_incremental() {
+        let evts = [
+            dummy_metadata_evt(0),
+            dummy_isr_evt(1, 0, true),
+            dummy_isr_evt(3, 0, false),
+            dummy_core_id_evt(2, 1),
+            dummy_isr_evt(2, 1, true),
+            dummy_isr_evt(5, 1, false),
+            dummy_core_id_evt(4, 0),
+            dummy_isr_evt(6, 0, true),
+            dummy_metadata_evt(1),
+            dummy_isr_evt(8, 0, false),
+            dummy_core_id_evt(9, 1),
+        ];
+
+        let mut full = TraceConverter::new(2, TraceMode::Base).unwrap();
+        full.add_evts(&evts).unwrap();
+        let full_trace = full.convert().unwrap();
+        let full_data = PerfettoGenerator::new().generate(&full_trace);
+
+        let mut live = TraceConverter::new(2, TraceMode::Base).unwrap();
+        let mut generator = PerfettoGenerator::new();
+        let mut data = vec![];
+        for evt in &evts {
+            live.add_evts(std::slice::from_ref(evt)).unwrap();
+            data.extend(generator.generate(live.convert_incremental().unwrap()));
+        }
+        let live_trace = live.convert_incremental().unwrap();
+        assert!(generator.generate(live_trace).is_empty());
+
+        assert_eq!(live_trace.evt_count, full_trace.evt_count);
+        assert_eq!(data.len(), full_data.len());
+        for (core_id, core) in &full_trace.cores {
+            let live_core = &live_trace.cores[core_id];
+            assert_eq!(live_core.isrs.len(), core.isrs.len());
+            for (isr_id, isr) in &core.isrs {
+                let live_isr = live_core.isrs.get(isr_id).unwrap();
+                assert_eq!(live_isr.name, isr.name);
+                let ts: Vec<_> = isr.state.0.iter().map(|evt| evt.ts).collect();
+                let live_ts: Vec<_> = live_isr.state.0.iter().map(|evt| evt.ts).collect();
+                assert_eq!(live_ts, ts);
+            }
+        }
+    }
+
+    #[test]
+    fn resume_from_checkpoint() {
+        let evts = [
+            dummy_metadata_evt(0),
+            dummy_isr_evt(1, 0, true),
+            dummy_isr_evt(3, 0, false),
+            dummy_isr_evt(4, 1, true),
+            dummy_isr_evt(12, 1, false),
+            dummy_isr_evt(13, 0, true),
+            dummy_isr_evt(21, 0, false),
+        ];
+
+        let mut full = TraceConverter::new(1, TraceMode::Base).unwrap();
+        full.add_evts(&evts).unwrap();
+        let (_, checkpoints) = full.convert_with_checkpoints(5).unwrap();
+        let checkpoint_ts: Vec<_> = checkpoints.iter().map(|cp| cp.ts).collect();
+        assert_eq!(checkpoint_ts, vec![11, 21]);
+
+        let mut window = TraceConverter::new(1, TraceMode::Base).unwrap();
+        window.restore_checkpoint(checkpoints[0].clone()).unwrap();
+        window.set_end_ts(13);
+        window.add_evts(&evts).unwrap();
+        window.restore_checkpoint(checkpoints[1].clone()).unwrap_err();
+        let trace = window.convert().unwrap();
+
+        let isrs = &trace.cores[&0].isrs;
+        assert_eq!(isrs.get(0).unwrap().name.as_deref(), Some("isr"));
+
+        let isr_0 = &isrs.get(0).unwrap().state.0;
+        assert_eq!(isr_0.len(), 1);
+        assert_eq!(isr_0[0].ts, 13);
+
+        // ISR 1 was active at the checkpoint:
+        let isr_1 = &isrs.get(1).unwrap().state.0;
+        assert_eq!(isr_1.len(), 2);
+        assert_eq!(isr_1[0].ts, 11);
+        assert!(matches!(isr_1[0].inner, crate::ISRState::Active));
+        assert_eq!(isr_1[1].ts, 12);
+        assert!(matches!(isr_1[1].inner, crate::ISRState::NotActive));
+    }
+
+    #[test]
+    fn checkpoints_every_evts() {
+        let evts = [
+            dummy_metadata_evt(0),
+            dummy_isr_evt(1, 0, true),
+            dummy_isr_evt(3, 0, false),
+            dummy_isr_evt(4, 1, true),
+            dummy_isr_evt(4, 1, false),
+            dummy_isr_evt(5, 0, true),
+            dummy_isr_evt(6, 0, false),
+            dummy_isr_evt(8, 0, true),
+        ];
+
+        let mut full = TraceConverter::new(1, TraceMode::Base).unwrap();
+        full.add_evts(&evts).unwrap();
+        let (_, checkpoints) = full.convert_with_checkpoints_every(CheckpointEvery::Evts(3)).unwrap();
+
+        // Events with the same timestamp are not split across checkpoints:
+        let checkpoint_ts: Vec<_> = checkpoints.iter().map(|cp| cp.ts).collect();
+        assert_eq!(checkpoint_ts, vec![5]);
+
+        assert!(full.convert_with_checkpoints_every(CheckpointEvery::Evts(0)).is_err());
+    }
+
+    #[test]
+    fn checkpoint_restores_markers() {
+        let evt = |ts, kind| RawEvt::Base(BaseEvt { ts, kind });
+        let begin = |ts, msg: &str| {
+            let msg = Arc::from(msg);
+            evt(ts, BaseEvtKind::EvtmarkerBegin(BaseEvtmarkerBeginEvt { evtmarker_id: 0, msg }))
+        };
+        let end = |ts| evt(ts, BaseEvtKind::EvtmarkerEnd(BaseEvtmarkerEndEvt { evtmarker_id: 0 }));
+        let val = |ts, val| evt(ts, BaseEvtKind::Valmarker(BaseValmarkerEvt { valmarker_id: 0, val }));
+
+        let evts = [
+            begin(1, "outer"),
+            val(2, 7),
+            begin(3, "inner"),
+            end(4),
+            begin(5, "open"),
+            val(6, 9),
+            end(12),
+            end(13),
+            dummy_raw_evt(20),
+        ];
+
+        let mut full = TraceConverter::new(1, TraceMode::Base).unwrap();
+        full.add_evts(&evts).unwrap();
+        let (_, checkpoints) = full.convert_with_checkpoints(10).unwrap();
+        assert_eq!(checkpoints[0].ts, 11);
+
+        let mut window = TraceConverter::new(1, TraceMode::Base).unwrap();
+        window.restore_checkpoint(checkpoints[0].clone()).unwrap();
+        window.add_evts(&evts).unwrap();
+        let trace = window.convert().unwrap();
+
+        // Both slices that were open at the checkpoint are re-opened, outermost first:
+        let markers = &trace.user_evt_markers.get(0).unwrap().markers.0;
+        let msgs: Vec<_> = markers
+            .iter()
+            .map(|m| match &m.inner {
+                UserEvtMarker::SliceBegin { msg } => (m.ts, Some(msg.to_string())),
+                _ => (m.ts, None),
+            })
+            .collect();
+        assert_eq!(
+            msgs,
+            [
+                (11, Some("outer".to_string())),
+                (11, Some("open".to_string())),
+                (12, None),
+                (13, None)
+            ]
+        );
+
+        // The value marker starts at its current value:
+        let vals = &trace.user_val_markers.get(0).unwrap().vals.0;
+        assert_eq!(vals.len(), 1);
+        assert_eq!((vals[0].ts, vals[0].inner), (11, 9));
+    }
 }
@@ -0,0 +1,240 @@
+//! Level-of-detail downsampling of counter tracks.
+
+use synthetto::{CounterTrack, Synthetto, Track, TrackScope};
+
+use super::generate_perfetto::{PerfettoOptions, TrackCursor};
+use crate::{Trace, Ts};
+
+/// Downsampling of dense counter tracks, such as a value marker that is updated at a high rate.
+///
+/// The samples of a counter are grouped into buckets of fixed duration, of which only the
+/// samples with the minimum and maximum value and the last sample are kept. This keeps the
+/// envelope of the counter intact, while limiting the number of samples per bucket to three.
+#[derive(Debug, Clone)]
+pub struct CounterLod {
+    /// Duration of a bucket, in ns.
+    pub bucket_ns: u64,
+    /// Time windows `(start, end)` in which all samples are kept, in ns relative to the start of
+    /// the trace.
+    pub full_res_windows: Vec<(u64, u64)>,
+    /// Also emit every downsampled counter at full resolution, on a separate track.
+    pub full_res_tracks: bool,
+}
+
+/// Counter downsampling in effect for the trace being generated.
+#[derive(Debug, Clone, Copy)]
+pub(crate) struct Lod<'a> {
+    cfg: &'a CounterLod,
+    /// Timestamp of the start of the trace, in ns.
+    origin: u64,
+}
+
+impl<'a> Lod<'a> {
+    /// Downsampling configured in `options`, if any. Buckets and windows are aligned to `origin`.
+    pub fn new(options: &'a PerfettoOptions, origin: Option<u64>) -> Option<Self> {
+        let cfg = options.counter_lod.as_ref().filter(|cfg| cfg.bucket_ns > 0)?;
+        Some(Lod {
+            cfg,
+            origin: origin.unwrap_or(0),
+        })
+    }
+
+    fn is_full_res(&self, ts: u64) -> bool {
+        let ts = ts.saturating_sub(self.origin);
+        self.cfg
+            .full_res_windows
+            .iter()
+            .any(|(start, end)| *start <= ts && ts <= *end)
+    }
+
+    /// Indices of the samples to keep, in order. `sample` returns the timestamp (in ns) and value
+    /// of every one of the `len` samples, which must be in order of their timestamp.
+    fn downsample(&self, len: usize, sample: impl Fn(usize) -> (u64, i64)) -> Vec<usize> {
+        let mut keep = vec![];
+        let mut bucket: Option<Bucket> = None;
+
+        for idx in 0..len {
+            let (ts, val) = sample(idx);
+
+            if self.is_full_res(ts) {
+                if let Some(bucket) = bucket.take() {
+                    bucket.keep(&mut keep);
+                }
+                keep.push(idx);
+                continue;
+            }
+
+            let bucket_id = ts.saturating_sub(self.origin) / self.cfg.bucket_ns;
+            match &mut bucket {
+                Some(bucket) if bucket.id == bucket_id => bucket.add(idx, val),
+                _ => {
+                    if let Some(bucket) = bucket.replace(Bucket::new(bucket_id, idx, val)) {
+                        bucket.keep(&mut keep);
+                    }
+                }
+            }
+        }
+
+        if let Some(bucket) = bucket {
+            bucket.keep(&mut keep);
+        }
+        keep
+    }
+}
+
+/// Samples of a single bucket that are kept, as pairs of index and value.
+struct Bucket {
+    id: u64,
+    min: (usize, i64),
+    max: (usize, i64),
+    last: usize,
+}
+
+impl Bucket {
+    fn new(id: u64, idx: usize, val: i64) -> Self {
+        Bucket {
+            id,
+            min: (idx, val),
+            max: (idx, val),
+            last: idx,
+        }
+    }
+
+    fn add(&mut self, idx: usize, val: i64) {
+        if val < self.min.1 {
+            self.min = (idx, val);
+        }
+        if val > self.max.1 {
+            self.max = (idx, val);
+        }
+        self.last = idx;
+    }
+
+    fn keep(&self, keep: &mut Vec<usize>) {
+        let mut idxs = [self.min.0, self.max.0, self.last];
+        idxs.sort_unstable();
+        for idx in idxs {
+            if keep.last() != Some(&idx) {
+                keep.push(idx);
+            }
+        }
+    }
+}
+
+/// Counter track that is downsampled if enabled, and its optional full-resolution copy.
+pub(crate) struct CounterCursor<S: TrackScope> {
+    cursor: TrackCursor<Track<S, CounterTrack>>,
+    full_res: Option<Track<S, CounterTrack>>,
+}
+
+impl<S: TrackScope> CounterCursor<S> {
+    /// Create the counter track `name` with `new_track`, and its full-resolution copy if
+    /// downsampling is enabled and configured to keep one.
+    pub fn new(
+        syn: &mut Synthetto,
+        lod: Option<Lod>,
+        name: String,
+        new_track: impl Fn(&mut Synthetto, String) -> Track<S, CounterTrack>,
+    ) -> Self {
+        let full_res_name = format!("{name} (Full Resolution)");
+        let cursor = TrackCursor::new(new_track(syn, name));
+        let full_res = lod
+            .filter(|lod| lod.cfg.full_res_tracks)
+            .map(|_| new_track(syn, full_res_name));
+        CounterCursor { cursor, full_res }
+    }
+
+    /// Write the samples of `series` that have not been emitted yet. `val` extracts the value of
+    /// a sample.
+    pub fn write<V>(
+        &mut self,
+        t: &Trace,
+        lod: Option<Lod>,
+        series: &[Ts<V>],
+        val: impl Fn(&V) -> i64,
+        buf: &mut Vec<u8>,
+    ) {
+        let pending = self.cursor.advance(series);
+
+        if let Some(full_res) = &self.full_res {
+            for evt in pending {
+                full_res.write_int_counter_evt(buf, t.convert_ts(evt.ts), val(&evt.inner));
+            }
+        }
+
+        match lod {
+            None => {
+                for evt in pending {
+                    let ts = t.convert_ts(evt.ts);
+                    self.cursor.track.write_int_counter_evt(buf, ts, val(&evt.inner));
+                }
+            }
+            Some(lod) => {
+                let keep =
+                    lod.downsample(pending.len(), |idx| (t.convert_ts(pending[idx].ts), val(&pending[idx].inner)));
+                for idx in keep {
+                    let evt = &pending[idx];
+                    let ts = t.convert_ts(evt.ts);
+                    self.cursor.track.write_int_counter_evt(buf, ts, val(&evt.inner));
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn options(bucket_ns: u64, full_res_windows: Vec<(u64, u64)>) -> PerfettoOptions {
+        PerfettoOptions {
+            counter_lod: Some(CounterLod {
+                bucket_ns,
+                full_res_windows,
+                full_res_tracks: false,
+            }),
+            ..PerfettoOptions::default()
+        }
+    }
+
+    #[test]
+    fn downsample_min_max_last() {
+        let options = options(10, vec![]);
+        let lod = Lod::new(&options, Some(100)).unwrap();
+
+        // Bucket 0: 100..110, bucket 1: 110..120, bucket 3: 130..140
+        let samples = [(100, 5), (102, 9), (104, -3), (106, 4), (110, 1), (111, 1), (135, 7)];
+        let keep = lod.downsample(samples.len(), |idx| samples[idx]);
+        assert_eq!(keep, [1, 2, 3, 4, 5, 6]);
+
+        // A single sample per bucket is always kept:
+        let samples: Vec<_> = (0..5).map(|idx| (100 + idx * 10, idx as i64)).collect();
+        let keep = lod.downsample(samples.len(), |idx| samples[idx]);
+        assert_eq!(keep, [0, 1, 2, 3, 4]);
+
+        // Dense samples are reduced to at most three per bucket:
+        let samples: Vec<_> = (0..1000).map(|idx| (100 + idx, (idx % 7) as i64)).collect();
+        let keep = lod.downsample(samples.len(), |idx| samples[idx]);
+        assert!(keep.len() <= 300);
+        assert!(keep.windows(2).all(|w| w[0] < w[1]));
+    }
+
+    #[test]
+    fn full_res_windows() {
+        let options = options(100, vec![(50, 59)]);
+        let lod = Lod::new(&options, Some(1000)).unwrap();
+
+        let samples: Vec<_> = (0..100).map(|idx| (1000 + idx, idx as i64)).collect();
+        let keep = lod.downsample(samples.len(), |idx| samples[idx]);
+
+        // Min and max before the window, everything within it, and min, max and last after it:
+        let expected: Vec<usize> = [0, 49].into_iter().chain(50..60).chain([60, 99]).collect();
+        assert_eq!(keep, expected);
+    }
+
+    #[test]
+    fn disabled_without_bucket_duration() {
+        assert!(Lod::new(&PerfettoOptions::default(), Some(0)).is_none());
+        assert!(Lod::new(&options(0, vec![]), Some(0)).is_none());
+    }
+}
@@ -0,0 +1,555 @@
+use std::{cmp::Reverse, collections::BinaryHeap, sync::Arc};
+
+use crate::decode::evts::*;
+
+/// Compact store of decoded trace events.
+///
+/// Every event is stored as a fixed-size record in dense columns: Its timestamp, core ID, kind,
+/// and a 32-bit payload. Events whose payload is a single `u32` (such as task switches or ISR
+/// entries) store it in the record directly. All other payloads are stored in side tables by
+/// shape, and the record holds their index in the table. Which events are stored in which way
+/// is generated along with the event definitions (see [`RawEvt::pack`]). The events of every
+/// core are indexed, so that they can be iterated without scanning the events of all other cores.
+///
+/// Events are decoded back into a [`RawEvt`] when accessed, which only copies the payload and
+/// increments the reference count of interned strings. At most `u32::MAX` events can be stored.
+#[derive(Debug, Clone, Default)]
+pub struct EvtStore {
+    /// Timestamp of every event, or 0 for events without a timestamp.
+    sort_ts: Vec<u64>,
+    core_ids: Vec<u16>,
+    kinds: Vec<PackedKind>,
+    /// Payload of every event, or its index in the side table of its kind.
+    payloads: Vec<u32>,
+    /// Index of every event of a core, by core ID.
+    core_evt_idxs: Vec<Vec<u32>>,
+
+    // Side tables. Entries are stored in order of their events:
+    pairs: Vec<[u32; 2]>,
+    strs: Vec<(u32, Arc<str>)>,
+    vals: Vec<(u32, i64)>,
+    heap: Vec<(u64, u32)>,
+    /// Events that cannot be packed (such as invalid events or task state dumps), stored as they
+    /// are.
+    other: Vec<RawEvt>,
+}
+
+/// Add an entry to a side table, returning its index.
+fn push_entry<T>(table: &mut Vec<T>, entry: T) -> u32 {
+    table.push(entry);
+    (table.len() - 1) as u32
+}
+
+/// An index into every side table.
+#[derive(Debug, Clone, Copy)]
+struct SideTableIdxs {
+    pairs: usize,
+    strs: usize,
+    vals: usize,
+    heap: usize,
+    other: usize,
+}
+
+impl SideTableIdxs {
+    /// Index into the side table of the given shape, or 0 if payloads of this shape are not stored
+    /// in a side table.
+    fn get(&self, shape: PackedShape) -> u32 {
+        let idx = match shape {
+            PackedShape::Word => 0,
+            PackedShape::Pair => self.pairs,
+            PackedShape::Str => self.strs,
+            PackedShape::Val => self.vals,
+            PackedShape::Heap => self.heap,
+            PackedShape::Other => self.other,
+        };
+        idx as u32
+    }
+}
+
+impl EvtStore {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn len(&self) -> usize {
+        self.kinds.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.kinds.is_empty()
+    }
+
+    pub fn core_id(&self, idx: usize) -> usize {
+        self.core_ids[idx] as usize
+    }
+
+    /// Timestamp of the event, or 0 if the event has none.
+    pub fn sort_ts(&self, idx: usize) -> u64 {
+        self.sort_ts[idx]
+    }
+
+    pub fn ts(&self, idx: usize) -> Option<u64> {
+        match self.kinds[idx] {
+            PackedKind::Other => self.other[self.payloads[idx] as usize].ts(),
+            kind if kind.is_metadata() => None,
+            _ => Some(self.sort_ts[idx]),
+        }
+    }
+
+    /// Index of every event that occurred on the given core, in order.
+    pub fn core_evt_idxs(&self, core_id: usize) -> &[u32] {
+        self.core_evt_idxs
+            .get(core_id)
+            .map(|idxs| idxs.as_slice())
+            .unwrap_or(&[])
+    }
+
+    /// Number of bytes allocated to store the events, including unused capacity but excluding the
+    /// interned strings (which are shared with all other users of the string).
+    pub fn allocated_bytes(&self) -> usize {
+        fn bytes<T>(v: &Vec<T>) -> usize {
+            v.capacity() * std::mem::size_of::<T>()
+        }
+        bytes(&self.sort_ts)
+            + bytes(&self.core_ids)
+            + bytes(&self.kinds)
+            + bytes(&self.payloads)
+            + bytes(&self.core_evt_idxs)
+            + self.core_evt_idxs.iter().map(bytes).sum::<usize>()
+            + bytes(&self.pairs)
+            + bytes(&self.strs)
+            + bytes(&self.vals)
+            + bytes(&self.heap)
+            + bytes(&self.other)
+    }
+
+    pub fn evt(&self, idx: usize) -> RawEvt {
+        let kind = self.kinds[idx];
+        let entry = self.payloads[idx];
+        let payload = match kind.shape() {
+            PackedShape::Word => PackedPayload::Word(entry),
+            PackedShape::Pair => PackedPayload::Pair(self.pairs[entry as usize]),
+            PackedShape::Str => {
+                let (id, s) = &self.strs[entry as usize];
+                PackedPayload::Str(*id, s.clone())
+            }
+            PackedShape::Val => {
+                let (id, val) = self.vals[entry as usize];
+                PackedPayload::Val(id, val)
+            }
+            PackedShape::Heap => {
+                let (addr, size) = self.heap[entry as usize];
+                PackedPayload::Heap(addr, size)
+            }
+            PackedShape::Other => return self.other[entry as usize].clone(),
+        };
+        RawEvt::unpack(kind, self.sort_ts[idx], payload)
+    }
+
+    /// Store the payload of an event, returning its kind and the payload of its record.
+    fn store_payload(&mut self, evt: RawEvt) -> (PackedKind, u32) {
+        match evt.pack() {
+            Ok((kind, payload)) => {
+                let entry = match payload {
+                    PackedPayload::Word(val) => val,
+                    PackedPayload::Pair(pair) => push_entry(&mut self.pairs, pair),
+                    PackedPayload::Str(id, s) => push_entry(&mut self.strs, (id, s)),
+                    PackedPayload::Val(id, val) => push_entry(&mut self.vals, (id, val)),
+                    PackedPayload::Heap(addr, size) => push_entry(&mut self.heap, (addr, size)),
+                };
+                (kind, entry)
+            }
+            Err(evt) => (PackedKind::Other, push_entry(&mut self.other, evt)),
+        }
+    }
+
+    pub(crate) fn reserve(&mut self, additional: usize) {
+        self.sort_ts.reserve(additional);
+        self.core_ids.reserve(additional);
+        self.kinds.reserve(additional);
+        self.payloads.reserve(additional);
+    }
+
+    pub(crate) fn push(&mut self, core_id: usize, evt: RawEvt) {
+        let idx = self.len() as u32;
+        self.sort_ts.push(evt.ts().unwrap_or(0));
+        self.core_ids.push(core_id as u16);
+        let (kind, payload) = self.store_payload(evt);
+        self.kinds.push(kind);
+        self.payloads.push(payload);
+
+        if self.core_evt_idxs.len() <= core_id {
+            self.core_evt_idxs.resize_with(core_id + 1, Vec::new);
+        }
+        self.core_evt_idxs[core_id].push(idx);
+    }
+
+    /// Length of every side table.
+    fn side_table_lens(&self) -> SideTableIdxs {
+        SideTableIdxs {
+            pairs: self.pairs.len(),
+            strs: self.strs.len(),
+            vals: self.vals.len(),
+            heap: self.heap.len(),
+            other: self.other.len(),
+        }
+    }
+
+    /// Index of the first side table entry of the events from `idx` on, in every side table.
+    fn side_table_starts(&self, idx: usize) -> SideTableIdxs {
+        // Side table entries are stored in order of their events, so the entries of the events
+        // from `idx` on are at the end of every table, starting at the entry of the first of
+        // these events:
+        let mut starts = self.side_table_lens();
+        for evt_idx in (idx..self.len()).rev() {
+            let entry = self.payloads[evt_idx] as usize;
+            match self.kinds[evt_idx].shape() {
+                PackedShape::Word => (),
+                PackedShape::Pair => starts.pairs = entry,
+                PackedShape::Str => starts.strs = entry,
+                PackedShape::Val => starts.vals = entry,
+                PackedShape::Heap => starts.heap = entry,
+                PackedShape::Other => starts.other = entry,
+            }
+        }
+        starts
+    }
+
+    /// Split the store in two at the given index, returning all events from `idx` on.
+    pub(crate) fn split_off(&mut self, idx: usize) -> EvtStore {
+        let starts = self.side_table_starts(idx);
+
+        let mut tail = EvtStore {
+            sort_ts: self.sort_ts.split_off(idx),
+            core_ids: self.core_ids.split_off(idx),
+            kinds: self.kinds.split_off(idx),
+            payloads: self.payloads.split_off(idx),
+            core_evt_idxs: Vec::with_capacity(self.core_evt_idxs.len()),
+            pairs: self.pairs.split_off(starts.pairs),
+            strs: self.strs.split_off(starts.strs),
+            vals: self.vals.split_off(starts.vals),
+            heap: self.heap.split_off(starts.heap),
+            other: self.other.split_off(starts.other),
+        };
+
+        // Re-base the side table indices of the tail:
+        for (kind, payload) in tail.kinds.iter().zip(tail.payloads.iter_mut()) {
+            *payload -= starts.get(kind.shape());
+        }
+
+        for idxs in &mut self.core_evt_idxs {
+            let tail_idxs = idxs.split_off(idxs.partition_point(|evt_idx| (*evt_idx as usize) < idx));
+            tail.core_evt_idxs
+                .push(tail_idxs.into_iter().map(|evt_idx| evt_idx - idx as u32).collect());
+        }
+
+        tail
+    }
+
+    pub(crate) fn append(&mut self, other: EvtStore) {
+        let offset = self.len() as u32;
+        let table_offsets = self.side_table_lens();
+
+        self.sort_ts.extend(other.sort_ts);
+        self.core_ids.extend(other.core_ids);
+        self.payloads.extend(
+            other
+                .kinds
+                .iter()
+                .zip(other.payloads)
+                .map(|(kind, payload)| payload + table_offsets.get(kind.shape())),
+        );
+        self.kinds.extend(other.kinds);
+
+        self.pairs.extend(other.pairs);
+        self.strs.extend(other.strs);
+        self.vals.extend(other.vals);
+        self.heap.extend(other.heap);
+        self.other.extend(other.other);
+
+        if self.core_evt_idxs.len() < other.core_evt_idxs.len() {
+            self.core_evt_idxs.resize_with(other.core_evt_idxs.len(), Vec::new);
+        }
+        for (idxs, other_idxs) in self.core_evt_idxs.iter_mut().zip(other.core_evt_idxs) {
+            idxs.extend(other_idxs.into_iter().map(|evt_idx| evt_idx + offset));
+        }
+    }
+
+    /// Add a copy of an event of another store, without decoding it.
+    fn push_copy(&mut self, src: &EvtStore, idx: usize) {
+        let kind = src.kinds[idx];
+        let entry = src.payloads[idx];
+        let entry = match kind.shape() {
+            PackedShape::Word => entry,
+            PackedShape::Pair => push_entry(&mut self.pairs, src.pairs[entry as usize]),
+            PackedShape::Str => push_entry(&mut self.strs, src.strs[entry as usize].clone()),
+            PackedShape::Val => push_entry(&mut self.vals, src.vals[entry as usize]),
+            PackedShape::Heap => push_entry(&mut self.heap, src.heap[entry as usize]),
+            PackedShape::Other => push_entry(&mut self.other, src.other[entry as usize].clone()),
+        };
+
+        let new_idx = self.len() as u32;
+        let core_id = src.core_id(idx);
+        self.sort_ts.push(src.sort_ts[idx]);
+        self.core_ids.push(core_id as u16);
+        self.kinds.push(kind);
+        self.payloads.push(entry);
+
+        if self.core_evt_idxs.len() <= core_id {
+            self.core_evt_idxs.resize_with(core_id + 1, Vec::new);
+        }
+        self.core_evt_idxs[core_id].push(new_idx);
+    }
+
+    /// Number of leading events for whose timestamp `pred` holds. The events must be sorted.
+    pub(crate) fn partition_point(&self, mut pred: impl FnMut(u64) -> bool) -> usize {
+        self.sort_ts.partition_point(|ts| pred(*ts))
+    }
+
+    /// Merge stores that are each sorted by timestamp into a single sorted store, using a k-way
+    /// merge. Events with the same timestamp are ordered by the position of their store in
+    /// `stores`.
+    pub(crate) fn merge(stores: Vec<EvtStore>) -> EvtStore {
+        let mut result = EvtStore::new();
+        result.reserve(stores.iter().map(|store| store.len()).sum());
+
+        // Index of the next event of every store:
+        let mut next = vec![0; stores.len()];
+
+        // Smallest timestamp at the head of every non-empty store, by store index:
+        let mut heads: BinaryHeap<Reverse<(u64, usize)>> = BinaryHeap::with_capacity(stores.len());
+        for (store_idx, store) in stores.iter().enumerate() {
+            if !store.is_empty() {
+                heads.push(Reverse((store.sort_ts(0), store_idx)));
+            }
+        }
+
+        while let Some(Reverse((_, store_idx))) = heads.pop() {
+            let store = &stores[store_idx];
+            let idx = next[store_idx];
+            result.push_copy(store, idx);
+
+            next[store_idx] += 1;
+            if next[store_idx] < store.len() {
+                heads.push(Reverse((store.sort_ts(idx + 1), store_idx)));
+            }
+        }
+
+        result
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn isr_enter(ts: u64, isr_id: u32) -> RawEvt {
+        RawEvt::Base(BaseEvt {
+            ts,
+            kind: BaseEvtKind::IsrEnter(BaseIsrEnterEvt { isr_id }),
+        })
+    }
+
+    #[test]
+    fn merge() {
+        let mut a = EvtStore::new();
+        a.push(0, isr_enter(1, 0));
+        a.push(0, isr_enter(5, 1));
+        a.push(0, isr_enter(5, 2));
+
+        let mut b = EvtStore::new();
+        b.push(0, RawEvt::BaseMetadata(BaseMetadataEvt::TsResolutionNs(BaseTsResolutionNsEvt { ns_per_ts: 1 })));
+
+        let mut c = EvtStore::new();
+        c.push(1, isr_enter(0, 3));
+        c.push(1, isr_enter(5, 4));
+        c.push(1, isr_enter(7, 5));
+
+        let store = EvtStore::merge(vec![a, b, EvtStore::new(), c]);
+
+        let order: Vec<_> = (0..store.len())
+            .map(|idx| match store.evt(idx) {
+                RawEvt::Base(BaseEvt {
+                    kind: BaseEvtKind::IsrEnter(evt),
+                    ..
+                }) => Some(evt.isr_id),
+                _ => None,
+            })
+            .collect();
+        assert_eq!(order, vec![None, Some(3), Some(0), Some(1), Some(2), Some(4), Some(5)]);
+
+        let core_ids: Vec<_> = (0..store.len()).map(|idx| store.core_id(idx)).collect();
+        assert_eq!(core_ids, vec![0, 1, 0, 0, 0, 1, 1]);
+
+        let sort_ts: Vec<_> = (0..store.len()).map(|idx| store.sort_ts(idx)).collect();
+        assert_eq!(sort_ts, vec![0, 0, 1, 5, 5, 5, 7]);
+        assert_eq!(store.ts(0), None);
+    }
+
+    fn freertos(ts: u64, kind: FreeRTOSEvtKind) -> RawEvt {
+        RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind })
+    }
+
+    /// One event of every way its payload is stored.
+    fn evts() -> Vec<RawEvt> {
+        use FreeRTOSEvtKind as F;
+        vec![
+            RawEvt::BaseMetadata(BaseMetadataEvt::TsResolutionNs(BaseTsResolutionNsEvt { ns_per_ts: 10 })),
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskName(FreeRTOSTaskNameEvt {
+                task_id: 1,
+                name: "worker".into(),
+            })),
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsTimerTask(FreeRTOSTaskIsTimerTaskEvt { task_id: 2 })),
+            isr_enter(1, 3),
+            freertos(2, F::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id: 1 })),
+            freertos(
+                3,
+                F::QueueSend(FreeRTOSQueueSendEvt {
+                    queue_id: 4,
+                    len_after: 2,
+                }),
+            ),
+            freertos(
+                4,
+                F::HeapMalloc(FreeRTOSHeapMallocEvt {
+                    addr: 1 << 40,
+                    size: 64,
+                }),
+            ),
+            RawEvt::Base(BaseEvt {
+                ts: 5,
+                kind: BaseEvtKind::Valmarker(BaseValmarkerEvt {
+                    valmarker_id: 1,
+                    val: -7,
+                }),
+            }),
+            freertos(
+                6,
+                F::TaskEvtmarkerBegin(FreeRTOSTaskEvtmarkerBeginEvt {
+                    evtmarker_id: 2,
+                    msg: "go".into(),
+                }),
+            ),
+            freertos(
+                7,
+                F::TaskState(FreeRTOSTaskStateEvt {
+                    task_id: 1,
+                    state: FrTaskState::FrtsReady,
+                    core_id: 0,
+                }),
+            ),
+            RawEvt::Invalid(InvalidEvt {
+                ts: Some(8),
+                err: Some("bad".into()),
+            }),
+            freertos(
+                9,
+                F::TaskPrioritySet(FreeRTOSTaskPrioritySetEvt {
+                    task_id: 1,
+                    priority: 3,
+                }),
+            ),
+            freertos(
+                10,
+                F::HeapFree(FreeRTOSHeapFreeEvt {
+                    addr: 1 << 40,
+                    size: 64,
+                }),
+            ),
+        ]
+    }
+
+    fn debug(store: &EvtStore) -> Vec<String> {
+        (0..store.len()).map(|idx| format!("{:?}", store.evt(idx))).collect()
+    }
+
+    #[test]
+    fn round_trip() {
+        let evts = evts();
+        let expected: Vec<_> = evts.iter().map(|evt| format!("{evt:?}")).collect();
+
+        let mut store = EvtStore::new();
+        for (idx, evt) in evts.into_iter().enumerate() {
+            store.push(idx % 2, evt);
+        }
+        assert_eq!(debug(&store), expected);
+        assert_eq!(store.ts(0), None);
+        assert_eq!(store.ts(2), None);
+        assert_eq!(store.ts(10), Some(8));
+        assert_eq!(store.core_evt_idxs(1), &[1, 3, 5, 7, 9, 11]);
+        assert_eq!(store.core_evt_idxs(2), &[] as &[u32]);
+
+        // Split in the middle of every side table, and put back together:
+        let tail = store.split_off(6);
+        assert_eq!(debug(&store), expected[..6]);
+        assert_eq!(debug(&tail), expected[6..]);
+        assert_eq!(store.core_evt_idxs(0), &[0, 2, 4]);
+        assert_eq!(tail.core_evt_idxs(0), &[0, 2, 4, 6]);
+
+        store.append(tail);
+        assert_eq!(debug(&store), expected);
+        assert_eq!(store.core_evt_idxs(1), &[1, 3, 5, 7, 9, 11]);
+
+        // Merge copies the side table entries of every store:
+        let tail = store.split_off(6);
+        let store = EvtStore::merge(vec![tail, store]);
+        assert_eq!(debug(&store), expected);
+        assert_eq!(store.core_evt_idxs(0), &[0, 2, 4, 6, 8, 10, 12]);
+    }
+
+    #[test]
+    fn bytes_per_evt() {
+        use FreeRTOSEvtKind as F;
+
+        // Typical mix of events of a FreeRTOS trace, dominated by task switches, queue
+        // operations and ISRs:
+        let mut store = EvtStore::new();
+        for i in 0..1000u32 {
+            let ts = i as u64 * 10;
+            let task_id = i % 4;
+            store.push(0, isr_enter(ts, 0));
+            store.push(0, freertos(ts + 1, F::TaskToRdyState(FreeRTOSTaskToRdyStateEvt { task_id })));
+            store.push(
+                0,
+                RawEvt::Base(BaseEvt {
+                    ts: ts + 2,
+                    kind: BaseEvtKind::IsrExit(BaseIsrExitEvt { isr_id: 0 }),
+                }),
+            );
+            store.push(0, freertos(ts + 3, F::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id })));
+            store.push(
+                0,
+                freertos(
+                    ts + 4,
+                    F::QueueSend(FreeRTOSQueueSendEvt {
+                        queue_id: 0,
+                        len_after: 1,
+                    }),
+                ),
+            );
+            store.push(
+                0,
+                freertos(
+                    ts + 5,
+                    F::QueueReceive(FreeRTOSQueueReceiveEvt {
+                        queue_id: 0,
+                        len_after: 0,
+                    }),
+                ),
+            );
+            store.push(0, freertos(ts + 6, F::CurtaskDelay(FreeRTOSCurtaskDelayEvt { ticks: 1 })));
+            if i % 10 == 0 {
+                let evt = F::TaskEvtmarker(FreeRTOSTaskEvtmarkerEvt {
+                    evtmarker_id: 0,
+                    msg: "tick".into(),
+                });
+                store.push(0, freertos(ts + 7, evt));
+            }
+        }
+
+        // Sorted events are merged into the final store, as done by the converter:
+        let store = EvtStore::merge(vec![store]);
+        let bytes_per_evt = store.allocated_bytes() as f64 / store.len() as f64;
+        assert!(bytes_per_evt <= 24.0, "{bytes_per_evt} bytes per event");
+    }
+}
@@ -0,0 +1,149 @@
+use std::collections::{BTreeMap, VecDeque};
+
+use serde::{Deserialize, Serialize};
+
+use crate::trace::checkpoint::{
+    evt_marker_checkpoints, restore_evt_markers, restore_val_markers, val_marker_checkpoints, EvtMarkerCheckpoint,
+    ValMarkerCheckpoint,
+};
+
+use super::{FreeRTOSTrace, HeapAllocation, PriorityInversion, QueueKind, QueueState, TaskKind, TaskState};
+
+/// FreeRTOS part of a [`crate::ConverterCheckpoint`].
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub(crate) struct FreeRTOSCheckpoint {
+    tasks: Vec<TaskCheckpoint>,
+    queues: Vec<QueueCheckpoint>,
+    heap_in_use: Option<i64>,
+    heap_outstanding: BTreeMap<u64, HeapAllocation>,
+    open_priority_inversions: Vec<PriorityInversion>,
+    #[serde(default)]
+    flow_cnt: u64,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+struct TaskCheckpoint {
+    id: usize,
+    name: Option<String>,
+    kind: TaskKind,
+    state: Option<TaskState>,
+    state_when_switched_out: TaskState,
+    last_core_id: Option<usize>,
+    priority: Option<u32>,
+    stack_high_water_mark: Option<u32>,
+    #[serde(default)]
+    heap_alloc_run_start: Option<u64>,
+    #[serde(default)]
+    heap_alloc_run_bytes: u64,
+    user_evt_markers: BTreeMap<usize, EvtMarkerCheckpoint>,
+    user_val_markers: BTreeMap<usize, ValMarkerCheckpoint>,
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+struct QueueCheckpoint {
+    id: usize,
+    name: Option<String>,
+    kind: QueueKind,
+    created_ts: Option<u64>,
+    state: Option<QueueState>,
+    /// Flows of the items in the queue, so that items received after the checkpoint still end
+    /// the flow that was started when they were sent.
+    #[serde(default)]
+    item_flow_ids: VecDeque<Option<u64>>,
+}
+
+impl FreeRTOSTrace {
+    pub(crate) fn checkpoint(&self) -> FreeRTOSCheckpoint {
+        let tasks = self
+            .tasks
+            .iter()
+            .map(|(id, task)| TaskCheckpoint {
+                id,
+                name: task.name.clone(),
+                kind: task.kind.clone(),
+                state: task.state.0.last().map(|x| x.inner.clone()),
+                state_when_switched_out: task.state_when_switched_out.clone(),
+                last_core_id: task.last_core_id,
+                priority: task.priority.0.last().map(|x| x.inner),
+                stack_high_water_mark: task.stack_high_water_mark.0.last().map(|x| x.inner),
+                heap_alloc_run_start: task.heap_alloc_run_start,
+                heap_alloc_run_bytes: task.heap_alloc_run_bytes,
+                user_evt_markers: evt_marker_checkpoints(&task.user_evt_markers),
+                user_val_markers: val_marker_checkpoints(&task.user_val_markers),
+            })
+            .collect();
+
+        let queues = self
+            .queues
+            .iter()
+            .map(|(id, queue)| QueueCheckpoint {
+                id,
+                name: queue.name.clone(),
+                kind: queue.kind.clone(),
+                created_ts: queue.created_ts,
+                state: queue.state.0.last().map(|x| x.inner.clone()),
+                item_flow_ids: queue.item_flow_ids.clone(),
+            })
+            .collect();
+
+        FreeRTOSCheckpoint {
+            tasks,
+            queues,
+            heap_in_use: self.heap.in_use.0.last().map(|x| x.inner),
+            heap_outstanding: self.heap.outstanding.clone(),
+            open_priority_inversions: self
+                .open_priority_inversions
+                .values()
+                .map(|idx| self.priority_inversions[*idx].clone())
+                .collect(),
+            flow_cnt: self.flow_cnt,
+        }
+    }
+
+    pub(crate) fn restore_checkpoint(&mut self, ts: u64, cp: &FreeRTOSCheckpoint) {
+        for task_cp in &cp.tasks {
+            let task = self.tasks.get_mut_or_create(task_cp.id);
+            task.name = task_cp.name.clone();
+            task.kind = task_cp.kind.clone();
+            if let Some(state) = &task_cp.state {
+                task.state.push(ts, state.clone());
+            }
+            task.state_when_switched_out = task_cp.state_when_switched_out.clone();
+            task.last_core_id = task_cp.last_core_id;
+            if let Some(priority) = task_cp.priority {
+                task.priority.push(ts, priority);
+            }
+            if let Some(stack_high_water_mark) = task_cp.stack_high_water_mark {
+                task.stack_high_water_mark.push(ts, stack_high_water_mark);
+            }
+            task.heap_alloc_run_start = task_cp.heap_alloc_run_start;
+            task.heap_alloc_run_bytes = task_cp.heap_alloc_run_bytes;
+            restore_evt_markers(ts, &mut task.user_evt_markers, &task_cp.user_evt_markers);
+            restore_val_markers(ts, &mut task.user_val_markers, &task_cp.user_val_markers);
+        }
+
+        for queue_cp in &cp.queues {
+            let queue = self.queues.get_mut_or_create(queue_cp.id);
+            queue.name = queue_cp.name.clone();
+            queue.kind = queue_cp.kind.clone();
+            queue.created_ts = queue_cp.created_ts;
+            if let Some(state) = &queue_cp.state {
+                queue.state.push(ts, state.clone());
+            }
+            queue.item_flow_ids = queue_cp.item_flow_ids.clone();
+        }
+
+        if let Some(in_use) = cp.heap_in_use {
+            self.heap.in_use.push(ts, in_use);
+        }
+        self.heap.outstanding = cp.heap_outstanding.clone();
+
+        for inversion in &cp.open_priority_inversions {
+            self.open_priority_inversions
+                .insert(inversion.holder_task_id, self.priority_inversions.len());
+            self.priority_inversions.push(inversion.clone());
+        }
+
+        self.flow_cnt = cp.flow_cnt;
+    }
+}
@@ -2,55 +2,142 @@ use log::warn;
 
 use crate::{
     convert::TraceConverter,
-    decode::evts::{FreeRTOSEvt, FreeRTOSEvtKind, FreeRTOSMetadataEvt},
-    Trace, TraceErrMarker, UserEvtMarker,
+    decode::evts::{FrTaskState, FreeRTOSEvt, FreeRTOSEvtKind, FreeRTOSMetadataEvt},
+    ISRState, Trace, TraceErrMarker, UserEvtMarker,
 };
 
-use super::{QueueKind, QueueState, TaskBlockingReason, TaskKind, TaskState};
+use super::{
+    FlowEvt, FlowEvtKind, HeapAllocation, PriorityInversion, QueueKind, QueueState, TaskBlockingReason, TaskKind,
+    TaskMigration, TaskState,
+};
 
 impl TraceConverter {
     pub(crate) fn convert_freertos_evt(&self, t: &mut Trace, core_id: usize, e: &FreeRTOSEvt) {
         let ts = e.ts;
 
         match &e.kind {
+            // State dump, taken when streaming was started while the system was already running:
+            FreeRTOSEvtKind::TaskState(evt) => {
+                let task_id = evt.task_id as usize;
+                let state = match evt.state {
+                    FrTaskState::FrtsRunning => {
+                        // A task reported as running by a state dump is handled like a switch-in at
+                        // the time of the dump. This counts as a migration if it last ran on a
+                        // different core (such as before streaming was restarted).
+                        let running_core_id = evt.core_id as usize;
+                        if running_core_id < t.core_count {
+                            switch_in_task(t, ts, running_core_id, task_id);
+                        } else {
+                            warn!("[{ts:012}] Task #{task_id} reported as running on unknown core {running_core_id}.");
+                        }
+                        return;
+                    }
+                    FrTaskState::FrtsReady => TaskState::Ready,
+                    FrTaskState::FrtsBlocked => TaskState::Blocked(TaskBlockingReason::Unknown),
+                    FrTaskState::FrtsSuspended => TaskState::Suspended { by_task_id: None },
+                    FrTaskState::FrtsDeleted => TaskState::Deleted { by_task_id: None },
+                };
+                let task = t.freertos.tasks.get_mut_or_create(task_id);
+                task.state_when_switched_out = TaskState::Ready;
+                task.state.push(ts, state);
+            }
+
+            FreeRTOSEvtKind::TaskStackHighWaterMark(evt) => {
+                let task_id = evt.task_id as usize;
+                t.freertos
+                    .tasks
+                    .get_mut_or_create(task_id)
+                    .stack_high_water_mark
+                    .push(ts, evt.min_free_bytes);
+            }
+
+            FreeRTOSEvtKind::HeapMalloc(evt) => {
+                let task_id = t.core(core_id).freertos.current_task_id;
+                let heap = &mut t.freertos.heap;
+                let allocation = HeapAllocation {
+                    ts,
+                    size: evt.size,
+                    task_id,
+                };
+                if let Some(previous) = heap.outstanding.insert(evt.addr, allocation) {
+                    warn!(
+                        "[{ts:012}] Heap allocation at 0x{:X} was never freed before being allocated again.",
+                        evt.addr
+                    );
+                    heap.record_in_use_change(ts, -(previous.size as i64));
+                }
+                heap.record_in_use_change(ts, evt.size as i64);
+                if let Some(task_id) = task_id {
+                    t.freertos.tasks.get_mut_or_create(task_id).heap_alloc_run_bytes += evt.size as u64;
+                }
+            }
+
+            FreeRTOSEvtKind::HeapFree(evt) => {
+                // Frees of allocations made before the trace started also lower heap usage, so that
+                // it matches the usage derived from aggregated heap events (which carry no addresses).
+                let size = match t.freertos.heap.outstanding.remove(&evt.addr) {
+                    Some(allocation) => allocation.size,
+                    None => evt.size,
+                };
+                t.freertos.heap.record_in_use_change(ts, -(size as i64));
+            }
+
+            FreeRTOSEvtKind::TaskHeapUsage(evt) => {
+                let task_id = evt.task_id as usize;
+                let delta = evt.malloc_bytes as i64 - evt.free_bytes as i64;
+                t.freertos.heap.record_in_use_change(ts, delta);
+                // Task ID 0 is reserved and marks allocations made before the scheduler started:
+                if task_id != 0 {
+                    // Usage is traced when the task is switched out or tracing is stopped, which ends
+                    // the run it was accumulated over:
+                    let ts_resolution_ns = t.ts_resolution_ns.unwrap_or(1);
+                    let task = t.freertos.tasks.get_mut_or_create(task_id);
+                    task.heap_alloc_run_bytes += evt.malloc_bytes as u64;
+                    task.record_heap_alloc_rate(ts, ts_resolution_ns);
+                }
+            }
+
             FreeRTOSEvtKind::TaskSwitchedIn(evt) => {
                 let task_id = evt.task_id as usize;
                 t.freertos.tasks.ensure_exists(task_id);
 
                 // Switch-out previous task (if any):
                 if let Some(previous_task_id) = t.core(core_id).freertos.current_task_id {
+                    let ts_resolution_ns = t.ts_resolution_ns.unwrap_or(1);
                     let previous_task = t.freertos.tasks.get_mut_or_create(previous_task_id);
                     previous_task
                         .state
                         .push(ts, previous_task.state_when_switched_out.clone());
+                    previous_task.record_heap_alloc_rate(ts, ts_resolution_ns);
+                    previous_task.heap_alloc_run_start = None;
                 }
 
                 // Switch-in next task:
-                t.freertos.tasks.get_mut_or_create(task_id).state_when_switched_out = TaskState::Ready;
-                t.freertos
-                    .tasks
-                    .get_mut_or_create(task_id)
-                    .state
-                    .push(ts, TaskState::Running { core_id });
-                t.core_mut(core_id).freertos.current_task_id = Some(task_id);
+                switch_in_task(t, ts, core_id, task_id);
             }
 
             FreeRTOSEvtKind::TaskToRdyState(evt) => {
                 let task_id = evt.task_id as usize;
-                let task = t.freertos.tasks.get_mut_or_create(task_id);
-                if !task.is_running() {
-                    task.state.push(ts, TaskState::Ready);
+                if !t.freertos.tasks.get_mut_or_create(task_id).is_running() {
+                    task_woken(t, ts, core_id, task_id);
+                    t.freertos
+                        .tasks
+                        .get_mut_or_create(task_id)
+                        .state
+                        .push(ts, TaskState::Ready);
                 }
             }
 
             FreeRTOSEvtKind::TaskResumed(evt) => {
                 let task_id = evt.task_id as usize;
+                task_woken(t, ts, core_id, task_id);
                 let task = t.freertos.tasks.get_mut_or_create(task_id);
                 task.state.push(ts, TaskState::Ready);
             }
 
             FreeRTOSEvtKind::TaskResumedFromIsr(evt) => {
                 let task_id = evt.task_id as usize;
+                task_woken(t, ts, core_id, task_id);
                 let task = t.freertos.tasks.get_mut_or_create(task_id);
                 task.state.push(ts, TaskState::Ready);
             }
@@ -110,11 +197,42 @@ impl TraceConverter {
 
             FreeRTOSEvtKind::TaskPriorityInherit(evt) => {
                 let task_id = evt.task_id as usize;
-                t.freertos
-                    .tasks
-                    .get_mut_or_create(task_id)
-                    .priority
-                    .push(ts, evt.priority);
+
+                // Priority is inherited by the mutex holder from the current task, right after
+                // the current task started blocking on the mutex:
+                let waiter_task_id = t.core(core_id).freertos.current_task_id;
+                let queue_id = waiter_task_id.and_then(|id| match t.freertos.tasks.get(id)?.state_when_switched_out {
+                    TaskState::Blocked(TaskBlockingReason::QueueReceive { queue_id }) => Some(queue_id),
+                    _ => None,
+                });
+
+                let task = t.freertos.tasks.get_mut_or_create(task_id);
+                let base_priority = task.priority.0.last().map(|x| x.inner);
+                task.priority.push(ts, evt.priority);
+
+                let freertos = &mut t.freertos;
+                if let Some(idx) = freertos.open_priority_inversions.get(&task_id) {
+                    let inversion = &mut freertos.priority_inversions[*idx];
+                    inversion.inherited_priority = u32::max(inversion.inherited_priority, evt.priority);
+                    if let Some(waiter_task_id) = waiter_task_id {
+                        if !inversion.waiter_task_ids.contains(&waiter_task_id) {
+                            inversion.waiter_task_ids.push(waiter_task_id);
+                        }
+                    }
+                } else {
+                    freertos
+                        .open_priority_inversions
+                        .insert(task_id, freertos.priority_inversions.len());
+                    freertos.priority_inversions.push(PriorityInversion {
+                        start_ts: ts,
+                        end_ts: None,
+                        holder_task_id: task_id,
+                        base_priority,
+                        inherited_priority: evt.priority,
+                        waiter_task_ids: waiter_task_id.into_iter().collect(),
+                        queue_id,
+                    });
+                }
             }
 
             FreeRTOSEvtKind::TaskPriorityDisinherit(evt) => {
@@ -124,6 +242,10 @@ impl TraceConverter {
                     .get_mut_or_create(task_id)
                     .priority
                     .push(ts, evt.priority);
+
+                if let Some(idx) = t.freertos.open_priority_inversions.remove(&task_id) {
+                    t.freertos.priority_inversions[idx].end_ts = Some(ts);
+                }
             }
 
             FreeRTOSEvtKind::TaskCreated(evt) => {
@@ -151,7 +273,7 @@ impl TraceConverter {
 
             FreeRTOSEvtKind::QueueCreated(evt) => {
                 let queue_id = evt.queue_id as usize;
-                t.freertos.queues.ensure_exists(queue_id);
+                t.freertos.queues.get_mut_or_create(queue_id).created_ts = Some(ts);
             }
 
             FreeRTOSEvtKind::QueueSend(evt) => {
@@ -165,6 +287,7 @@ impl TraceConverter {
                         by_task: current_task,
                     },
                 );
+                queue_item_sent(t, ts, core_id, queue_id, evt.len_after, false);
             }
 
             FreeRTOSEvtKind::QueueSendFromIsr(evt) => {
@@ -177,6 +300,7 @@ impl TraceConverter {
                         by_task: None,
                     },
                 );
+                queue_item_sent(t, ts, core_id, queue_id, evt.len_after, false);
             }
 
             FreeRTOSEvtKind::QueueOverwrite(evt) => {
@@ -190,6 +314,7 @@ impl TraceConverter {
                         by_task: current_task,
                     },
                 );
+                queue_item_sent(t, ts, core_id, queue_id, evt.len_after, true);
             }
 
             FreeRTOSEvtKind::QueueOverwriteFromIsr(evt) => {
@@ -202,6 +327,7 @@ impl TraceConverter {
                         by_task: None,
                     },
                 );
+                queue_item_sent(t, ts, core_id, queue_id, evt.len_after, true);
             }
 
             FreeRTOSEvtKind::QueueReceive(evt) => {
@@ -215,6 +341,7 @@ impl TraceConverter {
                         by_task: current_task,
                     },
                 );
+                queue_item_received(t, ts, core_id, queue_id, evt.len_after);
             }
 
             FreeRTOSEvtKind::QueueReceiveFromIsr(evt) => {
@@ -227,6 +354,7 @@ impl TraceConverter {
                         by_task: None,
                     },
                 );
+                queue_item_received(t, ts, core_id, queue_id, evt.len_after);
             }
 
             FreeRTOSEvtKind::QueueReset(evt) => {
@@ -240,6 +368,7 @@ impl TraceConverter {
                         by_task: current_task,
                     },
                 );
+                t.freertos.queues.get_mut_or_create(queue_id).item_flow_ids.clear();
             }
 
             FreeRTOSEvtKind::QueueCurLength(evt) => {
@@ -253,6 +382,7 @@ impl TraceConverter {
                         by_task: current_task,
                     },
                 );
+                queue_items_left(t, queue_id, evt.length);
             }
 
             FreeRTOSEvtKind::CurtaskBlockOnQueuePeek(evt) => {
@@ -307,9 +437,7 @@ impl TraceConverter {
                         .get_mut_or_create(current_task_id)
                         .user_evt_markers
                         .get_mut_or_create(evtmarker_id);
-                    evtmarker
-                        .markers
-                        .push(ts, UserEvtMarker::Instant { msg: evt.msg.clone() })
+                    evtmarker.push_marker(ts, UserEvtMarker::Instant { msg: evt.msg.clone() })
                 } else {
                     warn!("[{ts:012}] Received current task event while current task is not known ({:?}).", evt);
                     t.error_evts.push(ts, TraceErrMarker::no_current_task(core_id));
@@ -325,9 +453,7 @@ impl TraceConverter {
                         .get_mut_or_create(current_task_id)
                         .user_evt_markers
                         .get_mut_or_create(evtmarker_id);
-                    evtmarker
-                        .markers
-                        .push(ts, UserEvtMarker::SliceBegin { msg: evt.msg.clone() })
+                    evtmarker.push_marker(ts, UserEvtMarker::SliceBegin { msg: evt.msg.clone() })
                 } else {
                     warn!("[{ts:012}] Received current task event while current task is not known ({:?}).", evt);
                     t.error_evts.push(ts, TraceErrMarker::no_current_task(core_id));
@@ -343,7 +469,7 @@ impl TraceConverter {
                         .get_mut_or_create(current_task_id)
                         .user_evt_markers
                         .get_mut_or_create(evtmarker_id);
-                    evtmarker.markers.push(ts, UserEvtMarker::SliceEnd)
+                    evtmarker.push_marker(ts, UserEvtMarker::SliceEnd)
                 } else {
                     warn!("[{ts:012}] Received current task event while current task is not known ({:?}).", evt);
                     t.error_evts.push(ts, TraceErrMarker::no_current_task(core_id));
@@ -374,14 +500,14 @@ impl TraceConverter {
                 let task_id = evt.task_id as usize;
                 let task = t.freertos.tasks.get_mut_or_create(task_id);
                 if let Some(previous_name) = &mut task.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overwriting task #{task_id} name from '{previous_name}' to '{}'.",
                             evt.name
                         );
                     }
                 }
-                task.name = Some(evt.name.clone());
+                task.name = Some(evt.name.to_string());
             }
 
             FreeRTOSMetadataEvt::TaskIsIdleTask(evt) => {
@@ -410,14 +536,14 @@ impl TraceConverter {
                 let queue_id = evt.queue_id as usize;
                 let queue = t.freertos.queues.get_mut_or_create(queue_id);
                 if let Some(previous_name) = &mut queue.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overwriting queue #{queue_id} name from '{previous_name}' to '{}'.",
                             evt.name
                         );
                     }
                 }
-                queue.name = Some(evt.name.clone());
+                queue.name = Some(evt.name.to_string());
             }
 
             FreeRTOSMetadataEvt::QueueKind(evt) => {
@@ -440,7 +566,7 @@ impl TraceConverter {
                     .user_evt_markers
                     .get_mut_or_create(evtmarker_id);
                 if let Some(previous_name) = &evtmarker.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overwriting Task #{} Marker #{evtmarker_id} name from '{previous_name}' to '{}'.",
                             task_id,
@@ -448,7 +574,7 @@ impl TraceConverter {
                         );
                     }
                 }
-                evtmarker.name = Some(evt.name.clone());
+                evtmarker.name = Some(evt.name.to_string());
             }
 
             FreeRTOSMetadataEvt::TaskValmarkerName(evt) => {
@@ -461,15 +587,458 @@ impl TraceConverter {
                     .user_val_markers
                     .get_mut_or_create(valmarker_id);
                 if let Some(previous_name) = &valmarker.name {
-                    if *previous_name != evt.name {
+                    if **previous_name != *evt.name {
                         warn!(
                             "[--METADATA--] Overwriting Value Marker #{valmarker_id} name from '{previous_name}' to '{}'.",
                             evt.name
                         );
                     }
                 }
-                valmarker.name = Some(evt.name.clone());
+                valmarker.name = Some(evt.name.to_string());
+            }
+        }
+    }
+}
+
+/// Task or ISR in which an event happened.
+#[derive(Clone, Copy)]
+enum FlowActor {
+    Task(usize),
+    Isr(usize),
+}
+
+/// The innermost ISR that is active on a core, or else the task running on it.
+fn current_flow_actor(t: &Trace, core_id: usize) -> Option<FlowActor> {
+    let core = t.core(core_id);
+    let active_isr = core
+        .isrs
+        .iter()
+        .filter(|(_, isr)| matches!(isr.current_state, ISRState::Active))
+        .max_by_key(|(_, isr)| isr.state.0.last().map(|x| x.ts));
+    match active_isr {
+        Some((isr_id, _)) => Some(FlowActor::Isr(isr_id)),
+        None => core.freertos.current_task_id.map(FlowActor::Task),
+    }
+}
+
+fn push_flow_evt(t: &mut Trace, ts: u64, core_id: usize, actor: FlowActor, flow_id: u64, kind: FlowEvtKind) {
+    let evt = FlowEvt { flow_id, kind };
+    match actor {
+        FlowActor::Task(task_id) => t.freertos.tasks.get_mut_or_create(task_id).flows.push(ts, evt),
+        FlowActor::Isr(isr_id) => t.core_mut(core_id).isrs.get_mut_or_create(isr_id).flows.push(ts, evt),
+    }
+}
+
+fn new_flow_id(t: &mut Trace) -> u64 {
+    // Flow IDs start at 1, leaving 0 unused:
+    t.freertos.flow_cnt += 1;
+    t.freertos.flow_cnt
+}
+
+// Start a flow at an item being sent to a queue by the current task or ISR. It ends where the item
+// is received (see `queue_item_received`). Mutexes are not followed, since giving and taking them
+// does not pass on anything.
+fn queue_item_sent(t: &mut Trace, ts: u64, core_id: usize, queue_id: usize, len_after: u32, overwrite: bool) {
+    if t.freertos.queues.get_mut_or_create(queue_id).kind.is_mutex() {
+        return;
+    }
+
+    let flow_id = match current_flow_actor(t, core_id) {
+        Some(actor) => {
+            let flow_id = new_flow_id(t);
+            push_flow_evt(t, ts, core_id, actor, flow_id, FlowEvtKind::QueueSend { queue_id });
+            Some(flow_id)
+        }
+        None => None,
+    };
+
+    let queue = t.freertos.queues.get_mut_or_create(queue_id);
+    if overwrite {
+        queue.item_flow_ids.clear();
+    }
+    queue.item_flow_ids.push_back(flow_id);
+    queue_items_left(t, queue_id, len_after);
+}
+
+// End the flow of the oldest item of a queue, which was just received by the current task or ISR.
+// Items are received in the order they were sent.
+fn queue_item_received(t: &mut Trace, ts: u64, core_id: usize, queue_id: usize, len_after: u32) {
+    let queue = t.freertos.queues.get_mut_or_create(queue_id);
+
+    // Unless more items were sent during the trace than are left, the received item was sent
+    // before the trace started:
+    if queue.item_flow_ids.len() > len_after as usize {
+        if let Some(flow_id) = queue.item_flow_ids.pop_front().flatten() {
+            if let Some(actor) = current_flow_actor(t, core_id) {
+                push_flow_evt(t, ts, core_id, actor, flow_id, FlowEvtKind::QueueReceive { queue_id });
             }
         }
     }
+    queue_items_left(t, queue_id, len_after);
+}
+
+// Drop the oldest items of a queue that are known to have left it, such as after events were
+// dropped.
+fn queue_items_left(t: &mut Trace, queue_id: usize, len: u32) {
+    let item_flow_ids = &mut t.freertos.queues.get_mut_or_create(queue_id).item_flow_ids;
+    while item_flow_ids.len() > len as usize {
+        item_flow_ids.pop_front();
+    }
+}
+
+// Connect a blocked or suspended task that is being made ready to the task or ISR that did so with
+// a flow. Must be called before the task's state is updated. Tasks whose delay expired are made
+// ready by the tick interrupt, and not by the task that happens to be running, so they are only
+// connected to an ISR.
+fn task_woken(t: &mut Trace, ts: u64, core_id: usize, task_id: usize) {
+    let delay_expired = match t.freertos.tasks.get(task_id).and_then(|task| task.state.0.last()) {
+        Some(state) => match &state.inner {
+            TaskState::Blocked(TaskBlockingReason::Delay { .. } | TaskBlockingReason::DelayUntil { .. }) => true,
+            TaskState::Blocked(_) | TaskState::Suspended { .. } => false,
+            _ => return,
+        },
+        None => return,
+    };
+
+    let actor = match current_flow_actor(t, core_id) {
+        Some(FlowActor::Task(waker_id)) if delay_expired || waker_id == task_id => return,
+        Some(actor) => actor,
+        None => return,
+    };
+
+    let flow_id = new_flow_id(t);
+    push_flow_evt(t, ts, core_id, actor, flow_id, FlowEvtKind::Wake { task_id });
+    push_flow_evt(t, ts, core_id, FlowActor::Task(task_id), flow_id, FlowEvtKind::Woken);
+}
+
+// Mark a task as running on a core, recording a migration if it last ran on a different core.
+fn switch_in_task(t: &mut Trace, ts: u64, core_id: usize, task_id: usize) {
+    let task = t.freertos.tasks.get_mut_or_create(task_id);
+    if let Some(last_core_id) = task.last_core_id {
+        if last_core_id != core_id {
+            task.migrations.push(
+                ts,
+                TaskMigration {
+                    from_core_id: last_core_id,
+                    to_core_id: core_id,
+                },
+            );
+        }
+    }
+    task.last_core_id = Some(core_id);
+    task.heap_alloc_run_start = Some(ts);
+    task.state_when_switched_out = TaskState::Ready;
+    task.state.push(ts, TaskState::Running { core_id });
+
+    let core = &mut t.core_mut(core_id).freertos;
+    core.running_task.push(ts, task_id);
+    core.current_task_id = Some(task_id);
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        convert::TraceConverter,
+        decode::evts::{
+            BaseCoreIdEvt, BaseEvt, BaseEvtKind, FrTaskState, FreeRTOSEvt, FreeRTOSEvtKind, FreeRTOSHeapFreeEvt,
+            FreeRTOSHeapMallocEvt, FreeRTOSMetadataEvt, FreeRTOSQueueReceiveEvt, FreeRTOSQueueSendEvt,
+            FreeRTOSTaskHeapUsageEvt, FreeRTOSTaskNameEvt, FreeRTOSTaskStackHighWaterMarkEvt, FreeRTOSTaskStateEvt,
+            FreeRTOSTaskSwitchedInEvt, RawEvt, TraceMode,
+        },
+        generate_perfetto::PerfettoGenerator,
+        trace::freertos::{FlowEvtKind, TaskMigration, TaskState},
+        Trace,
+    };
+
+    fn evt(ts: u64, kind: FreeRTOSEvtKind) -> RawEvt {
+        RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind })
+    }
+
+    fn switched_in(ts: u64, task_id: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id }))
+    }
+
+    fn malloc(ts: u64, addr: u64, size: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::HeapMalloc(FreeRTOSHeapMallocEvt { addr, size }))
+    }
+
+    fn free(ts: u64, addr: u64, size: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::HeapFree(FreeRTOSHeapFreeEvt { addr, size }))
+    }
+
+    fn heap_usage(ts: u64, task_id: u32, malloc_bytes: u32, free_bytes: u32) -> RawEvt {
+        evt(
+            ts,
+            FreeRTOSEvtKind::TaskHeapUsage(FreeRTOSTaskHeapUsageEvt {
+                task_id,
+                malloc_cnt: u32::from(malloc_bytes != 0),
+                malloc_bytes,
+                free_cnt: u32::from(free_bytes != 0),
+                free_bytes,
+            }),
+        )
+    }
+
+    fn stack_hwm(ts: u64, task_id: u32, min_free_bytes: u32) -> RawEvt {
+        let kind = FreeRTOSTaskStackHighWaterMarkEvt {
+            task_id,
+            min_free_bytes,
+        };
+        evt(ts, FreeRTOSEvtKind::TaskStackHighWaterMark(kind))
+    }
+
+    fn task_name(task_id: u32, name: &str) -> RawEvt {
+        let name = name.into();
+        RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskName(FreeRTOSTaskNameEvt { task_id, name }))
+    }
+
+    fn core_id(ts: u64, core_id: u32) -> RawEvt {
+        RawEvt::Base(BaseEvt {
+            ts,
+            kind: BaseEvtKind::CoreId(BaseCoreIdEvt { core_id }),
+        })
+    }
+
+    fn dumped_running(ts: u64, task_id: u32, core_id: u32) -> RawEvt {
+        let state = FrTaskState::FrtsRunning;
+        evt(
+            ts,
+            FreeRTOSEvtKind::TaskState(FreeRTOSTaskStateEvt {
+                task_id,
+                state,
+                core_id,
+            }),
+        )
+    }
+
+    fn convert(core_count: usize, evts: &[RawEvt]) -> Trace {
+        let mut c = TraceConverter::new(core_count, TraceMode::FreeRTOS).unwrap();
+        c.add_evts(evts).unwrap();
+        c.convert().unwrap()
+    }
+
+    fn values<T: Clone>(series: &crate::Timeseries<T>) -> Vec<(u64, T)> {
+        series.0.iter().map(|x| (x.ts, x.inner.clone())).collect()
+    }
+
+    #[test]
+    fn heap_usage_matches_in_both_modes() {
+        // Task 1 allocates 100 bytes, and frees a 30 byte block allocated before the trace started.
+        // Task 2 then allocates 50 bytes. Tracing is stopped at ts 40.
+        let per_evt = convert(
+            1,
+            &[
+                switched_in(0, 1),
+                malloc(5, 0x1000, 100),
+                free(6, 0x2000, 30),
+                switched_in(10, 2),
+                malloc(20, 0x3000, 50),
+                switched_in(40, 1),
+            ],
+        );
+        let aggregated = convert(
+            1,
+            &[
+                switched_in(0, 1),
+                heap_usage(10, 1, 100, 30),
+                switched_in(10, 2),
+                heap_usage(40, 2, 50, 0),
+            ],
+        );
+
+        let in_use = |t: &Trace| t.freertos.heap.in_use.0.last().map(|x| x.inner);
+        assert_eq!(in_use(&per_evt), Some(120));
+        assert_eq!(in_use(&aggregated), Some(120));
+
+        // The block allocated before the trace lowers the usage below zero if freed first:
+        let t = convert(1, &[switched_in(0, 1), free(1, 0x2000, 30)]);
+        assert_eq!(values(&t.freertos.heap.in_use), [(1, -30)]);
+    }
+
+    #[test]
+    fn heap_alloc_rate() {
+        // 1ns timestamps. Task 1 allocates 100 bytes during its run from 0 to 10, task 2 allocates
+        // nothing from 10 to 20, and task 1 allocates another 50 bytes from 20 to 45.
+        let expected_1 = [(0, 10_000_000_000), (10, 0), (20, 2_000_000_000), (45, 0)];
+
+        let per_evt = convert(
+            1,
+            &[
+                switched_in(0, 1),
+                malloc(2, 0x1000, 60),
+                malloc(8, 0x2000, 40),
+                switched_in(10, 2),
+                switched_in(20, 1),
+                malloc(30, 0x3000, 50),
+                switched_in(45, 2),
+            ],
+        );
+        assert_eq!(values(&per_evt.freertos.tasks.get(1).unwrap().heap_alloc_rate), expected_1);
+        assert!(per_evt.freertos.tasks.get(2).unwrap().heap_alloc_rate.0.is_empty());
+
+        // Aggregated usage is traced just before the next task is switched in, or when tracing is
+        // stopped (at 45, while task 1 is still running):
+        let aggregated = convert(
+            1,
+            &[
+                switched_in(0, 1),
+                heap_usage(10, 1, 100, 0),
+                switched_in(10, 2),
+                switched_in(20, 1),
+                heap_usage(45, 1, 50, 0),
+            ],
+        );
+        assert_eq!(values(&aggregated.freertos.tasks.get(1).unwrap().heap_alloc_rate), expected_1);
+    }
+
+    #[test]
+    fn heap_alloc_rate_ignores_runs_started_before_trace() {
+        // Task 1 was already running when the trace started, so the duration of its run is unknown:
+        let t = convert(
+            1,
+            &[
+                malloc(5, 0x1000, 100),
+                switched_in(10, 1),
+                malloc(12, 0x2000, 10),
+                switched_in(20, 2),
+            ],
+        );
+        let task_1 = t.freertos.tasks.get(1).unwrap();
+        assert_eq!(values(&task_1.heap_alloc_rate), [(10, 1_000_000_000), (20, 0)]);
+    }
+
+    #[test]
+    fn stack_high_water_mark() {
+        let evts = [
+            task_name(1, "worker"),
+            switched_in(0, 1),
+            stack_hwm(10, 1, 512),
+            stack_hwm(20, 2, 128),
+            stack_hwm(30, 1, 256),
+            switched_in(40, 2),
+        ];
+        let t = convert(1, &evts);
+        assert_eq!(values(&t.freertos.tasks.get(1).unwrap().stack_high_water_mark), [(10, 512), (30, 256)]);
+        assert_eq!(values(&t.freertos.tasks.get(2).unwrap().stack_high_water_mark), [(20, 128)]);
+
+        // Every sampled task gets a counter track:
+        let data = PerfettoGenerator::new().generate(&t);
+        let track = b"Task worker (#1) Stack High Water Mark";
+        assert!(data.windows(track.len()).any(|w| w == track));
+    }
+
+    #[test]
+    fn stack_high_water_mark_checkpoint() {
+        let evts = [
+            switched_in(0, 1),
+            stack_hwm(10, 1, 512),
+            switched_in(20, 2),
+            stack_hwm(30, 1, 256),
+            switched_in(40, 1),
+        ];
+        let mut full = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        full.add_evts(&evts).unwrap();
+        let (_, checkpoints) = full.convert_with_checkpoints(15).unwrap();
+        assert_eq!(checkpoints[0].ts, 15);
+
+        // The last sample before the checkpoint is restored at its start:
+        let mut window = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        window.restore_checkpoint(checkpoints[0].clone()).unwrap();
+        window.add_evts(&evts).unwrap();
+        let t = window.convert().unwrap();
+        assert_eq!(values(&t.freertos.tasks.get(1).unwrap().stack_high_water_mark), [(15, 512), (30, 256)]);
+    }
+
+    #[test]
+    fn queue_flow_checkpoint() {
+        let send = FreeRTOSQueueSendEvt {
+            queue_id: 0,
+            len_after: 1,
+        };
+        let receive = FreeRTOSQueueReceiveEvt {
+            queue_id: 0,
+            len_after: 0,
+        };
+        let evts = [
+            switched_in(0, 1),
+            evt(10, FreeRTOSEvtKind::QueueSend(send)),
+            switched_in(20, 2),
+            evt(30, FreeRTOSEvtKind::QueueReceive(receive)),
+            switched_in(40, 1),
+        ];
+        let mut full = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        full.add_evts(&evts).unwrap();
+        let (_, checkpoints) = full.convert_with_checkpoints(15).unwrap();
+
+        // The item queued before the checkpoint still ends the flow it started when received:
+        let mut window = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        window.restore_checkpoint(checkpoints[0].clone()).unwrap();
+        window.add_evts(&evts).unwrap();
+        let t = window.convert().unwrap();
+        let flows = &t.freertos.tasks.get(2).unwrap().flows.0;
+        assert_eq!(flows.len(), 1);
+        assert_eq!(flows[0].ts, 30);
+        assert_eq!(flows[0].inner.flow_id, 1);
+        assert!(matches!(flows[0].inner.kind, FlowEvtKind::QueueReceive { queue_id: 0 }));
+    }
+
+    #[test]
+    fn task_migration() {
+        let evts = [
+            switched_in(0, 1),
+            switched_in(10, 3),
+            core_id(0, 1),
+            switched_in(0, 2),
+            switched_in(20, 1),
+            switched_in(30, 2),
+            core_id(40, 0),
+            switched_in(40, 1),
+            core_id(40, 1),
+        ];
+        let t = convert(2, &evts);
+
+        let migrations: Vec<_> = t
+            .freertos
+            .tasks
+            .get(1)
+            .unwrap()
+            .migrations
+            .0
+            .iter()
+            .map(|m| m.ts)
+            .collect();
+        assert_eq!(migrations, [20, 40]);
+        let task_1 = t.freertos.tasks.get(1).unwrap();
+        assert!(matches!(
+            task_1.migrations.0[0].inner,
+            TaskMigration {
+                from_core_id: 0,
+                to_core_id: 1
+            }
+        ));
+        assert!(matches!(
+            task_1.migrations.0[1].inner,
+            TaskMigration {
+                from_core_id: 1,
+                to_core_id: 0
+            }
+        ));
+        assert!(t.freertos.tasks.get(2).unwrap().migrations.0.is_empty());
+        assert!(t.freertos.tasks.get(3).unwrap().migrations.0.is_empty());
+
+        assert_eq!(values(&t.cores[&0].freertos.running_task), [(0, 1), (10, 3), (40, 1)]);
+        assert_eq!(values(&t.cores[&1].freertos.running_task), [(0, 2), (20, 1), (30, 2)]);
+    }
+
+    #[test]
+    fn dumped_running_task_is_switched_in() {
+        // Streaming is restarted at 50, and the state dump reports task 1 as running on core 1:
+        let t = convert(2, &[switched_in(0, 1), dumped_running(50, 1, 1), core_id(50, 1)]);
+        let task_1 = t.freertos.tasks.get(1).unwrap();
+
+        let migrations: Vec<_> = task_1.migrations.0.iter().map(|m| m.ts).collect();
+        assert_eq!(migrations, [50]);
+        assert!(matches!(task_1.state.0.last().unwrap().inner, TaskState::Running { core_id: 1 }));
+        assert_eq!(values(&t.cores[&1].freertos.running_task), [(50, 1)]);
+    }
 }
@@ -1,174 +1,574 @@
-use synthetto::{CounterTrackUnit, EventTrack, Process, Synthetto, TracePacket, Track};
+use std::collections::BTreeMap;
 
-use crate::Trace;
+use synthetto::{
+    CounterTrack, CounterTrackUnit, CpuSched, EventTrack, Global, Process, Sequence, Synthetto, ThreadState, Track,
+    TrackScope,
+};
 
-use super::{TaskKind, TaskState};
+use crate::{
+    generate_perfetto::{CounterCursor, GenCtx, Lod, PacketSink, PerfettoGenerator, PerfettoOptions, TrackCursor},
+    Trace, Ts,
+};
+
+use super::{FlowEvt, TaskKind, TaskState};
+
+/// Maximum number of scheduling events in a single packet.
+const SCHED_BUNDLE_MAX_EVTS: usize = 4096;
+
+/// FreeRTOS tracks of a [`PerfettoGenerator`], other than those of its cores.
+pub(crate) struct FreeRTOSTracks {
+    pub(crate) global: FreeRTOSGlobalTracks,
+    pub(crate) task_tracks: BTreeMap<usize, TaskTracks>,
+    /// Task wakeups that have not been emitted as scheduling data yet, by core: (ts, task id)
+    pub(crate) sched_wakeups: BTreeMap<usize, Vec<(u64, usize)>>,
+}
+
+/// FreeRTOS tracks that are generated with the global tracks.
+pub(crate) struct FreeRTOSGlobalTracks {
+    queue_tracks: BTreeMap<usize, QueueTrack>,
+    heap_in_use_track: Option<CounterCursor<Global>>,
+}
+
+enum QueueTrack {
+    Mutex(TrackCursor<Track<Global, EventTrack>>),
+    Counter(CounterCursor<Global>),
+}
+
+pub(crate) struct TaskTracks {
+    seq: Sequence,
+    process: Process,
+    /// Running and state tracks. Not generated if task switches are emitted as scheduling data.
+    running: Option<TrackCursor<Track<Process, EventTrack>>>,
+    state: Option<TrackCursor<Track<Process, EventTrack>>>,
+    priority: TrackCursor<Track<Global, CounterTrack>>,
+    stack_high_water_mark: Option<CounterCursor<Global>>,
+    heap_alloc_rate: Option<CounterCursor<Global>>,
+    migrations: Option<TrackCursor<Track<Process, EventTrack>>>,
+    flows: Option<TrackCursor<Track<Process, EventTrack>>>,
+    user_evt_markers: BTreeMap<usize, TrackCursor<Track<Process, EventTrack>>>,
+    user_val_markers: BTreeMap<usize, CounterCursor<Global>>,
+    /// Index of the next state of the task to check for wakeups (scheduling data only).
+    sched_next: usize,
+    /// Core the task ran on last, before `sched_next`.
+    sched_core_id: usize,
+}
+
+/// FreeRTOS tracks of a core, which are generated with the core's other tracks.
+pub(crate) struct FreeRTOSCoreTracks {
+    parent_track: Track<Process, EventTrack>,
+    /// Running task track. Not generated if task switches are emitted as scheduling data.
+    running_task: Option<TrackCursor<Track<Process, EventTrack>>>,
+    /// Tracks stacked below the core's parent track, showing when each task runs on the core.
+    task_tracks: BTreeMap<usize, TrackCursor<Track<Process, EventTrack>>>,
+    /// Index of the next task switch of the core to emit as scheduling data.
+    sched_next: usize,
+}
+
+impl FreeRTOSTracks {
+    pub(crate) fn new() -> Self {
+        FreeRTOSTracks {
+            global: FreeRTOSGlobalTracks {
+                queue_tracks: BTreeMap::new(),
+                heap_in_use_track: None,
+            },
+            task_tracks: BTreeMap::new(),
+            sched_wakeups: BTreeMap::new(),
+        }
+    }
+}
+
+impl FreeRTOSCoreTracks {
+    pub(crate) fn new(
+        syn: &mut Synthetto,
+        options: &PerfettoOptions,
+        core_id: usize,
+        core_process: &Process,
+        parent_track: Track<Process, EventTrack>,
+    ) -> Self {
+        let running_task = (!options.compact_sched).then(|| {
+            let track = syn.new_process_track(format!("Core #{core_id} Running Task"), core_process);
+            TrackCursor::new(track)
+        });
+        FreeRTOSCoreTracks {
+            parent_track,
+            running_task,
+            task_tracks: BTreeMap::new(),
+            sched_next: 0,
+        }
+    }
+}
+
+// ==== Track Creation =========================================================
 
 impl Trace {
-    pub(crate) fn generate_freertos_queue_tracks(&self, syn: &mut Synthetto, evts: &mut Vec<TracePacket>) {
+    pub(crate) fn create_freertos_queue_tracks(&self, g: &mut PerfettoGenerator) {
+        let lod = Lod::new(&g.options, g.lod_origin);
         for (queue_id, queue) in &self.freertos.queues {
-            let trace_name = format!("{} State", self.freertos.name_queue(*queue_id));
-            if queue.kind.is_mutex() {
-                let track = syn.new_global_track(trace_name);
-                evts.extend(syn.new_descriptor_trace_evts());
-
-                let mut in_event = false;
-                for evt in &queue.state.0 {
-                    let ts = self.convert_ts(evt.ts);
-                    if in_event {
-                        evts.push(track.slice_end_evt(ts));
+            g.freertos.global.queue_tracks.entry(queue_id).or_insert_with(|| {
+                let trace_name = format!("{} State", self.freertos.name_queue(queue_id));
+                if queue.kind.is_mutex() {
+                    QueueTrack::Mutex(TrackCursor::new(g.syn.new_global_track(trace_name)))
+                } else {
+                    QueueTrack::Counter(CounterCursor::new(&mut g.syn, lod, trace_name, |syn, name| {
+                        syn.new_global_counter_track(name, CounterTrackUnit::Count, 1, false)
+                    }))
+                }
+            });
+        }
+    }
+
+    pub(crate) fn create_freertos_heap_tracks(&self, g: &mut PerfettoGenerator) {
+        if self.freertos.heap.in_use.0.is_empty() || g.freertos.global.heap_in_use_track.is_some() {
+            return;
+        }
+
+        let lod = Lod::new(&g.options, g.lod_origin);
+        g.freertos.global.heap_in_use_track =
+            Some(CounterCursor::new(&mut g.syn, lod, String::from("Heap In Use"), |syn, name| {
+                syn.new_global_counter_track(name, CounterTrackUnit::SizeBytes, 1, false)
+            }));
+    }
+
+    pub(crate) fn create_freertos_task_tracks(&self, g: &mut PerfettoGenerator) {
+        let compact_sched = g.options.compact_sched;
+        let lod = Lod::new(&g.options, g.lod_origin);
+
+        for (task_id, task) in &self.freertos.tasks {
+            let process_name = self.freertos.name_task(task_id);
+
+            let tracks = g.freertos.task_tracks.entry(task_id).or_insert_with(|| {
+                let pid = (task_id as i32) + self.rtos_pid_offset();
+                let process = g.syn.new_process(pid, process_name.clone(), vec![], None);
+                let state =
+                    (!compact_sched).then(|| g.syn.new_process_track(format!("{process_name} State"), &process));
+                let priority = g.syn.new_process_counter_track(
+                    format!("{process_name} Priority"),
+                    CounterTrackUnit::Custom(String::from("Priority")),
+                    1,
+                    false,
+                    &process,
+                );
+                let running =
+                    (!compact_sched).then(|| g.syn.new_process_track(self.freertos.name_task(task_id), &process));
+                if compact_sched && self.sched_tid(task_id) != 0 {
+                    // The task's thread, which the scheduling data refers to:
+                    g.syn.new_thread(&process, pid, process_name.clone());
+                }
+                TaskTracks {
+                    seq: g.syn.new_sequence(),
+                    process,
+                    running: running.map(TrackCursor::new),
+                    state: state.map(TrackCursor::new),
+                    priority: TrackCursor::new(priority),
+                    stack_high_water_mark: None,
+                    heap_alloc_rate: None,
+                    migrations: None,
+                    flows: None,
+                    user_evt_markers: BTreeMap::new(),
+                    user_val_markers: BTreeMap::new(),
+                    sched_next: 0,
+                    sched_core_id: 0,
+                }
+            });
+
+            if !task.stack_high_water_mark.0.is_empty() && tracks.stack_high_water_mark.is_none() {
+                let name = format!("{process_name} Stack High Water Mark");
+                tracks.stack_high_water_mark = Some(CounterCursor::new(&mut g.syn, lod, name, |syn, name| {
+                    syn.new_process_counter_track(name, CounterTrackUnit::SizeBytes, 1, false, &tracks.process)
+                }));
+            }
+
+            if !task.heap_alloc_rate.0.is_empty() && tracks.heap_alloc_rate.is_none() {
+                let name = format!("{process_name} Heap Allocation Rate");
+                tracks.heap_alloc_rate = Some(CounterCursor::new(&mut g.syn, lod, name, |syn, name| {
+                    let unit = CounterTrackUnit::Custom("B/s".to_string());
+                    syn.new_process_counter_track(name, unit, 1, false, &tracks.process)
+                }));
+            }
+
+            if !task.migrations.0.is_empty() && tracks.migrations.is_none() {
+                let name = format!("{process_name} Migrations");
+                tracks.migrations = Some(TrackCursor::new(g.syn.new_process_track(name, &tracks.process)));
+            }
+
+            if !task.flows.0.is_empty() && tracks.flows.is_none() {
+                let name = format!("{process_name} Flows");
+                tracks.flows = Some(TrackCursor::new(g.syn.new_process_track(name, &tracks.process)));
+            }
+
+            for (marker_id, _) in &task.user_evt_markers {
+                tracks.user_evt_markers.entry(marker_id).or_insert_with(|| {
+                    let marker_name = task.name_user_evtmarker(marker_id);
+                    TrackCursor::new(g.syn.new_process_track(marker_name, &tracks.process))
+                });
+            }
+
+            for (marker_id, _) in &task.user_val_markers {
+                tracks.user_val_markers.entry(marker_id).or_insert_with(|| {
+                    let marker_name = task.name_user_valmarker(marker_id);
+                    CounterCursor::new(&mut g.syn, lod, marker_name, |syn, name| {
+                        syn.new_process_counter_track(name, CounterTrackUnit::Unspecified, 1, false, &tracks.process)
+                    })
+                });
+            }
+        }
+    }
+
+    pub(crate) fn create_freertos_core_tracks(
+        &self,
+        syn: &mut Synthetto,
+        options: &PerfettoOptions,
+        tracks: &mut FreeRTOSCoreTracks,
+    ) {
+        if options.compact_sched {
+            return;
+        }
+
+        for (task_id, _) in &self.freertos.tasks {
+            tracks
+                .task_tracks
+                .entry(task_id)
+                .or_insert_with(|| TrackCursor::new(syn.new_stacked_process_track(&tracks.parent_track)));
+        }
+    }
+
+    /// Collect the wakeups of all tasks for scheduling data: The task becoming ready without
+    /// having been preempted. Emitted with the task switches of the core it last ran on.
+    pub(crate) fn collect_freertos_sched_wakeups(&self, g: &mut PerfettoGenerator) {
+        for (task_id, task) in &self.freertos.tasks {
+            let tracks = g.freertos.task_tracks.get_mut(&task_id).unwrap();
+            let states = &task.state.0;
+            for idx in tracks.sched_next..states.len() {
+                match states[idx].inner {
+                    TaskState::Running { core_id } => tracks.sched_core_id = core_id,
+                    TaskState::Ready => {
+                        let preempted = idx > 0 && matches!(states[idx - 1].inner, TaskState::Running { .. });
+                        if !preempted {
+                            let wakeups = g.freertos.sched_wakeups.entry(tracks.sched_core_id).or_default();
+                            wakeups.push((states[idx].ts, task_id));
+                        }
                     }
-                    let state_name = if evt.inner.fill == 0 {
-                        if let Some(locked_by_id) = evt.inner.by_task {
-                            format!("Taken by {}", self.freertos.name_task(locked_by_id))
-                        } else {
-                            String::from("Taken")
+                    _ => (),
+                }
+            }
+            tracks.sched_next = states.len();
+        }
+    }
+}
+
+// ==== Track Generation =======================================================
+
+impl Trace {
+    pub(crate) fn generate_freertos_queue_tracks(
+        &self,
+        ctx: GenCtx,
+        tracks: &mut FreeRTOSGlobalTracks,
+        seq: &mut Sequence,
+        evts: &mut PacketSink,
+    ) {
+        for (queue_id, queue) in &self.freertos.queues {
+            match tracks.queue_tracks.get_mut(&queue_id).unwrap() {
+                QueueTrack::Mutex(track) => {
+                    for evt in track.advance(&queue.state.0) {
+                        let ts = self.convert_ts(evt.ts);
+                        if track.open {
+                            track.track.write_slice_end_evt(evts.buf(), ts);
                         }
-                    } else {
-                        String::from("Available")
-                    };
-                    evts.push(track.slice_begin_evt(ts, Some(state_name)));
-                    in_event = true;
+                        let state_name = if evt.inner.fill == 0 {
+                            if let Some(locked_by_id) = evt.inner.by_task {
+                                format!("Taken by {}", self.freertos.name_task(locked_by_id))
+                            } else {
+                                String::from("Taken")
+                            }
+                        } else {
+                            String::from("Available")
+                        };
+                        track
+                            .track
+                            .write_interned_slice_begin_evt(seq, evts.buf(), ts, &state_name);
+                        track.open = true;
+                    }
                 }
-            } else {
-                let track = syn.new_global_counter_track(trace_name, CounterTrackUnit::Count, 1, false);
-                evts.extend(syn.new_descriptor_trace_evts());
-                for evt in &queue.state.0 {
-                    let ts = self.convert_ts(evt.ts);
-                    evts.push(track.int_counter_evt(ts, evt.inner.fill));
+                QueueTrack::Counter(track) => {
+                    track.write(self, ctx.lod, &queue.state.0, |state| state.fill.into(), evts.buf());
                 }
             }
         }
     }
 
-    pub(crate) fn generate_freertos_task_tracks(&self, syn: &mut Synthetto, evts: &mut Vec<TracePacket>) {
-        for (task_id, task) in &self.freertos.tasks {
-            let process_name = self.freertos.name_task(*task_id);
-
-            let task_track_process =
-                syn.new_process((*task_id as i32) + self.rtos_pid_offset(), process_name.clone(), vec![], None);
-            let state_track = syn.new_process_track(format!("{process_name} State"), &task_track_process);
-            let priority_track = syn.new_process_counter_track(
-                format!("{process_name} Priority"),
-                CounterTrackUnit::Custom(String::from("Priority")),
-                1,
-                false,
-                &task_track_process,
-            );
-            let running_track = syn.new_process_track(self.freertos.name_task(*task_id), &task_track_process);
-            evts.extend(syn.new_descriptor_trace_evts());
-
-            // Generate "running" track:
-            let mut running = false;
-            for evt in &task.state.0 {
+    pub(crate) fn generate_freertos_heap_tracks(
+        &self,
+        ctx: GenCtx,
+        tracks: &mut FreeRTOSGlobalTracks,
+        evts: &mut PacketSink,
+    ) {
+        if let Some(in_use_track) = &mut tracks.heap_in_use_track {
+            in_use_track.write(self, ctx.lod, &self.freertos.heap.in_use.0, |val| *val, evts.buf());
+        }
+    }
+
+    /// Allocations that were not freed are only known at the end of the trace.
+    pub(crate) fn generate_freertos_heap_outstanding_track(&self, g: &mut PerfettoGenerator, evts: &mut PacketSink) {
+        let heap = &self.freertos.heap;
+        if heap.outstanding.is_empty() {
+            return;
+        }
+
+        let outstanding_track = g.syn.new_global_track(String::from("Heap Outstanding Allocations"));
+        evts.extend(g.syn.new_descriptor_trace_evts());
+        for (addr, allocation) in &heap.outstanding {
+            let ts = self.convert_ts(allocation.ts);
+            let by = match allocation.task_id {
+                Some(task_id) => self.freertos.name_task(task_id),
+                None => String::from("unknown task"),
+            };
+            let name = format!("0x{addr:X}: {} bytes by {by}", allocation.size);
+            outstanding_track.write_instant_evt(evts.buf(), ts, &name);
+        }
+    }
+
+    pub(crate) fn generate_freertos_task_tracks(
+        &self,
+        ctx: GenCtx,
+        task_id: usize,
+        tracks: &mut TaskTracks,
+        evts: &mut PacketSink,
+    ) {
+        let task = self.freertos.tasks.get(task_id).unwrap();
+
+        // Generate "running" track:
+        if let Some(running_track) = &mut tracks.running {
+            for evt in running_track.advance(&task.state.0) {
                 let ts = self.convert_ts(evt.ts);
                 let state_name = evt.inner.rich_name(&self.freertos);
                 if let TaskState::Running { .. } = evt.inner {
-                    if !running {
-                        evts.push(running_track.slice_begin_evt(ts, Some(state_name)));
-                        running = true;
+                    if !running_track.open {
+                        let track = &running_track.track;
+                        track.write_interned_slice_begin_evt(&mut tracks.seq, evts.buf(), ts, &state_name);
+                        running_track.open = true;
                     }
-                } else if running {
-                    evts.push(running_track.slice_end_evt(ts));
-                    running = false;
+                } else if running_track.open {
+                    running_track.track.write_slice_end_evt(evts.buf(), ts);
+                    running_track.open = false;
                 }
             }
+        }
 
-            // Generate "state" track:
-            for (idx, evt) in task.state.0.iter().enumerate() {
+        // Generate "state" track:
+        if let Some(state_track) = &mut tracks.state {
+            for evt in state_track.advance(&task.state.0) {
                 let ts = self.convert_ts(evt.ts);
                 let state_name = evt.inner.rich_name(&self.freertos);
 
-                if idx != 0 {
-                    evts.push(state_track.slice_end_evt(ts));
+                if state_track.open {
+                    state_track.track.write_slice_end_evt(evts.buf(), ts);
                 }
-                evts.push(state_track.slice_begin_evt(ts, Some(state_name)));
+                state_track
+                    .track
+                    .write_interned_slice_begin_evt(&mut tracks.seq, evts.buf(), ts, &state_name);
+                state_track.open = true;
             }
+        }
 
-            // Generate "priority" track:
-            for priority in &task.priority.0 {
-                let ts = self.convert_ts(priority.ts);
-                evts.push(priority_track.int_counter_evt(ts, priority.inner));
-            }
+        // Generate "priority" track:
+        let priority_track = &mut tracks.priority;
+        for priority in priority_track.advance(&task.priority.0) {
+            let ts = self.convert_ts(priority.ts);
+            priority_track
+                .track
+                .write_int_counter_evt(evts.buf(), ts, priority.inner);
+        }
 
-            // Generate "user event marker" tracks:
-            for (marker_id, marker) in &task.user_evt_markers {
-                let marker_name = task.name_user_evtmarker(*marker_id);
-                let track = syn.new_process_track(marker_name, &task_track_process);
-                evts.extend(syn.new_descriptor_trace_evts());
-
-                for evt in &marker.markers.0 {
-                    let ts = self.convert_ts(evt.ts);
-                    match &evt.inner {
-                        crate::UserEvtMarker::Instant { msg } => {
-                            evts.push(track.instant_evt(ts, msg.clone()));
-                        }
-                        crate::UserEvtMarker::SliceBegin { msg } => {
-                            evts.push(track.slice_begin_evt(ts, Some(msg.clone())));
-                        }
-                        crate::UserEvtMarker::SliceEnd => {
-                            evts.push(track.slice_end_evt(ts));
-                        }
-                    }
-                }
-            }
+        // Generate "stack high water mark" track:
+        if let Some(stack_track) = &mut tracks.stack_high_water_mark {
+            stack_track.write(self, ctx.lod, &task.stack_high_water_mark.0, |val| (*val).into(), evts.buf());
+        }
 
-            // Generate "user value marker" tracks:
-            for (marker_id, marker) in &task.user_val_markers {
-                let marker_name = task.name_user_valmarker(*marker_id);
-                let track = syn.new_process_counter_track(
-                    marker_name,
-                    CounterTrackUnit::Unspecified,
-                    1,
-                    false,
-                    &task_track_process,
-                );
-                evts.extend(syn.new_descriptor_trace_evts());
+        // Generate "heap allocation rate" track:
+        if let Some(heap_track) = &mut tracks.heap_alloc_rate {
+            heap_track.write(self, ctx.lod, &task.heap_alloc_rate.0, |val| *val, evts.buf());
+        }
 
-                for evt in &marker.vals.0 {
-                    let ts = self.convert_ts(evt.ts);
-                    evts.push(track.int_counter_evt(ts, evt.inner));
-                }
+        // Generate "migrations" track:
+        if let Some(migration_track) = &mut tracks.migrations {
+            for evt in migration_track.advance(&task.migrations.0) {
+                let ts = self.convert_ts(evt.ts);
+                let name = format!("Core {} to core {}", evt.inner.from_core_id, evt.inner.to_core_id);
+                migration_track
+                    .track
+                    .write_interned_instant_evt(&mut tracks.seq, evts.buf(), ts, &name);
             }
         }
+
+        // Generate "flows" track:
+        if let Some(flow_track) = &mut tracks.flows {
+            let pending = flow_track.advance(&task.flows.0);
+            self.generate_freertos_flow_evts(&mut tracks.seq, &flow_track.track, pending, evts);
+        }
+
+        // Generate "user event marker" tracks:
+        for (marker_id, marker) in &task.user_evt_markers {
+            let track = tracks.user_evt_markers.get_mut(&marker_id).unwrap();
+            let pending = track.advance(&marker.markers.0);
+            self.generate_user_evt_marker_evts(&mut tracks.seq, &track.track, pending, evts);
+        }
+
+        // Generate "user value marker" tracks:
+        for (marker_id, marker) in &task.user_val_markers {
+            let track = tracks.user_val_markers.get_mut(&marker_id).unwrap();
+            track.write(self, ctx.lod, &marker.vals.0, |val| *val, evts.buf());
+        }
     }
 
     pub(crate) fn generate_freertos_core_tracks(
         &self,
-        syn: &mut Synthetto,
-        evts: &mut Vec<TracePacket>,
+        ctx: GenCtx,
         core_id: usize,
-        parent_track: &Track<Process, EventTrack>,
+        tracks: &mut FreeRTOSCoreTracks,
+        seq: &mut Sequence,
+        wakeups: Vec<(u64, usize)>,
+        evts: &mut PacketSink,
     ) {
-        for (task_id, task) in &self.freertos.tasks {
-            let core_track = syn.new_stacked_process_track(parent_track);
-            evts.extend(syn.new_descriptor_trace_evts());
+        if ctx.options.compact_sched {
+            self.generate_freertos_core_sched(core_id, tracks, wakeups, evts);
+            return;
+        }
 
-            let mut task_running_on_core = false;
+        // Generate "running task" track:
+        let running_track = tracks.running_task.as_mut().unwrap();
+        for evt in running_track.advance(&self.core(core_id).freertos.running_task.0) {
+            let ts = self.convert_ts(evt.ts);
+            if running_track.open {
+                running_track.track.write_slice_end_evt(evts.buf(), ts);
+            }
+            let name = self.freertos.name_task(evt.inner);
+            running_track
+                .track
+                .write_interned_slice_begin_evt(seq, evts.buf(), ts, &name);
+            running_track.open = true;
+        }
+
+        for (task_id, task) in &self.freertos.tasks {
+            let core_track = tracks.task_tracks.get_mut(&task_id).unwrap();
 
-            for evt in &task.state.0 {
+            for evt in core_track.advance(&task.state.0) {
                 let ts = self.convert_ts(evt.ts);
 
                 if let TaskState::Running { core_id: task_core_id } = evt.inner {
                     if core_id == task_core_id {
                         if let TaskKind::Idle { .. } = &task.kind {
-                            if task_running_on_core {
-                                evts.push(core_track.slice_end_evt(ts));
-                                task_running_on_core = false;
+                            if core_track.open {
+                                core_track.track.write_slice_end_evt(evts.buf(), ts);
+                                core_track.open = false;
                             }
                         } else {
-                            if task_running_on_core {
-                                evts.push(core_track.slice_end_evt(ts));
+                            if core_track.open {
+                                core_track.track.write_slice_end_evt(evts.buf(), ts);
                             }
-                            evts.push(core_track.slice_begin_evt(ts, Some(self.freertos.name_task(*task_id))));
-                            task_running_on_core = true;
+                            let name = self.freertos.name_task(task_id);
+                            core_track
+                                .track
+                                .write_interned_slice_begin_evt(seq, evts.buf(), ts, &name);
+                            core_track.open = true;
                         }
                     }
-                } else if task_running_on_core {
-                    evts.push(core_track.slice_end_evt(ts));
-                    task_running_on_core = false;
+                } else if core_track.open {
+                    core_track.track.write_slice_end_evt(evts.buf(), ts);
+                    core_track.open = false;
                 }
             }
         }
     }
+
+    /// Emit events that are connected to other events by flows. Every flow starts at one event, and
+    /// ends at another one, which may be on a track of another group.
+    pub(crate) fn generate_freertos_flow_evts<S: TrackScope>(
+        &self,
+        seq: &mut Sequence,
+        track: &Track<S, EventTrack>,
+        flows: &[Ts<FlowEvt>],
+        evts: &mut PacketSink,
+    ) {
+        for evt in flows {
+            let ts = self.convert_ts(evt.ts);
+            let name = evt.inner.kind.rich_name(&self.freertos);
+            let flow_id = [evt.inner.flow_id];
+            let (flow_ids, terminating_flow_ids): (&[u64], &[u64]) = if evt.inner.kind.is_end() {
+                (&[], &flow_id)
+            } else {
+                (&flow_id, &[])
+            };
+            track.write_interned_instant_evt_with_flows(seq, evts.buf(), ts, &name, flow_ids, terminating_flow_ids);
+        }
+    }
+
+    /// Emit the task switches of a core, and the wakeups of tasks that last ran on it, as
+    /// scheduling data.
+    fn generate_freertos_core_sched(
+        &self,
+        core_id: usize,
+        tracks: &mut FreeRTOSCoreTracks,
+        mut wakeups: Vec<(u64, usize)>,
+        evts: &mut PacketSink,
+    ) {
+        let running = &self.core(core_id).freertos.running_task.0;
+
+        let mut sched = CpuSched::new(core_id as u32);
+        for idx in tracks.sched_next..running.len() {
+            let evt = &running[idx];
+            let ts = evt.ts;
+
+            let prev_state = match idx.checked_sub(1).map(|prev| running[prev].inner) {
+                Some(prev_task_id) => match self.freertos.tasks.get(prev_task_id).and_then(|t| t.state.value_at(ts)) {
+                    Some(TaskState::Blocked(_)) => ThreadState::Sleeping,
+                    Some(TaskState::Suspended { .. }) => ThreadState::Stopped,
+                    Some(TaskState::Deleted { .. }) => ThreadState::Dead,
+                    _ => ThreadState::Runnable,
+                },
+                None => ThreadState::Runnable,
+            };
+
+            let (tid, prio, name) = self.sched_thread(evt.inner, ts);
+            sched.switch(self.convert_ts(ts), prev_state, tid, prio, &name);
+
+            if sched.len() >= SCHED_BUNDLE_MAX_EVTS {
+                evts.push(std::mem::replace(&mut sched, CpuSched::new(core_id as u32)).into_packet());
+            }
+        }
+        tracks.sched_next = running.len();
+
+        wakeups.sort_unstable();
+        for (ts, task_id) in wakeups {
+            let (tid, prio, name) = self.sched_thread(task_id, ts);
+            sched.waking(self.convert_ts(ts), tid, core_id as u32, prio, &name);
+
+            if sched.len() >= SCHED_BUNDLE_MAX_EVTS {
+                evts.push(std::mem::replace(&mut sched, CpuSched::new(core_id as u32)).into_packet());
+            }
+        }
+
+        if !sched.is_empty() {
+            evts.push(sched.into_packet());
+        }
+    }
+
+    /// Thread ID of a task in the scheduling data. Idle tasks are the idle thread (0) of their
+    /// core.
+    fn sched_tid(&self, task_id: usize) -> i32 {
+        match self.freertos.tasks.get(task_id).map(|t| &t.kind) {
+            Some(TaskKind::Idle { .. }) => 0,
+            _ => (task_id as i32) + self.rtos_pid_offset(),
+        }
+    }
+
+    /// Thread ID, priority and name of a task at `ts`.
+    fn sched_thread(&self, task_id: usize, ts: u64) -> (i32, i32, String) {
+        let prio = self
+            .freertos
+            .tasks
+            .get(task_id)
+            .and_then(|t| t.priority.value_at(ts))
+            .map_or(0, |prio| *prio as i32);
+        (self.sched_tid(task_id), prio, self.freertos.name_task(task_id))
+    }
 }
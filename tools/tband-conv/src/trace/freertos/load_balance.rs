@@ -0,0 +1,184 @@
+use std::collections::BTreeMap;
+
+use crate::Trace;
+
+use super::TaskKind;
+
+/// Per-core utilisation and task migration summary of a FreeRTOS trace.
+pub struct LoadBalanceSummary {
+    /// Duration between the first and last event of the trace, in ns.
+    pub duration_ns: u64,
+    pub cores: Vec<CoreLoad>,
+    pub tasks: Vec<TaskLoad>,
+}
+
+pub struct CoreLoad {
+    pub core_id: usize,
+    /// Time during which the running task on this core is known, in ns.
+    pub known_ns: u64,
+    /// Time spent running non-idle tasks, in ns.
+    pub busy_ns: u64,
+    /// Number of tasks that migrated to this core.
+    pub migrations_in: usize,
+    /// Number of tasks that migrated away from this core.
+    pub migrations_out: usize,
+}
+
+impl CoreLoad {
+    /// Fraction of the known time spent running non-idle tasks.
+    pub fn utilisation(&self) -> f64 {
+        if self.known_ns == 0 {
+            return 0.0;
+        }
+        self.busy_ns as f64 / self.known_ns as f64
+    }
+}
+
+pub struct TaskLoad {
+    pub task_id: usize,
+    pub name: String,
+    pub is_idle: bool,
+    pub migrations: usize,
+    /// Time spent running on each core, in ns.
+    pub run_ns: BTreeMap<usize, u64>,
+}
+
+impl Trace {
+    /// Summarise how the load was spread across cores, based on which task was running on each
+    /// core over time. Time spent in ISRs is attributed to the interrupted task.
+    pub fn freertos_load_balance(&self) -> LoadBalanceSummary {
+        let (start_ts, end_ts) = self.ts_range();
+
+        let mut tasks: BTreeMap<usize, TaskLoad> = BTreeMap::new();
+        for (task_id, task) in &self.freertos.tasks {
+            tasks.insert(
+                task_id,
+                TaskLoad {
+                    task_id,
+                    name: self.freertos.name_task(task_id),
+                    is_idle: matches!(task.kind, TaskKind::Idle { .. }),
+                    migrations: task.migrations.0.len(),
+                    run_ns: BTreeMap::new(),
+                },
+            );
+        }
+
+        let mut cores = vec![];
+        for (core_id, core) in &self.cores {
+            let mut load = CoreLoad {
+                core_id: *core_id,
+                known_ns: 0,
+                busy_ns: 0,
+                migrations_in: 0,
+                migrations_out: 0,
+            };
+
+            let running = &core.freertos.running_task.0;
+            for (idx, evt) in running.iter().enumerate() {
+                let until = running.get(idx + 1).map(|next| next.ts).unwrap_or(end_ts);
+                let duration_ns = self.convert_ts(until.saturating_sub(evt.ts));
+                load.known_ns += duration_ns;
+
+                if let Some(task) = tasks.get_mut(&evt.inner) {
+                    *task.run_ns.entry(*core_id).or_insert(0) += duration_ns;
+                    if !task.is_idle {
+                        load.busy_ns += duration_ns;
+                    }
+                }
+            }
+
+            cores.push(load);
+        }
+
+        for task in self.freertos.tasks.values() {
+            for migration in &task.migrations.0 {
+                // Cores are stored in order of their ID:
+                if let Some(from) = cores.get_mut(migration.inner.from_core_id) {
+                    from.migrations_out += 1;
+                }
+                if let Some(to) = cores.get_mut(migration.inner.to_core_id) {
+                    to.migrations_in += 1;
+                }
+            }
+        }
+
+        LoadBalanceSummary {
+            duration_ns: self.convert_ts(end_ts - start_ts),
+            cores,
+            tasks: tasks.into_values().collect(),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        convert::TraceConverter,
+        decode::evts::{
+            BaseCoreIdEvt, BaseEvt, BaseEvtKind, FreeRTOSEvt, FreeRTOSEvtKind, FreeRTOSMetadataEvt,
+            FreeRTOSTaskIsIdleTaskEvt, FreeRTOSTaskSwitchedInEvt, RawEvt, TraceMode,
+        },
+    };
+
+    fn switched_in(ts: u64, task_id: u32) -> RawEvt {
+        RawEvt::FreeRTOS(FreeRTOSEvt {
+            ts,
+            kind: FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id }),
+        })
+    }
+
+    fn core_id(ts: u64, core_id: u32) -> RawEvt {
+        RawEvt::Base(BaseEvt {
+            ts,
+            kind: BaseEvtKind::CoreId(BaseCoreIdEvt { core_id }),
+        })
+    }
+
+    #[test]
+    fn load_balance() {
+        // Task 3 is core 0's idle task. Task 1 migrates from core 0 to core 1 and back.
+        let evts = [
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::TaskIsIdleTask(FreeRTOSTaskIsIdleTaskEvt {
+                task_id: 3,
+                core_id: 0,
+            })),
+            switched_in(0, 1),
+            switched_in(10, 3),
+            core_id(0, 1),
+            switched_in(0, 2),
+            switched_in(20, 1),
+            switched_in(30, 2),
+            core_id(40, 0),
+            switched_in(40, 1),
+            core_id(40, 1),
+        ];
+        let mut c = TraceConverter::new(2, TraceMode::FreeRTOS).unwrap();
+        c.add_evts(&evts).unwrap();
+        let summary = c.convert().unwrap().freertos_load_balance();
+
+        assert_eq!(summary.duration_ns, 40);
+
+        let cores: Vec<_> = summary
+            .cores
+            .iter()
+            .map(|c| (c.core_id, c.known_ns, c.busy_ns, c.migrations_in, c.migrations_out))
+            .collect();
+        assert_eq!(cores, [(0, 40, 10, 1, 1), (1, 40, 40, 1, 1)]);
+        assert_eq!(summary.cores[0].utilisation(), 0.25);
+        assert_eq!(summary.cores[1].utilisation(), 1.0);
+
+        let tasks: Vec<_> = summary
+            .tasks
+            .iter()
+            .map(|t| (t.task_id, t.is_idle, t.migrations, t.run_ns.clone().into_iter().collect::<Vec<_>>()))
+            .collect();
+        assert_eq!(
+            tasks,
+            [
+                (1, false, 2, vec![(0, 10), (1, 10)]),
+                (2, false, 0, vec![(1, 30)]),
+                (3, true, 0, vec![(0, 30)]),
+            ]
+        );
+    }
+}
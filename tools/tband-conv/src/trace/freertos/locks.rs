@@ -0,0 +1,249 @@
+use std::collections::BTreeMap;
+
+use crate::Trace;
+
+use super::{TaskBlockingReason, TaskState};
+
+/// Mutex contention and priority inversion summary of a FreeRTOS trace.
+pub struct LockAnalysis {
+    pub mutexes: Vec<MutexContention>,
+    pub priority_inversions: Vec<PriorityInversionReport>,
+}
+
+/// Contention summary of a single mutex.
+pub struct MutexContention {
+    pub queue_id: usize,
+    pub name: String,
+    /// Number of times the mutex was taken.
+    pub acquisitions: usize,
+    /// Duration of every completed hold, in ns, sorted in ascending order.
+    pub hold_times_ns: Vec<u64>,
+    /// Number of times a task blocked waiting for the mutex.
+    pub waits: usize,
+    /// Names of all tasks that blocked waiting for the mutex.
+    pub waiters: Vec<String>,
+    /// Total time tasks spent blocked waiting for the mutex, in ns.
+    pub total_wait_ns: u64,
+    /// Longest time a task spent blocked waiting for the mutex, in ns.
+    pub max_wait_ns: u64,
+}
+
+impl MutexContention {
+    /// Hold time below which the given fraction (`0.0..=1.0`) of all holds fall, in ns.
+    pub fn hold_time_percentile(&self, p: f64) -> Option<u64> {
+        if self.hold_times_ns.is_empty() {
+            return None;
+        }
+        let idx = ((self.hold_times_ns.len() - 1) as f64 * p).round() as usize;
+        Some(self.hold_times_ns[idx])
+    }
+}
+
+pub struct PriorityInversionReport {
+    /// Start of the episode, relative to the start of the trace, in ns.
+    pub start_ns: u64,
+    /// Duration of the episode, in ns. Lasts until the end of the trace if ongoing.
+    pub duration_ns: u64,
+    /// The priority was not disinherited before the end of the trace.
+    pub ongoing: bool,
+    /// Task holding the mutex, that inherited the priority.
+    pub holder: String,
+    pub base_priority: Option<u32>,
+    pub inherited_priority: u32,
+    /// Tasks whose priority was inherited.
+    pub waiters: Vec<String>,
+    /// Mutex the waiters blocked on, if known.
+    pub mutex: Option<String>,
+}
+
+impl Trace {
+    /// Summarise mutex usage and contention, and list all priority inheritance episodes.
+    pub fn freertos_lock_analysis(&self) -> LockAnalysis {
+        let (start_ts, end_ts) = self.ts_range();
+
+        let mut mutexes: BTreeMap<usize, MutexContention> = BTreeMap::new();
+        for (queue_id, queue) in &self.freertos.queues {
+            if !queue.kind.is_mutex() {
+                continue;
+            }
+
+            let mut contention = MutexContention {
+                queue_id,
+                name: self.freertos.name_queue(queue_id),
+                acquisitions: 0,
+                hold_times_ns: vec![],
+                waits: 0,
+                waiters: vec![],
+                total_wait_ns: 0,
+                max_wait_ns: 0,
+            };
+
+            // The first state of a mutex created during the trace is the empty queue before
+            // the mutex is given for the first time, and not an acquisition:
+            let skip = if queue.created_ts.is_some() { 1 } else { 0 };
+
+            let mut taken_ts = None;
+            for evt in queue.state.0.iter().skip(skip) {
+                if evt.inner.fill == 0 {
+                    if taken_ts.is_none() {
+                        contention.acquisitions += 1;
+                        taken_ts = Some(evt.ts);
+                    }
+                } else if let Some(taken_ts) = taken_ts.take() {
+                    contention.hold_times_ns.push(self.convert_ts(evt.ts - taken_ts));
+                }
+            }
+            contention.hold_times_ns.sort_unstable();
+
+            mutexes.insert(queue_id, contention);
+        }
+
+        for (task_id, task) in &self.freertos.tasks {
+            for (idx, evt) in task.state.0.iter().enumerate() {
+                let queue_id = match evt.inner {
+                    TaskState::Blocked(TaskBlockingReason::QueueReceive { queue_id }) => queue_id,
+                    TaskState::Blocked(TaskBlockingReason::QueuePeek { queue_id }) => queue_id,
+                    _ => continue,
+                };
+                let Some(contention) = mutexes.get_mut(&queue_id) else {
+                    continue;
+                };
+
+                let until = task.state.0.get(idx + 1).map(|next| next.ts).unwrap_or(end_ts);
+                let wait_ns = self.convert_ts(until.saturating_sub(evt.ts));
+                contention.waits += 1;
+                contention.total_wait_ns += wait_ns;
+                contention.max_wait_ns = u64::max(contention.max_wait_ns, wait_ns);
+
+                let waiter = self.freertos.name_task(task_id);
+                if !contention.waiters.contains(&waiter) {
+                    contention.waiters.push(waiter);
+                }
+            }
+        }
+
+        let priority_inversions = self
+            .freertos
+            .priority_inversions
+            .iter()
+            .map(|inversion| PriorityInversionReport {
+                start_ns: self.convert_ts(inversion.start_ts.saturating_sub(start_ts)),
+                duration_ns: self.convert_ts(inversion.end_ts.unwrap_or(end_ts).saturating_sub(inversion.start_ts)),
+                ongoing: inversion.end_ts.is_none(),
+                holder: self.freertos.name_task(inversion.holder_task_id),
+                base_priority: inversion.base_priority,
+                inherited_priority: inversion.inherited_priority,
+                waiters: inversion
+                    .waiter_task_ids
+                    .iter()
+                    .map(|id| self.freertos.name_task(*id))
+                    .collect(),
+                mutex: inversion.queue_id.map(|id| self.freertos.name_queue(id)),
+            })
+            .collect();
+
+        LockAnalysis {
+            mutexes: mutexes.into_values().collect(),
+            priority_inversions,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        convert::TraceConverter,
+        decode::evts::{
+            FrQueueKind, FreeRTOSCurtaskBlockOnQueueReceiveEvt, FreeRTOSEvt, FreeRTOSEvtKind, FreeRTOSMetadataEvt,
+            FreeRTOSQueueCreatedEvt, FreeRTOSQueueCurLengthEvt, FreeRTOSQueueKindEvt, FreeRTOSQueueReceiveEvt,
+            FreeRTOSQueueSendEvt, FreeRTOSTaskSwitchedInEvt, FreeRTOSTaskToRdyStateEvt, RawEvt, TraceMode,
+        },
+    };
+
+    use super::LockAnalysis;
+
+    fn evt(ts: u64, kind: FreeRTOSEvtKind) -> RawEvt {
+        RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind })
+    }
+
+    fn switched_in(ts: u64, task_id: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id }))
+    }
+
+    fn ready(ts: u64, task_id: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::TaskToRdyState(FreeRTOSTaskToRdyStateEvt { task_id }))
+    }
+
+    fn give(ts: u64, queue_id: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::QueueSend(FreeRTOSQueueSendEvt { queue_id, len_after: 1 }))
+    }
+
+    fn take(ts: u64, queue_id: u32) -> RawEvt {
+        evt(ts, FreeRTOSEvtKind::QueueReceive(FreeRTOSQueueReceiveEvt { queue_id, len_after: 0 }))
+    }
+
+    fn block_on_take(ts: u64, queue_id: u32) -> RawEvt {
+        let kind = FreeRTOSCurtaskBlockOnQueueReceiveEvt {
+            queue_id,
+            ticks_to_wait: u32::MAX,
+        };
+        evt(ts, FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(kind))
+    }
+
+    /// Mutex #1 is created at 1, and taken three times: By task 1 from 10 to 30, while task 2
+    /// waits for it from 20 to 30, by task 2 from 35 to 40, and by task 2 from 50 until the end of
+    /// the trace, while task 1 waits for it from 60 to the end of the trace at 80.
+    fn analysis() -> LockAnalysis {
+        let evts = [
+            RawEvt::FreeRTOSMetadata(FreeRTOSMetadataEvt::QueueKind(FreeRTOSQueueKindEvt {
+                queue_id: 1,
+                kind: FrQueueKind::FrqkMutex,
+            })),
+            switched_in(0, 1),
+            evt(1, FreeRTOSEvtKind::QueueCreated(FreeRTOSQueueCreatedEvt { queue_id: 1 })),
+            evt(1, FreeRTOSEvtKind::QueueCurLength(FreeRTOSQueueCurLengthEvt { queue_id: 1, length: 0 })),
+            give(1, 1),
+            take(10, 1),
+            switched_in(15, 2),
+            block_on_take(20, 1),
+            switched_in(20, 1),
+            give(30, 1),
+            ready(30, 2),
+            switched_in(35, 2),
+            take(35, 1),
+            give(40, 1),
+            take(50, 1),
+            switched_in(55, 1),
+            block_on_take(60, 1),
+            switched_in(60, 3),
+            switched_in(80, 3),
+        ];
+
+        let mut c = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        c.add_evts(&evts).unwrap();
+        c.convert().unwrap().freertos_lock_analysis()
+    }
+
+    #[test]
+    fn mutex_contention() {
+        let analysis = analysis();
+        assert_eq!(analysis.mutexes.len(), 1);
+        let mutex = &analysis.mutexes[0];
+        assert_eq!(mutex.queue_id, 1);
+
+        // The mutex is still held at the end of the trace. That hold counts as an acquisition, but
+        // has no hold time:
+        assert_eq!(mutex.acquisitions, 3);
+        assert_eq!(mutex.hold_times_ns, [5, 20]);
+        assert_eq!(mutex.hold_time_percentile(0.0), Some(5));
+        assert_eq!(mutex.hold_time_percentile(1.0), Some(20));
+
+        // The wait of task 1 lasts until the end of the trace:
+        assert_eq!(mutex.waits, 2);
+        assert_eq!(mutex.waiters, ["Task #1", "Task #2"]);
+        assert_eq!(mutex.total_wait_ns, 30);
+        assert_eq!(mutex.max_wait_ns, 20);
+
+        assert!(analysis.priority_inversions.is_empty());
+    }
+}
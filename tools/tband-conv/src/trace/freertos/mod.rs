@@ -1,32 +1,53 @@
+mod checkpoint;
 mod convert;
 mod generate_perfetto;
+mod load_balance;
+mod locks;
 
-use std::fmt::Display;
+pub use load_balance::{CoreLoad, LoadBalanceSummary, TaskLoad};
+pub use locks::{LockAnalysis, MutexContention, PriorityInversionReport};
+
+pub(crate) use checkpoint::FreeRTOSCheckpoint;
+pub(crate) use generate_perfetto::{FreeRTOSCoreTracks, FreeRTOSGlobalTracks, FreeRTOSTracks, TaskTracks};
+
+use std::{
+    collections::{BTreeMap, VecDeque},
+    fmt::Display,
+};
+
+use serde::{Deserialize, Serialize};
 
 use crate::{decode::evts, NewWithId, ObjectMap, Timeseries, UserEvtMarkerTrace, UserValMarkerTrace};
 
 // == Core =====================================================================
 
 pub struct FreeRTOSCoreTrace {
+    /// ID of the task running on this core, recorded every time a task is switched in.
+    pub running_task: Timeseries<usize>,
+
     // conversion state:
     pub current_task_id: Option<usize>,
 }
 
 impl FreeRTOSCoreTrace {
     pub(crate) fn new() -> FreeRTOSCoreTrace {
-        FreeRTOSCoreTrace { current_task_id: None }
+        FreeRTOSCoreTrace {
+            running_task: Timeseries::new(),
+            current_task_id: None,
+        }
     }
 }
 
 // == Task =====================================================================
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum TaskBlockingReason {
     Delay { ticks: u32 },
     DelayUntil { time_to_wake: u32 },
     QueuePeek { queue_id: usize },
     QueueSend { queue_id: usize },
     QueueReceive { queue_id: usize },
+    Unknown,
 }
 
 impl TaskBlockingReason {
@@ -37,11 +58,12 @@ impl TaskBlockingReason {
             TaskBlockingReason::QueuePeek { queue_id } => format!("Receive {}", t.name_queue(*queue_id)),
             TaskBlockingReason::QueueSend { queue_id } => format!("Send to {}", t.name_queue(*queue_id)),
             TaskBlockingReason::QueueReceive { queue_id } => format!("Receive from {}", t.name_queue(*queue_id)),
+            TaskBlockingReason::Unknown => String::from("Unknown"),
         }
     }
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum TaskState {
     Running { core_id: usize },
     Ready,
@@ -68,7 +90,7 @@ impl TaskState {
     }
 }
 
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub enum TaskKind {
     Normal,
     Idle { core_id: usize },
@@ -85,6 +107,12 @@ impl Display for TaskKind {
     }
 }
 
+#[derive(Debug, Clone, PartialEq)]
+pub struct TaskMigration {
+    pub from_core_id: usize,
+    pub to_core_id: usize,
+}
+
 pub struct TaskTrace {
     pub id: usize,
     pub name: Option<String>,
@@ -92,6 +120,16 @@ pub struct TaskTrace {
     pub kind: TaskKind,
     pub state: Timeseries<TaskState>,
     pub priority: Timeseries<u32>,
+    /// Minimum amount of free stack space ever observed, in bytes.
+    pub stack_high_water_mark: Timeseries<u32>,
+    /// Rate at which the task allocated from the heap while it was running, in bytes per second.
+    /// Averaged over every run of the task in which it allocated: Recorded at the start of the
+    /// run, and back to zero at its end.
+    pub heap_alloc_rate: Timeseries<i64>,
+    /// Switch-ins on a different core than the one the task last ran on.
+    pub migrations: Timeseries<TaskMigration>,
+    /// Events of the task that are connected to events of other tasks or ISRs.
+    pub flows: Timeseries<FlowEvt>,
 
     // User markers:
     pub user_evt_markers: ObjectMap<UserEvtMarkerTrace>,
@@ -99,6 +137,11 @@ pub struct TaskTrace {
 
     // Conversion state:
     state_when_switched_out: TaskState,
+    last_core_id: Option<usize>,
+    /// Start of the current run of the task, if it is running.
+    heap_alloc_run_start: Option<u64>,
+    /// Bytes allocated by the task since the start of its current run.
+    heap_alloc_run_bytes: u64,
 }
 
 impl NewWithId for TaskTrace {
@@ -109,9 +152,16 @@ impl NewWithId for TaskTrace {
             kind: TaskKind::Normal,
             state: Timeseries::new(),
             priority: Timeseries::new(),
+            stack_high_water_mark: Timeseries::new(),
+            heap_alloc_rate: Timeseries::new(),
+            migrations: Timeseries::new(),
+            flows: Timeseries::new(),
             user_evt_markers: ObjectMap::new(),
             user_val_markers: ObjectMap::new(),
             state_when_switched_out: TaskState::Ready,
+            last_core_id: None,
+            heap_alloc_run_start: None,
+            heap_alloc_run_bytes: 0,
         }
     }
 }
@@ -125,6 +175,23 @@ impl TaskTrace {
             .unwrap_or(false)
     }
 
+    /// Record the allocation rate of the current run up to `ts`, and start a new run at `ts`.
+    /// Allocations made during a run whose start is not part of the trace are not recorded.
+    fn record_heap_alloc_rate(&mut self, ts: u64, ts_resolution_ns: u64) {
+        let bytes = std::mem::take(&mut self.heap_alloc_run_bytes);
+        let Some(start_ts) = self.heap_alloc_run_start.replace(ts) else {
+            return;
+        };
+        if bytes == 0 {
+            return;
+        }
+
+        let duration_ns = u64::max((ts - start_ts) * ts_resolution_ns, 1);
+        let rate = (bytes as u128 * 1_000_000_000 / duration_ns as u128) as i64;
+        self.heap_alloc_rate.push(start_ts, rate);
+        self.heap_alloc_rate.push(ts, 0);
+    }
+
     fn name_user_evtmarker(&self, id: usize) -> String {
         let task_name = self.name();
         if let Some(marker) = self.user_evt_markers.get(id) {
@@ -156,7 +223,7 @@ impl TaskTrace {
 
 // == Queue ====================================================================
 
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub enum QueueKind {
     Queue,
     CountingSemphr,
@@ -205,6 +272,7 @@ impl From<evts::FrQueueKind> for QueueKind {
     }
 }
 
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct QueueState {
     fill: u32,
     // Track the task that put the queue into this state. If this queue is a
@@ -217,6 +285,13 @@ pub struct QueueTrace {
     pub name: Option<String>,
     pub kind: QueueKind,
     pub state: Timeseries<QueueState>,
+    /// Set if the queue was created during the trace.
+    pub created_ts: Option<u64>,
+
+    // Conversion state:
+    /// Flow IDs of the items in the queue that were sent during the trace, oldest first. `None`
+    /// for items whose sender is not known.
+    item_flow_ids: VecDeque<Option<u64>>,
 }
 
 impl NewWithId for QueueTrace {
@@ -226,10 +301,107 @@ impl NewWithId for QueueTrace {
             name: None,
             kind: QueueKind::Queue,
             state: Timeseries::new(),
+            created_ts: None,
+            item_flow_ids: VecDeque::new(),
         }
     }
 }
 
+// == Flows ====================================================================
+
+/// Event of a task or ISR that is connected to an event of another task or ISR by a flow: A
+/// queue item from being sent to being received, or a task from being made ready by a task or ISR.
+#[derive(Debug, Clone)]
+pub struct FlowEvt {
+    /// Flow ID, unique within the trace. Shared by the event at the start and end of the flow.
+    pub flow_id: u64,
+    pub kind: FlowEvtKind,
+}
+
+#[derive(Debug, Clone)]
+pub enum FlowEvtKind {
+    /// Start of a flow: An item was sent to a queue.
+    QueueSend { queue_id: usize },
+    /// End of a flow: The item was received from the queue.
+    QueueReceive { queue_id: usize },
+    /// Start of a flow: A blocked or suspended task was made ready.
+    Wake { task_id: usize },
+    /// End of a flow: The task was made ready.
+    Woken,
+}
+
+impl FlowEvtKind {
+    /// Set if the flow ends at this event.
+    pub fn is_end(&self) -> bool {
+        match self {
+            FlowEvtKind::QueueSend { .. } | FlowEvtKind::Wake { .. } => false,
+            FlowEvtKind::QueueReceive { .. } | FlowEvtKind::Woken => true,
+        }
+    }
+
+    pub fn rich_name(&self, t: &FreeRTOSTrace) -> String {
+        match self {
+            FlowEvtKind::QueueSend { queue_id } => format!("Send to {}", t.name_queue(*queue_id)),
+            FlowEvtKind::QueueReceive { queue_id } => format!("Receive from {}", t.name_queue(*queue_id)),
+            FlowEvtKind::Wake { task_id } => format!("Wake {}", t.name_task(*task_id)),
+            FlowEvtKind::Woken => String::from("Woken"),
+        }
+    }
+}
+
+// == Heap =====================================================================
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct HeapAllocation {
+    pub ts: u64,
+    pub size: u32,
+    pub task_id: Option<usize>,
+}
+
+pub struct HeapTrace {
+    /// Change in the number of bytes allocated from the heap since the start of the trace.
+    /// Freeing a block that was allocated before the start of the trace lowers it, so it
+    /// can be negative.
+    pub in_use: Timeseries<i64>,
+    /// Allocations that have not been freed by the end of the trace, by address.
+    pub outstanding: BTreeMap<u64, HeapAllocation>,
+}
+
+impl HeapTrace {
+    fn new() -> Self {
+        Self {
+            in_use: Timeseries::new(),
+            outstanding: BTreeMap::new(),
+        }
+    }
+
+    fn record_in_use_change(&mut self, ts: u64, delta: i64) {
+        let in_use = self.in_use.0.last().map(|x| x.inner).unwrap_or(0);
+        self.in_use.push(ts, in_use + delta);
+    }
+}
+
+// == Priority Inversion =======================================================
+
+/// A task holding a mutex temporarily inheriting the priority of a higher-priority
+/// task waiting for it.
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct PriorityInversion {
+    pub start_ts: u64,
+    /// `None` if the priority was not disinherited before the end of the trace.
+    pub end_ts: Option<u64>,
+    /// Task holding the mutex, that inherited the priority.
+    pub holder_task_id: usize,
+    /// Priority of the holder before inheriting, if known.
+    pub base_priority: Option<u32>,
+    /// Highest priority inherited during this episode.
+    pub inherited_priority: u32,
+    /// Tasks whose priority was inherited, if known.
+    pub waiter_task_ids: Vec<usize>,
+    /// Mutex the waiters blocked on, if known.
+    pub queue_id: Option<usize>,
+}
+
 // == Trace ====================================================================
 
 pub struct FreeRTOSTrace {
@@ -239,6 +411,18 @@ pub struct FreeRTOSTrace {
     // Resources:
     pub queues: ObjectMap<QueueTrace>,
     // pub stream_buffers: ..
+
+    // Heap:
+    pub heap: HeapTrace,
+
+    // Priority inheritance:
+    pub priority_inversions: Vec<PriorityInversion>,
+
+    // Conversion state:
+    /// Index into `priority_inversions` of the ongoing episode, by holder task ID.
+    open_priority_inversions: BTreeMap<usize, usize>,
+    /// Number of flows started so far (see [`FlowEvt`]).
+    flow_cnt: u64,
 }
 
 impl FreeRTOSTrace {
@@ -246,6 +430,10 @@ impl FreeRTOSTrace {
         Self {
             tasks: ObjectMap::new(),
             queues: ObjectMap::new(),
+            heap: HeapTrace::new(),
+            priority_inversions: vec![],
+            open_priority_inversions: BTreeMap::new(),
+            flow_cnt: 0,
         }
     }
 
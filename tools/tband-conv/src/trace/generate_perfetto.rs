@@ -1,72 +1,650 @@
-use synthetto::{encode_trace, CounterTrackUnit, Synthetto, TracePacket};
+use std::{
+    collections::{BTreeMap, VecDeque},
+    fmt::Write as _,
+    io::Write,
+    sync::{mpsc, Mutex},
+    thread::JoinHandle,
+};
 
-use crate::Trace;
+use synthetto::{
+    compressed_packets, write_packet, CounterTrackUnit, DebugValue, EventTrack, Global, Process, Sequence, Synthetto,
+    TracePacket, Track, TrackScope,
+};
+
+use crate::{
+    decode::evts::EvtFieldVal,
+    freertos::{FreeRTOSCoreTracks, FreeRTOSGlobalTracks, FreeRTOSTracks, TaskTracks},
+    Trace, Ts, UserEvtMarker,
+};
+
+pub use super::counter_lod::CounterLod;
+pub(crate) use super::counter_lod::{CounterCursor, Lod};
 
 impl Trace {
     pub fn generate_perfetto_trace(&self) -> Vec<u8> {
-        let mut proto_evts = vec![];
+        let mut trace = vec![];
+        self.generate_perfetto_trace_to(&mut trace)
+            .expect("Writing to a vector cannot fail.");
+        trace
+    }
+
+    /// Generate the Perfetto trace, and write it to `w` while it is being generated. Only a
+    /// small batch of packets is held in memory at any time.
+    pub fn generate_perfetto_trace_to<W: Write>(&self, w: &mut W) -> std::io::Result<()> {
+        PerfettoGenerator::new().finish_to(self, w)
+    }
+}
+
+// ==== Perfetto Generator =====================================================
+
+/// Options of the generated Perfetto trace.
+#[derive(Debug, Clone, Default)]
+pub struct PerfettoOptions {
+    /// Emit FreeRTOS task switches as Perfetto scheduling data, with every task as a thread and
+    /// every core as a CPU, instead of as slices on per-task and per-core tracks. This enables
+    /// Perfetto's native CPU and thread state views, and is much more compact.
+    pub compact_sched: bool,
+    /// Include a "Trace Events" track for every core, with an instant event for every raw trace
+    /// event. The event is named after its kind, and carries its fields as arguments. Mostly
+    /// useful to debug the tracer or converter.
+    pub raw_evts: bool,
+    /// Downsample dense counter tracks (value markers, queue fill levels, heap usage and stack
+    /// high water marks).
+    pub counter_lod: Option<CounterLod>,
+    /// Group the packets into deflate-compressed batches, which are compressed in parallel.
+    /// Perfetto decompresses them when loading the trace.
+    pub compress: bool,
+    /// Number of threads that generate the events of the global, task and core tracks in
+    /// parallel. With 0 or 1, all events are generated on the calling thread, and only a single
+    /// batch of packets is held in memory. Otherwise, the packets of every group of tracks are
+    /// held in memory until all groups before it are done. The trace is the same either way.
+    pub threads: usize,
+}
 
+/// Perfetto trace generator that keeps its tracks between calls.
+///
+/// Every call to [`PerfettoGenerator::generate`] only emits the track descriptors and events that
+/// were added to the trace since the previous call. Concatenating the output of all calls yields
+/// a single valid Perfetto trace, which allows a trace that is converted incrementally (see
+/// [`crate::convert::TraceConverter::convert_incremental`]) to be streamed to a viewer.
+///
+/// All tracks are created before any events are generated. The events are generated in groups of
+/// tracks (see [`TrackGroup`]) that do not depend on each other, and can be generated in
+/// parallel (see [`PerfettoOptions::threads`]).
+pub struct PerfettoGenerator {
+    pub(crate) syn: Synthetto,
+    pub(crate) options: PerfettoOptions,
+
+    global: GlobalTracks,
+    core_tracks: BTreeMap<usize, CoreTracks>,
+    /// Timestamp of the start of the trace, which counter downsampling is aligned to.
+    pub(crate) lod_origin: Option<u64>,
+
+    pub(crate) freertos: FreeRTOSTracks,
+}
+
+impl Default for PerfettoGenerator {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl PerfettoGenerator {
+    pub fn new() -> Self {
+        Self::with_options(PerfettoOptions::default())
+    }
+
+    pub fn with_options(options: PerfettoOptions) -> Self {
         let mut syn = Synthetto::new();
+        let global = GlobalTracks {
+            seq: syn.new_sequence(),
+            error_track: None,
+            evt_marker_tracks: BTreeMap::new(),
+            val_marker_tracks: BTreeMap::new(),
+        };
+        PerfettoGenerator {
+            syn,
+            options,
+            global,
+            core_tracks: BTreeMap::new(),
+            lod_origin: None,
+            freertos: FreeRTOSTracks::new(),
+        }
+    }
+
+    /// Align counter downsampling to `origin_ns` instead of to the start of the converted trace,
+    /// such as to the start of the complete recording when generating only a part of it.
+    pub fn with_lod_origin(mut self, origin_ns: u64) -> Self {
+        self.lod_origin = Some(origin_ns);
+        self
+    }
 
-        // Global Tracks:
-        self.generate_error_track(&mut syn, &mut proto_evts);
-        self.generate_marker_tracks(&mut syn, &mut proto_evts);
+    /// Encode all tracks and events added to the trace since the last call.
+    ///
+    /// Information that is only final at the end of the trace (such as the heap allocations
+    /// that were never freed) is not included.
+    pub fn generate(&mut self, t: &Trace) -> Vec<u8> {
+        let mut sink = PacketSink::collect(self.options.compress);
+        self.write_packets(t, &mut sink);
+        sink.into_data()
+    }
 
-        match self.mode {
+    /// Like [`PerfettoGenerator::generate`], but write the encoded packets to `w` while they are
+    /// being generated.
+    pub fn generate_to<W: Write>(&mut self, t: &Trace, w: &mut W) -> std::io::Result<()> {
+        let mut sink = PacketSink::write_to(w, self.options.compress);
+        self.write_packets(t, &mut sink);
+        sink.finish()
+    }
+
+    /// Like [`PerfettoGenerator::generate_to`], but also include the information that is only
+    /// final at the end of the trace. Call once, after the trace was converted completely.
+    pub fn finish_to<W: Write>(&mut self, t: &Trace, w: &mut W) -> std::io::Result<()> {
+        let mut sink = PacketSink::write_to(w, self.options.compress);
+        self.write_packets(t, &mut sink);
+        self.write_final_packets(t, &mut sink);
+        sink.finish()
+    }
+
+    /// Tracks describing the state at the end of the trace. Generated once, after the trace was
+    /// converted completely.
+    pub fn generate_final(&mut self, t: &Trace) -> Vec<u8> {
+        let mut sink = PacketSink::collect(self.options.compress);
+        self.write_final_packets(t, &mut sink);
+        sink.into_data()
+    }
+
+    fn write_packets(&mut self, t: &Trace, sink: &mut PacketSink) {
+        if self.lod_origin.is_none() && t.evt_count != 0 {
+            self.lod_origin = Some(t.convert_ts(t.ts_range().0));
+        }
+
+        // Create all tracks, which allocates their UUIDs, in a fixed order:
+        t.create_global_tracks(self);
+        match t.mode {
+            crate::decode::evts::TraceMode::Base => (),
+            crate::decode::evts::TraceMode::FreeRTOS => t.create_freertos_task_tracks(self),
+        }
+        t.create_core_tracks(self);
+        sink.extend(self.syn.new_descriptor_trace_evts());
+
+        // Task wakeups are emitted with the scheduling data of the core the task last ran on:
+        match t.mode {
+            crate::decode::evts::TraceMode::Base => (),
+            crate::decode::evts::TraceMode::FreeRTOS if self.options.compact_sched => {
+                t.collect_freertos_sched_wakeups(self);
+            }
+            crate::decode::evts::TraceMode::FreeRTOS => (),
+        }
+
+        let ctx = GenCtx {
+            options: &self.options,
+            lod: Lod::new(&self.options, self.lod_origin),
+        };
+
+        let mut groups = vec![TrackGroup::Global(&mut self.global, &mut self.freertos.global)];
+        groups.extend(
+            self.freertos
+                .task_tracks
+                .iter_mut()
+                .map(|(task_id, tracks)| TrackGroup::Task(*task_id, tracks)),
+        );
+        groups.extend(self.core_tracks.iter_mut().map(|(core_id, tracks)| {
+            let wakeups = self.freertos.sched_wakeups.remove(core_id).unwrap_or_default();
+            TrackGroup::Core(*core_id, tracks, wakeups)
+        }));
+
+        t.generate_track_groups(ctx, groups, sink);
+    }
+
+    fn write_final_packets(&mut self, t: &Trace, sink: &mut PacketSink) {
+        match t.mode {
             crate::decode::evts::TraceMode::Base => (),
             crate::decode::evts::TraceMode::FreeRTOS => {
-                self.generate_freertos_queue_tracks(&mut syn, &mut proto_evts);
-                self.generate_freertos_task_tracks(&mut syn, &mut proto_evts);
+                t.generate_freertos_heap_outstanding_track(self, sink);
             }
         }
+    }
+}
+
+/// Size of the encoded packets that a [`PacketSink`] writes or compresses at once.
+const PACKET_SINK_BATCH_SIZE: usize = 256 * 1024;
+
+/// Destination of generated packets.
+///
+/// Packets are encoded as they are generated. Most packets are written to the buffer directly
+/// (see synthetto's `write_*` functions), without building a [`TracePacket`] first. The encoded
+/// packets are either collected, or written in batches while they are generated, so that only a
+/// single batch is held in memory. The batches form a single trace. Since adding a packet cannot
+/// fail, the first write error is kept and returned by [`PacketSink::finish`], and nothing is
+/// written after it.
+///
+/// If enabled, every batch is wrapped into a single compressed packet before it is collected or
+/// written (see [`Compressor`]).
+pub(crate) struct PacketSink<'a> {
+    data: Vec<u8>,
+    output: SinkOutput<'a>,
+    compressor: Option<Compressor>,
+    err: Option<std::io::Error>,
+}
+
+enum SinkOutput<'a> {
+    /// Collect all packets. Unless they are compressed, they are collected in the current batch,
+    /// which is never passed on.
+    Collect(Vec<u8>),
+    Write(&'a mut dyn Write),
+    /// Keep all batches, to be passed on to another sink (see [`PacketSink::push_batch`]).
+    Batches(Vec<Vec<u8>>),
+}
+
+impl<'a> PacketSink<'a> {
+    fn collect(compress: bool) -> Self {
+        PacketSink {
+            data: vec![],
+            output: SinkOutput::Collect(vec![]),
+            compressor: compress.then(Compressor::new),
+            err: None,
+        }
+    }
+
+    fn write_to(w: &'a mut dyn Write, compress: bool) -> Self {
+        PacketSink {
+            data: Vec::with_capacity(PACKET_SINK_BATCH_SIZE),
+            output: SinkOutput::Write(w),
+            compressor: compress.then(Compressor::new),
+            err: None,
+        }
+    }
 
-        // Core tracks:
-        self.generate_core_tracks(&mut syn, &mut proto_evts);
+    fn batches() -> Self {
+        PacketSink {
+            data: Vec::with_capacity(PACKET_SINK_BATCH_SIZE),
+            output: SinkOutput::Batches(vec![]),
+            compressor: None,
+            err: None,
+        }
+    }
 
-        encode_trace(proto_evts)
+    /// Buffer to append the next encoded packet to.
+    pub fn buf(&mut self) -> &mut Vec<u8> {
+        if self.is_batched() && self.data.len() >= PACKET_SINK_BATCH_SIZE {
+            self.end_batch();
+        }
+        &mut self.data
     }
 
-    fn generate_error_track(&self, syn: &mut Synthetto, evts: &mut Vec<TracePacket>) {
-        let track = syn.new_global_track("Tracing Errors".to_string());
-        evts.extend(syn.new_descriptor_trace_evts());
+    pub fn push(&mut self, packet: TracePacket) {
+        write_packet(self.buf(), &packet);
+    }
 
-        for error_evt in &self.error_evts.0 {
-            let ts = self.convert_ts(error_evt.ts);
-            evts.push(track.instant_evt(ts, format!("{:?}", error_evt.inner)));
+    pub fn extend(&mut self, packets: impl IntoIterator<Item = TracePacket>) {
+        for packet in packets {
+            self.push(packet);
         }
     }
 
-    fn generate_marker_tracks(&self, syn: &mut Synthetto, evts: &mut Vec<TracePacket>) {
-        for (marker_id, marker) in &self.user_evt_markers {
-            let marker_name = self.name_user_evtmarker(*marker_id);
+    /// Pass on a batch of packets collected by another sink (see [`PacketSink::batches`]), as if
+    /// its packets were added to this sink and followed by [`PacketSink::end_batch`].
+    fn push_batch(&mut self, batch: Vec<u8>) {
+        if !self.is_batched() {
+            self.data.extend_from_slice(&batch);
+            return;
+        }
 
-            let track = syn.new_global_track(marker_name);
-            evts.extend(syn.new_descriptor_trace_evts());
+        self.end_batch();
+        self.data = batch;
+        self.end_batch();
+    }
 
-            for evt in &marker.markers.0 {
-                let ts = self.convert_ts(evt.ts);
-                match &evt.inner {
-                    crate::UserEvtMarker::Instant { msg } => {
-                        evts.push(track.instant_evt(ts, msg.clone()));
+    fn is_batched(&self) -> bool {
+        !matches!(self.output, SinkOutput::Collect(_)) || self.compressor.is_some()
+    }
+
+    /// Pass on the current batch: Write or keep it, or start compressing it and pass on the
+    /// compressed batches that are done. The next packet starts a new batch.
+    fn end_batch(&mut self) {
+        if self.data.is_empty() || !self.is_batched() {
+            return;
+        }
+
+        if let SinkOutput::Batches(batches) = &mut self.output {
+            batches.push(std::mem::replace(&mut self.data, Vec::with_capacity(PACKET_SINK_BATCH_SIZE)));
+            return;
+        }
+
+        match &mut self.compressor {
+            None => {
+                let data = std::mem::take(&mut self.data);
+                self.emit(&data);
+                self.data = data;
+                self.data.clear();
+            }
+            Some(compressor) => {
+                let batch = std::mem::replace(&mut self.data, Vec::with_capacity(PACKET_SINK_BATCH_SIZE));
+                if let Some(compressed) = compressor.push(batch) {
+                    self.emit(&compressed);
+                }
+            }
+        }
+    }
+
+    /// End the current batch, and wait for all batches that are still being compressed.
+    fn drain(&mut self) {
+        self.end_batch();
+        while let Some(compressed) = self.compressor.as_mut().and_then(Compressor::pop) {
+            self.emit(&compressed);
+        }
+    }
+
+    /// Write or collect data that is ready for output.
+    fn emit(&mut self, data: &[u8]) {
+        match &mut self.output {
+            SinkOutput::Collect(collected) => collected.extend_from_slice(data),
+            SinkOutput::Write(writer) => {
+                if self.err.is_none() {
+                    if let Err(err) = writer.write_all(data) {
+                        self.err = Some(err);
                     }
-                    crate::UserEvtMarker::SliceBegin { msg } => {
-                        evts.push(track.slice_begin_evt(ts, Some(msg.clone())));
+                }
+            }
+            SinkOutput::Batches(_) => unreachable!("Batches are kept, not emitted."),
+        }
+    }
+
+    fn into_data(mut self) -> Vec<u8> {
+        if !self.is_batched() {
+            return self.data;
+        }
+        self.drain();
+        match self.output {
+            SinkOutput::Collect(collected) => collected,
+            _ => unreachable!("Only a collecting sink has data."),
+        }
+    }
+
+    fn into_batches(mut self) -> Vec<Vec<u8>> {
+        self.end_batch();
+        match self.output {
+            SinkOutput::Batches(batches) => batches,
+            _ => unreachable!("Only a batch keeping sink has batches."),
+        }
+    }
+
+    fn finish(mut self) -> std::io::Result<()> {
+        self.drain();
+        match self.err {
+            Some(err) => Err(err),
+            None => Ok(()),
+        }
+    }
+}
+
+/// Compresses batches of packets into a single packet each (see synthetto's
+/// [`compressed_packets`]).
+///
+/// Batches are compressed in the background, by up to one thread per core, while the next batch
+/// is generated. The compressed batches are passed on in the order their packets were generated
+/// in, so that the interned data of the trace stays valid. Without threads (such as on wasm),
+/// every batch is compressed immediately.
+struct Compressor {
+    pending: VecDeque<JoinHandle<Vec<u8>>>,
+    max_pending: usize,
+}
+
+impl Compressor {
+    fn new() -> Self {
+        Compressor {
+            pending: VecDeque::new(),
+            max_pending: std::thread::available_parallelism().map_or(1, |n| n.get()),
+        }
+    }
+
+    /// Start compressing `batch`. If the maximum number of batches is already being compressed,
+    /// returns the oldest one once it is done.
+    fn push(&mut self, batch: Vec<u8>) -> Option<Vec<u8>> {
+        if self.max_pending <= 1 {
+            return Some(Self::compress(&batch));
+        }
+
+        let done = if self.pending.len() >= self.max_pending {
+            self.pop()
+        } else {
+            None
+        };
+        self.pending
+            .push_back(std::thread::spawn(move || Self::compress(&batch)));
+        done
+    }
+
+    /// Wait for the oldest batch that is being compressed.
+    fn pop(&mut self) -> Option<Vec<u8>> {
+        let pending = self.pending.pop_front()?;
+        Some(pending.join().expect("Compression thread panicked."))
+    }
+
+    fn compress(batch: &[u8]) -> Vec<u8> {
+        let mut compressed = vec![];
+        write_packet(&mut compressed, &compressed_packets(batch));
+        compressed
+    }
+}
+
+/// A track, and the number of items of the timeseries it is generated from that have already
+/// been emitted.
+pub(crate) struct TrackCursor<T> {
+    pub track: T,
+    pub next: usize,
+    /// Set while a slice is open on the track.
+    pub open: bool,
+}
+
+impl<T> TrackCursor<T> {
+    pub fn new(track: T) -> Self {
+        TrackCursor {
+            track,
+            next: 0,
+            open: false,
+        }
+    }
+
+    /// Items of `series` that have not been emitted yet. Marks them as emitted.
+    pub fn advance<'a, V>(&mut self, series: &'a [Ts<V>]) -> &'a [Ts<V>] {
+        let pending = &series[self.next..];
+        self.next = series.len();
+        pending
+    }
+}
+
+/// Tracks of the whole system (errors and markers), generated as one group.
+struct GlobalTracks {
+    seq: Sequence,
+    error_track: Option<TrackCursor<Track<Global, EventTrack>>>,
+    evt_marker_tracks: BTreeMap<usize, TrackCursor<Track<Global, EventTrack>>>,
+    val_marker_tracks: BTreeMap<usize, CounterCursor<Global>>,
+}
+
+struct CoreTracks {
+    seq: Sequence,
+    process: Process,
+    isr_tracks: BTreeMap<usize, TrackCursor<Track<Process, EventTrack>>>,
+    /// Events of ISRs that are connected to events of tasks (FreeRTOS only).
+    isr_flow_tracks: BTreeMap<usize, TrackCursor<Track<Process, EventTrack>>>,
+    /// Trace events track. Its cursor is the index of the next event in the trace's event store.
+    evt_track: Option<TrackCursor<Track<Process, EventTrack>>>,
+    freertos: Option<FreeRTOSCoreTracks>,
+}
+
+/// Tracks whose events are generated together, independently of all other tracks.
+///
+/// Every group emits its events on its own packet sequence, so that the names it interns do not
+/// depend on any other group. Groups can therefore be generated in any order, or in parallel.
+enum TrackGroup<'g> {
+    Global(&'g mut GlobalTracks, &'g mut FreeRTOSGlobalTracks),
+    /// A FreeRTOS task.
+    Task(usize, &'g mut TaskTracks),
+    /// A core, and the wakeups of tasks that last ran on it (scheduling data only).
+    Core(usize, &'g mut CoreTracks, Vec<(u64, usize)>),
+}
+
+/// Shared state while generating the events of track groups.
+#[derive(Clone, Copy)]
+pub(crate) struct GenCtx<'a> {
+    pub options: &'a PerfettoOptions,
+    pub lod: Option<Lod<'a>>,
+}
+
+// ==== Track Generation =======================================================
+
+impl Trace {
+    /// Generate the events of all track groups, and pass them on in order.
+    ///
+    /// With more than one thread (see [`PerfettoOptions::threads`]), every thread takes the next
+    /// group that was not generated yet, and collects its packets in separate batches. Every group
+    /// starts a new batch, and is split into batches the same way on any thread, so the generated
+    /// trace (and the compressed batches) does not depend on the number of threads.
+    fn generate_track_groups(&self, ctx: GenCtx, groups: Vec<TrackGroup>, sink: &mut PacketSink) {
+        let threads = ctx.options.threads.min(groups.len());
+        if threads <= 1 {
+            for group in groups {
+                sink.end_batch();
+                self.generate_track_group(ctx, group, sink);
+            }
+            sink.end_batch();
+            return;
+        }
+
+        let groups = Mutex::new(groups.into_iter().enumerate());
+        let (done_send, done_recv) = mpsc::channel();
+        std::thread::scope(|s| {
+            for _ in 0..threads {
+                let groups = &groups;
+                let done_send = done_send.clone();
+                s.spawn(move || loop {
+                    let Some((idx, group)) = groups.lock().unwrap().next() else {
+                        return;
+                    };
+                    let mut group_sink = PacketSink::batches();
+                    self.generate_track_group(ctx, group, &mut group_sink);
+                    if done_send.send((idx, group_sink.into_batches())).is_err() {
+                        return;
+                    }
+                });
+            }
+            drop(done_send);
+
+            // Pass on the batches of every group once all groups before it are done:
+            let mut done = BTreeMap::new();
+            let mut next = 0;
+            for (idx, batches) in done_recv {
+                done.insert(idx, batches);
+                while let Some(batches) = done.remove(&next) {
+                    for batch in batches {
+                        sink.push_batch(batch);
                     }
-                    crate::UserEvtMarker::SliceEnd => {
-                        evts.push(track.slice_end_evt(ts));
+                    next += 1;
+                }
+            }
+        });
+    }
+
+    fn generate_track_group(&self, ctx: GenCtx, group: TrackGroup, evts: &mut PacketSink) {
+        match group {
+            TrackGroup::Global(tracks, freertos) => {
+                self.generate_error_track(tracks, evts);
+                self.generate_marker_tracks(ctx, tracks, evts);
+
+                match self.mode {
+                    crate::decode::evts::TraceMode::Base => (),
+                    crate::decode::evts::TraceMode::FreeRTOS => {
+                        self.generate_freertos_queue_tracks(ctx, freertos, &mut tracks.seq, evts);
+                        self.generate_freertos_heap_tracks(ctx, freertos, evts);
                     }
                 }
             }
+            TrackGroup::Task(task_id, tracks) => self.generate_freertos_task_tracks(ctx, task_id, tracks, evts),
+            TrackGroup::Core(core_id, tracks, wakeups) => {
+                self.generate_core_tracks(ctx, core_id, tracks, wakeups, evts)
+            }
+        }
+    }
+
+    fn create_global_tracks(&self, g: &mut PerfettoGenerator) {
+        let tracks = &mut g.global;
+
+        if tracks.error_track.is_none() {
+            tracks.error_track = Some(TrackCursor::new(g.syn.new_global_track("Tracing Errors".to_string())));
+        }
+
+        for (marker_id, _) in &self.user_evt_markers {
+            tracks.evt_marker_tracks.entry(marker_id).or_insert_with(|| {
+                let marker_name = self.name_user_evtmarker(marker_id);
+                TrackCursor::new(g.syn.new_global_track(marker_name))
+            });
+        }
+
+        let lod = Lod::new(&g.options, g.lod_origin);
+        for (marker_id, _) in &self.user_val_markers {
+            tracks.val_marker_tracks.entry(marker_id).or_insert_with(|| {
+                let marker_name = self.name_user_valmarker(marker_id);
+                CounterCursor::new(&mut g.syn, lod, marker_name, |syn, name| {
+                    syn.new_global_counter_track(name, CounterTrackUnit::Unspecified, 1, false)
+                })
+            });
+        }
+
+        match self.mode {
+            crate::decode::evts::TraceMode::Base => (),
+            crate::decode::evts::TraceMode::FreeRTOS => {
+                self.create_freertos_queue_tracks(g);
+                self.create_freertos_heap_tracks(g);
+            }
+        }
+    }
+
+    fn generate_error_track(&self, tracks: &mut GlobalTracks, evts: &mut PacketSink) {
+        let track = tracks.error_track.as_mut().unwrap();
+
+        let mut name = String::new();
+        for error_evt in track.advance(&self.error_evts.0) {
+            let ts = self.convert_ts(error_evt.ts);
+            name.clear();
+            write!(name, "{:?}", error_evt.inner).unwrap();
+            track.track.write_instant_evt(evts.buf(), ts, &name);
+        }
+    }
+
+    fn generate_marker_tracks(&self, ctx: GenCtx, tracks: &mut GlobalTracks, evts: &mut PacketSink) {
+        for (marker_id, marker) in &self.user_evt_markers {
+            let track = tracks.evt_marker_tracks.get_mut(&marker_id).unwrap();
+            let pending = track.advance(&marker.markers.0);
+            self.generate_user_evt_marker_evts(&mut tracks.seq, &track.track, pending, evts);
         }
 
         for (marker_id, marker) in &self.user_val_markers {
-            let marker_name = self.name_user_valmarker(*marker_id);
-            let track = syn.new_global_counter_track(marker_name, CounterTrackUnit::Unspecified, 1, false);
-            evts.extend(syn.new_descriptor_trace_evts());
+            let track = tracks.val_marker_tracks.get_mut(&marker_id).unwrap();
+            track.write(self, ctx.lod, &marker.vals.0, |val| *val, evts.buf());
+        }
+    }
 
-            for evt in &marker.vals.0 {
-                let ts = self.convert_ts(evt.ts);
-                evts.push(track.int_counter_evt(ts, evt.inner));
+    pub(crate) fn generate_user_evt_marker_evts<S: TrackScope>(
+        &self,
+        seq: &mut Sequence,
+        track: &Track<S, EventTrack>,
+        markers: &[Ts<UserEvtMarker>],
+        evts: &mut PacketSink,
+    ) {
+        for evt in markers {
+            let ts = self.convert_ts(evt.ts);
+            match &evt.inner {
+                UserEvtMarker::Instant { msg } => {
+                    track.write_interned_instant_evt(seq, evts.buf(), ts, msg);
+                }
+                UserEvtMarker::SliceBegin { msg } => {
+                    track.write_interned_slice_begin_evt(seq, evts.buf(), ts, msg);
+                }
+                UserEvtMarker::SliceEnd => {
+                    track.write_slice_end_evt(evts.buf(), ts);
+                }
             }
         }
     }
@@ -79,60 +657,560 @@ impl Trace {
         i32::max(self.core_count as i32 + self.core_pid_offset(), 20)
     }
 
-    fn generate_core_tracks(&self, syn: &mut Synthetto, evts: &mut Vec<TracePacket>) {
+    fn create_core_tracks(&self, g: &mut PerfettoGenerator) {
         for (core_id, core) in &self.cores {
             let core_name = format!("Core #{core_id}");
 
-            let core_process =
-                syn.new_process((*core_id as i32) + self.core_pid_offset(), core_name.clone(), vec![], None);
-            let core_parent_track = syn.new_process_track(core_name.clone(), &core_process);
-            evts.extend(syn.new_descriptor_trace_evts());
+            let tracks = g.core_tracks.entry(*core_id).or_insert_with(|| {
+                let pid = (*core_id as i32) + self.core_pid_offset();
+                let process = g.syn.new_process(pid, core_name.clone(), vec![], None);
+                let parent_track = g.syn.new_process_track(core_name.clone(), &process);
+                let freertos = match self.mode {
+                    crate::decode::evts::TraceMode::Base => None,
+                    crate::decode::evts::TraceMode::FreeRTOS => {
+                        Some(FreeRTOSCoreTracks::new(&mut g.syn, &g.options, *core_id, &process, parent_track))
+                    }
+                };
 
-            match self.mode {
-                crate::decode::evts::TraceMode::Base => (),
-                crate::decode::evts::TraceMode::FreeRTOS => {
-                    self.generate_freertos_core_tracks(syn, evts, *core_id, &core_parent_track);
+                CoreTracks {
+                    seq: g.syn.new_sequence(),
+                    process,
+                    isr_tracks: BTreeMap::new(),
+                    isr_flow_tracks: BTreeMap::new(),
+                    evt_track: None,
+                    freertos,
                 }
+            });
+
+            if let Some(freertos) = &mut tracks.freertos {
+                self.create_freertos_core_tracks(&mut g.syn, &g.options, freertos);
             }
 
             for (isr_id, isr) in &core.isrs {
-                let track_name = format!("{core_name} {}", self.name_isr(*core_id, *isr_id));
+                tracks.isr_tracks.entry(isr_id).or_insert_with(|| {
+                    let track_name = format!("{core_name} {}", self.name_isr(*core_id, isr_id));
+                    TrackCursor::new(g.syn.new_process_track(track_name, &tracks.process))
+                });
+
+                if !isr.flows.0.is_empty() {
+                    tracks.isr_flow_tracks.entry(isr_id).or_insert_with(|| {
+                        let track_name = format!("{core_name} {} Flows", self.name_isr(*core_id, isr_id));
+                        TrackCursor::new(g.syn.new_process_track(track_name, &tracks.process))
+                    });
+                }
+            }
+
+            if g.options.raw_evts && tracks.evt_track.is_none() {
+                let evt_track_name = format!("{core_name} Trace Events");
+                tracks.evt_track = Some(TrackCursor::new(g.syn.new_process_track(evt_track_name, &tracks.process)));
+            }
+        }
+    }
+
+    fn generate_core_tracks(
+        &self,
+        ctx: GenCtx,
+        core_id: usize,
+        tracks: &mut CoreTracks,
+        wakeups: Vec<(u64, usize)>,
+        evts: &mut PacketSink,
+    ) {
+        let core = self.core(core_id);
 
-                let isr_track = syn.new_process_track(track_name, &core_process);
-                evts.extend(syn.new_descriptor_trace_evts());
+        if let Some(freertos) = &mut tracks.freertos {
+            self.generate_freertos_core_tracks(ctx, core_id, freertos, &mut tracks.seq, wakeups, evts);
+        }
 
-                let mut isr_active = false;
+        for (isr_id, isr) in &core.isrs {
+            let isr_track = tracks.isr_tracks.get_mut(&isr_id).unwrap();
 
-                for evt in &isr.state.0 {
-                    let ts = self.convert_ts(evt.ts);
-                    let state = &evt.inner;
+            for evt in isr_track.advance(&isr.state.0) {
+                let ts = self.convert_ts(evt.ts);
+                let state = &evt.inner;
 
-                    match state {
-                        crate::ISRState::Active => {
-                            if !isr_active {
-                                evts.push(isr_track.slice_begin_evt(ts, Some(self.name_isr(*core_id, *isr_id))));
-                                isr_active = true;
-                            }
+                match state {
+                    crate::ISRState::Active => {
+                        if !isr_track.open {
+                            let name = self.name_isr(core_id, isr_id);
+                            isr_track
+                                .track
+                                .write_interned_slice_begin_evt(&mut tracks.seq, evts.buf(), ts, &name);
+                            isr_track.open = true;
                         }
-                        crate::ISRState::NotActive => {
-                            if isr_active {
-                                evts.push(isr_track.slice_end_evt(ts));
-                                isr_active = false;
-                            }
+                    }
+                    crate::ISRState::NotActive => {
+                        if isr_track.open {
+                            isr_track.track.write_slice_end_evt(evts.buf(), ts);
+                            isr_track.open = false;
                         }
                     }
                 }
             }
 
-            let evt_track_name = format!("{core_name} Trace Events");
-            let evt_track = syn.new_process_track(evt_track_name, &core_process);
-            evts.extend(syn.new_descriptor_trace_evts());
+            if let Some(flow_track) = tracks.isr_flow_tracks.get_mut(&isr_id) {
+                let pending = flow_track.advance(&isr.flows.0);
+                self.generate_freertos_flow_evts(&mut tracks.seq, &flow_track.track, pending, evts);
+            }
+        }
 
-            for evt in &core.evts.0 {
-                let ts = self.convert_ts(evt.ts);
-                let evt = &evt.inner.0;
-                evts.push(evt_track.instant_evt(ts, format!("{:?}", evt)));
+        if let Some(evt_track) = &mut tracks.evt_track {
+            for (ts, evt) in self.core_evts_from(core_id, evt_track.next) {
+                let ts = self.convert_ts(ts);
+                let mut args = vec![];
+                evt.for_each_field(|name, val| {
+                    let val = match val {
+                        EvtFieldVal::Uint(val) => DebugValue::Uint(val),
+                        EvtFieldVal::Int(val) => DebugValue::Int(val),
+                        EvtFieldVal::Str(val) => DebugValue::Str(val),
+                    };
+                    args.push((name, val));
+                });
+                evt_track.track.write_interned_instant_evt_with_args(
+                    &mut tracks.seq,
+                    evts.buf(),
+                    ts,
+                    evt.kind_name(),
+                    &args,
+                );
+            }
+            evt_track.next = self.evt_count;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::{
+        convert::TraceConverter,
+        decode::evts::{
+            BaseEvt, BaseEvtKind, BaseIsrEnterEvt, BaseIsrExitEvt, BaseValmarkerEvt,
+            FreeRTOSCurtaskBlockOnQueueReceiveEvt, FreeRTOSCurtaskDelayEvt, FreeRTOSEvt, FreeRTOSEvtKind,
+            FreeRTOSQueueReceiveEvt, FreeRTOSQueueSendEvt, FreeRTOSQueueSendFromIsrEvt, FreeRTOSTaskCreatedEvt,
+            FreeRTOSTaskSwitchedInEvt, FreeRTOSTaskToRdyStateEvt, RawEvt, TraceMode,
+        },
+    };
+
+    /// Writer that fails once more than `limit` bytes were written.
+    struct LimitedWriter {
+        written: usize,
+        limit: usize,
+    }
+
+    impl Write for LimitedWriter {
+        fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+            self.written += buf.len();
+            if self.written > self.limit {
+                return Err(std::io::Error::other("limit reached"));
+            }
+            Ok(buf.len())
+        }
+
+        fn flush(&mut self) -> std::io::Result<()> {
+            Ok(())
+        }
+    }
+
+    fn isr_trace(isr_cnt: u64) -> Trace {
+        let evts: Vec<_> = (0..isr_cnt * 2)
+            .map(|idx| {
+                let isr_id = (idx / 2 % 8) as u32;
+                let kind = if idx % 2 == 0 {
+                    BaseEvtKind::IsrEnter(BaseIsrEnterEvt { isr_id })
+                } else {
+                    BaseEvtKind::IsrExit(BaseIsrExitEvt { isr_id })
+                };
+                RawEvt::Base(BaseEvt { ts: idx, kind })
+            })
+            .collect();
+
+        let mut tc = TraceConverter::new(1, TraceMode::Base).unwrap();
+        tc.add_evts(&evts).unwrap();
+        tc.convert().unwrap()
+    }
+
+    fn varint(data: &mut &[u8]) -> u64 {
+        let mut val = 0;
+        for shift in (0..).step_by(7) {
+            let byte = data[0];
+            *data = &data[1..];
+            val |= ((byte & 0x7F) as u64) << shift;
+            if byte & 0x80 == 0 {
+                break;
+            }
+        }
+        val
+    }
+
+    /// Values of a packed repeated varint field.
+    fn decode_packed(mut data: &[u8]) -> Vec<u64> {
+        let mut vals = vec![];
+        while !data.is_empty() {
+            vals.push(varint(&mut data));
+        }
+        vals
+    }
+
+    /// Fields of an encoded protobuf message, as pairs of tag and either the value of a varint
+    /// field or the content of a length-delimited field.
+    fn decode_fields(mut data: &[u8]) -> Vec<(u64, Result<u64, &[u8]>)> {
+        let mut fields = vec![];
+        while !data.is_empty() {
+            let key = varint(&mut data);
+            let val = match key & 0x7 {
+                0 => Ok(varint(&mut data)),
+                1 => {
+                    let val = u64::from_le_bytes(data[..8].try_into().unwrap());
+                    data = &data[8..];
+                    Ok(val)
+                }
+                2 => {
+                    let len = varint(&mut data) as usize;
+                    let (content, rest) = data.split_at(len);
+                    data = rest;
+                    Err(content)
+                }
+                wire_type => panic!("Unexpected wire type {wire_type}."),
+            };
+            fields.push((key >> 3, val));
+        }
+        fields
+    }
+
+    #[test]
+    fn streamed_trace_matches_collected_trace() {
+        let trace = isr_trace(32768);
+
+        let mut generator = PerfettoGenerator::new();
+        let mut collected = generator.generate(&trace);
+        collected.extend(generator.generate_final(&trace));
+        assert!(collected.len() > 2 * PACKET_SINK_BATCH_SIZE);
+
+        let mut streamed = vec![];
+        trace.generate_perfetto_trace_to(&mut streamed).unwrap();
+        assert_eq!(streamed, collected);
+    }
+
+    #[test]
+    fn event_names_interned_once() {
+        let trace = isr_trace(1000);
+        let data = trace.generate_perfetto_trace();
+        let packets: Vec<_> = decode_fields(&data)
+            .into_iter()
+            .map(|(_, packet)| decode_fields(packet.unwrap_err()))
+            .collect();
+
+        // Every one of the 8 ISR names is only included once:
+        let interned_names: usize = packets
+            .iter()
+            .flatten()
+            .filter(|(tag, _)| *tag == 12)
+            .map(|(_, interned_data)| decode_fields(interned_data.unwrap_err()).len())
+            .sum();
+        assert_eq!(interned_names, 8);
+
+        // The first packet that relies on interned data clears the incremental state:
+        let flags: Vec<u64> = packets
+            .iter()
+            .flatten()
+            .filter(|(tag, _)| *tag == 13)
+            .map(|(_, flags)| flags.unwrap())
+            .collect();
+        assert_eq!(flags.len(), 1000);
+        assert_eq!(flags[0], 3);
+        assert!(flags[1..].iter().all(|f| *f == 2));
+    }
+
+    #[test]
+    fn raw_evts_track_is_opt_in() {
+        fn count(data: &[u8], s: &str) -> usize {
+            data.windows(s.len()).filter(|w| *w == s.as_bytes()).count()
+        }
+
+        let trace = isr_trace(100);
+        assert_eq!(count(&trace.generate_perfetto_trace(), "Trace Events"), 0);
+
+        let options = PerfettoOptions {
+            raw_evts: true,
+            ..PerfettoOptions::default()
+        };
+        let mut data = vec![];
+        PerfettoGenerator::with_options(options)
+            .finish_to(&trace, &mut data)
+            .unwrap();
+        assert_eq!(count(&data, "Trace Events"), 1);
+
+        // Event kinds and field names are interned:
+        assert_eq!(count(&data, "IsrEnter"), 1);
+        assert_eq!(count(&data, "IsrExit"), 1);
+        assert_eq!(count(&data, "isr_id"), 1);
+    }
+
+    #[test]
+    fn compressed_trace_matches_uncompressed_trace() {
+        let trace = isr_trace(32768);
+        let uncompressed = trace.generate_perfetto_trace();
+
+        let options = PerfettoOptions {
+            compress: true,
+            ..PerfettoOptions::default()
+        };
+        let mut compressed = vec![];
+        PerfettoGenerator::with_options(options)
+            .finish_to(&trace, &mut compressed)
+            .unwrap();
+        assert!(compressed.len() < uncompressed.len() / 4);
+
+        // Every packet holds a compressed batch, and the batches are in order:
+        let mut decompressed = vec![];
+        let packets = decode_fields(&compressed);
+        assert!(packets.len() > 1);
+        for (_, packet) in packets {
+            let fields = decode_fields(packet.unwrap_err());
+            assert_eq!(fields.len(), 1);
+            assert_eq!(fields[0].0, 50);
+            flate2::write::ZlibDecoder::new(&mut decompressed)
+                .write_all(fields[0].1.unwrap_err())
+                .unwrap();
+        }
+        assert_eq!(decompressed, uncompressed);
+    }
+
+    #[test]
+    fn parallel_trace_matches_sequential_trace() {
+        let mut evts: Vec<_> = (1..=4)
+            .map(|task_id| (0, FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id })))
+            .collect();
+        evts.extend((1..4000).map(|ts| {
+            let task_id = (ts % 4) as u32 + 1;
+            (ts, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id }))
+        }));
+        let evts: Vec<_> = evts
+            .into_iter()
+            .map(|(ts, kind)| RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind }))
+            .collect();
+        let mut tc = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        tc.add_evts(&evts).unwrap();
+        let freertos_trace = tc.convert().unwrap();
+
+        for trace in [&freertos_trace, &isr_trace(8192)] {
+            for (compact_sched, compress) in [(false, false), (false, true), (true, false), (true, true)] {
+                let generate = |threads: usize| {
+                    let options = PerfettoOptions {
+                        compact_sched,
+                        compress,
+                        threads,
+                        ..PerfettoOptions::default()
+                    };
+                    let mut data = vec![];
+                    PerfettoGenerator::with_options(options.clone())
+                        .finish_to(trace, &mut data)
+                        .unwrap();
+                    assert_eq!(data, PerfettoGenerator::with_options(options).generate(trace));
+                    data
+                };
+                assert_eq!(generate(4), generate(1));
             }
         }
     }
+
+    #[test]
+    fn streamed_trace_write_error() {
+        let trace = isr_trace(8192);
+
+        let mut w = LimitedWriter {
+            written: 0,
+            limit: 1024,
+        };
+        trace.generate_perfetto_trace_to(&mut w).unwrap_err();
+
+        // Nothing is written after the error:
+        let written = w.written;
+        assert!(written > w.limit);
+        assert!(written < trace.generate_perfetto_trace().len());
+    }
+
+    #[test]
+    fn task_switches_as_sched_data() {
+        let evts = [
+            (0, FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id: 1 })),
+            (0, FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id: 2 })),
+            (10, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id: 1 })),
+            (15, FreeRTOSEvtKind::CurtaskDelay(FreeRTOSCurtaskDelayEvt { ticks: 1 })),
+            (20, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id: 2 })),
+            (25, FreeRTOSEvtKind::TaskToRdyState(FreeRTOSTaskToRdyStateEvt { task_id: 1 })),
+            (30, FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id: 1 })),
+        ]
+        .map(|(ts, kind)| RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind }));
+        let mut tc = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        tc.add_evts(&evts).unwrap();
+        let trace = tc.convert().unwrap();
+
+        let options = PerfettoOptions {
+            compact_sched: true,
+            ..PerfettoOptions::default()
+        };
+        let mut data = vec![];
+        PerfettoGenerator::with_options(options)
+            .finish_to(&trace, &mut data)
+            .unwrap();
+
+        let bundles: Vec<_> = decode_fields(&data)
+            .into_iter()
+            .flat_map(|(_, packet)| decode_fields(packet.unwrap_err()))
+            .filter(|(tag, _)| *tag == 1)
+            .map(|(_, bundle)| decode_fields(bundle.unwrap_err()))
+            .collect();
+        assert_eq!(bundles.len(), 1);
+        assert_eq!(bundles[0][0], (1, Ok(0)));
+
+        let compact = decode_fields(bundles[0][1].1.unwrap_err());
+        let field = |tag: u64| decode_packed(compact.iter().find(|(t, _)| *t == tag).unwrap().1.unwrap_err());
+        let tid = |task_id: u64| task_id + trace.rtos_pid_offset() as u64;
+
+        // Timestamps are delta-encoded:
+        assert_eq!(field(1), [10, 10, 10]);
+        // Task 1 blocks, task 2 is preempted:
+        assert_eq!(field(2), [0, 1, 0]);
+        assert_eq!(field(3), [tid(1), tid(2), tid(1)]);
+        // Task 1 is woken up after its delay, which is the last wakeup:
+        assert_eq!(field(8).last(), Some(&tid(1)));
+        assert_eq!(field(7).iter().sum::<u64>(), 25);
+    }
+
+    #[test]
+    fn queue_and_wakeup_flows() {
+        let fr = |ts, kind| RawEvt::FreeRTOS(FreeRTOSEvt { ts, kind });
+        let base = |ts, kind| RawEvt::Base(BaseEvt { ts, kind });
+        let send = |queue_id, len_after| FreeRTOSEvtKind::QueueSend(FreeRTOSQueueSendEvt { queue_id, len_after });
+        let receive =
+            |queue_id, len_after| FreeRTOSEvtKind::QueueReceive(FreeRTOSQueueReceiveEvt { queue_id, len_after });
+        let switch_in = |task_id| FreeRTOSEvtKind::TaskSwitchedIn(FreeRTOSTaskSwitchedInEvt { task_id });
+
+        let evts = [
+            fr(0, FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id: 1 })),
+            fr(0, FreeRTOSEvtKind::TaskCreated(FreeRTOSTaskCreatedEvt { task_id: 2 })),
+            // Task 2 blocks on queue 7, and is woken by task 1 sending to it:
+            fr(10, switch_in(2)),
+            fr(
+                11,
+                FreeRTOSEvtKind::CurtaskBlockOnQueueReceive(FreeRTOSCurtaskBlockOnQueueReceiveEvt {
+                    queue_id: 7,
+                    ticks_to_wait: 100,
+                }),
+            ),
+            fr(12, switch_in(1)),
+            fr(13, send(7, 1)),
+            fr(13, FreeRTOSEvtKind::TaskToRdyState(FreeRTOSTaskToRdyStateEvt { task_id: 2 })),
+            // An ISR sends to the queue as well:
+            base(14, BaseEvtKind::IsrEnter(BaseIsrEnterEvt { isr_id: 5 })),
+            fr(
+                15,
+                FreeRTOSEvtKind::QueueSendFromIsr(FreeRTOSQueueSendFromIsrEvt {
+                    queue_id: 7,
+                    len_after: 2,
+                }),
+            ),
+            base(16, BaseEvtKind::IsrExit(BaseIsrExitEvt { isr_id: 5 })),
+            // Task 2 receives both items in order, and an item of queue 8 that was sent before the
+            // trace started:
+            fr(20, switch_in(2)),
+            fr(21, receive(7, 1)),
+            fr(22, receive(7, 0)),
+            fr(23, receive(8, 3)),
+        ];
+        let mut tc = TraceConverter::new(1, TraceMode::FreeRTOS).unwrap();
+        tc.add_evts(&evts).unwrap();
+        let trace = tc.convert().unwrap();
+
+        let flows = |flows: &crate::Timeseries<crate::freertos::FlowEvt>| -> Vec<(u64, u64, bool)> {
+            flows
+                .0
+                .iter()
+                .map(|evt| (evt.ts, evt.inner.flow_id, evt.inner.kind.is_end()))
+                .collect()
+        };
+        let producer = trace.freertos.tasks.get(1).unwrap();
+        let consumer = trace.freertos.tasks.get(2).unwrap();
+        let isr = trace.core(0).isrs.get(5).unwrap();
+        assert_eq!(flows(&producer.flows), [(13, 1, false), (13, 2, false)]);
+        assert_eq!(flows(&isr.flows), [(15, 3, false)]);
+        assert_eq!(flows(&consumer.flows), [(13, 2, true), (21, 1, true), (22, 3, true)]);
+
+        // Every flow starts and ends at a track event:
+        let data = trace.generate_perfetto_trace();
+        let flow_ids = |tag| {
+            decode_fields(&data)
+                .into_iter()
+                .flat_map(|(_, packet)| decode_fields(packet.unwrap_err()))
+                .filter(|(tag, _)| *tag == 11)
+                .flat_map(|(_, evt)| decode_fields(evt.unwrap_err()))
+                .filter(|(evt_tag, _)| *evt_tag == tag)
+                .count()
+        };
+        assert_eq!(flow_ids(47), 3);
+        assert_eq!(flow_ids(48), 3);
+    }
+
+    #[test]
+    fn dense_counters_downsampled() {
+        let evts: Vec<_> = (0..1000)
+            .map(|ts| {
+                let kind = BaseEvtKind::Valmarker(BaseValmarkerEvt {
+                    valmarker_id: 0,
+                    val: (ts % 7) as i64,
+                });
+                RawEvt::Base(BaseEvt { ts, kind })
+            })
+            .collect();
+        let mut tc = TraceConverter::new(1, TraceMode::Base).unwrap();
+        tc.add_evts(&evts).unwrap();
+        let trace = tc.convert().unwrap();
+
+        let generate = |counter_lod: Option<CounterLod>| {
+            let options = PerfettoOptions {
+                counter_lod,
+                ..PerfettoOptions::default()
+            };
+            let mut data = vec![];
+            PerfettoGenerator::with_options(options)
+                .finish_to(&trace, &mut data)
+                .unwrap();
+            data
+        };
+        let counter_evts = |data: &[u8]| {
+            decode_fields(data)
+                .into_iter()
+                .flat_map(|(_, packet)| decode_fields(packet.unwrap_err()))
+                .filter(|(tag, _)| *tag == 11)
+                .filter(|(_, evt)| decode_fields(evt.unwrap_err()).iter().any(|(tag, _)| *tag == 30))
+                .count()
+        };
+
+        assert_eq!(counter_evts(&generate(None)), 1000);
+
+        // At most three samples per 100ns bucket:
+        let lod = CounterLod {
+            bucket_ns: 100,
+            full_res_windows: vec![],
+            full_res_tracks: false,
+        };
+        let downsampled = counter_evts(&generate(Some(lod.clone())));
+        assert!(downsampled <= 30);
+
+        // Everything in the window is kept:
+        let windowed = counter_evts(&generate(Some(CounterLod {
+            full_res_windows: vec![(0, 99)],
+            ..lod.clone()
+        })));
+        assert_eq!(windowed, downsampled - 3 + 100);
+
+        // The full-resolution copy holds every sample:
+        let data = generate(Some(CounterLod {
+            full_res_tracks: true,
+            ..lod
+        }));
+        assert_eq!(counter_evts(&data), downsampled + 1000);
+    }
 }
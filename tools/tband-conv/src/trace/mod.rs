@@ -1,21 +1,22 @@
 pub mod base;
+mod checkpoint;
 pub mod convert;
+mod counter_lod;
+mod evt_store;
 pub mod freertos;
 pub mod generate_perfetto;
 
-use std::collections::BTreeMap;
+pub use checkpoint::ConverterCheckpoint;
+pub use evt_store::EvtStore;
+
+use std::{collections::BTreeMap, sync::Arc};
 
 use crate::{
     decode::evts::{InvalidEvt, RawEvt, TraceMode},
     NewWithId, ObjectMap, Timeseries,
 };
 
-use self::freertos::{FreeRTOSCoreTrace, FreeRTOSTrace};
-
-// == Trace Event Marker =======================================================
-
-#[derive(Debug)]
-pub struct TraceEvtMarker(pub RawEvt);
+use self::freertos::{FlowEvt, FreeRTOSCoreTrace, FreeRTOSTrace};
 
 #[derive(Debug)]
 pub enum ErrMarkerKind {
@@ -58,8 +59,8 @@ impl TraceErrMarker {
 // == User Markers =============================================================
 
 pub enum UserEvtMarker {
-    Instant { msg: String },
-    SliceBegin { msg: String },
+    Instant { msg: Arc<str> },
+    SliceBegin { msg: Arc<str> },
     SliceEnd,
 }
 
@@ -68,6 +69,10 @@ pub struct UserEvtMarkerTrace {
     id: usize,
     name: Option<String>,
     markers: Timeseries<UserEvtMarker>,
+
+    // Conversion state:
+    /// Messages of the slices that have begun but not yet ended, outermost first.
+    open_slices: Vec<Arc<str>>,
 }
 
 impl NewWithId for UserEvtMarkerTrace {
@@ -76,7 +81,21 @@ impl NewWithId for UserEvtMarkerTrace {
             id,
             name: None,
             markers: Timeseries::new(),
+            open_slices: vec![],
+        }
+    }
+}
+
+impl UserEvtMarkerTrace {
+    pub(crate) fn push_marker(&mut self, ts: u64, marker: UserEvtMarker) {
+        match &marker {
+            UserEvtMarker::Instant { .. } => (),
+            UserEvtMarker::SliceBegin { msg } => self.open_slices.push(msg.clone()),
+            UserEvtMarker::SliceEnd => {
+                self.open_slices.pop();
+            }
         }
+        self.markers.push(ts, marker)
     }
 }
 
@@ -108,6 +127,8 @@ pub struct ISRTrace {
     pub id: usize,
     pub name: Option<String>,
     pub state: Timeseries<ISRState>,
+    /// Events of the ISR that are connected to events of tasks (FreeRTOS only).
+    pub flows: Timeseries<FlowEvt>,
 
     // Conversion state:
     current_state: ISRState,
@@ -119,6 +140,7 @@ impl NewWithId for ISRTrace {
             id,
             name: None,
             state: Timeseries::new(),
+            flows: Timeseries::new(),
             current_state: ISRState::NotActive,
         }
     }
@@ -127,7 +149,6 @@ impl NewWithId for ISRTrace {
 pub struct CoreTrace {
     pub id: usize,
     pub isrs: ObjectMap<ISRTrace>,
-    pub evts: Timeseries<TraceEvtMarker>,
 
     pub freertos: FreeRTOSCoreTrace,
 }
@@ -137,7 +158,6 @@ impl NewWithId for CoreTrace {
         CoreTrace {
             id,
             isrs: ObjectMap::new(),
-            evts: Timeseries::new(),
             freertos: FreeRTOSCoreTrace::new(),
         }
     }
@@ -164,15 +184,23 @@ pub struct Trace {
     // FreeRTOS trace:
     pub freertos: FreeRTOSTrace,
 
+    // Events:
+    /// All events the trace was converted from, sorted by timestamp. Only the first `evt_count`
+    /// events were converted.
+    pub evts: Arc<EvtStore>,
+    pub evt_count: usize,
+
     // Conversion state:
     dropped_evt_cnt: u32,
 }
 
 impl Trace {
-    fn new(core_count: usize, mode: TraceMode) -> Self {
+    fn new(core_count: usize, mode: TraceMode, evts: Arc<EvtStore>, evt_count: usize) -> Self {
         let mut s = Self {
             mode,
             core_count,
+            evts,
+            evt_count,
             ts_resolution_ns: None,
             error_evts: Timeseries::new(),
             cores: BTreeMap::new(),
@@ -194,6 +222,29 @@ impl Trace {
         ts * ts_resolution_ns
     }
 
+    /// First and last timestamp of any event in the trace, or `(0, 0)` if there are none.
+    pub fn ts_range(&self) -> (u64, u64) {
+        let start_ts = (0..self.evt_count).find_map(|idx| self.evts.ts(idx));
+        let end_ts = (0..self.evt_count).rev().find_map(|idx| self.evts.ts(idx));
+        (start_ts.unwrap_or(0), end_ts.unwrap_or(0))
+    }
+
+    /// All converted events with a timestamp that occurred on the given core, in order.
+    pub fn core_evts(&self, core_id: usize) -> impl Iterator<Item = (u64, RawEvt)> + '_ {
+        self.core_evts_from(core_id, 0)
+    }
+
+    /// Like [`Trace::core_evts`], but starting at the given index into the event store.
+    fn core_evts_from(&self, core_id: usize, start_idx: usize) -> impl Iterator<Item = (u64, RawEvt)> + '_ {
+        let idxs = self.evts.core_evt_idxs(core_id);
+        let start = idxs.partition_point(|idx| (*idx as usize) < start_idx);
+        idxs[start..]
+            .iter()
+            .map(|idx| *idx as usize)
+            .take_while(|idx| *idx < self.evt_count)
+            .filter_map(|idx| Some((self.evts.ts(idx)?, self.evts.evt(idx))))
+    }
+
     fn name_isr(&self, core_id: usize, id: usize) -> String {
         if let Some(isr) = self.cores[&core_id].isrs.get(id) {
             if let Some(name) = &isr.name {
@@ -2,7 +2,11 @@ use log::{info, Level, Log};
 use serde::Serialize;
 use wasm_bindgen::prelude::*;
 
-use tband_conv::{convert::TraceConverter, decode::evts};
+use tband_conv::{
+    convert::TraceConverter,
+    decode::evts,
+    generate_perfetto::{PerfettoGenerator, PerfettoOptions},
+};
 use web_sys::console;
 
 #[wasm_bindgen]
@@ -44,7 +48,17 @@ pub fn convert(
             .map_err(|x| x.to_string())?;
     }
     let trace = tr.convert().map_err(|x| x.to_string())?;
-    Ok(trace.generate_perfetto_trace())
+
+    // The trace is handed to perfetto and offered for download, so keep it small:
+    let options = PerfettoOptions {
+        compress: true,
+        ..PerfettoOptions::default()
+    };
+    let mut data = vec![];
+    PerfettoGenerator::with_options(options)
+        .finish_to(&trace, &mut data)
+        .map_err(|x| x.to_string())?;
+    Ok(data)
 }
 
 // =======================================================================================